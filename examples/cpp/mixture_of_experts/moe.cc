@@ -28,6 +28,10 @@ void parse_input_args(char **argv, int argc, MoeConfig &config) {
       config.dataset_path = std::string(argv[++i]);
       continue;
     }
+    if (!strcmp(argv[i], "--dropless")) {
+      config.dropless = true;
+      continue;
+    }
   }
 }
 
@@ -120,7 +124,8 @@ Tensor create_moe_encoder(FFModel *model,
                                                 moeConfig->num_select,
                                                 moeConfig->hidden_size,
                                                 moeConfig->alpha,
-                                                moeConfig->lambda),
+                                                moeConfig->lambda,
+                                                moeConfig->dropless),
                                      x),
                           axes,
                           true,
@@ -161,7 +166,8 @@ void FlexFlow::top_level_task(Task const *task,
                     moeConfig.num_select,
                     moeConfig.hidden_size,
                     moeConfig.alpha,
-                    moeConfig.lambda);
+                    moeConfig.lambda,
+                    moeConfig.dropless);
   t = ff.dense(t, OUT_DIM, AC_MODE_RELU);
 
   //-----------------------------------------------------------------
@@ -35,6 +35,7 @@ struct MoeConfig {
     num_select = 2;
     alpha = 2.0f;
     lambda = 0.04f;
+    dropless = false;
     hidden_size = DATA_DIMS;
     // Encoder layer
     num_attention_heads = 16;
@@ -46,6 +47,7 @@ struct MoeConfig {
   int num_select;
   float alpha;  // factor overhead tensor size for imbalance
   float lambda; // multiplier for load balance term
+  bool dropless; // route every token instead of capping the expert load
   int hidden_size;
   // Encoder layer
   int num_attention_heads;
@@ -0,0 +1,93 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FLEXFLOW_ANALYTICAL_COST_MODEL_H_
+#define _FLEXFLOW_ANALYTICAL_COST_MODEL_H_
+
+#include "flexflow/simulator.h"
+
+namespace FlexFlow {
+
+class Op;
+
+/**
+ * @brief Source of operator costs for the Simulator.
+ *
+ * @details By default the Simulator measures operators by running their
+ * kernels (Op::measure_operator_cost). When a cost model is installed in
+ * Simulator::cost_model, it is asked instead.
+ */
+class OperatorCostModel {
+public:
+  virtual ~OperatorCostModel() = default;
+  /**
+   * @brief Estimate the per-device cost of running op with view.
+   *
+   * @return false if the cost model does not know how to cost op
+   */
+  virtual bool estimate_operator_cost(Op const *op,
+                                      MachineView const &view,
+                                      CostMetrics &cost_metrics) const = 0;
+};
+
+/**
+ * @brief Roofline cost model that costs operators without running kernels.
+ *
+ * @details The forward and backward time of an operator is the larger of its
+ * compute time (FLOPs over the peak throughput of the device) and its memory
+ * time (bytes moved over the framebuffer bandwidth), plus a fixed kernel
+ * launch overhead. Both peaks come from the MachineModel and are derated by
+ * an achievable efficiency. Memory usage is computed from the per-device
+ * shapes of the inputs, outputs and weights, like the measured costs.
+ *
+ * The search itself still needs a GPU: the graph optimize task runs on one,
+ * and the Simulator allocates its workspace there. The cost model only makes
+ * the costs independent of that GPU and avoids profiling.
+ */
+class AnalyticalCostModel : public OperatorCostModel {
+public:
+  AnalyticalCostModel(MachineModel const *machine, CompMode comp_mode);
+  bool estimate_operator_cost(Op const *op,
+                              MachineView const &view,
+                              CostMetrics &cost_metrics) const override;
+
+  /**
+   * @brief Number of FLOPs needed to compute one element of the output of op
+   * in the forward pass.
+   */
+  static double get_flops_per_output_element(Op const *op);
+  /**
+   * @brief Number of weight elements of op stored on each device.
+   */
+  static size_t get_weight_volume_per_device(Op const *op);
+
+public:
+  // Fraction of the peak numbers that kernels achieve in practice
+  static constexpr float COMPUTE_EFFICIENCY = 0.7f;
+  static constexpr float MEMORY_EFFICIENCY = 0.8f;
+  // Launch overhead of a single kernel, in ms
+  static constexpr float KERNEL_LAUNCH_OVERHEAD = 0.005f;
+
+private:
+  float estimate_kernel_time(double flops, double bytes) const;
+
+private:
+  MachineModel const *machine;
+  CompMode comp_mode;
+};
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_ANALYTICAL_COST_MODEL_H_
@@ -16,6 +16,7 @@
 #ifndef _FLEXFLOW_CONFIG_H_
 #define _FLEXFLOW_CONFIG_H_
 #include "ffconst.h"
+#include "flexflow/memory_optimization.h"
 #include "legion.h"
 #include <cstring>
 #if defined(FF_USE_CUDA) || defined(FF_USE_HIP_CUDA)
@@ -41,7 +42,6 @@ namespace FlexFlow {
 #define MAX_NUM_WEIGHTS 64
 #define MAX_NUM_OUTPUTS 256
 #define MAX_NUM_FUSED_OPERATORS 64
-#define MAX_NUM_FUSED_TENSORS 64
 #define MAX_NUM_WORKERS 1024
 #define MAX_FILENAME 200
 #define MAX_OPNAME 128
@@ -141,7 +141,14 @@ public:
   std::string import_strategy_file;
   std::string export_strategy_file;
   std::string export_strategy_task_graph_file;
+  std::string export_strategy_trace_file;
+  std::string export_strategy_report_file;
   std::string export_strategy_computation_graph_file;
+  std::string cost_database_file;
+  std::string strategy_cache_dir;
+  bool analytical_cost_model;
+  float gpu_peak_tflops;      // 0 keeps the machine model's value
+  float gpu_fb_mem_bandwidth; // GB/s, 0 keeps the machine model's value
   bool include_costs_dot_graph;
   tl::optional<std::string> substitution_json_path = tl::nullopt;
   // We use MappingTagID as the key since we will pass the tag to the mapper
@@ -150,13 +157,22 @@ public:
   std::string machine_model_file;
   int simulator_segment_size;
   int simulator_max_num_segments;
+  int simulator_num_threads;
+  bool simulator_flow_level_network;
+  AllReduceAlgorithm allreduce_algorithm;
   bool enable_propagation;
   tl::optional<int> search_num_nodes = tl::nullopt;
   tl::optional<int> search_num_workers = tl::nullopt;
   int base_optimize_threshold;
+  int search_num_threads;
+  unsigned search_seed;
+  int mcmc_exchange_interval; // 0 disables replica exchange
+  int mcmc_chains;            // one simulator and thread per chain
   bool enable_control_replication;
   int python_data_loader_type;
   bool perform_memory_search{false};
+  MemoryUsageType memory_usage_type{MemoryUsageType::PER_DEVICE_MAX};
+  MemorySearchAlgo memory_search_algo{MemorySearchAlgo::MULTI_OBJECTIVE};
 };
 
 class FFIterationConfig {
@@ -55,6 +55,14 @@ enum ParameterSyncType {
   NCCL = 82,
 };
 
+enum AllReduceAlgorithm {
+  ALLREDUCE_AUTO = 85,
+  ALLREDUCE_RING = 86,
+  ALLREDUCE_TREE = 87,
+  ALLREDUCE_HIERARCHICAL = 88,
+  ALLREDUCE_PARAMETER_SERVER = 89,
+};
+
 enum MetricsType {
   METRICS_ACCURACY = 1001,
   METRICS_CATEGORICAL_CROSSENTROPY = 1002,
@@ -158,6 +166,7 @@ enum OperatorType {
   OP_REDUCTION,
   OP_PIPELINE,
   OP_FUSED_PARALLEL,
+  OP_EXPERTS,
   OP_INVALID,
 };
 
@@ -89,14 +89,24 @@ struct NodeCompare {
   };
 };
 
+/**
+ * @brief The optimized PCG and its MachineViews, as returned by
+ * Graph::graph_optimize_task.
+ *
+ * @details data holds a versioned compact encoding (see
+ * Graph::graph_optimize_task). The legion_* methods make Legion serialize it
+ * as a variable-size future, so its size is not bounded by
+ * LEGION_MAX_RETURN_SIZE.
+ */
 struct GraphOptimalViewSerialized {
-#ifdef LEGION_MAX_RETURN_SIZE
-  static const size_t buffer_size = LEGION_MAX_RETURN_SIZE - 8;
-#else
-  static const size_t buffer_size = 1024 * 1024 - 8;
-#endif
-  size_t total_bytes;
-  char data[buffer_size];
+  static constexpr char MAGIC[4] = {'F', 'F', 'P', 'G'};
+  static constexpr uint64_t VERSION = 1;
+
+  std::vector<char> data;
+
+  size_t legion_buffer_size(void) const;
+  size_t legion_serialize(void *buffer) const;
+  size_t legion_deserialize(void const *buffer);
 };
 
 struct NodeAssignment {
@@ -167,6 +177,13 @@ struct NonsequenceSplit {
 
 using SequenceSplit = NodeAssignment;
 
+struct DominatorCacheStats {
+  size_t num_hits = 0;
+  size_t num_misses = 0;
+  // entries restricted from the graph they were split from
+  size_t num_derived = 0;
+};
+
 class SearchHelper {
 public:
   SearchHelper(FFModel *model);
@@ -209,6 +226,38 @@ public:
   std::vector<MachineView> get_valid_machine_views(
       Op const *op, MachineResource const &resource, bool log = false) const;
 
+  /**
+   * @brief Immediate post-dominators of all nodes of graph, cached by the
+   * graph hash.
+   *
+   * @details Computed over MultisourceGraphStructure, so the entry of
+   * Node::INVALID_NODE is the immediate post-dominator of the virtual source.
+   * A node without an immediate post-dominator maps to itself.
+   */
+  std::unordered_map<Node, Node> const &
+      get_imm_post_dominators(Graph const *graph) const;
+  /**
+   * @brief Same as Graph::find_bottleneck_node, but answered from the cached
+   * post-dominator tree.
+   */
+  Node find_bottleneck_node(Graph const *graph,
+                            Node const &sink_node,
+                            Node const &source_node) const;
+  /**
+   * @brief Seed the post-dominator cache for the two halves of
+   * graph->split_at_node(bottleneck).
+   *
+   * @details As bottleneck post-dominates every node before it, the immediate
+   * post-dominators of both halves are those of graph restricted to their
+   * nodes, so the halves never need a full dominator computation. Does
+   * nothing if graph itself is not cached.
+   */
+  void split_imm_post_dominators(Graph const *graph,
+                                 Node const &bottleneck,
+                                 Graph const *pre_graph,
+                                 Graph const *post_graph) const;
+  DominatorCacheStats const &get_dominator_cache_stats() const;
+
   template <typename T>
   std::pair<bool, T> try_get_cost_from_cache(size_t hash) const;
 
@@ -281,6 +330,10 @@ private:
   mutable std::unordered_map<size_t,
                              std::unique_ptr<const std::vector<MachineView>>>
       cached_operator_valid_views;
+  // Depends only on the graph structure, so it survives clear_cache()
+  mutable std::unordered_map<size_t, std::unordered_map<Node, Node>>
+      cached_imm_post_dominators;
+  mutable DominatorCacheStats dominator_cache_stats;
 };
 
 struct SimplificationSettings {
@@ -319,13 +372,21 @@ public:
   std::unordered_map<Node, Node> deduplicate_input_nodes();
   Node declone_node(Node const &);
 
+  /**
+   * @brief Hash of the graph structure.
+   *
+   * @details The hash is a sum of one term per node and one term per edge,
+   * which is maintained by add_node, add_edge, remove_node and remove_edge.
+   * Computing it is therefore O(1), and rewriting a graph only updates the
+   * terms that changed.
+   */
   size_t hash(void) const;
   void print(void) const;
   void print_dot() const;
   void print_dot(std::ostream &) const;
 
   bool check_correctness(void);
-  bool has_loop(void);
+  bool has_loop(void) const;
   bool map_operators_to_layers(std::vector<Op *> &layers) const;
   static GraphOptimalViewSerialized
       graph_optimize_task(Legion::Task const *task,
@@ -365,10 +426,35 @@ public:
   template <typename T>
   T generic_optimal_cost() const;
 
+  /**
+   * @brief The in-edges and out-edges of every node, which has an entry in
+   * both maps even if it has no edge.
+   *
+   * @details They are read-only so that hash() stays consistent; the graph
+   * changes through add_node, add_edge, remove_node and remove_edge.
+   */
+  std::unordered_map<Node, std::unordered_set<Edge>> const &
+      get_in_edges() const {
+    return inEdges;
+  }
+  std::unordered_map<Node, std::unordered_set<Edge>> const &
+      get_out_edges() const {
+    return outEdges;
+  }
+  std::unordered_set<Edge> const &get_in_edges(Node const &node) const {
+    return inEdges.at(node);
+  }
+  std::unordered_set<Edge> const &get_out_edges(Node const &node) const {
+    return outEdges.at(node);
+  }
+
 public:
   FFModel *model;
   SearchHelper *search;
+
+private:
   std::unordered_map<Node, std::unordered_set<Edge>> inEdges, outEdges;
+  size_t hash_value = 0;
 
 private:
   void remove_inverse_parallel_ops();
@@ -376,6 +462,26 @@ private:
       std::unordered_set<Node> const &currentNodes, Graph const &replaceWith);
 };
 
+/**
+ * @brief The changes an xfer makes to a graph, recorded without copying it.
+ *
+ * @details Applying a rewrite to its base graph removes removed_edges and
+ * adds added_edges. Like a graph rebuilt edge by edge, the result keeps
+ * exactly the nodes that have an edge, so the endpoints of removed_edges that
+ * are left without any edge are dropped, and so are edgeless_nodes, the nodes
+ * of the base graph that had none. added_edges must not be in the base graph.
+ * hash() gives the hash of the result in O(size of the rewrite), so duplicate
+ * rewrites can be discarded before the graph is copied by apply().
+ */
+struct GraphRewrite {
+  std::vector<Edge> removed_edges;
+  std::vector<Edge> added_edges;
+  std::vector<Node> edgeless_nodes;
+
+  size_t hash(Graph const &base) const;
+  Graph *apply(Graph const &base) const;
+};
+
 struct GraphOptimizeResult {
   tl::optional<Graph> graph;
   float cost;
@@ -408,10 +514,10 @@ struct GraphStructure<FlexFlow::PCG::Graph> {
 
   std::unordered_set<vertex_type> get_nodes(G const &g) const {
     std::unordered_set<vertex_type> nodes;
-    for (auto const &kv : g.inEdges) {
+    for (auto const &kv : g.get_in_edges()) {
       nodes.insert(kv.first);
     }
-    for (auto const &kv : g.outEdges) {
+    for (auto const &kv : g.get_out_edges()) {
       nodes.insert(kv.first);
     }
 
@@ -420,19 +526,19 @@ struct GraphStructure<FlexFlow::PCG::Graph> {
 
   std::unordered_set<edge_type> get_incoming_edges(G const &g,
                                                    vertex_type const &n) const {
-    if (g.inEdges.find(n) == g.inEdges.end()) {
+    if (g.get_in_edges().find(n) == g.get_in_edges().end()) {
       return {};
     } else {
-      return {g.inEdges.at(n).begin(), g.inEdges.at(n).end()};
+      return {g.get_in_edges(n).begin(), g.get_in_edges(n).end()};
     }
   }
 
   std::unordered_set<edge_type> get_outgoing_edges(G const &g,
                                                    vertex_type const &n) const {
-    if (g.outEdges.find(n) == g.outEdges.end()) {
+    if (g.get_out_edges().find(n) == g.get_out_edges().end()) {
       return {};
     } else {
-      return {g.outEdges.at(n).begin(), g.outEdges.at(n).end()};
+      return {g.get_out_edges(n).begin(), g.get_out_edges(n).end()};
     }
   }
 
@@ -58,7 +58,9 @@ public:
            Processor local,
            char const *mapper_name, // const std::string& strategyFile,
            bool _enable_control_replication,
-           bool _log_instance_creation);
+           bool _log_instance_creation,
+           bool _enable_numa_aware_mapping,
+           bool _search_on_cpu);
   ~FFMapper();
   virtual char const *get_mapper_name(void) const;
   virtual MapperSyncModel get_mapper_sync_model(void) const;
@@ -343,9 +345,15 @@ protected:
   char const *mapper_name;
   bool enable_control_replication;
   bool log_instance_creation;
+  // Keep CPU tasks and their instances on one socket
+  bool enable_numa_aware_mapping;
+  // Run the graph search on a CPU, with --analytical-cost-model
+  bool search_on_cpu;
   std::vector<Processor> all_gpus, all_cpus, all_pys, local_gpus, local_cpus,
       local_pys;
   std::map<Processor, Memory> proc_fbmems, proc_zcmems;
+  // The NUMA memory of the socket of each CPU, if Realm has any (-ll:nsize)
+  std::map<Processor, Memory> proc_sockmems;
   std::map<unsigned long long, Processor> cache_update_tasks;
   // We use MappingTagID has the key since we will pass the tag to the mapper
   std::map<MappingTagID, MachineView> machine_views;
@@ -16,8 +16,13 @@
 #ifndef _FLEXFLOW_MEMORY_OPTIMIZATION_H_
 #define _FLEXFLOW_MEMORY_OPTIMIZATION_H_
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace FlexFlow {
 
@@ -29,12 +34,23 @@ enum class MemoryUsageType {
   // Use the max of peak per-device memory usage among devices as the measure.
   // Need associated device mapping views.
   PER_DEVICE_MAX,
+
+  // Like PER_DEVICE_MAX, but the peak of each device is that of the live
+  // memory along the forward and backward schedule (see LivenessMemoryModel)
+  // rather than the sum over all operators. Need associated device mapping
+  // views.
+  PER_DEVICE_LIVENESS,
 };
 
 enum class MemorySearchAlgo {
   // Multiple objective DP search. Combine memory cost and run time cost into
   // one single cost function and add a factor to balance them.
   MULTI_OBJECTIVE,
+
+  // Pareto-set DP search. Keep every strategy of a sub-problem that no other
+  // one beats in both run time and memory cost, so that a single search
+  // finds the fastest strategy under any memory limit.
+  PARETO,
 };
 
 /**
@@ -76,6 +92,48 @@ public:
 
 namespace PCG {
 
+/**
+ * @brief Peak memory of each device along the schedule of a training (or
+ * inference) iteration, given when each operator's memory is live.
+ *
+ * @details Operators are added in forward order and the backward pass runs
+ * them in reverse. Weights are live throughout. The output activations of an
+ * operator are allocated by its forward pass and kept until its own backward
+ * pass, which comes after that of all its consumers; their gradients are
+ * allocated by the backward pass of the last consumer and freed with them.
+ * Without a backward pass, outputs are freed once the last consumer ran.
+ * Inputs are not counted, since they are the outputs of other operators.
+ */
+class LivenessMemoryModel {
+public:
+  /**
+   * @brief Add the next operator in forward order and return its index.
+   *
+   * @param devices Devices the operator runs on
+   * @param weights_memory Bytes of weights on each of its devices
+   * @param outputs_memory Bytes of outputs on each of its devices
+   * @param producers Indices of the operators whose outputs it reads
+   */
+  int add_op(std::vector<int> const &devices,
+             size_t weights_memory,
+             size_t outputs_memory,
+             std::vector<int> const &producers);
+
+  /**
+   * @brief Peak bytes of live memory on every device.
+   */
+  std::unordered_map<int, size_t> peak_memory(bool training) const;
+
+private:
+  struct OpInfo {
+    std::vector<int> devices;
+    size_t weights_memory, outputs_memory;
+    // the last consumer in forward order, -1 if none
+    int last_consumer;
+  };
+  std::vector<OpInfo> ops;
+};
+
 /**
  * @brief Class to hold memory usage information of a (sub-)PCG.
  */
@@ -101,6 +159,36 @@ public:
   friend std::ostream &operator<<(std::ostream &s, MemoryUsage const &usage);
 };
 
+/**
+ * @brief Keep only the results that no other result beats in both run time
+ * and memory cost, sorted by increasing run time (and so by decreasing
+ * memory cost).
+ *
+ * @tparam T Any type with a float run time "cost" and a MemoryUsage
+ * "mem_cost"
+ */
+template <typename T>
+void prune_to_pareto_front(std::vector<T> &results) {
+  std::stable_sort(
+      results.begin(), results.end(), [](T const &lhs, T const &rhs) {
+        if (lhs.cost != rhs.cost) {
+          return lhs.cost < rhs.cost;
+        }
+        return lhs.mem_cost.num < rhs.mem_cost.num;
+      });
+  size_t num_kept = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    if (num_kept == 0 ||
+        results[i].mem_cost.num < results[num_kept - 1].mem_cost.num) {
+      if (num_kept != i) {
+        results[num_kept] = std::move(results[i]);
+      }
+      num_kept++;
+    }
+  }
+  results.erase(results.begin() + num_kept, results.end());
+}
+
 } // namespace PCG
 } // namespace FlexFlow
 
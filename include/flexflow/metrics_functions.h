@@ -38,6 +38,13 @@ public:
   float mse_loss;               // measure_mean_squared_error
   float rmse_loss;              // measure_root_mean_squared_error
   float mae_loss;               // measure_mean_absolute_error
+  // Routing of the tokens of the group_by operators to their experts. The
+  // busiest expert receives expert_peak_load / routed_tokens times the
+  // average load; the largest of these ratios, max_load_imbalance, is the
+  // smallest alpha for which group_by would have dropped no token.
+  int routed_tokens, dropped_tokens;
+  float expert_peak_load;   // sum of n * tokens of the busiest expert
+  float max_load_imbalance; // largest busiest-to-average load ratio
   double start_time;
 };
 
@@ -72,6 +72,7 @@ enum TaskIDs {
   GROUP_BY_INIT_TASK_ID,
   GROUP_BY_FWD_TASK_ID,
   GROUP_BY_BWD_TASK_ID,
+  GROUP_BY_METRICS_TASK_ID,
   CACHE_INIT_TASK_ID,
   CACHE_FWD_TASK_ID,
   CACHE_UPDATE_TASK_ID,
@@ -81,6 +82,9 @@ enum TaskIDs {
   AGGREGATE_INIT_TASK_ID,
   AGGREGATE_FWD_TASK_ID,
   AGGREGATE_BWD_TASK_ID,
+  EXPERTS_INIT_TASK_ID,
+  EXPERTS_FWD_TASK_ID,
+  EXPERTS_BWD_TASK_ID,
   AGG_SPEC_INIT_TASK_ID,
   AGG_SPEC_FWD_TASK_ID,
   AGG_SPEC_BWD_TASK_ID,
@@ -230,6 +234,7 @@ namespace PCG {
 class SearchHelper;
 class GraphSearchHelper;
 class Graph;
+struct GraphOptimalViewSerialized;
 }; // namespace PCG
 
 class FFModel;
@@ -259,6 +264,7 @@ class Dropout;
 class ElementBinary;
 class ElementUnary;
 class Embedding;
+class Experts;
 class Flat;
 class Gather;
 class Group_by;
@@ -330,6 +336,8 @@ public:
   static constexpr float PROPAGATION_CHANCE = 0.25;
   static constexpr float CONTINUE_PROPAGATION_CHANCE = 0.75;
   static constexpr float PROPAGATION_SIZE_WEIGHT = 1.0;
+  // Ratio between the temperatures of neighboring chains in mcmc_optimize
+  static constexpr float MCMC_TEMPERATURE_RATIO = 2.0;
 
   // C++ APIs for constructing models
   // Add an exp layer
@@ -441,6 +449,12 @@ public:
                 int n,
                 float alpha,
                 char const *name = NULL);
+  // Add a group_by layer that drops no tokens, packing the tokens of all
+  // experts in a single output of k * batch_size rows
+  Tensor group_by_dropless(const Tensor data,
+                           const Tensor assign,
+                           int n,
+                           char const *name = NULL);
   // Add a cache layer
   Tensor cache(Tensor const &input,
                int num_batches,
@@ -452,11 +466,36 @@ public:
                    int n,
                    float lambda_bal,
                    char const *name = NULL);
+  // Add aggregate layer over the packed expert predictions of a dropless
+  // group_by
+  Tensor aggregate_dropless(Tensor const *inputs,
+                            int n,
+                            float lambda_bal,
+                            char const *name = NULL);
   // Add aggregate_spec layer
   Tensor aggregate_spec(Tensor const *inputs,
                         int n,
                         float lambda_bal,
                         char const *name = NULL);
+  // Add the dense layers of the experts of a MoE, applied to the outputs of
+  // a group_by in a single operator
+  void experts(Tensor const *inputs,
+               Tensor *outputs,
+               int num_experts,
+               int out_dim,
+               ActiMode activation = AC_MODE_NONE,
+               bool use_bias = true,
+               bool apply_softmax = false,
+               char const *name = NULL);
+  // Same as above over the packed output of a dropless group_by
+  Tensor experts_dropless(const Tensor input,
+                          const Tensor assign,
+                          int num_experts,
+                          int out_dim,
+                          ActiMode activation = AC_MODE_NONE,
+                          bool use_bias = true,
+                          bool apply_softmax = false,
+                          char const *name = NULL);
   // Add a 2D pooling layer
   Tensor pool2d(const Tensor input,
                 int kernelH,
@@ -511,7 +550,8 @@ public:
              int num_select,
              int expert_hidden_size,
              float alpha,
-             float lambda);
+             float lambda,
+             bool dropless = false);
   // Add a split layer
   void split(const Tensor input,
              Tensor *outputs,
@@ -662,7 +702,7 @@ public:
       float optimal_cost,
       std::unordered_map<PCG::Node, MachineView> &optimal_views);
   void deserialize_graph_optimal_view(
-      Legion::Deserializer &dez,
+      PCG::GraphOptimalViewSerialized const &serialized,
       PCG::Graph *graph,
       std::unordered_map<PCG::Node, MachineView> &optimal_views);
   bool convert_graph_to_operators(
@@ -773,7 +813,7 @@ public:
   void get_metrics();
   void backward(int seq_length = -1);
   void update();
-  bool apply_fusion(std::vector<Op *> const &operators,
+  void apply_fusion(std::vector<Op *> const &operators,
                     std::vector<Op *> &new_operators);
   Op *get_final_operator() const;
   void compile(LossType loss_type,
@@ -794,11 +834,44 @@ public:
                       bool perform_memory_search,
                       MemoryOptimConfig new_config,
                       MemorySearchResult &search_result);
+  /**
+   * @brief Get a strategy of the Pareto front found by the last
+   * graph_optimize with MemorySearchAlgo::PARETO, fastest first.
+   *
+   * @return false if the front has no more than index strategies
+   */
+  bool get_pareto_strategy(
+      size_t index,
+      std::unique_ptr<PCG::Graph> &best_graph,
+      std::unordered_map<PCG::Node, MachineView> &optimal_views,
+      MemorySearchResult &search_result);
+  /**
+   * @brief Run config.mcmc_chains chains, the first on simulator and the
+   * others on simulators that measure operators on it.
+   */
   void mcmc_optimize(std::map<Op const *, ParallelConfig> &best,
                      size_t budget,
                      float alpha,
                      CompMode comp_mode,
                      bool use_propagation) const;
+  /**
+   * @brief Run one Markov chain per simulator, each on its own thread.
+   *
+   * @details See replica_exchange_search: chain c samples at inverse
+   * temperature alpha / MCMC_TEMPERATURE_RATIO^c with config.search_seed + c,
+   * and neighboring chains propose to swap their current strategies every
+   * config.mcmc_exchange_interval iterations (if positive). The best
+   * strategy over all chains is returned in best, and written to
+   * config.export_strategy_file if set. The simulators must not share a
+   * TaskManager; they may measure operators on a common profiler, which
+   * then needs a profile_mutex.
+   */
+  void mcmc_optimize(std::vector<Simulator *> const &simulators,
+                     std::map<Op const *, ParallelConfig> &best,
+                     size_t budget,
+                     float alpha,
+                     CompMode comp_mode,
+                     bool use_propagation) const;
 #ifdef FF_USE_NCCL
   ncclComm_t *find_nccl_comms(MachineView const &view) const;
 #endif
@@ -883,6 +956,9 @@ public:
                          ElementUnary *>,
       std::unordered_map<std::pair<ParallelTensorShape, EmbeddingParams>,
                          Embedding *>,
+      std::unordered_map<
+          std::pair<std::vector<ParallelTensorShape>, ExpertsParams>,
+          Experts *>,
       std::unordered_map<std::pair<ParallelTensorShape, FlatParams>, Flat *>,
       std::unordered_map<
           std::pair<std::pair<ParallelTensorShape, ParallelTensorShape>,
@@ -1006,6 +1082,11 @@ void register_flexflow_internal_tasks(Legion::Runtime *runtime = NULL,
 
 void register_custom_tasks();
 
+// Defined in strategy.cc
+bool save_strategies_to_file(
+    std::string const &filename,
+    std::map<std::string, ParallelConfig> const &strategies);
+
 }; // namespace FlexFlow
 
 #endif //_FLEXFLOW_MODEL_H_
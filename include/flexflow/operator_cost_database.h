@@ -0,0 +1,95 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FLEXFLOW_OPERATOR_COST_DATABASE_H_
+#define _FLEXFLOW_OPERATOR_COST_DATABASE_H_
+
+#include "flexflow/simulator.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace FlexFlow {
+
+/**
+ * @brief A persistent, append-only database of measured operator costs.
+ *
+ * @details The database lives in a single file that starts with a versioned
+ * header followed by fixed-size records. Each record maps a key (see
+ * Simulator::get_persistent_cost_key) to the CostMetrics measured for it. The
+ * key hash indexes the records and its check is compared on every lookup, so
+ * a hash collision is detected and measured again instead of returning the
+ * costs of another operator. The
+ * file is memory-mapped once when the database is opened, and every new
+ * measurement is appended to it under an exclusive file lock, so that
+ * concurrent jobs on one host can share a database. A record that was only
+ * partially written (e.g. because a job was killed) is ignored when loading,
+ * and so is a header that was.
+ *
+ * Costs depend on the device they were measured on; use one database per GPU
+ * type.
+ */
+class OperatorCostDatabase {
+public:
+  static constexpr uint32_t VERSION = 1;
+
+  OperatorCostDatabase(std::string const &filename);
+  ~OperatorCostDatabase();
+
+  /**
+   * @brief Look up the cost of a key.
+   *
+   * @return true if the key is in the database and cost_metrics was set
+   */
+  bool lookup(OperatorCostKey const &key, CostMetrics &cost_metrics) const;
+  /**
+   * @brief Add a new measurement to the database and append it to the file.
+   * A key whose hash collides with a stored key is not persisted.
+   */
+  void insert(OperatorCostKey const &key, CostMetrics const &cost_metrics);
+  size_t size() const;
+
+public:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+  };
+
+  struct Record {
+    uint64_t key, check;
+    float forward_time, backward_time, sync_time;
+    uint32_t reserved;
+    uint64_t inputs_memory, outputs_memory, weights_memory, op_total_mem;
+  };
+
+private:
+  struct Entry {
+    uint64_t check;
+    CostMetrics cost_metrics;
+  };
+
+  void load();
+  bool append(Record const &record);
+
+private:
+  std::string filename;
+  int fd;
+  std::unordered_map<uint64_t, Entry> costs;
+};
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_OPERATOR_COST_DATABASE_H_
@@ -12,6 +12,7 @@
 #include "flexflow/ops/element_binary_params.h"
 #include "flexflow/ops/element_unary_params.h"
 #include "flexflow/ops/embedding_params.h"
+#include "flexflow/ops/experts_params.h"
 #include "flexflow/ops/flat_params.h"
 #include "flexflow/ops/gather_params.h"
 #include "flexflow/ops/groupby_params.h"
@@ -45,6 +46,7 @@ using OperatorParameters = mp::variant<AggregateParams,
                                        ElementUnaryParams,
                                        DropoutParams,
                                        EmbeddingParams,
+                                       ExpertsParams,
                                        FlatParams,
                                        GatherParams,
                                        Group_byParams,
@@ -16,6 +16,7 @@ public:
   ~AggregateMeta(void);
   float **dev_exp_preds;
   float **dev_exp_grads;
+  bool dropless;
 };
 
 class Aggregate : public Op {
@@ -26,6 +27,7 @@ public:
             ParallelTensor const *inputs,
             int _n,
             float _lambda_bal,
+            bool _dropless,
             char const *name);
   Aggregate(FFModel &model,
             Aggregate const &other,
@@ -89,6 +91,9 @@ public:
 public:
   int n;
   float lambda_bal;
+  // Read the predictions of all experts from the single buffer packed by a
+  // dropless group_by
+  bool dropless;
 };
 
 }; // namespace FlexFlow
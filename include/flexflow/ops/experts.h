@@ -0,0 +1,187 @@
+#ifndef _FLEXFLOW_EXPERTS_H_
+#define _FLEXFLOW_EXPERTS_H_
+
+#include "flexflow/model.h"
+#include "flexflow/node.h"
+#include "flexflow/ops/experts_params.h"
+
+namespace FlexFlow {
+
+class Experts;
+
+class ExpertsMeta : public OpMeta {
+public:
+  ExpertsMeta(FFHandler handle, Experts const *experts, int rows);
+  ~ExpertsMeta(void);
+  int num_experts;
+  ActiMode activation;
+  bool use_bias, apply_softmax, dropless;
+  // Device copy of the per-expert pointers handed to the batched GEMMs
+  float **dev_ptrs;
+  // Activations of the experts before the softmax, for the backward pass
+  float *activations;
+  // Offsets of the experts in the packed rows, followed by the offsets of
+  // their tiles in the grouped GEMMs, computed on the device (dropless)
+  int *dev_offsets;
+};
+
+/**
+ * @brief The dense layers of all the experts of a MoE, applied to the
+ * outputs of a group_by in a single operator.
+ *
+ * @details Expert i computes activation(inputs[i] * kernel[i] + bias[i]),
+ * followed by a softmax over its outputs when apply_softmax is set. The
+ * kernels and biases of all experts are stacked in one weight each, so the
+ * matrix multiplications of all experts run as one batched GEMM, and the
+ * bias, activation and softmax as one kernel each, whatever the number of
+ * experts.
+ *
+ * In dropless mode the layer instead takes the single packed output of a
+ * dropless group_by and its assignment tensor. The rows of expert i are
+ * recounted from the assignment, and each expert multiplies its own
+ * contiguous segment of the packed rows.
+ */
+class Experts : public Op {
+public:
+  using Params = ExpertsParams;
+  using Input = std::vector<ParallelTensor>;
+  Experts(FFModel &model,
+          LayerID const &layer_guid,
+          ParallelTensor const *inputs,
+          int num_experts,
+          int out_dim,
+          ActiMode activation,
+          bool use_bias,
+          bool apply_softmax,
+          bool dropless,
+          bool allocate_weights,
+          char const *name);
+  Experts(FFModel &model,
+          Experts const &other,
+          std::vector<ParallelTensor> const &inputs,
+          bool allocate_weights);
+  Experts(FFModel &model,
+          Params const &params,
+          Input const &inputs,
+          char const *name = nullptr,
+          bool allocate_weights = false);
+  void init(FFModel const &) override;
+  void forward(FFModel const &) override;
+  void backward(FFModel const &) override;
+  void print_layer(FFModel const &model) override {
+    assert(0);
+  }
+  static Op *
+      create_operator_from_layer(FFModel &model,
+                                 Layer const *layer,
+                                 std::vector<ParallelTensor> const &inputs);
+  static OpMeta *init_task(Legion::Task const *task,
+                           std::vector<Legion::PhysicalRegion> const &regions,
+                           Legion::Context ctx,
+                           Legion::Runtime *runtime);
+  static void forward_task(Legion::Task const *task,
+                           std::vector<Legion::PhysicalRegion> const &regions,
+                           Legion::Context ctx,
+                           Legion::Runtime *runtime);
+  static void backward_task(Legion::Task const *task,
+                            std::vector<Legion::PhysicalRegion> const &regions,
+                            Legion::Context ctx,
+                            Legion::Runtime *runtime);
+  void serialize(Legion::Serializer &s) const override;
+  static PCG::Node deserialize(FFModel &ff,
+                               Legion::Deserializer &d,
+                               ParallelTensor inputs[],
+                               int num_inputs);
+  Op *materialize(FFModel &ff,
+                  ParallelTensor inputs[],
+                  int num_inputs) const override;
+  // kernel is (in_dim, out_dim, num_experts) and bias (out_dim, num_experts);
+  // every input is (in_dim, rows) and every output (out_dim, rows)
+  static void forward_kernel_wrapper(ExpertsMeta const *m,
+                                     float const **inputs,
+                                     float **outputs,
+                                     float const *kernel,
+                                     float const *bias,
+                                     int in_dim,
+                                     int out_dim,
+                                     int rows);
+  static void backward_kernel_wrapper(ExpertsMeta const *m,
+                                      float const **inputs,
+                                      float **input_grads,
+                                      float const **outputs,
+                                      float **output_grads,
+                                      float const *kernel,
+                                      float *kernel_grad,
+                                      float *bias_grad,
+                                      int in_dim,
+                                      int out_dim,
+                                      int rows);
+  // input is the packed (in_dim, rows) buffer and output (out_dim, rows);
+  // exp_assign holds the expert of each of the rows
+  static void forward_dropless_kernel_wrapper(ExpertsMeta const *m,
+                                              float const *input,
+                                              int const *exp_assign,
+                                              float *output,
+                                              float const *kernel,
+                                              float const *bias,
+                                              int in_dim,
+                                              int out_dim,
+                                              int rows);
+  static void backward_dropless_kernel_wrapper(ExpertsMeta const *m,
+                                               float const *input,
+                                               float *input_grad,
+                                               float const *output,
+                                               float *output_grad,
+                                               int const *exp_assign,
+                                               float const *kernel,
+                                               float *kernel_grad,
+                                               float *bias_grad,
+                                               int in_dim,
+                                               int out_dim,
+                                               int rows);
+  // Routes the rows evenly to the experts, to measure a dropless layer
+  static void even_assignment_kernel_wrapper(int *exp_assign,
+                                             int num_experts,
+                                             int rows);
+  // Reference implementations of the kernels on the CPU. The backward pass
+  // takes the activations before the softmax, which are the outputs when
+  // apply_softmax is not set; like Softmax, it passes the gradients of the
+  // softmax through unchanged.
+  static void forward_kernel_cpu(float const *const *inputs,
+                                 float *const *outputs,
+                                 float const *kernel,
+                                 float const *bias,
+                                 int num_experts,
+                                 ActiMode activation,
+                                 bool apply_softmax,
+                                 int in_dim,
+                                 int out_dim,
+                                 int rows);
+  static void backward_kernel_cpu(float const *const *inputs,
+                                  float *const *input_grads,
+                                  float const *const *activations,
+                                  float *const *output_grads,
+                                  float const *kernel,
+                                  float *kernel_grad,
+                                  float *bias_grad,
+                                  int num_experts,
+                                  ActiMode activation,
+                                  int in_dim,
+                                  int out_dim,
+                                  int rows);
+  bool measure_operator_cost(Simulator *sim,
+                             MachineView const &pc,
+                             CostMetrics &cost_metrics) const override;
+  Params get_params() const;
+
+public:
+  int num_experts, in_dim, out_dim;
+  ActiMode activation;
+  bool use_bias, apply_softmax;
+  // Takes the packed output of a dropless group_by and its assignment
+  bool dropless;
+};
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_EXPERTS_H_
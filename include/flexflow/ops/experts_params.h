@@ -0,0 +1,31 @@
+#ifndef _FLEXFLOW_EXPERTS_PARAMS_H
+#define _FLEXFLOW_EXPERTS_PARAMS_H
+
+#include "flexflow/ffconst.h"
+#include "flexflow/fftype.h"
+#include "flexflow/parallel_tensor.h"
+
+namespace FlexFlow {
+
+struct ExpertsParams {
+  LayerID layer_guid;
+  int num_experts;
+  int out_dim;
+  ActiMode activation;
+  bool use_bias;
+  bool apply_softmax;
+  bool dropless;
+  bool is_valid(std::vector<ParallelTensorShape> const &) const;
+};
+bool operator==(ExpertsParams const &, ExpertsParams const &);
+
+} // namespace FlexFlow
+
+namespace std {
+template <>
+struct hash<FlexFlow::ExpertsParams> {
+  size_t operator()(FlexFlow::ExpertsParams const &) const;
+};
+} // namespace std
+
+#endif // _FLEXFLOW_EXPERTS_PARAMS_H
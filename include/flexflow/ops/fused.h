@@ -5,15 +5,6 @@
 
 namespace FlexFlow {
 
-class FusedOp;
-class FusedOpMeta {
-public:
-  FusedOpMeta(void) {}
-  OpMeta *meta[MAX_NUM_FUSED_OPERATORS];
-  FusedOp *fused_op;
-  int numOperators;
-};
-
 class FusedOp : public Op {
 public:
   enum SourceType {
@@ -50,23 +41,62 @@ public:
                              MachineView const &pc,
                              CostMetrics &cost_metrics) const override;
 
+  void serialize_layout(Legion::Serializer &sez) const;
+
+public:
+  FFIterationConfig iter_config;
+  // Sized by the number of fused operators (op_*_source and op_*_idx by the
+  // total number of their inputs, weights and outputs)
+  std::vector<int> op_num_inputs;
+  std::vector<int> op_num_weights;
+  std::vector<int> op_num_outputs;
+  std::vector<OperatorType> op_op_type;
+  std::vector<SourceType> op_input_source;
+  std::vector<SourceType> op_weight_source;
+  std::vector<SourceType> op_output_source;
+  DataType input_data_types[MAX_NUM_INPUTS];
+  DataType weight_data_types[MAX_NUM_WEIGHTS];
+  DataType output_data_types[MAX_NUM_OUTPUTS];
+  std::vector<int> op_input_idx;
+  std::vector<int> op_weight_idx;
+  std::vector<int> op_output_idx;
+  std::vector<Op *> operators;
+  int numOperators;
+};
+
+/**
+ * @brief The fields of a FusedOp read by its tasks.
+ *
+ * @details A FusedOp is not trivially copyable, so FusedOp::init sends these
+ * to the devices serialized (see FusedOp::serialize_layout).
+ */
+class FusedOpLayout {
+public:
+  void deserialize(Legion::Deserializer &dez);
+
 public:
   FFIterationConfig iter_config;
-  int op_num_inputs[MAX_NUM_FUSED_OPERATORS];
-  int op_num_weights[MAX_NUM_FUSED_OPERATORS];
-  int op_num_outputs[MAX_NUM_FUSED_OPERATORS];
-  OperatorType op_op_type[MAX_NUM_FUSED_OPERATORS];
-  SourceType op_input_source[MAX_NUM_FUSED_TENSORS];
-  SourceType op_weight_source[MAX_NUM_FUSED_TENSORS];
-  SourceType op_output_source[MAX_NUM_FUSED_TENSORS];
+  int numInputs, numWeights, numOutputs, numOperators;
   DataType input_data_types[MAX_NUM_INPUTS];
   DataType weight_data_types[MAX_NUM_WEIGHTS];
   DataType output_data_types[MAX_NUM_OUTPUTS];
-  int op_input_idx[MAX_NUM_FUSED_TENSORS];
-  int op_weight_idx[MAX_NUM_FUSED_TENSORS];
-  int op_output_idx[MAX_NUM_FUSED_TENSORS];
-  Op *operators[MAX_NUM_FUSED_OPERATORS];
-  FusedOpMeta fused_meta[MAX_NUM_WORKERS];
+  std::vector<int> op_num_inputs;
+  std::vector<int> op_num_weights;
+  std::vector<int> op_num_outputs;
+  std::vector<OperatorType> op_op_type;
+  std::vector<FusedOp::SourceType> op_input_source;
+  std::vector<FusedOp::SourceType> op_weight_source;
+  std::vector<FusedOp::SourceType> op_output_source;
+  std::vector<int> op_input_idx;
+  std::vector<int> op_weight_idx;
+  std::vector<int> op_output_idx;
+};
+
+class FusedOpMeta {
+public:
+  FusedOpMeta(void) {}
+  std::vector<OpMeta *> meta;
+  FusedOpLayout fused_op;
   int numOperators;
 };
 
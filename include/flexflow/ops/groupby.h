@@ -12,6 +12,7 @@ public:
   GroupByMeta(FFHandler handle, int n);
   ~GroupByMeta(void);
   float **dev_region_ptrs;
+  bool dropless;
 };
 
 class Group_by : public Op {
@@ -23,6 +24,7 @@ public:
            const ParallelTensor _assign,
            int _n,
            float _alpha,
+           bool _dropless,
            char const *name);
   Group_by(FFModel &model,
            Group_by const &other,
@@ -54,6 +56,14 @@ public:
                             std::vector<Legion::PhysicalRegion> const &regions,
                             Legion::Context ctx,
                             Legion::Runtime *runtime);
+  // Launches the computation of the routing statistics of the last batch,
+  // one future of PerfMetrics per partition
+  Legion::FutureMap compute_routing_metrics(FFModel const &ff) const;
+  static PerfMetrics
+      routing_metrics_task(Legion::Task const *task,
+                           std::vector<Legion::PhysicalRegion> const &regions,
+                           Legion::Context ctx,
+                           Legion::Runtime *runtime);
   void serialize(Legion::Serializer &s) const override;
   static PCG::Node deserialize(FFModel &ff,
                                Legion::Deserializer &d,
@@ -82,6 +92,27 @@ public:
                               float alpha, // factor additional memory assigned
                               int batch_size,
                               int data_dim);
+  static PerfMetrics routing_metrics_kernel_wrapper(int const *exp_assign,
+                                                    int n,
+                                                    int k,
+                                                    float alpha,
+                                                    bool dropless,
+                                                    int batch_size);
+  // In dropless mode, the tokens of expert i are packed in rows
+  // [offsets[i], offsets[i + 1]) of the single output, in the order of
+  // exp_assign. offsets holds n + 1 entries.
+  static void get_expert_offsets(int const *exp_assign,
+                                 int num_assignments,
+                                 int n,
+                                 int *offsets);
+  // Tokens routed and dropped, and how much more the busiest expert
+  // receives than the average, for the assignment of one batch on the CPU
+  static PerfMetrics get_routing_metrics(int const *exp_assign,
+                                         int n,
+                                         int k,
+                                         float alpha,
+                                         bool dropless,
+                                         int batch_size);
   bool measure_operator_cost(Simulator *sim,
                              MachineView const &pc,
                              CostMetrics &cost_metrics) const override;
@@ -90,6 +121,10 @@ public:
 public:
   int n;
   float alpha;
+  // Pack the tokens of all experts in one buffer of k * batch_size rows
+  // instead of one buffer of alpha-scaled capacity per expert, so that no
+  // token is dropped
+  bool dropless;
 };
 
 }; // namespace FlexFlow
@@ -21,9 +21,15 @@
 #include "flexflow/utils/hash_utils.h"
 #include "mpark/variant.hpp"
 #include "parallel_tensor.h"
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -47,6 +53,18 @@ class ConcatMeta;
 class TransposeMeta;
 class Op;
 class FFModel;
+class OperatorCostDatabase;
+class OperatorCostModel;
+
+/**
+ * @brief Key of an (operator, view) pair in the persistent cost database.
+ * @details The hash indexes the database, while the check is computed
+ * independently so that two keys whose hashes collide are told apart.
+ */
+struct OperatorCostKey {
+  uint64_t hash;
+  uint64_t check;
+};
 
 /**
  * @brief Costs of an operator.
@@ -168,7 +186,26 @@ public:
 typedef std::vector<CommDevice *> Route;
 /* first is an array of cumulative distribution */
 typedef std::pair<std::vector<float>, std::vector<Route>> EcmpRoutes;
+#define DEFAULT_MAX_NUM_ECMP_ROUTES 16
 typedef std::vector<int> ConnectionMatrix;
+
+/**
+ * Compressed sparse row form of a ConnectionMatrix.
+ * The links leaving node i go to dsts[offsets[i]] .. dsts[offsets[i + 1] - 1]
+ * and links[k] is the number of parallel links to dsts[k]. With transpose,
+ * the rows hold the links entering each node instead.
+ */
+struct ConnectionCSR {
+  ConnectionCSR() = default;
+  ConnectionCSR(ConnectionMatrix const &conn,
+                int total_devs,
+                bool transpose = false);
+
+  std::vector<int> offsets;
+  std::vector<int> dsts;
+  std::vector<int> links;
+};
+
 class NetworkRoutingStrategy;
 /**
  * Nomincal communication device.
@@ -182,8 +219,9 @@ public:
                     int device_id,
                     int nnode,
                     NetworkRoutingStrategy *routing);
-  /* pick one of the weighted ECMP path */
-  Route expand_to_physical() const;
+  /* pick one of the weighted ECMP paths by hashing flow_id */
+  Route expand_to_physical(size_t flow_id) const;
+  /* routed on first use; safe to call from several threads */
   EcmpRoutes const &get_all_routes();
   void set_physical_paths(EcmpRoutes const &rs);
   void reset();
@@ -193,6 +231,9 @@ public:
   EcmpRoutes routes;
   bool dirty = true;
   int nnode;
+
+private:
+  std::mutex route_mutex;
 };
 
 /**
@@ -207,6 +248,50 @@ public:
    */
   virtual EcmpRoutes get_routes(int src_node, int dst_node) = 0;
   virtual std::vector<EcmpRoutes> get_routes_from_src(int src_node) = 0;
+  /* drop everything derived from the topology, which may have changed */
+  virtual void clear() {}
+};
+
+/**
+ * Equal-cost multipath routing over the CSR form of a ConnectionMatrix.
+ * The hop distances from a source are computed by a single BFS and cached,
+ * so routing a pair costs time proportional to the routes found rather than
+ * to the size of the network. Each route gets the probability that per-hop
+ * ECMP, which splits traffic among the next hops in proportion to their
+ * number of links, takes it. At most max_num_routes routes are kept per pair
+ * and their probabilities renormalized.
+ */
+class EcmpRouteCache {
+public:
+  EcmpRouteCache(ConnectionMatrix const &conn,
+                 std::map<size_t, CommDevice *> const &devmap,
+                 int total_devs,
+                 int max_num_routes);
+  EcmpRoutes get_routes(int src_node, int dst_node);
+  std::vector<EcmpRoutes> get_routes_from_src(int src_node);
+  void hop_count(int src_node, int dst_node, int &hop, int &narrowest);
+  std::vector<std::pair<int, int>> hop_count(int src_node);
+  void clear();
+
+private:
+  /* hop distance of every node from src_node, -1 if unreachable */
+  std::shared_ptr<std::vector<int> const> get_hops(int src_node);
+  EcmpRoutes enumerate_routes(std::vector<int> const &hops,
+                              int src_node,
+                              int dst_node) const;
+  void build_links();
+
+  ConnectionMatrix const &conn;
+  std::map<size_t, CommDevice *> const &devmap;
+  int total_devs;
+  int max_num_routes;
+  ConnectionCSR out_links;
+  ConnectionCSR in_links;
+  // the link device of each entry of out_links
+  std::vector<CommDevice *> out_devices;
+  std::mutex cache_mutex;
+  std::unordered_map<int, std::shared_ptr<std::vector<int> const>>
+      cached_hops;
 };
 
 class MachineModel {
@@ -223,7 +308,41 @@ public:
   virtual std::vector<CommDevice *> get_comm_path(MemDevice *src_mem,
                                                   MemDevice *tar_mem) = 0;
   virtual std::string to_string() const = 0;
+  /**
+   * @brief Number of CPUs the model describes; CPU parts of a strategy run on
+   * GPUs in models without any.
+   */
+  virtual int get_num_cpus() const {
+    return 0;
+  }
+  virtual CompDevice *get_cpu(int device_id) const {
+    assert(false && "The machine model does not describe CPUs");
+    return nullptr;
+  }
+  /**
+   * @brief The system memory of the socket of a CPU.
+   */
+  virtual MemDevice *get_cpu_mem(int device_id) const {
+    assert(false && "The machine model does not describe CPUs");
+    return nullptr;
+  }
+  /**
+   * @brief Peak compute throughput of a single GPU, in FLOPs per ms.
+   */
+  virtual float get_gpu_peak_flops() const {
+    return gpu_peak_flops;
+  }
+  /**
+   * @brief Peak bandwidth between a GPU and its framebuffer memory, in B/ms.
+   */
+  virtual float get_gpu_fb_mem_bandwidth() const {
+    return gpu_fb_mem_bandwidth;
+  }
   int version;
+  // Defaults describe a V100 (15.7 TFLOPS FP32, 900 GB/s HBM2); they are only
+  // used by the analytical cost model
+  float gpu_peak_flops = 15.7e9f;                      /* FLOPs/ms */
+  float gpu_fb_mem_bandwidth = 900 * 1024 * 1024.0f; /* B/ms */
 };
 
 class SimpleMachineModel : public MachineModel {
@@ -281,8 +400,10 @@ public:
   EnhancedMachineModel(std::string file, size_t gpu_fb_mem_capacity);
   ~EnhancedMachineModel();
   int get_version() const;
+  int get_num_cpus() const;
   CompDevice *get_cpu(int device_id) const;
   CompDevice *get_cpu(int socket_id, int local_id) const;
+  MemDevice *get_cpu_mem(int device_id) const;
   CompDevice *get_gpu(int device_id) const;
   CompDevice *get_gpu(int socket_id, int local_id) const;
   MemDevice *get_sys_mem(int socket_id) const;
@@ -376,24 +497,26 @@ private:
 };
 
 /**
- * Single shortest path routing based on hop count
+ * Equal-cost multipath routing based on hop count
  */
 class WeightedShortestPathRoutingStrategy : public NetworkRoutingStrategy {
 public:
   WeightedShortestPathRoutingStrategy(
       ConnectionMatrix const &c,
       std::map<size_t, CommDevice *> const &devmap,
-      int total_devs);
+      int total_devs,
+      int max_num_routes = DEFAULT_MAX_NUM_ECMP_ROUTES);
   virtual EcmpRoutes get_routes(int src_node, int dst_node);
   virtual std::vector<EcmpRoutes> get_routes_from_src(int src_node);
   void hop_count(int src_node, int dst_node, int &hop, int &narrowest);
   std::vector<std::pair<int, int>> hop_count(int src_node);
-  void clear();
+  virtual void clear();
 
 public:
   ConnectionMatrix const &conn;
   std::map<size_t, CommDevice *> const &devmap;
   int total_devs;
+  EcmpRouteCache routes;
 };
 
 class ShortestPathNetworkRoutingStrategy : public NetworkRoutingStrategy {
@@ -401,17 +524,19 @@ public:
   ShortestPathNetworkRoutingStrategy(
       ConnectionMatrix const &c,
       std::map<size_t, CommDevice *> const &devmap,
-      int total_devs);
+      int total_devs,
+      int max_num_routes = DEFAULT_MAX_NUM_ECMP_ROUTES);
   virtual EcmpRoutes get_routes(int src_node, int dst_node);
   virtual std::vector<EcmpRoutes> get_routes_from_src(int src_node);
   void hop_count(int src_node, int dst_node, int &hop, int &narrowest);
   std::vector<std::pair<int, int>> hop_count(int src_node);
-  void clear();
+  virtual void clear();
 
 public:
   ConnectionMatrix const &conn;
   std::map<size_t, CommDevice *> const &devmap;
   int total_devs;
+  EcmpRouteCache routes;
 };
 
 /**
@@ -420,7 +545,14 @@ public:
  */
 class NetworkTopologyGenerator {
 public:
+  virtual ~NetworkTopologyGenerator() = default;
+  /* an entry is the number of parallel links, each of the machine model's
+   * link_bandwidth, so wider links are expressed as larger entries */
   virtual ConnectionMatrix generate_topology() const = 0;
+  virtual int get_num_nodes() const = 0;
+  virtual int get_num_switches() const {
+    return 0;
+  }
   static void
       print_conn_matrix(ConnectionMatrix const &conn, int nnode, int nswitch) {
     int nnwdevs = nnode + nswitch;
@@ -448,6 +580,9 @@ class FlatDegConstraintNetworkTopologyGenerator
 public:
   FlatDegConstraintNetworkTopologyGenerator(int num_nodes, int degree);
   virtual ConnectionMatrix generate_topology() const;
+  virtual int get_num_nodes() const {
+    return num_nodes;
+  }
 
 public:
   inline int get_id(int i, int j) const;
@@ -464,6 +599,12 @@ class BigSwitchNetworkTopologyGenerator : public NetworkTopologyGenerator {
 public:
   BigSwitchNetworkTopologyGenerator(int num_nodes);
   virtual ConnectionMatrix generate_topology() const;
+  virtual int get_num_nodes() const {
+    return num_nodes;
+  }
+  virtual int get_num_switches() const {
+    return 1;
+  }
 
 public:
   int num_nodes;
@@ -478,6 +619,9 @@ public:
   virtual ConnectionMatrix generate_topology() const {
     return ConnectionMatrix(num_nodes * num_nodes, 0);
   }
+  virtual int get_num_nodes() const {
+    return num_nodes;
+  }
 
 public:
   int num_nodes;
@@ -493,10 +637,92 @@ public:
     }
     return result;
   }
+  virtual int get_num_nodes() const {
+    return num_nodes;
+  }
+
+public:
+  int num_nodes;
+};
+
+/**
+ * Generate a k-ary fat-tree (Al-Fares et al.): k pods of k/2 edge and k/2
+ * aggregation switches, and (k/2)^2 core switches. Every edge switch has
+ * k/2 uplinks and oversubscription * k/2 servers, so an oversubscription of
+ * r leaves each server 1/r of its link bandwidth for traffic that leaves its
+ * edge switch. Switch ids are edge, then aggregation, then core switches.
+ */
+class FatTreeTopologyGenerator : public NetworkTopologyGenerator {
+public:
+  FatTreeTopologyGenerator(int k, int oversubscription = 1);
+  virtual ConnectionMatrix generate_topology() const;
+  virtual int get_num_nodes() const {
+    return num_nodes;
+  }
+  virtual int get_num_switches() const {
+    return num_switches;
+  }
+
+public:
+  int k;
+  int oversubscription;
+  int num_nodes;
+  int num_switches;
+};
+
+/**
+ * Generate a dragonfly (Kim et al.): groups of routers_per_group routers
+ * that are fully connected by local links, with nodes_per_router servers and
+ * global_links_per_router global links per router. There are
+ * routers_per_group * global_links_per_router + 1 groups, so every pair of
+ * groups is joined by exactly one global link. Link widths are given in
+ * units of the link bandwidth.
+ */
+class DragonflyTopologyGenerator : public NetworkTopologyGenerator {
+public:
+  DragonflyTopologyGenerator(int routers_per_group,
+                             int nodes_per_router,
+                             int global_links_per_router,
+                             int local_link_width = 1,
+                             int global_link_width = 1);
+  virtual ConnectionMatrix generate_topology() const;
+  virtual int get_num_nodes() const {
+    return num_nodes;
+  }
+  virtual int get_num_switches() const {
+    return num_switches;
+  }
 
 public:
+  int routers_per_group;
+  int nodes_per_router;
+  int global_links_per_router;
+  int local_link_width;
+  int global_link_width;
+  int num_groups;
   int num_nodes;
+  int num_switches;
 };
+
+/**
+ * Generate a switchless torus with the given dimensions (e.g. {4, 4} or
+ * {4, 4, 4}); server (x, y, z) is numbered x + dims[0] * (y + dims[1] * z)
+ * and is linked to its two neighbours, with wrap-around, in every dimension.
+ */
+class TorusTopologyGenerator : public NetworkTopologyGenerator {
+public:
+  TorusTopologyGenerator(std::vector<int> const &dims, int link_width = 1);
+  virtual ConnectionMatrix generate_topology() const;
+  virtual int get_num_nodes() const {
+    return num_nodes;
+  }
+
+public:
+  std::vector<int> dims;
+  int link_width;
+  int num_nodes;
+};
+
 /**
  * A model that is network topology-aware.
  * The network topology is represented as follows:
@@ -525,6 +751,13 @@ public:
                         std::vector<int> const &topology,
                         size_t capacity,
                         float link_bandwidth);
+  /**
+   * Build the machine and its network topology from a config file in the
+   * format of the EnhancedMachineModel's, e.g.
+   * network_machine_config_example.
+   */
+  static NetworkedMachineModel *from_config_file(std::string const &file,
+                                                 size_t capacity);
   ~NetworkedMachineModel();
   int get_version() const;
   CompDevice *get_gpu(int device_id) const;
@@ -562,6 +795,8 @@ public:
   void set_topology(std::vector<int> const &topology);
   ConnectionMatrix const &get_conn_matrix();
   std::map<size_t, NominalCommDevice *> const &get_nomm_comm_devs();
+  /* created on first use, as most pairs of a large fabric never talk */
+  NominalCommDevice *get_nominal_device(int src_node, int dst_node) const;
 
   void set_pcie(bool state);
   void set_pipeline(bool state);
@@ -576,8 +811,8 @@ public:
   float network_latency;
   float gpu_dram_bandwidth;
 
-  bool pipelined;
-  bool pcie_on;
+  bool pipelined{true};
+  bool pcie_on{false};
 
   // float gpu_dram_bandwidth;
   /* Note that every non-zero entry corrsepond to a device in
@@ -597,7 +832,13 @@ public:
    * or the "logical connection" in side the system. Note that this is
    * keyed on GPUs only
    */
-  std::map<size_t, NominalCommDevice *> ids_to_nw_nominal_device;
+  mutable std::map<size_t, NominalCommDevice *> ids_to_nw_nominal_device;
+  // guards ids_to_nw_nominal_device, which simulators on several threads
+  // extend through get_nominal_device
+  mutable std::mutex nominal_device_mutex;
+
+private:
+  void add_link_device(int src, int dst);
 
 public:
   std::map<size_t, uint64_t> logical_traffic_demand;
@@ -617,6 +858,8 @@ struct OpSyncTaskEarliestFirst {
   }
 };
 
+class TaskManager;
+
 class SimTask {
 public:
   enum SimTaskType {
@@ -639,32 +882,81 @@ public:
   int counter;
   size_t xfer_size;
   size_t xfer_left;
-  std::vector<SimTask *> next_tasks;
+  // Successors, stored in the arena of the TaskManager
+  SimTask **next_tasks;
+  size_t num_next_tasks, max_num_next_tasks;
   // const char *op_name;
   bool store;
-  std::string name;
+  // Either the name of an Op or a copy owned by the TaskManager; never NULL
+  char const *name;
+  TaskManager *manager;
+  // Position in the creation order of the tasks of the TaskManager
+  size_t id;
   std::string get_type_str() const;
 };
 
 class SimTaskCompare {
 public:
   bool operator()(SimTask *lhs, SimTask *rhs) {
-    return lhs->ready_time > rhs->ready_time;
+    // Ties are broken by creation order regardless of the order tasks
+    // became ready
+    if (lhs->ready_time != rhs->ready_time) {
+      return lhs->ready_time > rhs->ready_time;
+    }
+    return lhs->id > rhs->id;
   }
 };
 
+/**
+ * @brief Open-addressing map from (op, part index) to the task simulating
+ * it.
+ *
+ * @details Entries are tagged with the epoch they were inserted in, so reset()
+ * empties the table without touching (or freeing) its slots.
+ */
+class SimTaskTable {
+public:
+  SimTaskTable();
+  void reset();
+  void insert(Op const *op, int idx, SimTask *task);
+  SimTask *find(Op const *op, int idx) const;
+
+private:
+  struct Slot {
+    Op const *op;
+    int idx;
+    size_t epoch;
+    SimTask *task;
+  };
+  size_t get_slot_index(Op const *op, int idx) const;
+  void grow();
+
+private:
+  std::vector<Slot> slots;
+  size_t num_entries, epoch;
+};
+
+/**
+ * @brief Pool of the tasks, successor lists and names of a task graph.
+ *
+ * @details The Simulator builds a new task graph for every simulate_runtime
+ * call. All of its storage is carved out of buffers owned by the TaskManager,
+ * which reset() rewinds without freeing, so that once the buffers have grown
+ * to the size of the largest task graph, building one does not allocate.
+ */
 class TaskManager {
 public:
   TaskManager(size_t max_num_tasks);
+  ~TaskManager();
   void reset();
   SimTask *new_barrier_task();
   SimTask *new_update_task();
   SimTask *new_comm_task();
   SimTask *new_nominal_comm_task();
-  SimTask *new_comm_task(std::string const &name,
+  SimTask *new_comm_task(char const *name,
                          CommDevice *comm_device,
                          size_t message_size);
-  SimTask *new_nominal_comm_task(std::string const &name,
+  SimTask *new_nominal_comm_task(char const *name,
                                  CommDevice *comm_device,
                                  size_t message_size);
   SimTask *new_forward_task(Op const *op, int idx);
@@ -676,16 +968,252 @@ public:
   SimTask *get_backward_task(Op const *op, int idx);
 
   SimTask *new_task();
+  /**
+   * @brief Copy name into the name buffer; the copy lives until reset().
+   */
+  char const *copy_name(char const *name);
+  /**
+   * @brief Allocate room for num_tasks successors from the successor
+   * buffer; the room lives until reset().
+   */
+  SimTask **allocate_next_tasks(size_t num_tasks);
 
 public:
   size_t global_task_id, max_num_tasks;
-  SimTask **tasks;
+  SimTask *tasks;
 
-  std::map<size_t, SimTask *> hash_to_forward_task, hash_to_backward_task;
+  SimTaskTable forward_tasks, backward_tasks;
+
+private:
+  // Successor lists and names are bump-allocated from chunks that are kept
+  // across resets
+  static constexpr size_t NEXT_TASKS_CHUNK_SIZE = 1 << 16;
+  static constexpr size_t NAMES_CHUNK_SIZE = 1 << 16;
+  std::vector<std::vector<SimTask *>> next_tasks_chunks;
+  size_t next_tasks_chunk_idx, next_tasks_offset;
+  std::vector<std::vector<char>> names_chunks;
+  size_t names_chunk_idx, names_offset;
 };
 
 size_t data_type_size(DataType);
 
+/**
+ * @brief A phase of a collective: point-to-point transfers between GPUs that
+ * run concurrently once the previous phase has finished.
+ *
+ * @details A pipelined algorithm moves its data in num_steps sequential hops,
+ * so a phase pays num_steps link latencies on top of its busiest link.
+ */
+struct CollectivePhase {
+  struct Transfer {
+    int src_gpu;
+    int dst_gpu;
+    size_t size;
+  };
+  std::vector<Transfer> transfers;
+  int num_steps;
+};
+
+/**
+ * @brief Phases of an allreduce of message_size bytes among gpus.
+ *
+ * @details ALLREDUCE_RING is a reduce-scatter followed by an all-gather
+ * around one ring. ALLREDUCE_TREE reduces and then broadcasts half of the
+ * message along each of two complementary binary trees, like NCCL's double
+ * binary tree. ALLREDUCE_HIERARCHICAL reduce-scatters over NVLink inside each
+ * node, allreduces every shard across nodes with one ring per local rank and
+ * all-gathers inside each node again; it is a ring when the GPUs are not
+ * spread evenly over several nodes. ALLREDUCE_PARAMETER_SERVER gathers to and
+ * scatters from the first GPU. ALLREDUCE_AUTO picks the ring, tree or
+ * hierarchical plan that estimate_collective_time finds fastest for this
+ * message size.
+ */
+std::vector<CollectivePhase> plan_allreduce(AllReduceAlgorithm algorithm,
+                                            std::vector<int> const &gpus,
+                                            size_t message_size,
+                                            MachineModel *machine);
+/**
+ * @brief Latency of the sequential steps of a phase, with the inter-node
+ * latency if any of its transfers leaves a node.
+ */
+float collective_phase_latency(CollectivePhase const &phase,
+                               MachineModel *machine);
+/**
+ * @brief Alpha-beta estimate of a collective on an idle network: per phase,
+ * its latency plus the time of its busiest GPU or NIC.
+ */
+float estimate_collective_time(std::vector<CollectivePhase> const &phases,
+                               MachineModel *machine);
+
+/**
+ * @brief What Simulator::simulate_runtime needs to remember about the last
+ * task graph it simulated to resume from it.
+ *
+ * @details The task graph is built in segments, each holding the tasks that
+ * one step of the construction creates for one op (or one op and one of its
+ * inputs). A segment is dirty when the config of one of its ops changed, and
+ * a clean segment holds the same tasks as in the previous task graph.
+ */
+struct SimulationCheckpoint {
+  struct Segment {
+    size_t begin, end; // range of task ids
+  };
+  // Part dstId of an op's input overlaps part srcId of the producer's output
+  struct Overlap {
+    int dst_id, src_id;
+    size_t volume;
+  };
+  FFModel const *model = nullptr;
+  CompMode comp_mode;
+  std::vector<ParallelConfig> configs; // indexed like model->operators
+  std::vector<Segment> segments;
+  // Only filled for the segments of the dependencies between ops
+  std::vector<std::vector<Overlap>> overlaps;
+  // Indexed by task id
+  std::vector<float> ready_times, end_times;
+};
+
+/**
+ * @brief Worker threads that stay alive across simulations and run the
+ * iterations of a loop in parallel.
+ */
+class SimulatorThreadPool {
+public:
+  /* num_threads counts the calling thread, which also runs iterations */
+  SimulatorThreadPool(int num_threads);
+  ~SimulatorThreadPool();
+  /* runs body(i) for i in [0, n) and returns once all of them are done */
+  void parallel_for(int n, std::function<void(int)> const &body);
+
+private:
+  void run_iterations();
+  void worker_loop();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable work_ready, work_done;
+  std::function<void(int)> const *body = nullptr;
+  int num_iterations = 0;
+  std::atomic<int> next_iteration;
+  int num_running = 0;
+  size_t generation = 0;
+  bool stop = false;
+};
+
+/**
+ * @brief Flow-level model of the transfers in flight: the active flows on a
+ * link share its bandwidth max-min fairly.
+ *
+ * @details Rates are recomputed by progressive filling only when a flow
+ * starts or finishes, and between such events every flow drains at a
+ * constant rate, so the cost of a simulation grows with its number of
+ * transfers rather than with their sizes.
+ */
+class FlowLevelNetwork {
+public:
+  /* time is in ms, sizes in bytes and bandwidths in B/ms */
+  void start_flow(SimTask *task,
+                  Route const &route,
+                  float size,
+                  float latency,
+                  float now);
+  /* infinity if no flow is active */
+  float next_completion_time() const;
+  /* drains the flows up to now, which must not be later than
+   * next_completion_time(), and returns the ones that finished together with
+   * the time their last byte arrives */
+  void advance(float now, std::vector<std::pair<SimTask *, float>> &finished);
+  bool empty() const {
+    return flows.empty();
+  }
+  void clear();
+
+private:
+  struct Flow {
+    SimTask *task;
+    std::vector<int> links;
+    double remaining;
+    double rate;
+    float latency;
+  };
+  void drain(double now);
+  void update_rates();
+
+  std::vector<Flow> flows;
+  std::unordered_map<CommDevice *, int> link_ids;
+  std::vector<double> link_bandwidth;
+  // scratch space of update_rates, kept to avoid reallocating it per event
+  std::vector<double> capacity;
+  std::vector<int> num_unfrozen;
+  std::vector<int> link_flow_offsets;
+  std::vector<int> link_flows;
+  std::vector<int> touched_round;
+  std::vector<std::pair<double, int>> heap;
+  double clock = 0.0;
+  double next_completion = std::numeric_limits<double>::infinity();
+};
+
+/**
+ * @brief Where the simulated time of a strategy goes.
+ *
+ * @details The critical path is the chain of tasks, in execution order, that
+ * ends with the last task to finish; every task on it started as soon as the
+ * previous one finished, either because it depended on it or because it
+ * waited for its device. Times are in ms and sizes in bytes; devices are
+ * identified by name.
+ */
+struct SimulationReport {
+  struct TaskSpan {
+    std::string name;
+    std::string type;
+    std::string device;
+    float ready_time;
+    float start_time;
+    float end_time;
+  };
+  struct DeviceUtilization {
+    float busy_time = 0.0f;
+    float idle_time = 0.0f;
+    size_t num_tasks = 0;
+  };
+  float total_time = 0.0f;
+  float memory_penalty = 0.0f;
+  std::vector<TaskSpan> critical_path;
+  std::map<std::string, DeviceUtilization> device_utilization;
+  std::map<std::string, size_t> comm_volume;
+  // peak of the live memory of every GPU along the iteration, as given by
+  // PCG::LivenessMemoryModel
+  std::map<std::string, size_t> peak_memory;
+
+  void write_json(std::string const &filename) const;
+};
+
+/**
+ * @brief Builds a SimulationReport from the tasks of a simulation, as they
+ * are run.
+ */
+class SimulationReportBuilder {
+public:
+  /* called once the end time of task has become the ready time of next */
+  void set_ready_after(SimTask const *next, SimTask const *task);
+  /* called for every task, in the order the simulation runs them */
+  void add_task(SimTask const *task, float start_time, float end_time);
+  void build(SimulationReport &report, float makespan) const;
+
+private:
+  struct TaskRecord {
+    SimTask const *task;
+    float start_time;
+    float end_time;
+    // the task whose end let this one start, -1 if none
+    int critical_pred;
+  };
+  std::vector<TaskRecord> records;
+  std::unordered_map<SimTask const *, int> record_ids;
+  std::unordered_map<SimTask const *, SimTask const *> ready_after;
+  std::unordered_map<Device const *, int> last_on_device;
+};
+
 using ProfilingRecordKey = std::tuple<OperatorParameters, MachineView>;
 
 class Simulator {
@@ -695,6 +1223,15 @@ public:
             FFHandler handler,
             Legion::Memory memory,
             MachineModel *machine);
+  /**
+   * @brief A simulator with a task graph of its own that measures operators
+   * on profiler, which must outlive it.
+   *
+   * @details Allocates no workspace: measure_operator_cost goes to
+   * profiler, so that all of them share one workspace and one cost cache,
+   * under profiler->profile_mutex if they run from several threads.
+   */
+  explicit Simulator(Simulator *profiler);
   ~Simulator(void);
   void free_all();
   void *allocate(size_t num_elements, DataType type);
@@ -702,8 +1239,29 @@ public:
                                        SimTask *dst_task,
                                        size_t message_size,
                                        bool force_zero_cost = false);
+  /**
+   * @brief Allreduce message_size bytes among gpus, planned by
+   * plan_allreduce for allreduce_algorithm.
+   *
+   * @details Every phase of the plan gets one barrier task per GPU, and its
+   * transfers are comm. tasks between the barriers of consecutive phases.
+   * The allreduce of gpus[i] starts after src_tasks[i], and dst_tasks[i]
+   * waits for its last phase.
+   */
+  void add_allreduce_dependencies(std::vector<SimTask *> const &src_tasks,
+                                  std::vector<SimTask *> const &dst_tasks,
+                                  std::vector<int> const &gpus,
+                                  size_t message_size);
   CostMetrics measure_operator_cost(Op const *op, ParallelConfig const &config);
   CostMetrics measure_operator_cost(Op const *op, MachineView const &view);
+  /**
+   * @brief Key of an (operator, view) pair in the persistent cost database.
+   * @details Unlike the in-memory caches, the key only depends on values that
+   * are identical across processes: the operator parameters, its input shapes,
+   * the machine view, and the computation mode.
+   */
+  OperatorCostKey get_persistent_cost_key(Op const *op,
+                                          MachineView const &view) const;
   float estimate_xfer_cost(Op const *op,
                            int input_idx,
                            MachineView const &source_view,
@@ -721,10 +1279,30 @@ public:
   float simulate_runtime(FFModel const *model,
                          std::map<Op const *, ParallelConfig> const &global,
                          CompMode comp_mode);
+  /**
+   * @brief Also writes the task graph as DOT to export_file_name and the
+   * simulated timeline as a Chrome trace to trace_file_name, if not empty,
+   * and fills report, if not null.
+   */
   float simulate_runtime(FFModel const *model,
                          std::map<Op const *, ParallelConfig> const &global,
                          CompMode comp_mode,
-                         std::string const &export_file_name);
+                         std::string const &export_file_name,
+                         std::string const &trace_file_name = "",
+                         SimulationReport *report = nullptr);
+  /**
+   * @brief Same result as simulate_runtime, but reuses the previous
+   * simulation for the ops whose config did not change since.
+   *
+   * @details Only the tasks of the changed ops and the comm. tasks around
+   * them are rebuilt, and the simulation resumes from the earliest time one
+   * of them may run. Meant for searches like FFModel::mcmc_optimize that
+   * change the config of a few ops between simulations.
+   */
+  float simulate_runtime_incremental(
+      FFModel const *model,
+      std::map<Op const *, ParallelConfig> const &global,
+      CompMode comp_mode);
   static void
       strategy_search_task(Legion::Task const *task,
                            std::vector<Legion::PhysicalRegion> const &regions,
@@ -750,6 +1328,17 @@ public:
   std::unordered_map<size_t, CostMetrics> hash_to_operator_cost;
   std::unordered_map<ProfilingRecordKey, CostMetrics>
       strict_hash_to_operator_cost;
+  // Optional on-disk cache shared by all jobs on the host
+  std::shared_ptr<OperatorCostDatabase> cost_database;
+  // Optional replacement for running the operators' kernels
+  std::shared_ptr<OperatorCostModel> cost_model;
+  // Optional lock held by measure_operator_cost, needed when simulators
+  // measure operators on this one from several threads
+  std::shared_ptr<std::mutex> profile_mutex;
+  // Simulator whose workspace and cost caches this one measures operators
+  // with, null if it has its own
+  Simulator *profiler = nullptr;
+  SimulationCheckpoint checkpoint;
 
 public:
   Conv2DMeta *conv2d_meta;
@@ -767,7 +1356,25 @@ public:
   int segment_size;
   int max_num_segments; // simulation could be slow if the number of segments
                         // are too large
+  AllReduceAlgorithm allreduce_algorithm;
+  // share link bandwidth among concurrent transfers instead of queueing them
+  bool flow_level_network;
+  FlowLevelNetwork flow_network;
+  // route of every comm. task that is simulated as a flow, by task id
+  std::unordered_map<size_t, Route> flow_routes;
+  // Finds the overlapping partitions of the ops while building a task graph;
+  // null with a single simulator thread
+  std::unique_ptr<SimulatorThreadPool> thread_pool;
+
 private:
+  float simulate_runtime(FFModel const *model,
+                         std::map<Op const *, ParallelConfig> const &global,
+                         CompMode comp_mode,
+                         std::string const &export_file_name,
+                         std::string const &trace_file_name,
+                         SimulationReport *report,
+                         bool incremental);
+  CostMetrics profile_operator_cost(Op const *op, MachineView const &view);
   float estimate_repartition_xfer_cost(
       int repartition_dim,
       int repartition_degree,
@@ -777,6 +1384,69 @@ private:
       MachineView const &target_view) const;
 };
 
+/**
+ * @brief Event loop of the LogicalTaskgraphBasedSimulator over the tasks of a
+ * TaskManager.
+ *
+ * @details With a thread pool, the loop takes the ready tasks in windows: a
+ * window ends before the first task that could be released by one already
+ * in it, i.e. the first ready no earlier than the smallest ready time plus
+ * lookahead (the run time of a compute task, the link latency of a
+ * transfer) of the window. The tasks of a window that share no device run
+ * in parallel, and those sharing one in queue order, after which they
+ * release their successors in queue order, so that the simulated times are
+ * the same as those of the serial loop. Flows and allreduce expansions
+ * always run serially.
+ */
+class LogicalEventLoop {
+public:
+  /* flow_network and thread_pool may be NULL */
+  LogicalEventLoop(TaskManager *task_manager,
+                   MachineModel *machine,
+                   AllReduceAlgorithm allreduce_algorithm,
+                   bool segment_transfer,
+                   size_t segment_size,
+                   FlowLevelNetwork *flow_network,
+                   SimulatorThreadPool *thread_pool);
+  /* runs every task of task_manager and returns the simulated time */
+  float run();
+  float route_transfer(SimTask *transfer_task,
+                       Route const &route,
+                       std::map<Device *, float> &device_times) const;
+  float route_transfer_seg(SimTask *transfer_task,
+                           Route const &route,
+                           std::map<Device *, float> &device_times,
+                           bool &finished) const;
+  void expand_allreduce(
+      SimTask *allreduce_task,
+      std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
+          &ready_queue);
+  SimTask *new_comm_task_unrecorded();
+  SimTask *new_update_task_unrecorded();
+  SimTask *new_barrier_task_unrecorded();
+
+private:
+  struct WindowTask {
+    SimTask *task = nullptr;
+    // the links of a transfer
+    Route route;
+    float end_time = 0.0f;
+    // false while segments of a transfer are left
+    bool finished = true;
+  };
+  float run_serial();
+  float run_windows();
+  void run_task(WindowTask &w, std::map<Device *, float> &device_times) const;
+
+  TaskManager *task_manager;
+  MachineModel *machine;
+  AllReduceAlgorithm allreduce_algorithm;
+  bool segment_transfer;
+  size_t segment_size;
+  FlowLevelNetwork *flow_network;
+  SimulatorThreadPool *thread_pool;
+};
+
 /**
  * An alternative implementation of the simulator which uses the "logical
  * task graph", defined as a taskgraph that only records computation
@@ -789,8 +1459,6 @@ public:
                                  Legion::Memory memory,
                                  MachineModel *machine);
 
-  SimTask *new_comm_task_unrecorded();
-  SimTask *new_update_task_unrecorded();
   virtual float
       simulate_runtime(FFModel const *model,
                        std::map<Op const *, ParallelConfig> const &global,
@@ -800,18 +1468,6 @@ public:
                        std::map<Op const *, ParallelConfig> const &global,
                        CompMode comp_mode,
                        std::string const &export_file_name);
-  virtual float route_transfer(SimTask *transfer_task,
-                               float start_time,
-                               std::map<Device *, float> &device_times);
-  virtual float route_transfer_seg(SimTask *transfer_task,
-                                   float start_time,
-                                   std::map<Device *, float> &device_times,
-                                   bool &finished);
-  virtual void expand_allreduce(
-      SimTask *allreduce_task,
-      float start_time,
-      std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
-          &ready_queue);
   void add_task_dependencies_with_xfer(SimTask *src_task,
                                        SimTask *dst_task,
                                        size_t message_size);
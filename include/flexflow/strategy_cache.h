@@ -0,0 +1,83 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FLEXFLOW_STRATEGY_CACHE_H_
+#define _FLEXFLOW_STRATEGY_CACHE_H_
+
+#include "flexflow/graph.h"
+#include <cstdint>
+#include <string>
+
+namespace FlexFlow {
+
+/**
+ * @brief A persistent cache of the strategies found by
+ * Graph::graph_optimize_task, so that launching the same model again skips
+ * the search.
+ *
+ * @details Every strategy is a file of the cache directory named after its
+ * key, holding the serialized PCG and MachineViews returned by the search
+ * behind a versioned header. A strategy is written to a temporary file that
+ * is then renamed, so a job killed while writing it leaves no partial file
+ * behind, and concurrent jobs can share a directory.
+ *
+ * Strategies depend on the costs measured on the GPU the search ran on; use
+ * one directory per GPU type.
+ */
+class StrategyCache {
+public:
+  static constexpr uint32_t VERSION = 2;
+
+  StrategyCache(std::string const &directory);
+
+  /**
+   * @brief Key of the search of a compiled model: its operators and how they
+   * are connected, the machine, the options of the search and the contents
+   * of the machine model file. The cost database only counts by its format,
+   * since its contents change with every search that uses it.
+   */
+  static uint64_t get_key(FFModel const *model);
+
+  /**
+   * @brief Look up the strategy of a key.
+   *
+   * @return true if the key is in the cache and strategy was set
+   */
+  bool lookup(uint64_t key, PCG::GraphOptimalViewSerialized &strategy) const;
+  /**
+   * @brief Store the strategy of a key, replacing any previous one.
+   */
+  void insert(uint64_t key,
+              PCG::GraphOptimalViewSerialized const &strategy) const;
+
+public:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t total_bytes;
+  };
+
+private:
+  std::string get_filename(uint64_t key) const;
+
+private:
+  std::string directory;
+};
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_STRATEGY_CACHE_H_
@@ -166,6 +166,19 @@ private:
   GraphXfer const *xfer;
 };
 
+/**
+ * @brief Per-xfer statistics of the pattern matcher.
+ */
+struct GraphXferMatchStats {
+  size_t num_searches = 0;   ///< Number of graphs searched for matches
+  size_t num_candidates = 0; ///< Number of nodes tested with can_match
+  size_t num_pruned = 0;     ///< Number of nodes rejected by can_match
+  size_t num_matches = 0;    ///< Number of complete matches of all srcOps
+  ///< Total search time in ms. For GraphXfer::run this includes creating and
+  ///< costing the rewritten graphs.
+  double search_time = 0;
+};
+
 class GraphXfer {
 public:
   GraphXfer(FFModel *_model);
@@ -209,6 +222,11 @@ public:
   OpX *create_combine(TensorX const &input, int combine_dim, int num_parts);
   bool map_output(TensorX const &src, TensorX const &dst);
 
+  /**
+   * @brief The changes the current match makes to the graph, in O(size of
+   * the match). The graph must be the one last indexed by build_match_index.
+   */
+  GraphRewrite get_rewrite(Graph const *graph) const;
   Graph *create_new_graph(Graph const *graph,
                           SimplificationSettings const &settings);
   bool create_new_operator(OpX const *opx, Node &op);
@@ -230,10 +248,49 @@ public:
   void find_matches(Graph const *, std::vector<GraphXferMatch> &matches);
   GraphXferMatch get_match_record(Graph const *) const;
 
+  /**
+   * @brief Enumerate all assignments of srcOps to nodes of the graph without
+   * creating any new operators or graphs. Each binding lists the matched node
+   * for srcOps[0..n) by index, and bindings are produced in the same order as
+   * GraphXfer::run visits them.
+   */
+  void find_match_bindings(Graph const *graph,
+                           std::vector<std::vector<Node>> &bindings);
+  /**
+   * @brief Get the rewrite of the graph for a binding returned by
+   * find_match_bindings, without copying the graph.
+   *
+   * @return Whether the binding can be applied
+   */
+  bool get_binding_rewrite(Graph const *graph,
+                           std::vector<Node> const &binding,
+                           GraphRewrite &rewrite);
+
 private:
   void find_matches(int depth,
                     Graph const *graph,
                     std::vector<GraphXferMatch> &matches);
+  void find_match_bindings(int depth,
+                           Graph const *graph,
+                           std::vector<Node> &binding,
+                           std::vector<std::vector<Node>> &bindings);
+  /**
+   * @brief Index the nodes of the graph by op type and choose the order in
+   * which srcOps are matched.
+   *
+   * @details Matching starts from the srcOp whose op type is the rarest in
+   * the graph and then prefers srcOps that are connected to an already
+   * matched one, so that get_match_candidates can follow graph edges instead
+   * of scanning every node.
+   */
+  void build_match_index(Graph const *graph);
+  /**
+   * @brief Nodes of the graph that srcOp may be matched to, given the
+   * current partial match.
+   */
+  void get_match_candidates(OpX *srcOp,
+                            Graph const *graph,
+                            std::vector<Node> &candidates) const;
 
 public:
   FFModel *model;
@@ -244,6 +301,12 @@ public:
   std::map<TensorX, TensorX, TensorXCompare> mappedOutputs;
   std::vector<OpX *> srcOps;
   std::vector<OpX *> dstOps;
+  GraphXferMatchStats match_stats;
+
+private:
+  std::unordered_map<OperatorType, std::vector<Node>> nodesByType;
+  std::vector<Node> edgelessNodes; ///< Nodes of the indexed graph, no edges
+  std::vector<int> matchOrder; ///< Indices into srcOps
 };
 
 class GraphSearchHelper {
@@ -264,6 +327,17 @@ public:
       bool only_data_parallel,
       std::unique_ptr<Graph> &best_graph,
       std::unordered_map<Node, MachineView> &optimal_views);
+  /**
+   * @brief Get a strategy of the Pareto front found by the last
+   * graph_optimize_with_memory with MemorySearchAlgo::PARETO.
+   *
+   * @param[in] index Position of the strategy in the front, fastest first
+   * @return false if the front has no more than index strategies
+   */
+  bool get_pareto_strategy(size_t index,
+                           std::unique_ptr<Graph> &best_graph,
+                           std::unordered_map<Node, MachineView> &optimal_views,
+                           MemorySearchResult &search_result);
   /**
    * @brief Substitute the mem_config with new_config.
    */
@@ -289,6 +363,17 @@ private:
       tl::optional<ParallelTensorShape> const &output_shape,
       tl::optional<ParallelTensorShape> const &input_shape);
 
+  /**
+   * @brief Pareto-set version of generic_sequence_optimize_with_memory:
+   * every strategy of the sub-problem that no other one beats in both run
+   * time and memory cost, fastest first.
+   */
+  std::vector<GraphOptimizeResultWithMemory> const &pareto_sequence_optimize(
+      Graph const *graph,
+      Node const &sink_node,
+      tl::optional<ParallelTensorShape> const &output_shape,
+      tl::optional<ParallelTensorShape> const &input_shape);
+
   float sequence_optimize(Graph const *graph,
                           Node const &sink_node,
                           tl::optional<ParallelTensorShape> const &output_shape,
@@ -325,11 +410,42 @@ private:
   std::unique_ptr<Graph> base_optimize_with_memory(
       Graph const *, SimplificationSettings const &simplification_settings);
 
+  std::vector<GraphOptimizeResultWithMemory> base_optimize_pareto(
+      Graph const *, SimplificationSettings const &simplification_settings);
+
+  /**
+   * @brief The graph that the base case of the DP optimizes for a sub-problem
+   * and the settings to simplify its candidates with.
+   */
+  Graph base_case_graph(Graph const *graph,
+                        tl::optional<ParallelTensorShape> const &output_shape,
+                        tl::optional<ParallelTensorShape> const &input_shape,
+                        SimplificationSettings &settings) const;
+
+  /**
+   * @brief Simplify the graph of a search result and get the machine views of
+   * its deduplicated input nodes.
+   */
+  void finalize_strategy(GraphOptimizeResultWithMemory const &optimal,
+                         std::unique_ptr<Graph> &best_graph,
+                         std::unordered_map<Node, MachineView> &optimal_views);
+
+  template <typename GraphComparator>
+  void expand_candidate_parallel(
+      Graph *graph,
+      std::vector<GraphXfer *> const &xfers,
+      std::priority_queue<Graph *, std::vector<Graph *>, GraphComparator> &,
+      std::unordered_set<size_t> &,
+      float threshold,
+      int maxNumOps,
+      SimplificationSettings const &simplification_settings);
+
   std::vector<ParallelTensorShape>
       possible_split_output_tensor_shapes(Node const &) const;
 
   void find_rewrite_matches(Graph const *graph,
                             std::vector<GraphXferMatch> &matches) const;
+  void log_split_cache_stats() const;
   tl::optional<Node> find_split_node(Graph const *graph,
                                      int base_optimize_threshold) const;
 
@@ -344,11 +460,22 @@ private:
 
 private:
   std::unordered_map<size_t, float> cached_optimized_graphs;
+  std::unordered_map<size_t, std::vector<GraphOptimizeResultWithMemory>>
+      cached_pareto_fronts;
+  // Result of the last search with MemorySearchAlgo::PARETO
+  std::vector<GraphOptimizeResultWithMemory> pareto_front;
+  float pareto_search_time = 0.0f;
+  // Split node of each (graph, threshold) pair seen by find_split_node
+  mutable std::unordered_map<size_t, tl::optional<Node>> cached_split_nodes;
+  mutable size_t num_split_cache_hits = 0;
+  mutable size_t num_split_cache_misses = 0;
   std::vector<GraphXfer *> all_pcg_xfers;
   FFModel *model;
   FFConfig const &config;
   MemoryOptimConfig mem_config;
   std::unique_ptr<RecursiveLogger> logger;
+  // Expands the candidates when search_num_threads > 1; kept across searches
+  std::unique_ptr<SimulatorThreadPool> thread_pool;
 };
 
 }; // namespace FlexFlow::PCG
@@ -69,6 +69,7 @@ NLOHMANN_JSON_SERIALIZE_ENUM(OperatorType,
                               {OP_CACHE, "OP_CACHE"},
                               {OP_AGGREGATE, "OP_AGGREGATE"},
                               {OP_AGG_SPEC, "OP_AGG_SPEC"},
+                              {OP_EXPERTS, "OP_EXPERTS"},
                               {OP_RESHAPE, "OP_RESHAPE"},
                               {OP_REVERSE, "OP_REVERSE"},
                               {OP_TRANSPOSE, "OP_TRANSPOSE"},
@@ -0,0 +1,90 @@
+#ifndef _FLEXFLOW_COMPACT_SERIALIZER_H
+#define _FLEXFLOW_COMPACT_SERIALIZER_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief An append-only byte stream storing integers as LEB128 varints, so
+ * that the small values making up most of a serialized graph (indices,
+ * counts, enums) take one byte instead of four or eight.
+ *
+ * @details Signed values are zigzag-encoded first, so small negative values
+ * stay small too.
+ */
+class CompactSerializer {
+public:
+  void write_varint(uint64_t value) {
+    while (value >= 0x80) {
+      buffer.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    buffer.push_back(static_cast<char>(value));
+  }
+  void write_signed_varint(int64_t value) {
+    write_varint((static_cast<uint64_t>(value) << 1) ^
+                 static_cast<uint64_t>(value >> 63));
+  }
+  void write_bytes(void const *data, size_t num_bytes) {
+    char const *bytes = static_cast<char const *>(data);
+    buffer.insert(buffer.end(), bytes, bytes + num_bytes);
+  }
+  size_t get_used_bytes() const {
+    return buffer.size();
+  }
+  std::vector<char> &get_buffer() {
+    return buffer;
+  }
+
+private:
+  std::vector<char> buffer;
+};
+
+/**
+ * @brief Reads back the stream written by a CompactSerializer.
+ */
+class CompactDeserializer {
+public:
+  CompactDeserializer(void const *data, size_t num_bytes)
+      : cur(static_cast<unsigned char const *>(data)), end(cur + num_bytes) {}
+
+  uint64_t read_varint() {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+      assert(cur < end && shift < 64);
+      unsigned char byte = *cur++;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        return value;
+      }
+    }
+  }
+  int64_t read_signed_varint() {
+    uint64_t value = read_varint();
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+  void read_bytes(void *data, size_t num_bytes) {
+    assert(get_remaining_bytes() >= num_bytes);
+    memcpy(data, cur, num_bytes);
+    cur += num_bytes;
+  }
+  // Skips num_bytes and returns where they start, to hand them to another
+  // deserializer without copying them
+  void const *skip_bytes(size_t num_bytes) {
+    assert(get_remaining_bytes() >= num_bytes);
+    void const *start = cur;
+    cur += num_bytes;
+    return start;
+  }
+  size_t get_remaining_bytes() const {
+    return static_cast<size_t>(end - cur);
+  }
+
+private:
+  unsigned char const *cur, *end;
+};
+
+#endif // _FLEXFLOW_COMPACT_SERIALIZER_H
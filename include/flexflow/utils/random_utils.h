@@ -2,14 +2,37 @@
 #define _RANDOM_UTILS_H
 
 #include <cstdlib>
+#include <random>
 #include <stdexcept>
 #include <vector>
 
+// Like std::rand(), but draws from the engine installed on the calling thread
+// by a RandomEngineGuard, if there is one
+int randi();
 float randf();
 
+/**
+ * @brief Makes randi() and randf() on the calling thread draw from engine
+ * for the lifetime of the guard.
+ *
+ * @details Lets a search give each of its threads (e.g. each Markov chain)
+ * its own seeded engine, so its results do not depend on how the threads
+ * interleave.
+ */
+class RandomEngineGuard {
+public:
+  explicit RandomEngineGuard(std::mt19937 &engine);
+  ~RandomEngineGuard();
+  RandomEngineGuard(RandomEngineGuard const &) = delete;
+  RandomEngineGuard &operator=(RandomEngineGuard const &) = delete;
+
+private:
+  std::mt19937 *prev_engine;
+};
+
 template <typename T>
 T select_random(std::vector<T> const &values) {
-  return values[std::rand() % values.size()];
+  return values[randi() % values.size()];
 }
 
 template <typename T>
@@ -0,0 +1,151 @@
+#ifndef _FLEXFLOW_REPLICA_EXCHANGE_H
+#define _FLEXFLOW_REPLICA_EXCHANGE_H
+
+#include "flexflow/utils/random_utils.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct ReplicaExchangeParams {
+  int num_chains = 1;
+  // the chains run iterations [0, budget]
+  size_t budget = 0;
+  // inverse temperature of the coldest chain
+  float alpha = 0.0f;
+  // ratio between the temperatures of neighboring chains
+  float temperature_ratio = 2.0f;
+  unsigned seed = 0;
+  // iterations between two exchanges, 0 for independent chains
+  size_t exchange_interval = 0;
+  // iterations after which a chain restarts from its best state
+  size_t reset_span = 1;
+};
+
+/**
+ * @brief Minimizes cost with one Markov chain per thread and replica
+ * exchange between them.
+ *
+ * @details Chain c samples at inverse temperature
+ * alpha / temperature_ratio^c, starting from best. Its randi() and randf()
+ * draw from its own engine, seeded with seed + c, and the exchanges draw
+ * from an engine seeded with seed, so a given seed always gives the same
+ * result, however the threads interleave. propose(c, current, next) writes
+ * a neighbor of current to next and cost(c, next) evaluates it, both on the
+ * thread of chain c. The best state over all chains is returned in best,
+ * with ties going to the coldest chain.
+ *
+ * @return the cost of best
+ */
+template <typename State>
+float replica_exchange_search(
+    State &best,
+    float initial_cost,
+    ReplicaExchangeParams const &params,
+    std::function<void(int, State const &, State &)> const &propose,
+    std::function<float(int, State const &)> const &cost) {
+  struct Chain {
+    float alpha;
+    std::mt19937 engine;
+    State current, best;
+    float current_cost, best_cost;
+    size_t last_reset_iter;
+  };
+  assert(params.num_chains > 0);
+  assert(params.reset_span > 0);
+  std::vector<Chain> chains(params.num_chains);
+  for (size_t c = 0; c < chains.size(); c++) {
+    Chain &chain = chains[c];
+    chain.alpha = params.alpha / std::pow(params.temperature_ratio, (float)c);
+    chain.engine.seed(params.seed + c);
+    chain.current = chain.best = best;
+    chain.current_cost = chain.best_cost = initial_cost;
+    chain.last_reset_iter = 0;
+  }
+  // Run iterations [begin, end) of a chain on the calling thread
+  auto run_chain = [&](int c, size_t begin, size_t end) {
+    Chain &chain = chains[c];
+    RandomEngineGuard guard(chain.engine);
+    State next;
+    for (size_t iter = begin; iter < end; iter++) {
+      // Reset the current state to be the best state
+      if (iter - chain.last_reset_iter >= params.reset_span) {
+        chain.current = chain.best;
+        chain.current_cost = chain.best_cost;
+        chain.last_reset_iter = iter;
+      }
+      propose(c, chain.current, next);
+      float next_cost = cost(c, next);
+      if (iter % 1000 == 0) {
+        printf("chain(%d) iteration(%zu) current_strategy(%.4lf) "
+               "best_strategy(%.4lf)\n",
+               c,
+               iter,
+               chain.current_cost,
+               chain.best_cost);
+      }
+      float rn = randf();
+      float diff = next_cost - chain.current_cost;
+      if (next_cost < chain.best_cost) {
+        chain.best_cost = next_cost;
+        chain.best = next;
+      }
+      if (next_cost < chain.current_cost) {
+        chain.current = next;
+        chain.current_cost = next_cost;
+      } else if (rn < std::exp(-chain.alpha * diff)) {
+        chain.current = next;
+        chain.current_cost = next_cost;
+      }
+    }
+  };
+  // Chains run independently between replica exchanges
+  size_t interval = params.exchange_interval > 0 ? params.exchange_interval
+                                                 : params.budget + 1;
+  std::mt19937 exchange_engine(params.seed);
+  std::uniform_real_distribution<float> exchange_dist(0.0f, 1.0f);
+  for (size_t begin = 0, round = 0; begin <= params.budget;
+       begin += interval, round++) {
+    size_t end = std::min(begin + interval, params.budget + 1);
+    if (chains.size() == 1) {
+      run_chain(0, begin, end);
+    } else {
+      std::vector<std::thread> threads;
+      for (size_t c = 0; c < chains.size(); c++) {
+        threads.emplace_back(run_chain, c, begin, end);
+      }
+      for (std::thread &thread : threads) {
+        thread.join();
+      }
+    }
+    if (end > params.budget) {
+      break;
+    }
+    // Propose to swap the current states of neighboring temperatures,
+    // alternating between even and odd pairs
+    for (size_t c = round % 2; c + 1 < chains.size(); c += 2) {
+      Chain &cold = chains[c], &hot = chains[c + 1];
+      float log_ratio =
+          (cold.alpha - hot.alpha) * (cold.current_cost - hot.current_cost);
+      if (exchange_dist(exchange_engine) < std::exp(log_ratio)) {
+        std::swap(cold.current, hot.current);
+        std::swap(cold.current_cost, hot.current_cost);
+      }
+    }
+  }
+  float best_cost = chains[0].best_cost;
+  best = chains[0].best;
+  for (size_t c = 1; c < chains.size(); c++) {
+    if (chains[c].best_cost < best_cost) {
+      best_cost = chains[c].best_cost;
+      best = chains[c].best;
+    }
+  }
+  return best_cost;
+}
+
+#endif // _FLEXFLOW_REPLICA_EXCHANGE_H
@@ -0,0 +1,56 @@
+#ifndef _TRACE_FILE_H
+#define _TRACE_FILE_H
+
+#include "tl/optional.hpp"
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Writes a timeline in the Chrome Trace Event format, which
+ * chrome://tracing and Perfetto (ui.perfetto.dev) open.
+ *
+ * @details Spans are grouped into processes (e.g. "Compute", "Network"),
+ * each of which shows one track per thread (e.g. a device). Times are in ms,
+ * as in the simulator, and are written in the format's microseconds.
+ */
+class ChromeTraceFile {
+public:
+  ChromeTraceFile(std::string const &filename);
+  ChromeTraceFile(std::ostream &s);
+  ~ChromeTraceFile();
+  ChromeTraceFile(ChromeTraceFile const &) = delete;
+  ChromeTraceFile &operator=(ChromeTraceFile const &) = delete;
+
+  /* the track named thread_name of process_name, created on first use */
+  std::pair<int, int> get_track(std::string const &process_name,
+                                std::string const &thread_name);
+  void add_span(std::pair<int, int> const &track,
+                std::string const &name,
+                std::string const &category,
+                double start_ms,
+                double duration_ms,
+                std::map<std::string, double> const &args = {});
+  void close();
+
+private:
+  std::ostream &get_ostream();
+  void start_event();
+  /* args is the body of the event's JSON args object */
+  void add_metadata(char const *kind,
+                    int pid,
+                    int tid,
+                    std::string const &args);
+  static std::string escape(std::string const &s);
+
+  tl::optional<std::ofstream> owned_fstream = tl::nullopt;
+  std::ostream *out;
+  bool first_event = true;
+  bool closed = false;
+  std::map<std::string, int> process_ids;
+  std::map<std::pair<int, std::string>, int> thread_ids;
+};
+
+#endif // _TRACE_FILE_H
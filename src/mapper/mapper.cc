@@ -63,11 +63,15 @@ FFMapper::FFMapper(MapperRuntime *rt,
                    char const *_mapper_name,
                    // const std::string& strategyFile,
                    bool _enable_control_replication,
-                   bool _log_instance_creation)
+                   bool _log_instance_creation,
+                   bool _enable_numa_aware_mapping,
+                   bool _search_on_cpu)
     : NullMapper(rt, machine), local_processor(_local),
       node_id(_local.address_space()), mapper_name(_mapper_name),
       enable_control_replication(_enable_control_replication),
-      log_instance_creation(_log_instance_creation) {
+      log_instance_creation(_log_instance_creation),
+      enable_numa_aware_mapping(_enable_numa_aware_mapping),
+      search_on_cpu(_search_on_cpu) {
   std::vector<Machine::ProcessorMemoryAffinity> proc_mem_affinities;
   machine.get_proc_mem_affinity(proc_mem_affinities);
   Machine::ProcessorQuery proc_query(machine);
@@ -101,6 +105,12 @@ FFMapper::FFMapper(MapperRuntime *rt,
       zc_query.has_affinity_to(*it);
       assert(zc_query.count() == 1);
       proc_zcmems[*it] = *(zc_query.begin());
+      Machine::MemoryQuery socket_query(machine);
+      socket_query.only_kind(Memory::SOCKET_MEM);
+      socket_query.best_affinity_to(*it);
+      if (socket_query.count() > 0) {
+        proc_sockmems[*it] = *(socket_query.begin());
+      }
     } else if (it->kind() == Processor::PY_PROC) {
       all_pys.push_back(*it);
       if (it->address_space() == node_id) {
@@ -117,6 +127,28 @@ FFMapper::FFMapper(MapperRuntime *rt,
   if (enable_control_replication) {
     log_ff_mapper.print("Enabled Control Replication Optimizations.");
   }
+  if (enable_numa_aware_mapping) {
+    // Number the CPUs of a node socket by socket, as the machine model does,
+    // so that a machine view of consecutive CPUs stays on one socket
+    auto socket_of = [&](Processor const &p) {
+      auto it = proc_sockmems.find(p);
+      return it == proc_sockmems.end() ? Memory::NO_MEMORY : it->second;
+    };
+    auto by_socket = [&](Processor const &a, Processor const &b) {
+      if (a.address_space() != b.address_space()) {
+        return a.address_space() < b.address_space();
+      }
+      return socket_of(a) < socket_of(b);
+    };
+    std::stable_sort(all_cpus.begin(), all_cpus.end(), by_socket);
+    std::stable_sort(local_cpus.begin(), local_cpus.end(), by_socket);
+    std::set<Memory> sockets;
+    for (auto const &it : proc_sockmems) {
+      sockets.insert(it.second);
+    }
+    log_ff_mapper.print("Enabled NUMA-aware mapping (%zu sockets).",
+                        sockets.size());
+  }
   // if (strategyFile == "") {
   //   // No strategy file provided, use data parallelism
   //   log_ff_mapper.print("No strategy file provided. Use default data
@@ -272,7 +304,8 @@ void FFMapper::select_task_options(const MapperContext ctx,
     return;
   }
   if (task.task_id == GRAPH_OPTIMIZE_TASK_ID) {
-    output.initial_proc = all_gpus[0];
+    output.initial_proc =
+        search_on_cpu || all_gpus.empty() ? all_cpus[0] : all_gpus[0];
     return;
   }
   if (task.task_id == NCCL_GETUNIQUEID_TASK_ID) {
@@ -496,7 +529,18 @@ void FFMapper::map_task(const MapperContext ctx,
     // Put any of our CPU procs here
     // If we're part of a must epoch launch, our
     // target proc will be sufficient
-    if (!task.must_epoch_task) {
+    if (!task.must_epoch_task && enable_numa_aware_mapping &&
+        proc_sockmems.find(task.target_proc) != proc_sockmems.end()) {
+      // Only the CPUs next to the memory of the target proc, which holds
+      // the task's instances
+      Memory socket = proc_sockmems[task.target_proc];
+      for (Processor const &cpu : local_cpus) {
+        auto it = proc_sockmems.find(cpu);
+        if (it != proc_sockmems.end() && it->second == socket) {
+          output.target_procs.push_back(cpu);
+        }
+      }
+    } else if (!task.must_epoch_task) {
       output.target_procs.insert(
           output.target_procs.end(), local_cpus.begin(), local_cpus.end());
     } else {
@@ -1293,6 +1337,12 @@ Memory FFMapper::default_select_target_memory(MapperContext ctx,
       return proc_fbmems[target_proc];
     }
   } else if (target_proc.kind() == Processor::LOC_PROC) {
+    // Regions that GPUs read in place (e.g. full datasets) stay in zero-copy
+    // memory
+    if (enable_numa_aware_mapping && req.tag != MAP_TO_ZC_MEMORY &&
+        proc_sockmems.find(target_proc) != proc_sockmems.end()) {
+      return proc_sockmems[target_proc];
+    }
     assert(proc_zcmems.find(target_proc) != proc_zcmems.end());
     return proc_zcmems[target_proc];
   } else if (target_proc.kind() == Processor::PY_PROC) {
@@ -1460,6 +1510,8 @@ void FFMapper::update_mappers(Machine machine,
 
   bool enable_control_replication = true;
   bool log_instance_creation = false;
+  bool enable_numa_aware_mapping = false;
+  bool search_on_cpu = false;
   for (int i = 1; i < argc; i++) {
     // if ((!strcmp(argv[i], "--import")) || (!strcmp(argv[i],
     // "--import-strategy"))) {
@@ -1474,6 +1526,14 @@ void FFMapper::update_mappers(Machine machine,
       log_instance_creation = true;
       continue;
     }
+    if (!strcmp(argv[i], "--numa-aware-mapping")) {
+      enable_numa_aware_mapping = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--analytical-cost-model")) {
+      search_on_cpu = true;
+      continue;
+    }
   }
 
   for (std::set<Processor>::const_iterator it = local_procs.begin();
@@ -1484,7 +1544,9 @@ void FFMapper::update_mappers(Machine machine,
                                     *it,
                                     "FlexFlow Mapper",
                                     enable_control_replication,
-                                    log_instance_creation);
+                                    log_instance_creation,
+                                    enable_numa_aware_mapping,
+                                    search_on_cpu);
     runtime->replace_default_mapper(mapper, *it);
   }
 }
@@ -15,6 +15,7 @@
 
 #include "flexflow/metrics_functions.h"
 #include "flexflow/model.h"
+#include "flexflow/ops/groupby.h"
 
 namespace FlexFlow {
 
@@ -104,6 +105,18 @@ void Metrics::compute(FFModel *model,
   for (Domain::DomainPointIterator it(part_domain); it; it++) {
     metrics_task.add_future(new_metrics[*it]);
   }
+  // Fold in the routing statistics of the MoE layers
+  for (Op const *op : model->operators) {
+    if (op->op_type != OP_GROUP_BY) {
+      continue;
+    }
+    FutureMap routing_metrics =
+        ((Group_by const *)op)->compute_routing_metrics(*model);
+    Domain domain = runtime->get_index_space_domain(ctx, op->parallel_is);
+    for (Domain::DomainPointIterator it(domain); it; it++) {
+      metrics_task.add_future(routing_metrics[*it]);
+    }
+  }
   model->current_metrics = runtime->execute_task(ctx, metrics_task);
 }
 
@@ -183,7 +196,8 @@ PerfMetrics
 
 PerfMetrics::PerfMetrics(void)
     : train_all(0), train_correct(0), cce_loss(0.0f), sparse_cce_loss(0.0f),
-      mse_loss(0.0f), rmse_loss(0.0f), mae_loss(0.0f) {
+      mse_loss(0.0f), rmse_loss(0.0f), mae_loss(0.0f), routed_tokens(0),
+      dropped_tokens(0), expert_peak_load(0.0f), max_load_imbalance(0.0f) {
   start_time = Realm::Clock::current_time_in_microseconds();
 }
 
@@ -195,6 +209,10 @@ void PerfMetrics::update(PerfMetrics const &one) {
   mse_loss += one.mse_loss;
   rmse_loss += one.rmse_loss;
   mae_loss += one.mae_loss;
+  routed_tokens += one.routed_tokens;
+  dropped_tokens += one.dropped_tokens;
+  expert_peak_load += one.expert_peak_load;
+  max_load_imbalance = std::max(max_load_imbalance, one.max_load_imbalance);
 }
 
 void PerfMetrics::apply_scale(float scale) {
@@ -243,6 +261,13 @@ void PerfMetrics::print(Metrics const *m) {
     output = output +
              " mean_absolute_error: " + std::to_string(mae_loss / train_all);
   }
+  if (routed_tokens > 0) {
+    output = output + " dropped_tokens: " + std::to_string(dropped_tokens) +
+             " / " + std::to_string(routed_tokens) +
+             " expert_load_imbalance: " +
+             std::to_string(expert_peak_load / routed_tokens) + " (max " +
+             std::to_string(max_load_imbalance) + ")";
+  }
   fprintf(stderr, "%s\n", output.c_str());
 }
 
@@ -64,6 +64,39 @@ Tensor FFModel::aggregate(
   }
   li->add_int_property("n", n);
   li->add_float_property("lambda_bal", lambda_bal);
+  li->add_int_property("dropless", false);
+  layers.push_back(li);
+  return li->outputs[0];
+}
+
+Tensor FFModel::aggregate_dropless(
+    Tensor const *inputs, /* gate_preds, gate_assign, gate assign TopK,
+                             full_gate_pred, packed exp_preds */
+    int n,
+    float lambda_bal,
+    char const *name) {
+  Layer *li = new Layer(this,
+                        OP_AGGREGATE,
+                        DT_FLOAT,
+                        name,
+                        5 /*inputs*/,
+                        0 /*weights*/,
+                        1 /*outputs*/,
+                        inputs);
+  {
+    int num_dim = inputs[4]->num_dims;
+    // Set output shape
+    int dims[MAX_TENSOR_DIM];
+    for (int i = 0; i < num_dim - 1; i++) {
+      dims[i] = inputs[4]->dims[i];
+    }
+    dims[num_dim - 1] = inputs[0]->dims[num_dim - 1];
+    li->outputs[0] = create_tensor_legion_ordering(
+        num_dim, dims, DT_FLOAT, li, 0, true /*create_grad*/);
+  }
+  li->add_int_property("n", n);
+  li->add_float_property("lambda_bal", lambda_bal);
+  li->add_int_property("dropless", true);
   layers.push_back(li);
   return li->outputs[0];
 }
@@ -78,13 +111,17 @@ Op *Aggregate::create_operator_from_layer(
   float value2;
   layer->get_float_property("lambda_bal", value2);
   float lambda_bal = value2;
-  return new Aggregate(model, inputs.data(), n, lambda_bal, layer->name);
+  layer->get_int_property("dropless", value1);
+  bool dropless = (bool)value1;
+  return new Aggregate(
+      model, inputs.data(), n, lambda_bal, dropless, layer->name);
 }
 
 AggregateParams Aggregate::get_params() const {
   AggregateParams params;
   params.n = this->n;
   params.lambda_bal = this->lambda_bal;
+  params.dropless = this->dropless;
   return params;
 }
 
@@ -94,23 +131,25 @@ bool AggregateParams::is_valid(std::vector<ParallelTensorShape> const &) const {
 }
 
 bool operator==(AggregateParams const &lhs, AggregateParams const &rhs) {
-  return lhs.n == rhs.n && lhs.lambda_bal == rhs.lambda_bal;
+  return lhs.n == rhs.n && lhs.lambda_bal == rhs.lambda_bal &&
+         lhs.dropless == rhs.dropless;
 }
 
 Aggregate::Aggregate(FFModel &model,
                      ParallelTensor const *_inputs,
                      int _n,
                      float _lambda_bal,
+                     bool _dropless,
                      char const *name)
     : Op(model,
          OP_AGGREGATE,
          DT_FLOAT,
          name,
-         _n + 4 /*inputs*/,
+         (_dropless ? 1 : _n) + 4 /*inputs*/,
          0 /*weights*/,
          1 /*outputs*/,
          _inputs),
-      n(_n), lambda_bal(_lambda_bal) {
+      n(_n), lambda_bal(_lambda_bal), dropless(_dropless) {
   // FIXME: For now, set upper limits Better: Do as follows, but memory is
   // assigned per block, so requires to check that
   // https://stackoverflow.com/questions/5531247/allocating-shared-memory/5531640#5531640
@@ -120,7 +159,8 @@ Aggregate::Aggregate(FFModel &model,
   assert(inputs[0]->dims[1].size <= AGGREGATE_MAX_BATCH_SIZE &&
          "Increase AGGREGATE_MAX_BATCH_SIZE in #define");
 
-  assert(n + 4 == numInputs);
+  int num_exp_preds = dropless ? 1 : n;
+  assert(num_exp_preds + 4 == numInputs);
   assert(n > 0);
   assert(inputs[0]->num_dims == 2 + 1);
   assert(inputs[1]->num_dims == 2 + 1);
@@ -137,10 +177,15 @@ Aggregate::Aggregate(FFModel &model,
   // expert inputs
   int num_dim = inputs[4]->num_dims;
   int out_dim = inputs[4]->dims[0].size;
-  for (int i = 1; i < n; i++) {
+  for (int i = 1; i < num_exp_preds; i++) {
     assert(inputs[i + 4]->num_dims == num_dim);
     assert(inputs[i + 4]->dims[0].size == out_dim);
   }
+  if (dropless) {
+    // k packed predictions per sample
+    assert(inputs[4]->dims[num_dim - 2].size ==
+           inputs[0]->dims[0].size * inputs[0]->dims[1].size);
+  }
   // Set output shape
   ParallelDim dims[MAX_TENSOR_DIM];
   for (int i = 0; i < num_dim - 1; i++) {
@@ -158,13 +203,23 @@ Aggregate::Aggregate(FFModel &model,
 Aggregate::Aggregate(FFModel &model,
                      Aggregate const &other,
                      std::vector<ParallelTensor> const &inputs)
-    : Aggregate(model, inputs.data(), other.n, other.lambda_bal, other.name) {}
+    : Aggregate(model,
+                inputs.data(),
+                other.n,
+                other.lambda_bal,
+                other.dropless,
+                other.name) {}
 
 Aggregate::Aggregate(FFModel &model,
                      AggregateParams const &params,
                      std::vector<ParallelTensor> const &inputs,
                      char const *name)
-    : Aggregate(model, inputs.data(), params.n, params.lambda_bal, name) {}
+    : Aggregate(model,
+                inputs.data(),
+                params.n,
+                params.lambda_bal,
+                params.dropless,
+                name) {}
 
 void Aggregate::init(FFModel const &ff) {
   assert(check_output_input_weight_same_parallel_is());
@@ -194,6 +249,7 @@ OpMeta *Aggregate::init_task(Task const *task,
   FFHandler handle = *((FFHandler *)task->local_args);
   AggregateMeta *m = new AggregateMeta(handle, agg->n);
   m->profiling = agg->profiling;
+  m->dropless = agg->dropless;
   return m;
 }
 
@@ -225,7 +281,8 @@ void Aggregate::forward(FFModel const &ff) {
                                                     inputs[1]->region));
   launcher.add_field(1, FID_DATA);
   // exp_preds
-  for (int i = 0; i < n; i++) {
+  int num_exp_preds = numInputs - 4;
+  for (int i = 0; i < num_exp_preds; i++) {
     launcher.add_region_requirement(RegionRequirement(inputs[i + 4]->part,
                                                       0 /*projection id*/,
                                                       READ_WRITE,
@@ -239,7 +296,7 @@ void Aggregate::forward(FFModel const &ff) {
                                                     WRITE_ONLY,
                                                     EXCLUSIVE,
                                                     outputs[0]->region));
-  launcher.add_field(n + 2, FID_DATA);
+  launcher.add_field(num_exp_preds + 2, FID_DATA);
   runtime->execute_index_space(ctx, launcher);
 }
 
@@ -247,24 +304,26 @@ void Aggregate::forward_task(Task const *task,
                              std::vector<PhysicalRegion> const &regions,
                              Context ctx,
                              Runtime *runtime) {
-  int n = ((Aggregate *)task->args)->n;
+  Aggregate const *agg = (Aggregate *)task->args;
+  int n = agg->n;
+  int num_exp_preds = agg->dropless ? 1 : n;
 
-  assert((int)regions.size() == n + 3);
-  assert((int)task->regions.size() == n + 3);
+  assert((int)regions.size() == num_exp_preds + 3);
+  assert((int)task->regions.size() == num_exp_preds + 3);
 
   AggregateMeta const *m = *((AggregateMeta **)task->local_args);
 
   // get gate_pred, gate_assign, output
   AccessorRO<float, 3> const acc_gate_pred(regions[0], FID_DATA);
   AccessorRO<int, 3> const acc_gate_assign(regions[1], FID_DATA);
-  AccessorWO<float, 3> const acc_output(regions[n + 2], FID_DATA);
+  AccessorWO<float, 3> const acc_output(regions[num_exp_preds + 2], FID_DATA);
 
   Rect<3> rect_gate_pred = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
   Rect<3> rect_gate_assign = runtime->get_index_space_domain(
       ctx, task->regions[1].region.get_index_space());
   Rect<3> rect_output = runtime->get_index_space_domain(
-      ctx, task->regions[n + 2].region.get_index_space());
+      ctx, task->regions[num_exp_preds + 2].region.get_index_space());
 
   coord_t batch_size = rect_gate_pred.hi[1] - rect_gate_pred.lo[1] + 1;
   assert(batch_size == rect_gate_assign.hi[1] - rect_gate_assign.lo[1] + 1);
@@ -274,7 +333,7 @@ void Aggregate::forward_task(Task const *task,
   coord_t out_dim = rect_output.hi[0] - rect_output.lo[0] + 1;
 
   // get exp_preds
-  float *exp_preds[n];
+  float *exp_preds[num_exp_preds];
   // get first exp_pred and row and out_dim
   Domain exp_domain = runtime->get_index_space_domain(
       ctx, task->regions[2].region.get_index_space());
@@ -283,7 +342,7 @@ void Aggregate::forward_task(Task const *task,
   coord_t rows = exp_domain.hi()[1] - exp_domain.lo()[1] + 1;
   assert(out_dim == exp_domain.hi()[0] - exp_domain.lo()[0] + 1);
 
-  for (int i = 1; i < n; i++) {
+  for (int i = 1; i < num_exp_preds; i++) {
     exp_domain = runtime->get_index_space_domain(
         ctx, task->regions[i + 2].region.get_index_space());
     exp_preds[i] = helperGetTensorPointerWO<float>(
@@ -349,7 +408,8 @@ void Aggregate::backward(FFModel const &ff) {
                                                     inputs[3]->region_grad));
   launcher.add_field(3, FID_DATA);
   // exp_preds
-  for (int i = 0; i < n; i++) {
+  int num_exp_preds = numInputs - 4;
+  for (int i = 0; i < num_exp_preds; i++) {
     launcher.add_region_requirement(RegionRequirement(inputs[i + 4]->part,
                                                       0 /*projection id*/,
                                                       READ_WRITE,
@@ -358,14 +418,14 @@ void Aggregate::backward(FFModel const &ff) {
     launcher.add_field(i + 4, FID_DATA);
   }
   // exp_preds gradients
-  for (int i = 0; i < n; i++) {
+  for (int i = 0; i < num_exp_preds; i++) {
     launcher.add_region_requirement(
         RegionRequirement(inputs[i + 4]->part_grad,
                           0 /*projection id*/,
                           READ_WRITE,
                           EXCLUSIVE,
                           inputs[i + 4]->region_grad));
-    launcher.add_field(i + n + 4, FID_DATA);
+    launcher.add_field(i + num_exp_preds + 4, FID_DATA);
   }
 
   // output
@@ -374,7 +434,7 @@ void Aggregate::backward(FFModel const &ff) {
                                                     READ_WRITE,
                                                     EXCLUSIVE,
                                                     outputs[0]->region_grad));
-  launcher.add_field(2 * n + 4, FID_DATA);
+  launcher.add_field(2 * num_exp_preds + 4, FID_DATA);
 
   runtime->execute_index_space(ctx, launcher);
 }
@@ -386,16 +446,18 @@ void Aggregate::backward_task(Task const *task,
   AggregateMeta const *m = *((AggregateMeta **)task->local_args);
   int n = ((Aggregate *)task->args)->n;
   float lambda_bal = ((Aggregate *)task->args)->lambda_bal;
+  int num_exp_preds = ((Aggregate *)task->args)->dropless ? 1 : n;
 
-  assert((int)regions.size() == 2 * n + 5);
-  assert((int)task->regions.size() == 2 * n + 5);
+  assert((int)regions.size() == 2 * num_exp_preds + 5);
+  assert((int)task->regions.size() == 2 * num_exp_preds + 5);
 
   // get gate_pred, gate_grad, gate_assign, output_grad
   AccessorRO<float, 3> const acc_gate_pred(regions[0], FID_DATA);
   AccessorRO<int, 3> const acc_gate_assign(regions[1], FID_DATA);
   AccessorRO<int, 3> const acc_true_gate_assign(regions[2], FID_DATA);
   AccessorWO<float, 3> const full_acc_gate_grad(regions[3], FID_DATA);
-  AccessorRO<float, 3> const acc_output_grad(regions[2 * n + 4], FID_DATA);
+  AccessorRO<float, 3> const acc_output_grad(regions[2 * num_exp_preds + 4],
+                                             FID_DATA);
 
   Rect<3> rect_gate_pred = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
@@ -406,7 +468,7 @@ void Aggregate::backward_task(Task const *task,
   Rect<3> rect_full_gate_grad = runtime->get_index_space_domain(
       ctx, task->regions[3].region.get_index_space());
   Rect<3> rect_out_grad = runtime->get_index_space_domain(
-      ctx, task->regions[2 * n + 4].region.get_index_space());
+      ctx, task->regions[2 * num_exp_preds + 4].region.get_index_space());
 
   coord_t batch_size = rect_gate_pred.hi[1] - rect_gate_pred.lo[1] + 1;
   assert(batch_size == rect_gate_assign.hi[1] - rect_gate_assign.lo[1] + 1);
@@ -420,7 +482,7 @@ void Aggregate::backward_task(Task const *task,
   assert(n == rect_full_gate_grad.hi[0] - rect_full_gate_grad.lo[0] + 1);
 
   // get exp_preds
-  float *exp_preds[n];
+  float *exp_preds[num_exp_preds];
   // get first exp_pred and row
   Domain exp_domain = runtime->get_index_space_domain(
       ctx, task->regions[4].region.get_index_space());
@@ -429,7 +491,7 @@ void Aggregate::backward_task(Task const *task,
   coord_t rows = exp_domain.hi()[1] - exp_domain.lo()[1] + 1;
   assert(out_dim == exp_domain.hi()[0] - exp_domain.lo()[0] + 1);
 
-  for (int i = 1; i < n; i++) {
+  for (int i = 1; i < num_exp_preds; i++) {
     exp_domain = runtime->get_index_space_domain(
         ctx, task->regions[i + 4].region.get_index_space());
     exp_preds[i] = helperGetTensorPointerRW<float>(
@@ -439,12 +501,13 @@ void Aggregate::backward_task(Task const *task,
   }
 
   // get chosen_exp_grads
-  float *exp_grads[n];
-  for (int i = 0; i < n; i++) {
+  float *exp_grads[num_exp_preds];
+  for (int i = 0; i < num_exp_preds; i++) {
+    int r = num_exp_preds + i + 4;
     exp_domain = runtime->get_index_space_domain(
-        ctx, task->regions[n + i + 4].region.get_index_space());
+        ctx, task->regions[r].region.get_index_space());
     exp_grads[i] = helperGetTensorPointerRW<float>(
-        regions[n + i + 4], task->regions[n + i + 4], FID_DATA, ctx, runtime);
+        regions[r], task->regions[r], FID_DATA, ctx, runtime);
     assert(rows == exp_domain.hi()[1] - exp_domain.lo()[1] + 1);
     assert(out_dim == exp_domain.hi()[0] - exp_domain.lo()[0] + 1);
   }
@@ -469,6 +532,7 @@ void Aggregate::backward_task(Task const *task,
 void Aggregate::serialize(Legion::Serializer &sez) const {
   sez.serialize(this->n);
   sez.serialize(this->lambda_bal);
+  sez.serialize(this->dropless);
 }
 
 bool Aggregate::measure_operator_cost(Simulator *sim,
@@ -478,7 +542,8 @@ bool Aggregate::measure_operator_cost(Simulator *sim,
   ParallelTensorBase sub_inputs[MAX_NUM_INPUTS], sub_pred, sub_assign,
       sub_output;
 
-  for (int i = 0; i < numInputs; ++i) {
+  int num_exp_preds = numInputs - 4;
+  for (int i = 0; i < num_exp_preds; ++i) {
     if (!inputs[i + 4]->get_sub_tensor(mv, sub_inputs[i])) {
       return false;
     }
@@ -495,12 +560,13 @@ bool Aggregate::measure_operator_cost(Simulator *sim,
   }
 
   AggregateMeta *m = new AggregateMeta(sim->handler, n);
+  m->dropless = dropless;
 
   // allocate
   sim->free_all();
   float *input_ptrs[MAX_NUM_INPUTS];
   bool out_of_memory = false;
-  for (int i = 0; i < numInputs; ++i) {
+  for (int i = 0; i < num_exp_preds; ++i) {
     input_ptrs[i] =
         (float *)sim->allocate(sub_inputs[i].get_volume(), DT_FLOAT);
     out_of_memory = out_of_memory || (input_ptrs[i] == NULL);
@@ -564,6 +630,7 @@ size_t hash<FlexFlow::AggregateParams>::operator()(
   size_t key = 0;
   hash_combine(key, params.n);
   hash_combine(key, params.lambda_bal);
+  hash_combine(key, params.dropless);
   return key;
 }
 }; // namespace std
@@ -19,6 +19,33 @@
 
 namespace FlexFlow {
 
+// Points expert_rows at the predictions of every expert: its own buffer, or
+// its rows of exp_preds[0], where a dropless group_by packed the tokens of all
+// experts one expert after the other
+__device__ void agg_get_expert_rows(float **exp_preds,
+                                    int const *exp_assign,
+                                    bool dropless,
+                                    int n,
+                                    int num_assignments,
+                                    int out_dim,
+                                    float **expert_rows) {
+  if (!dropless) {
+    for (int i = 0; i < n; i++) {
+      expert_rows[i] = exp_preds[i];
+    }
+    return;
+  }
+  int expert_count[AGGREGATE_MAX_N] = {0};
+  for (int i = 0; i < num_assignments; i++) {
+    expert_count[exp_assign[i]]++;
+  }
+  int offset = 0;
+  for (int i = 0; i < n; i++) {
+    expert_rows[i] = exp_preds[0] + offset * out_dim;
+    offset += expert_count[i];
+  }
+}
+
 __global__ void agg_forward_kernel(float **exp_preds,
                                    int const *exp_assign,
                                    float const *gate_net_preds,
@@ -26,6 +53,7 @@ __global__ void agg_forward_kernel(float **exp_preds,
                                    int n,
                                    int const k,     // num chosen experts
                                    int exp_samples, // max samples per expert
+                                   bool dropless,
                                    int const batch_size,
                                    int out_dim) {
   __shared__ float
@@ -34,6 +62,14 @@ __global__ void agg_forward_kernel(float **exp_preds,
   // Get pred pointers, single thread pre block
   if (threadIdx.x == 0) {
     int expert_idx[AGGREGATE_MAX_N] = {0};
+    float *expert_rows[AGGREGATE_MAX_N];
+    agg_get_expert_rows(exp_preds,
+                        exp_assign,
+                        dropless,
+                        n,
+                        k * batch_size,
+                        out_dim,
+                        expert_rows);
     for (int i = 0; i < batch_size; i++) {
       for (int j = 0; j < k; j++) {
         // Get pointer to chosen expert predictions
@@ -44,7 +80,7 @@ __global__ void agg_forward_kernel(float **exp_preds,
           continue;
         }
         chosen_exp_preds[i * k + j] =
-            exp_preds[expert] + expert_idx[expert] * out_dim;
+            expert_rows[expert] + expert_idx[expert] * out_dim;
         expert_idx[expert]++;
       }
     }
@@ -135,6 +171,7 @@ __global__ void agg_backward_kernel(float **exp_preds,
                                     int n,           // num experts
                                     int k,           // num chosen experts
                                     int exp_samples, // max samples per expert
+                                    bool dropless,
                                     float lambda_bal,
                                     int batch_size,
                                     int out_dim) {
@@ -154,6 +191,22 @@ __global__ void agg_backward_kernel(float **exp_preds,
     for (int i = 0; i < batch_size; i++) {
       cache_corr[i] = true;
     }
+    float *expert_pred_rows[AGGREGATE_MAX_N];
+    float *expert_grad_rows[AGGREGATE_MAX_N];
+    agg_get_expert_rows(exp_preds,
+                        true_exp_assign,
+                        dropless,
+                        n,
+                        k * batch_size,
+                        out_dim,
+                        expert_pred_rows);
+    agg_get_expert_rows(exp_grads,
+                        true_exp_assign,
+                        dropless,
+                        n,
+                        k * batch_size,
+                        out_dim,
+                        expert_grad_rows);
 
     // Get pointer to chosen expert predictions and expert counts
     for (int i = 0; i < batch_size; i++) {
@@ -170,9 +223,9 @@ __global__ void agg_backward_kernel(float **exp_preds,
           continue;
         }
         chosen_exp_preds[i * k + j] =
-            exp_preds[expert] + expert_bal[expert] * out_dim;
+            expert_pred_rows[expert] + expert_bal[expert] * out_dim;
         chosen_exp_grads[i * k + j] =
-            exp_grads[expert] + expert_bal[expert] * out_dim;
+            expert_grad_rows[expert] + expert_bal[expert] * out_dim;
         expert_bal[expert]++;
       }
     }
@@ -216,8 +269,11 @@ void Aggregate::forward_kernel_wrapper(AggregateMeta const *m,
   checkCUDNN(miopenSetStream(m->handle.dnn, stream));
 
   // call forward_kernel
-  hipMemcpy(
-      m->dev_exp_preds, exp_preds, n * sizeof(float *), hipMemcpyHostToDevice);
+  int num_exp_preds = m->dropless ? 1 : n;
+  hipMemcpy(m->dev_exp_preds,
+            exp_preds,
+            num_exp_preds * sizeof(float *),
+            hipMemcpyHostToDevice);
 
   hipLaunchKernelGGL(agg_forward_kernel,
                      GET_BLOCKS(batch_size * k * out_dim),
@@ -231,6 +287,7 @@ void Aggregate::forward_kernel_wrapper(AggregateMeta const *m,
                      n,
                      k,
                      rows,
+                     m->dropless,
                      batch_size,
                      out_dim);
 }
@@ -256,10 +313,15 @@ void Aggregate::backward_kernel_wrapper(AggregateMeta const *m,
   checkCUDNN(miopenSetStream(m->handle.dnn, stream));
 
   // call backward kernel
-  hipMemcpy(
-      m->dev_exp_preds, exp_preds, n * sizeof(float *), hipMemcpyHostToDevice);
-  hipMemcpy(
-      m->dev_exp_grads, exp_grads, n * sizeof(float *), hipMemcpyHostToDevice);
+  int num_exp_preds = m->dropless ? 1 : n;
+  hipMemcpy(m->dev_exp_preds,
+            exp_preds,
+            num_exp_preds * sizeof(float *),
+            hipMemcpyHostToDevice);
+  hipMemcpy(m->dev_exp_grads,
+            exp_grads,
+            num_exp_preds * sizeof(float *),
+            hipMemcpyHostToDevice);
 
   hipLaunchKernelGGL(agg_backward_kernel,
                      GET_BLOCKS(batch_size * k * out_dim),
@@ -276,12 +338,14 @@ void Aggregate::backward_kernel_wrapper(AggregateMeta const *m,
                      n,
                      k,
                      rows,
+                     m->dropless,
                      lambda_bal,
                      batch_size,
                      out_dim);
 }
 
-AggregateMeta::AggregateMeta(FFHandler handler, int n) : OpMeta(handler) {
+AggregateMeta::AggregateMeta(FFHandler handler, int n)
+    : OpMeta(handler), dropless(false) {
   checkCUDA(hipMalloc(&dev_exp_preds, n * sizeof(float *)));
   checkCUDA(hipMalloc(&dev_exp_grads, n * sizeof(float *)));
 }
@@ -18,6 +18,33 @@
 
 namespace FlexFlow {
 
+// Points expert_rows at the predictions of every expert: its own buffer, or
+// its rows of exp_preds[0], where a dropless group_by packed the tokens of all
+// experts one expert after the other
+__device__ void agg_get_expert_rows(float **exp_preds,
+                                    int const *exp_assign,
+                                    bool dropless,
+                                    int n,
+                                    int num_assignments,
+                                    int out_dim,
+                                    float **expert_rows) {
+  if (!dropless) {
+    for (int i = 0; i < n; i++) {
+      expert_rows[i] = exp_preds[i];
+    }
+    return;
+  }
+  int expert_count[AGGREGATE_MAX_N] = {0};
+  for (int i = 0; i < num_assignments; i++) {
+    expert_count[exp_assign[i]]++;
+  }
+  int offset = 0;
+  for (int i = 0; i < n; i++) {
+    expert_rows[i] = exp_preds[0] + offset * out_dim;
+    offset += expert_count[i];
+  }
+}
+
 __global__ void agg_forward_kernel(float **exp_preds,
                                    int const *exp_assign,
                                    float const *gate_net_preds,
@@ -25,6 +52,7 @@ __global__ void agg_forward_kernel(float **exp_preds,
                                    int n,
                                    int const k,     // num chosen experts
                                    int exp_samples, // max samples per expert
+                                   bool dropless,
                                    int const batch_size,
                                    int out_dim) {
   __shared__ float
@@ -33,6 +61,14 @@ __global__ void agg_forward_kernel(float **exp_preds,
   // Get pred pointers, single thread pre block
   if (threadIdx.x == 0) {
     int expert_idx[AGGREGATE_MAX_N] = {0};
+    float *expert_rows[AGGREGATE_MAX_N];
+    agg_get_expert_rows(exp_preds,
+                        exp_assign,
+                        dropless,
+                        n,
+                        k * batch_size,
+                        out_dim,
+                        expert_rows);
     for (int i = 0; i < batch_size; i++) {
       for (int j = 0; j < k; j++) {
         // Get pointer to chosen expert predictions
@@ -43,7 +79,7 @@ __global__ void agg_forward_kernel(float **exp_preds,
           continue;
         }
         chosen_exp_preds[i * k + j] =
-            exp_preds[expert] + expert_idx[expert] * out_dim;
+            expert_rows[expert] + expert_idx[expert] * out_dim;
         expert_idx[expert]++;
       }
     }
@@ -134,6 +170,7 @@ __global__ void agg_backward_kernel(float **exp_preds,
                                     int n,           // num experts
                                     int k,           // num chosen experts
                                     int exp_samples, // max samples per expert
+                                    bool dropless,
                                     float lambda_bal,
                                     int batch_size,
                                     int out_dim) {
@@ -153,6 +190,22 @@ __global__ void agg_backward_kernel(float **exp_preds,
     for (int i = 0; i < batch_size; i++) {
       cache_corr[i] = true;
     }
+    float *expert_pred_rows[AGGREGATE_MAX_N];
+    float *expert_grad_rows[AGGREGATE_MAX_N];
+    agg_get_expert_rows(exp_preds,
+                        true_exp_assign,
+                        dropless,
+                        n,
+                        k * batch_size,
+                        out_dim,
+                        expert_pred_rows);
+    agg_get_expert_rows(exp_grads,
+                        true_exp_assign,
+                        dropless,
+                        n,
+                        k * batch_size,
+                        out_dim,
+                        expert_grad_rows);
 
     // Get pointer to chosen expert predictions and expert counts
     for (int i = 0; i < batch_size; i++) {
@@ -169,9 +222,9 @@ __global__ void agg_backward_kernel(float **exp_preds,
           continue;
         }
         chosen_exp_preds[i * k + j] =
-            exp_preds[expert] + expert_bal[expert] * out_dim;
+            expert_pred_rows[expert] + expert_bal[expert] * out_dim;
         chosen_exp_grads[i * k + j] =
-            exp_grads[expert] + expert_bal[expert] * out_dim;
+            expert_grad_rows[expert] + expert_bal[expert] * out_dim;
         expert_bal[expert]++;
       }
     }
@@ -222,8 +275,11 @@ void Aggregate::forward_kernel_wrapper(AggregateMeta const *m,
   }
 
   // call forward_kernel
-  cudaMemcpy(
-      m->dev_exp_preds, exp_preds, n * sizeof(float *), cudaMemcpyHostToDevice);
+  int num_exp_preds = m->dropless ? 1 : n;
+  cudaMemcpy(m->dev_exp_preds,
+             exp_preds,
+             num_exp_preds * sizeof(float *),
+             cudaMemcpyHostToDevice);
 
   agg_forward_kernel<<<GET_BLOCKS(batch_size * k * out_dim),
                        min(CUDA_NUM_THREADS, (int)(batch_size * k * out_dim)),
@@ -235,6 +291,7 @@ void Aggregate::forward_kernel_wrapper(AggregateMeta const *m,
                                  n,
                                  k,
                                  rows,
+                                 m->dropless,
                                  batch_size,
                                  out_dim);
   if (m->profiling) {
@@ -275,10 +332,15 @@ void Aggregate::backward_kernel_wrapper(AggregateMeta const *m,
     cudaEventRecord(t_start, stream);
   }
   // call backward kernel
-  cudaMemcpy(
-      m->dev_exp_preds, exp_preds, n * sizeof(float *), cudaMemcpyHostToDevice);
-  cudaMemcpy(
-      m->dev_exp_grads, exp_grads, n * sizeof(float *), cudaMemcpyHostToDevice);
+  int num_exp_preds = m->dropless ? 1 : n;
+  cudaMemcpy(m->dev_exp_preds,
+             exp_preds,
+             num_exp_preds * sizeof(float *),
+             cudaMemcpyHostToDevice);
+  cudaMemcpy(m->dev_exp_grads,
+             exp_grads,
+             num_exp_preds * sizeof(float *),
+             cudaMemcpyHostToDevice);
 
   agg_backward_kernel<<<GET_BLOCKS(batch_size * k * out_dim),
                         min(CUDA_NUM_THREADS, (int)(batch_size * k * out_dim)),
@@ -293,6 +355,7 @@ void Aggregate::backward_kernel_wrapper(AggregateMeta const *m,
                                   n,
                                   k,
                                   rows,
+                                  m->dropless,
                                   lambda_bal,
                                   batch_size,
                                   out_dim);
@@ -307,7 +370,8 @@ void Aggregate::backward_kernel_wrapper(AggregateMeta const *m,
   }
 }
 
-AggregateMeta::AggregateMeta(FFHandler handler, int n) : OpMeta(handler) {
+AggregateMeta::AggregateMeta(FFHandler handler, int n)
+    : OpMeta(handler), dropless(false) {
   checkCUDA(cudaMalloc(&dev_exp_preds, n * sizeof(float *)));
   checkCUDA(cudaMalloc(&dev_exp_grads, n * sizeof(float *)));
 }
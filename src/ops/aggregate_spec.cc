@@ -63,6 +63,7 @@ Tensor FFModel::aggregate_spec(
   }
   li->add_int_property("n", n);
   li->add_float_property("lambda_bal", lambda_bal);
+  li->add_int_property("dropless", false);
   layers.push_back(li);
   return li->outputs[0];
 }
@@ -0,0 +1,1001 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/ops/experts.h"
+#include "flexflow/model.h"
+#include "flexflow/utils/hash_utils.h"
+#include "legion/legion_utilities.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+namespace FlexFlow {
+// declare Legion names
+using Legion::ArgumentMap;
+using Legion::Context;
+using Legion::coord_t;
+using Legion::Domain;
+using Legion::FutureMap;
+using Legion::IndexLauncher;
+using Legion::PhysicalRegion;
+using Legion::Predicate;
+using Legion::RegionRequirement;
+using Legion::Runtime;
+using Legion::Task;
+using Legion::TaskArgument;
+using PCG::Node;
+
+static constexpr int KERNEL_IDX = 0;
+static constexpr int BIAS_IDX = 1;
+
+// Creates the stacked weights of the experts and records the attributes of
+// the layer
+static void add_experts_weights_and_properties(FFModel &model,
+                                               Layer *li,
+                                               int in_dim,
+                                               int num_experts,
+                                               int out_dim,
+                                               ActiMode activation,
+                                               bool use_bias,
+                                               bool apply_softmax,
+                                               bool dropless) {
+  assert(activation == AC_MODE_NONE || activation == AC_MODE_RELU ||
+         activation == AC_MODE_SIGMOID);
+  {
+    int dims[3] = {in_dim, out_dim, num_experts};
+    li->weights[KERNEL_IDX] =
+        model.create_weight_legion_ordering(3,
+                                            dims,
+                                            DT_FLOAT,
+                                            li,
+                                            true /*create_grad*/,
+                                            nullptr,
+                                            CHOSEN_SYNC_TYPE);
+  }
+  if (use_bias) {
+    int dims[2] = {out_dim, num_experts};
+    li->weights[BIAS_IDX] =
+        model.create_weight_legion_ordering(2,
+                                            dims,
+                                            DT_FLOAT,
+                                            li,
+                                            true /*create_grad*/,
+                                            nullptr,
+                                            CHOSEN_SYNC_TYPE);
+  }
+  li->add_int_property("num_experts", num_experts);
+  li->add_int_property("out_dim", out_dim);
+  li->add_int_property("activation", activation);
+  li->add_int_property("use_bias", use_bias);
+  li->add_int_property("apply_softmax", apply_softmax);
+  li->add_int_property("dropless", dropless);
+}
+
+void FFModel::experts(Tensor const *inputs,
+                      Tensor *outputs,
+                      int num_experts,
+                      int out_dim,
+                      ActiMode activation,
+                      bool use_bias,
+                      bool apply_softmax,
+                      char const *name) {
+  Layer *li = new Layer(this,
+                        OP_EXPERTS,
+                        DT_FLOAT,
+                        name,
+                        num_experts /*inputs*/,
+                        use_bias ? 2 : 1 /*weights*/,
+                        num_experts /*outputs*/,
+                        inputs);
+  int in_dim = inputs[0]->dims[0];
+  {
+    int num_dims = inputs[0]->num_dims;
+    int dims[MAX_TENSOR_DIM];
+    for (int i = 0; i < num_dims; i++) {
+      dims[i] = inputs[0]->dims[i];
+    }
+    dims[0] = out_dim;
+    for (int i = 0; i < num_experts; i++) {
+      assert(inputs[i]->num_dims == num_dims);
+      for (int j = 0; j < num_dims; j++) {
+        assert(inputs[i]->dims[j] == inputs[0]->dims[j]);
+      }
+      li->outputs[i] = create_tensor_legion_ordering(
+          num_dims, dims, DT_FLOAT, li, i, true /*create_grad*/);
+    }
+  }
+  add_experts_weights_and_properties(*this,
+                                     li,
+                                     in_dim,
+                                     num_experts,
+                                     out_dim,
+                                     activation,
+                                     use_bias,
+                                     apply_softmax,
+                                     false /*dropless*/);
+  layers.push_back(li);
+  for (int i = 0; i < num_experts; i++) {
+    outputs[i] = li->outputs[i];
+  }
+}
+
+Tensor FFModel::experts_dropless(const Tensor input,
+                                 const Tensor assign,
+                                 int num_experts,
+                                 int out_dim,
+                                 ActiMode activation,
+                                 bool use_bias,
+                                 bool apply_softmax,
+                                 char const *name) {
+  // the packed rows hold the k assignments of every sample
+  assert(assign->data_type == DT_INT32);
+  assert(input->num_dims == 2 && assign->num_dims == 2);
+  assert(input->dims[1] == assign->dims[0] * assign->dims[1]);
+  Layer *li = new Layer(this,
+                        OP_EXPERTS,
+                        DT_FLOAT,
+                        name,
+                        2 /*inputs*/,
+                        use_bias ? 2 : 1 /*weights*/,
+                        1 /*outputs*/,
+                        input,
+                        assign);
+  {
+    int dims[2] = {out_dim, input->dims[1]};
+    li->outputs[0] = create_tensor_legion_ordering(
+        2, dims, DT_FLOAT, li, 0, true /*create_grad*/);
+  }
+  add_experts_weights_and_properties(*this,
+                                     li,
+                                     input->dims[0],
+                                     num_experts,
+                                     out_dim,
+                                     activation,
+                                     use_bias,
+                                     apply_softmax,
+                                     true /*dropless*/);
+  layers.push_back(li);
+  return li->outputs[0];
+}
+
+Op *Experts::create_operator_from_layer(
+    FFModel &model,
+    Layer const *layer,
+    std::vector<ParallelTensor> const &inputs) {
+  long long value;
+  layer->get_int_property("num_experts", value);
+  int num_experts = value;
+  layer->get_int_property("out_dim", value);
+  int out_dim = value;
+  layer->get_int_property("activation", value);
+  ActiMode activation = (ActiMode)value;
+  layer->get_int_property("use_bias", value);
+  bool use_bias = (bool)value;
+  layer->get_int_property("apply_softmax", value);
+  bool apply_softmax = (bool)value;
+  layer->get_int_property("dropless", value);
+  bool dropless = (bool)value;
+  return new Experts(model,
+                     layer->layer_guid,
+                     inputs.data(),
+                     num_experts,
+                     out_dim,
+                     activation,
+                     use_bias,
+                     apply_softmax,
+                     dropless,
+                     false /*allocate_weights*/,
+                     layer->name);
+}
+
+ExpertsParams Experts::get_params() const {
+  ExpertsParams params;
+  params.layer_guid = this->layer_guid;
+  params.num_experts = this->num_experts;
+  params.out_dim = this->out_dim;
+  params.activation = this->activation;
+  params.use_bias = this->use_bias;
+  params.apply_softmax = this->apply_softmax;
+  params.dropless = this->dropless;
+  return params;
+}
+
+bool ExpertsParams::is_valid(
+    std::vector<ParallelTensorShape> const &inputs) const {
+  if (dropless) {
+    if (inputs.size() != 2) {
+      return false;
+    }
+    // The packed rows hold the k assignments of every sample, and are
+    // partitioned along with the samples of the assignment
+    ParallelTensorShape const &input = inputs[0], &assign = inputs[1];
+    if (!input.is_valid() || !assign.is_valid() || input.num_dims != 3) {
+      return false;
+    }
+    if (input.dims[1].size != assign.dims[0].size * assign.dims[1].size ||
+        input.dims[1].degree != assign.dims[1].degree ||
+        assign.dims[0].degree != 1) {
+      return false;
+    }
+  } else {
+    if ((int)inputs.size() != num_experts) {
+      return false;
+    }
+    for (ParallelTensorShape const &input : inputs) {
+      if (!input.is_valid() || input != inputs[0]) {
+        return false;
+      }
+    }
+  }
+  // The experts can only be partitioned along their rows
+  ParallelTensorShape const &input = inputs[0];
+  return input.dims[0].degree == 1 &&
+         input.dims[input.num_dims - 1].degree == 1;
+}
+
+bool operator==(ExpertsParams const &lhs, ExpertsParams const &rhs) {
+  return lhs.layer_guid == rhs.layer_guid &&
+         lhs.num_experts == rhs.num_experts && lhs.out_dim == rhs.out_dim &&
+         lhs.activation == rhs.activation && lhs.use_bias == rhs.use_bias &&
+         lhs.apply_softmax == rhs.apply_softmax &&
+         lhs.dropless == rhs.dropless;
+}
+
+Experts::Experts(FFModel &model,
+                 LayerID const &_layer_guid,
+                 ParallelTensor const *_inputs,
+                 int _num_experts,
+                 int _out_dim,
+                 ActiMode _activation,
+                 bool _use_bias,
+                 bool _apply_softmax,
+                 bool _dropless,
+                 bool allocate_weights,
+                 char const *name)
+    : Op(model,
+         OP_EXPERTS,
+         DT_FLOAT,
+         name,
+         _dropless ? 2 : _num_experts /*inputs*/,
+         0 /*weights*/,
+         _dropless ? 1 : _num_experts /*outputs*/,
+         _inputs),
+      num_experts(_num_experts), in_dim(_inputs[0]->dims[0].size),
+      out_dim(_out_dim), activation(_activation), use_bias(_use_bias),
+      apply_softmax(_apply_softmax), dropless(_dropless) {
+  // overwrite layer_guid
+  layer_guid = _layer_guid;
+  assert(num_experts > 0);
+  int num_dims = inputs[0]->num_dims;
+  if (dropless) {
+    assert(inputs[1]->data_type == DT_INT32);
+    assert(inputs[0]->dims[num_dims - 2].size ==
+           inputs[1]->dims[0].size * inputs[1]->dims[1].size);
+  } else {
+    for (int i = 1; i < num_experts; i++) {
+      assert(inputs[i]->num_dims == num_dims);
+      for (int j = 0; j < num_dims; j++) {
+        assert(inputs[i]->dims[j] == inputs[0]->dims[j]);
+      }
+    }
+  }
+
+  ParallelDim dims[MAX_TENSOR_DIM];
+  for (int i = 0; i < num_dims; i++) {
+    dims[i] = inputs[0]->dims[i];
+  }
+  dims[0].size = out_dim;
+  for (int i = 0; i < numOutputs; i++) {
+    outputs[i] = model.create_parallel_tensor_legion_ordering(
+        num_dims, dims, DT_FLOAT, this, i /*owner_idx*/);
+  }
+
+  if (allocate_weights) {
+    // The weights are replicated across the partitions of the rows
+    ParallelDim const &rows = inputs[0]->dims[num_dims - 2];
+    ParallelDim replica;
+    replica.size = rows.degree;
+    replica.degree = rows.degree;
+    replica.parallel_idx = rows.parallel_idx;
+    replica.is_replica_dim = true;
+
+    // Glorot uniform over the [in_dim, out_dim] matrix of each expert
+    float scale = sqrt(6.0f / (in_dim + out_dim));
+    ParallelDim kernel_dims[4];
+    kernel_dims[0].size = in_dim;
+    kernel_dims[1].size = out_dim;
+    kernel_dims[2].size = num_experts;
+    kernel_dims[3] = replica;
+    weights[KERNEL_IDX] = model.create_parallel_weight_legion_ordering(
+        4,
+        kernel_dims,
+        DT_FLOAT,
+        NULL /*owner_op*/,
+        true /*create_grad*/,
+        new UniformInitializer(std::rand(), -scale, scale),
+        CHOSEN_SYNC_TYPE);
+    numWeights = 1;
+    if (use_bias) {
+      ParallelDim bias_dims[3];
+      bias_dims[0].size = out_dim;
+      bias_dims[1].size = num_experts;
+      bias_dims[2] = replica;
+      weights[BIAS_IDX] =
+          model.create_parallel_weight_legion_ordering(3,
+                                                       bias_dims,
+                                                       DT_FLOAT,
+                                                       NULL /*owner_op*/,
+                                                       true /*create_grad*/,
+                                                       new ZeroInitializer(),
+                                                       CHOSEN_SYNC_TYPE);
+      numWeights = 2;
+    }
+  }
+}
+
+Experts::Experts(FFModel &model,
+                 Experts const &other,
+                 std::vector<ParallelTensor> const &inputs,
+                 bool allocate_weights)
+    : Experts(model,
+              other.layer_guid,
+              inputs.data(),
+              other.num_experts,
+              other.out_dim,
+              other.activation,
+              other.use_bias,
+              other.apply_softmax,
+              other.dropless,
+              allocate_weights,
+              other.name) {}
+
+Experts::Experts(FFModel &model,
+                 ExpertsParams const &params,
+                 std::vector<ParallelTensor> const &inputs,
+                 char const *name,
+                 bool allocate_weights)
+    : Experts(model,
+              params.layer_guid,
+              inputs.data(),
+              params.num_experts,
+              params.out_dim,
+              params.activation,
+              params.use_bias,
+              params.apply_softmax,
+              params.dropless,
+              allocate_weights,
+              name) {}
+
+void Experts::init(FFModel const &ff) {
+  assert(check_output_input_weight_same_parallel_is());
+  parallel_is = outputs[0]->parallel_is;
+  ArgumentMap argmap;
+  Context ctx = ff.config.lg_ctx;
+  Runtime *runtime = ff.config.lg_hlr;
+  set_argumentmap_for_init(ff, argmap);
+  IndexLauncher launcher(EXPERTS_INIT_TASK_ID,
+                         parallel_is,
+                         TaskArgument(this, sizeof(Experts)),
+                         argmap,
+                         Predicate::TRUE_PRED,
+                         false /*must*/,
+                         0 /*mapper_id*/,
+                         outputs[0]->machine_view.hash());
+  // the rows of the first expert size the buffers of the meta
+  launcher.add_region_requirement(RegionRequirement(inputs[0]->part,
+                                                    0 /*projection id*/,
+                                                    READ_ONLY,
+                                                    EXCLUSIVE,
+                                                    inputs[0]->region));
+  launcher.add_field(0, FID_DATA);
+  FutureMap fm = runtime->execute_index_space(ctx, launcher);
+  fm.wait_all_results();
+  set_opmeta_from_futuremap(ff, fm);
+}
+
+OpMeta *Experts::init_task(Task const *task,
+                           std::vector<PhysicalRegion> const &regions,
+                           Context ctx,
+                           Runtime *runtime) {
+  Experts const *experts = (Experts *)task->args;
+  FFHandler handle = *((FFHandler *)task->local_args);
+  Domain input_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  int rows = input_domain.get_volume() / experts->in_dim;
+  ExpertsMeta *m = new ExpertsMeta(handle, experts, rows);
+  m->profiling = experts->profiling;
+  return m;
+}
+
+void Experts::forward(FFModel const &ff) {
+  ArgumentMap argmap;
+  Context ctx = ff.config.lg_ctx;
+  Runtime *runtime = ff.config.lg_hlr;
+  set_argumentmap_for_forward(ff, argmap);
+  IndexLauncher launcher(EXPERTS_FWD_TASK_ID,
+                         parallel_is,
+                         TaskArgument(this, sizeof(Experts)),
+                         argmap,
+                         Predicate::TRUE_PRED,
+                         false /*must*/,
+                         0 /*mapper_id*/,
+                         outputs[0]->machine_view.hash());
+  // a dropless layer takes a single packed input and output
+  int n = numOutputs;
+  // inputs
+  for (int i = 0; i < n; i++) {
+    launcher.add_region_requirement(RegionRequirement(inputs[i]->part,
+                                                      0 /*projection id*/,
+                                                      READ_ONLY,
+                                                      EXCLUSIVE,
+                                                      inputs[i]->region));
+    launcher.add_field(i, FID_DATA);
+  }
+  // outputs
+  for (int i = 0; i < n; i++) {
+    launcher.add_region_requirement(RegionRequirement(outputs[i]->part,
+                                                      0 /*projection id*/,
+                                                      WRITE_ONLY,
+                                                      EXCLUSIVE,
+                                                      outputs[i]->region));
+    launcher.add_field(n + i, FID_DATA);
+  }
+  // kernel and bias
+  for (int i = 0; i < numWeights; i++) {
+    launcher.add_region_requirement(RegionRequirement(weights[i]->part,
+                                                      0 /*projection id*/,
+                                                      READ_ONLY,
+                                                      EXCLUSIVE,
+                                                      weights[i]->region));
+    launcher.add_field(2 * n + i, FID_DATA);
+  }
+  // assign
+  if (dropless) {
+    launcher.add_region_requirement(RegionRequirement(inputs[1]->part,
+                                                      0 /*projection id*/,
+                                                      READ_ONLY,
+                                                      EXCLUSIVE,
+                                                      inputs[1]->region));
+    launcher.add_field(2 * n + numWeights, FID_DATA);
+  }
+  runtime->execute_index_space(ctx, launcher);
+}
+
+/*
+  regions[0..n-1](I): inputs
+  regions[n..2n-1](O): outputs
+  regions[2n](I): kernel
+  regions[2n+1](I): bias (if use_bias)
+  regions[last](I): assign (if dropless, in which case n is 1)
+*/
+void Experts::forward_task(Task const *task,
+                           std::vector<PhysicalRegion> const &regions,
+                           Context ctx,
+                           Runtime *runtime) {
+  ExpertsMeta const *m = *((ExpertsMeta **)task->local_args);
+  int n = m->dropless ? 1 : m->num_experts;
+  int num_weights = m->use_bias ? 2 : 1;
+  assert((int)regions.size() == 2 * n + num_weights + (m->dropless ? 1 : 0));
+  assert(task->regions.size() == regions.size());
+
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain out_domain = runtime->get_index_space_domain(
+      ctx, task->regions[n].region.get_index_space());
+  int in_dim = in_domain.hi()[0] - in_domain.lo()[0] + 1;
+  int out_dim = out_domain.hi()[0] - out_domain.lo()[0] + 1;
+  int rows = in_domain.get_volume() / in_dim;
+  assert((int)out_domain.get_volume() == rows * out_dim);
+
+  std::vector<float const *> inputs(n);
+  std::vector<float *> outputs(n);
+  for (int i = 0; i < n; i++) {
+    inputs[i] = helperGetTensorPointerRO<float>(
+        regions[i], task->regions[i], FID_DATA, ctx, runtime);
+    outputs[i] = helperGetTensorPointerWO<float>(
+        regions[n + i], task->regions[n + i], FID_DATA, ctx, runtime);
+  }
+  float const *kernel = helperGetTensorPointerRO<float>(
+      regions[2 * n], task->regions[2 * n], FID_DATA, ctx, runtime);
+  float const *bias = nullptr;
+  if (m->use_bias) {
+    bias = helperGetTensorPointerRO<float>(
+        regions[2 * n + 1], task->regions[2 * n + 1], FID_DATA, ctx, runtime);
+  }
+  if (m->dropless) {
+    int assign_idx = 2 * n + num_weights;
+    Domain assign_domain = runtime->get_index_space_domain(
+        ctx, task->regions[assign_idx].region.get_index_space());
+    assert((int)assign_domain.get_volume() == rows);
+    int const *exp_assign = helperGetTensorPointerRO<int>(
+        regions[assign_idx], task->regions[assign_idx], FID_DATA, ctx, runtime);
+    Experts::forward_dropless_kernel_wrapper(m,
+                                             inputs[0],
+                                             exp_assign,
+                                             outputs[0],
+                                             kernel,
+                                             bias,
+                                             in_dim,
+                                             out_dim,
+                                             rows);
+    return;
+  }
+  Experts::forward_kernel_wrapper(
+      m, inputs.data(), outputs.data(), kernel, bias, in_dim, out_dim, rows);
+}
+
+void Experts::backward(FFModel const &ff) {
+  ArgumentMap argmap;
+  Context ctx = ff.config.lg_ctx;
+  Runtime *runtime = ff.config.lg_hlr;
+  set_argumentmap_for_backward(ff, argmap);
+  IndexLauncher launcher(EXPERTS_BWD_TASK_ID,
+                         parallel_is,
+                         TaskArgument(this, sizeof(Experts)),
+                         argmap,
+                         Predicate::TRUE_PRED,
+                         false /*must*/,
+                         0 /*mapper_id*/,
+                         outputs[0]->machine_view.hash());
+  // a dropless layer takes a single packed input and output
+  int n = numOutputs;
+  // inputs
+  for (int i = 0; i < n; i++) {
+    launcher.add_region_requirement(RegionRequirement(inputs[i]->part,
+                                                      0 /*projection id*/,
+                                                      READ_ONLY,
+                                                      EXCLUSIVE,
+                                                      inputs[i]->region));
+    launcher.add_field(i, FID_DATA);
+  }
+  // input grads
+  for (int i = 0; i < n; i++) {
+    launcher.add_region_requirement(RegionRequirement(inputs[i]->part_grad,
+                                                      0 /*projection id*/,
+                                                      READ_WRITE,
+                                                      EXCLUSIVE,
+                                                      inputs[i]->region_grad));
+    launcher.add_field(n + i, FID_DATA);
+  }
+  // outputs
+  for (int i = 0; i < n; i++) {
+    launcher.add_region_requirement(RegionRequirement(outputs[i]->part,
+                                                      0 /*projection id*/,
+                                                      READ_ONLY,
+                                                      EXCLUSIVE,
+                                                      outputs[i]->region));
+    launcher.add_field(2 * n + i, FID_DATA);
+  }
+  // output grads
+  for (int i = 0; i < n; i++) {
+    launcher.add_region_requirement(RegionRequirement(outputs[i]->part_grad,
+                                                      0 /*projection id*/,
+                                                      READ_WRITE,
+                                                      EXCLUSIVE,
+                                                      outputs[i]->region_grad));
+    launcher.add_field(3 * n + i, FID_DATA);
+  }
+  // kernel
+  launcher.add_region_requirement(
+      RegionRequirement(weights[KERNEL_IDX]->part,
+                        0 /*projection id*/,
+                        READ_ONLY,
+                        EXCLUSIVE,
+                        weights[KERNEL_IDX]->region));
+  launcher.add_field(4 * n, FID_DATA);
+  // kernel and bias grads
+  for (int i = 0; i < numWeights; i++) {
+    launcher.add_region_requirement(RegionRequirement(weights[i]->part_grad,
+                                                      0 /*projection id*/,
+                                                      READ_WRITE,
+                                                      EXCLUSIVE,
+                                                      weights[i]->region_grad));
+    launcher.add_field(4 * n + 1 + i, FID_DATA);
+  }
+  // assign
+  if (dropless) {
+    launcher.add_region_requirement(RegionRequirement(inputs[1]->part,
+                                                      0 /*projection id*/,
+                                                      READ_ONLY,
+                                                      EXCLUSIVE,
+                                                      inputs[1]->region));
+    launcher.add_field(4 * n + 1 + numWeights, FID_DATA);
+  }
+  runtime->execute_index_space(ctx, launcher);
+}
+
+/*
+  regions[0..n-1](I): inputs
+  regions[n..2n-1](I/O): input grads
+  regions[2n..3n-1](I): outputs
+  regions[3n..4n-1](I/O): output grads
+  regions[4n](I): kernel
+  regions[4n+1](I/O): kernel grad
+  regions[4n+2](I/O): bias grad (if use_bias)
+  regions[last](I): assign (if dropless, in which case n is 1)
+*/
+void Experts::backward_task(Task const *task,
+                            std::vector<PhysicalRegion> const &regions,
+                            Context ctx,
+                            Runtime *runtime) {
+  ExpertsMeta const *m = *((ExpertsMeta **)task->local_args);
+  int n = m->dropless ? 1 : m->num_experts;
+  int num_weights = m->use_bias ? 2 : 1;
+  assert((int)regions.size() ==
+         4 * n + 1 + num_weights + (m->dropless ? 1 : 0));
+  assert(task->regions.size() == regions.size());
+
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain out_domain = runtime->get_index_space_domain(
+      ctx, task->regions[2 * n].region.get_index_space());
+  int in_dim = in_domain.hi()[0] - in_domain.lo()[0] + 1;
+  int out_dim = out_domain.hi()[0] - out_domain.lo()[0] + 1;
+  int rows = in_domain.get_volume() / in_dim;
+  assert((int)out_domain.get_volume() == rows * out_dim);
+
+  std::vector<float const *> inputs(n), outputs(n);
+  std::vector<float *> input_grads(n), output_grads(n);
+  for (int i = 0; i < n; i++) {
+    inputs[i] = helperGetTensorPointerRO<float>(
+        regions[i], task->regions[i], FID_DATA, ctx, runtime);
+    input_grads[i] = helperGetTensorPointerRW<float>(
+        regions[n + i], task->regions[n + i], FID_DATA, ctx, runtime);
+    outputs[i] = helperGetTensorPointerRO<float>(
+        regions[2 * n + i], task->regions[2 * n + i], FID_DATA, ctx, runtime);
+    output_grads[i] = helperGetTensorPointerRW<float>(
+        regions[3 * n + i], task->regions[3 * n + i], FID_DATA, ctx, runtime);
+  }
+  float const *kernel = helperGetTensorPointerRO<float>(
+      regions[4 * n], task->regions[4 * n], FID_DATA, ctx, runtime);
+  float *kernel_grad = helperGetTensorPointerRW<float>(
+      regions[4 * n + 1], task->regions[4 * n + 1], FID_DATA, ctx, runtime);
+  float *bias_grad = nullptr;
+  if (m->use_bias) {
+    bias_grad = helperGetTensorPointerRW<float>(
+        regions[4 * n + 2], task->regions[4 * n + 2], FID_DATA, ctx, runtime);
+  }
+  if (m->dropless) {
+    int assign_idx = 4 * n + 1 + num_weights;
+    int const *exp_assign = helperGetTensorPointerRO<int>(
+        regions[assign_idx], task->regions[assign_idx], FID_DATA, ctx, runtime);
+    Experts::backward_dropless_kernel_wrapper(m,
+                                              inputs[0],
+                                              input_grads[0],
+                                              outputs[0],
+                                              output_grads[0],
+                                              exp_assign,
+                                              kernel,
+                                              kernel_grad,
+                                              bias_grad,
+                                              in_dim,
+                                              out_dim,
+                                              rows);
+    return;
+  }
+  Experts::backward_kernel_wrapper(m,
+                                   inputs.data(),
+                                   input_grads.data(),
+                                   outputs.data(),
+                                   output_grads.data(),
+                                   kernel,
+                                   kernel_grad,
+                                   bias_grad,
+                                   in_dim,
+                                   out_dim,
+                                   rows);
+}
+
+/*static*/
+void Experts::forward_kernel_cpu(float const *const *inputs,
+                                 float *const *outputs,
+                                 float const *kernel,
+                                 float const *bias,
+                                 int num_experts,
+                                 ActiMode activation,
+                                 bool apply_softmax,
+                                 int in_dim,
+                                 int out_dim,
+                                 int rows) {
+  for (int e = 0; e < num_experts; e++) {
+    float const *w = kernel + (size_t)e * in_dim * out_dim;
+    for (int r = 0; r < rows; r++) {
+      float const *x = inputs[e] + (size_t)r * in_dim;
+      float *y = outputs[e] + (size_t)r * out_dim;
+      for (int c = 0; c < out_dim; c++) {
+        float sum = bias != nullptr ? bias[e * out_dim + c] : 0.0f;
+        for (int k = 0; k < in_dim; k++) {
+          sum += x[k] * w[(size_t)c * in_dim + k];
+        }
+        if (activation == AC_MODE_RELU) {
+          sum = sum > 0.0f ? sum : 0.0f;
+        } else if (activation == AC_MODE_SIGMOID) {
+          sum = 1.0f / (1.0f + expf(-sum));
+        } else {
+          assert(activation == AC_MODE_NONE);
+        }
+        y[c] = sum;
+      }
+      if (apply_softmax) {
+        float max_value = y[0];
+        for (int c = 1; c < out_dim; c++) {
+          max_value = std::max(max_value, y[c]);
+        }
+        float sum = 0.0f;
+        for (int c = 0; c < out_dim; c++) {
+          y[c] = expf(y[c] - max_value);
+          sum += y[c];
+        }
+        for (int c = 0; c < out_dim; c++) {
+          y[c] /= sum;
+        }
+      }
+    }
+  }
+}
+
+/*static*/
+void Experts::backward_kernel_cpu(float const *const *inputs,
+                                  float *const *input_grads,
+                                  float const *const *activations,
+                                  float *const *output_grads,
+                                  float const *kernel,
+                                  float *kernel_grad,
+                                  float *bias_grad,
+                                  int num_experts,
+                                  ActiMode activation,
+                                  int in_dim,
+                                  int out_dim,
+                                  int rows) {
+  for (int e = 0; e < num_experts; e++) {
+    float const *w = kernel + (size_t)e * in_dim * out_dim;
+    float *w_grad = kernel_grad + (size_t)e * in_dim * out_dim;
+    for (int r = 0; r < rows; r++) {
+      float const *x = inputs[e] + (size_t)r * in_dim;
+      float *x_grad = input_grads[e] + (size_t)r * in_dim;
+      float const *a = activations[e] + (size_t)r * out_dim;
+      float *y_grad = output_grads[e] + (size_t)r * out_dim;
+      for (int c = 0; c < out_dim; c++) {
+        if (activation == AC_MODE_RELU) {
+          y_grad[c] = a[c] > 0.0f ? y_grad[c] : 0.0f;
+        } else if (activation == AC_MODE_SIGMOID) {
+          y_grad[c] *= a[c] * (1.0f - a[c]);
+        } else {
+          assert(activation == AC_MODE_NONE);
+        }
+        if (bias_grad != nullptr) {
+          bias_grad[e * out_dim + c] += y_grad[c];
+        }
+        for (int k = 0; k < in_dim; k++) {
+          w_grad[(size_t)c * in_dim + k] += x[k] * y_grad[c];
+          x_grad[k] += w[(size_t)c * in_dim + k] * y_grad[c];
+        }
+      }
+    }
+  }
+}
+
+void Experts::serialize(Legion::Serializer &sez) const {
+  sez.serialize(this->layer_guid.id);
+  sez.serialize(this->num_experts);
+  sez.serialize(this->out_dim);
+  sez.serialize(this->activation);
+  sez.serialize(this->use_bias);
+  sez.serialize(this->apply_softmax);
+  sez.serialize(this->dropless);
+}
+
+Node Experts::deserialize(FFModel &ff,
+                          Legion::Deserializer &dez,
+                          ParallelTensor inputs[],
+                          int num_inputs) {
+  size_t id;
+  dez.deserialize(id);
+  ExpertsParams params;
+  params.layer_guid = LayerID(id);
+  dez.deserialize(params.num_experts);
+  dez.deserialize(params.out_dim);
+  dez.deserialize(params.activation);
+  dez.deserialize(params.use_bias);
+  dez.deserialize(params.apply_softmax);
+  dez.deserialize(params.dropless);
+  assert(num_inputs == (params.dropless ? 2 : params.num_experts));
+  return ff.get_or_create_node<Experts>(
+      {std::begin(inputs), std::begin(inputs) + num_inputs}, params);
+}
+
+Op *Experts::materialize(FFModel &ff,
+                         ParallelTensor inputs[],
+                         int num_inputs) const {
+  assert(num_inputs == numInputs);
+  std::vector<ParallelTensor> expert_inputs(inputs, inputs + num_inputs);
+  return new Experts(ff, *this, expert_inputs, true /*allocate_weights*/);
+}
+
+bool Experts::measure_operator_cost(Simulator *sim,
+                                    MachineView const &mv,
+                                    CostMetrics &cost_metrics) const {
+  ParallelTensorBase sub_input, sub_output;
+  if (!inputs[0]->get_sub_tensor(mv, sub_input)) {
+    return false;
+  }
+  if (!outputs[0]->get_sub_tensor(mv, sub_output)) {
+    return false;
+  }
+  int n = num_experts;
+  int rows = sub_input.get_volume() / in_dim;
+  // a dropless layer takes a single packed input and output
+  int num_buffers = dropless ? 1 : n;
+  size_t kernel_volume = (size_t)n * in_dim * out_dim;
+  size_t bias_volume = use_bias ? (size_t)n * out_dim : 0;
+
+  ExpertsMeta *m = new ExpertsMeta(sim->handler, this, rows);
+  assert(m->profiling == false);
+
+  // allocate
+  sim->free_all();
+  bool out_of_memory = false;
+  auto allocate_buffers = [&](std::vector<float *> &ptrs, size_t volume) {
+    ptrs.resize(num_buffers);
+    for (float *&ptr : ptrs) {
+      ptr = (float *)sim->allocate(volume, DT_FLOAT);
+      out_of_memory = out_of_memory || (ptr == NULL);
+    }
+  };
+  std::vector<float *> input_data;
+  allocate_buffers(input_data, sub_input.get_volume());
+  std::vector<float const *> input_ptrs(input_data.begin(), input_data.end());
+  // The rows a dropless layer routes to each expert are only known at run
+  // time, so it is measured with the rows evenly routed
+  int *assign_ptr = NULL;
+  if (dropless) {
+    assign_ptr = (int *)sim->allocate(rows, DT_INT32);
+    out_of_memory = out_of_memory || (assign_ptr == NULL);
+  }
+  cost_metrics.inputs_memory += cost_metrics.total_mem_diff_from(sim->offset);
+
+  std::vector<float *> output_ptrs;
+  allocate_buffers(output_ptrs, sub_output.get_volume());
+  cost_metrics.outputs_memory += cost_metrics.total_mem_diff_from(sim->offset);
+
+  float *kernel_ptr = (float *)sim->allocate(kernel_volume, DT_FLOAT);
+  float *bias_ptr = NULL;
+  if (use_bias) {
+    bias_ptr = (float *)sim->allocate(bias_volume, DT_FLOAT);
+    out_of_memory = out_of_memory || (bias_ptr == NULL);
+  }
+  cost_metrics.weights_memory += cost_metrics.total_mem_diff_from(sim->offset);
+  out_of_memory = out_of_memory || (kernel_ptr == NULL);
+
+  if (out_of_memory) {
+    cost_metrics.forward_time = Simulator::MAXIMUM_TASK_RUN_TIME;
+    cost_metrics.backward_time = Simulator::MAXIMUM_TASK_RUN_TIME;
+    delete m;
+    return true;
+  }
+  if (dropless) {
+    even_assignment_kernel_wrapper(assign_ptr, n, rows);
+  }
+
+  std::function<void()> forward, backward;
+  forward = [&] {
+    if (dropless) {
+      forward_dropless_kernel_wrapper(m,
+                                      input_ptrs[0],
+                                      assign_ptr,
+                                      output_ptrs[0],
+                                      kernel_ptr,
+                                      bias_ptr,
+                                      in_dim,
+                                      out_dim,
+                                      rows);
+      return;
+    }
+    forward_kernel_wrapper(m,
+                           input_ptrs.data(),
+                           output_ptrs.data(),
+                           kernel_ptr,
+                           bias_ptr,
+                           in_dim,
+                           out_dim,
+                           rows);
+  };
+  std::vector<float *> input_grad_ptrs, output_grad_ptrs;
+  std::vector<float const *> output_ro_ptrs(output_ptrs.begin(),
+                                            output_ptrs.end());
+  float *kernel_grad_ptr = NULL, *bias_grad_ptr = NULL;
+  if (sim->computationMode == COMP_MODE_TRAINING) {
+    allocate_buffers(input_grad_ptrs, sub_input.get_volume());
+    cost_metrics.inputs_memory += cost_metrics.total_mem_diff_from(sim->offset);
+
+    allocate_buffers(output_grad_ptrs, sub_output.get_volume());
+    cost_metrics.outputs_memory +=
+        cost_metrics.total_mem_diff_from(sim->offset);
+
+    kernel_grad_ptr = (float *)sim->allocate(kernel_volume, DT_FLOAT);
+    if (use_bias) {
+      bias_grad_ptr = (float *)sim->allocate(bias_volume, DT_FLOAT);
+      out_of_memory = out_of_memory || (bias_grad_ptr == NULL);
+    }
+    cost_metrics.weights_memory +=
+        cost_metrics.total_mem_diff_from(sim->offset);
+    out_of_memory = out_of_memory || (kernel_grad_ptr == NULL);
+
+    if (out_of_memory) {
+      cost_metrics.forward_time = Simulator::MAXIMUM_TASK_RUN_TIME;
+      cost_metrics.backward_time = Simulator::MAXIMUM_TASK_RUN_TIME;
+      delete m;
+      return true;
+    }
+    backward = [&] {
+      if (dropless) {
+        backward_dropless_kernel_wrapper(m,
+                                         input_ptrs[0],
+                                         input_grad_ptrs[0],
+                                         output_ro_ptrs[0],
+                                         output_grad_ptrs[0],
+                                         assign_ptr,
+                                         kernel_ptr,
+                                         kernel_grad_ptr,
+                                         bias_grad_ptr,
+                                         in_dim,
+                                         out_dim,
+                                         rows);
+        return;
+      }
+      backward_kernel_wrapper(m,
+                              input_ptrs.data(),
+                              input_grad_ptrs.data(),
+                              output_ro_ptrs.data(),
+                              output_grad_ptrs.data(),
+                              kernel_ptr,
+                              kernel_grad_ptr,
+                              bias_grad_ptr,
+                              in_dim,
+                              out_dim,
+                              rows);
+    };
+  }
+
+  inner_measure_operator_cost(sim, forward, backward, cost_metrics);
+  log_measure.debug("[Measure Experts] name(%s) num_experts(%d) rows(%d) "
+                    "in(%d) out(%d) forward_time(%.4lf) backward_time(%.4lf)\n",
+                    name,
+                    n,
+                    rows,
+                    in_dim,
+                    out_dim,
+                    cost_metrics.forward_time,
+                    cost_metrics.backward_time);
+  delete m;
+  return true;
+}
+
+}; // namespace FlexFlow
+
+namespace std {
+size_t hash<FlexFlow::ExpertsParams>::operator()(
+    FlexFlow::ExpertsParams const &params) const {
+  size_t key = 0;
+  hash_combine(key, params.layer_guid.id);
+  hash_combine(key, params.num_experts);
+  hash_combine(key, params.out_dim);
+  hash_combine(key, params.activation);
+  hash_combine(key, params.use_bias);
+  hash_combine(key, params.apply_softmax);
+  hash_combine(key, params.dropless);
+  return key;
+}
+}; // namespace std
@@ -0,0 +1,707 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/ops/experts.h"
+#include "flexflow/utils/cuda_helper.h"
+
+namespace FlexFlow {
+
+// Number of per-expert pointer arrays held by ExpertsMeta::dev_ptrs
+static constexpr int NUM_PTR_ARRAYS = 6;
+// Rows and columns of the tiles of the grouped GEMMs of a dropless layer
+static constexpr int EXPERTS_TILE = 16;
+
+__device__ float experts_activation(float value, ActiMode activation) {
+  if (activation == AC_MODE_RELU) {
+    return value > 0.0f ? value : 0.0f;
+  } else if (activation == AC_MODE_SIGMOID) {
+    return 1.0f / (1.0f + expf(-value));
+  }
+  return value;
+}
+
+// Scales the gradient of an output by the derivative of the activation a
+__device__ float
+    experts_activation_grad(float grad, float a, ActiMode activation) {
+  if (activation == AC_MODE_RELU) {
+    return a > 0.0f ? grad : 0.0f;
+  } else if (activation == AC_MODE_SIGMOID) {
+    return grad * a * (1.0f - a);
+  }
+  return grad;
+}
+
+// Softmax over a row of out_dim elements; x and y may alias
+__device__ void experts_softmax_row(float const *x, float *y, int out_dim) {
+  float max_value = x[0];
+  for (int c = 1; c < out_dim; c++) {
+    max_value = fmaxf(max_value, x[c]);
+  }
+  float sum = 0.0f;
+  for (int c = 0; c < out_dim; c++) {
+    y[c] = expf(x[c] - max_value);
+    sum += y[c];
+  }
+  for (int c = 0; c < out_dim; c++) {
+    y[c] /= sum;
+  }
+}
+
+// Expert owning a row of the packed buffer of a dropless layer
+__device__ int experts_packed_expert(int const *offsets, int row) {
+  int e = 0;
+  while (offsets[e + 1] <= row) {
+    e++;
+  }
+  return e;
+}
+
+// Adds the bias and applies the activation to the outputs of all experts,
+// each of out_dim * rows elements
+__global__ void experts_bias_activation_kernel(float *const *outputs,
+                                               float const *bias,
+                                               ActiMode activation,
+                                               int out_dim,
+                                               int rows,
+                                               size_t num_elements) {
+  size_t expert_size = (size_t)out_dim * rows;
+  CUDA_KERNEL_LOOP(i, num_elements) {
+    size_t e = i / expert_size, j = i % expert_size;
+    float value = outputs[e][j];
+    if (bias != nullptr) {
+      value += bias[e * out_dim + j % out_dim];
+    }
+    outputs[e][j] = experts_activation(value, activation);
+  }
+}
+
+// Same as above over the packed rows of a dropless layer
+__global__ void experts_packed_bias_activation_kernel(float *output,
+                                                      float const *bias,
+                                                      int const *offsets,
+                                                      ActiMode activation,
+                                                      int out_dim,
+                                                      size_t num_elements) {
+  CUDA_KERNEL_LOOP(i, num_elements) {
+    float value = output[i];
+    if (bias != nullptr) {
+      int e = experts_packed_expert(offsets, i / out_dim);
+      value += bias[e * out_dim + i % out_dim];
+    }
+    output[i] = experts_activation(value, activation);
+  }
+}
+
+// One thread per row of out_dim elements; input and output may alias
+__global__ void experts_softmax_kernel(float *const *inputs,
+                                       float *const *outputs,
+                                       int out_dim,
+                                       int rows,
+                                       int num_rows) {
+  CUDA_KERNEL_LOOP(i, num_rows) {
+    int e = i / rows;
+    float const *x = inputs[e] + (size_t)(i % rows) * out_dim;
+    float *y = outputs[e] + (size_t)(i % rows) * out_dim;
+    experts_softmax_row(x, y, out_dim);
+  }
+}
+
+__global__ void experts_packed_softmax_kernel(float const *input,
+                                              float *output,
+                                              int out_dim,
+                                              int rows) {
+  CUDA_KERNEL_LOOP(i, rows) {
+    experts_softmax_row(
+        input + (size_t)i * out_dim, output + (size_t)i * out_dim, out_dim);
+  }
+}
+
+__global__ void experts_activation_backward_kernel(float *const *output_grads,
+                                                   float *const *activations,
+                                                   ActiMode activation,
+                                                   size_t expert_size,
+                                                   size_t num_elements) {
+  CUDA_KERNEL_LOOP(i, num_elements) {
+    size_t e = i / expert_size, j = i % expert_size;
+    output_grads[e][j] = experts_activation_grad(
+        output_grads[e][j], activations[e][j], activation);
+  }
+}
+
+__global__ void
+    experts_packed_activation_backward_kernel(float *output_grad,
+                                              float const *activations,
+                                              ActiMode activation,
+                                              size_t num_elements) {
+  CUDA_KERNEL_LOOP(i, num_elements) {
+    output_grad[i] =
+        experts_activation_grad(output_grad[i], activations[i], activation);
+  }
+}
+
+// One thread per (expert, output channel), summing over the rows
+__global__ void experts_bias_backward_kernel(float *const *output_grads,
+                                             float *bias_grad,
+                                             int out_dim,
+                                             int rows,
+                                             int num_channels) {
+  CUDA_KERNEL_LOOP(i, num_channels) {
+    float const *grad = output_grads[i / out_dim] + i % out_dim;
+    float sum = 0.0f;
+    for (int r = 0; r < rows; r++) {
+      sum += grad[(size_t)r * out_dim];
+    }
+    bias_grad[i] += sum;
+  }
+}
+
+// Same as above over the segment of each expert in the packed rows
+__global__ void experts_packed_bias_backward_kernel(float const *output_grad,
+                                                    float *bias_grad,
+                                                    int const *offsets,
+                                                    int out_dim,
+                                                    int num_channels) {
+  CUDA_KERNEL_LOOP(i, num_channels) {
+    int e = i / out_dim;
+    float const *grad = output_grad + i % out_dim;
+    float sum = 0.0f;
+    for (int r = offsets[e]; r < offsets[e + 1]; r++) {
+      sum += grad[(size_t)r * out_dim];
+    }
+    bias_grad[i] += sum;
+  }
+}
+
+// Finds the offsets of the experts in the packed rows of a dropless layer,
+// where the rows of expert e start at the first row assigned to e or later,
+// and scans the tiles of EXPERTS_TILE rows of the experts into
+// tile_offsets; runs as a single block
+__global__ void experts_offsets_kernel(int const *exp_assign,
+                                       int rows,
+                                       int num_experts,
+                                       int *offsets,
+                                       int *tile_offsets) {
+  for (int i = threadIdx.x; i <= rows; i += blockDim.x) {
+    int prev = i > 0 ? exp_assign[i - 1] : -1;
+    int next = i < rows ? exp_assign[i] : num_experts;
+    for (int e = prev + 1; e <= next; e++) {
+      offsets[e] = i;
+    }
+  }
+  __syncthreads();
+  if (threadIdx.x == 0) {
+    tile_offsets[0] = 0;
+    for (int e = 0; e < num_experts; e++) {
+      int expert_rows = offsets[e + 1] - offsets[e];
+      tile_offsets[e + 1] =
+          tile_offsets[e] + (expert_rows + EXPERTS_TILE - 1) / EXPERTS_TILE;
+    }
+  }
+}
+
+// Grouped GEMM over the packed rows of a dropless layer: for every row r of
+// expert e, c[r][j] = beta * c[r][j] + sum_k a[r][k] * b_e(k, j), with
+// b_e(k, j) = b[e * b_size + k * b_k_stride + j * b_j_stride]. Blocks of
+// EXPERTS_TILE x EXPERTS_TILE threads compute tiles of rows of a single
+// expert, blockIdx.y indexing the tiles of all experts.
+__global__ void experts_grouped_gemm_kernel(float const *a,
+                                            float const *b,
+                                            float *c,
+                                            int const *offsets,
+                                            int const *tile_offsets,
+                                            int num_experts,
+                                            int k_dim,
+                                            int n_dim,
+                                            size_t b_size,
+                                            int b_k_stride,
+                                            int b_j_stride,
+                                            float beta) {
+  __shared__ float a_tile[EXPERTS_TILE][EXPERTS_TILE + 1];
+  __shared__ float b_tile[EXPERTS_TILE][EXPERTS_TILE + 1];
+  int tile = blockIdx.y;
+  if (tile >= tile_offsets[num_experts]) {
+    return;
+  }
+  int e = experts_packed_expert(tile_offsets, tile);
+  int row = offsets[e] + (tile - tile_offsets[e]) * EXPERTS_TILE + threadIdx.y;
+  bool valid_row = row < offsets[e + 1];
+  int col_base = blockIdx.x * EXPERTS_TILE;
+  int col = col_base + threadIdx.x;
+  b += e * b_size;
+  // Let consecutive threads read consecutive elements of b
+  int bk = b_k_stride == 1 ? threadIdx.x : threadIdx.y;
+  int bj = b_k_stride == 1 ? threadIdx.y : threadIdx.x;
+  float sum = 0.0f;
+  for (int k_base = 0; k_base < k_dim; k_base += EXPERTS_TILE) {
+    int k = k_base + threadIdx.x;
+    a_tile[threadIdx.y][threadIdx.x] =
+        valid_row && k < k_dim ? a[(size_t)row * k_dim + k] : 0.0f;
+    k = k_base + bk;
+    int j = col_base + bj;
+    b_tile[bk][bj] = k < k_dim && j < n_dim
+                         ? b[(size_t)k * b_k_stride + (size_t)j * b_j_stride]
+                         : 0.0f;
+    __syncthreads();
+    for (int t = 0; t < EXPERTS_TILE; t++) {
+      sum += a_tile[threadIdx.y][t] * b_tile[t][threadIdx.x];
+    }
+    __syncthreads();
+  }
+  if (valid_row && col < n_dim) {
+    float *out = c + (size_t)row * n_dim + col;
+    *out = beta == 0.0f ? sum : beta * *out + sum;
+  }
+}
+
+// Accumulates grad_e[j][k] += sum_r x[r][k] * d[r][j] over the packed rows r
+// of expert e, with x of k_dim and d of n_dim columns; blockIdx.z is the
+// expert
+__global__ void experts_grouped_weight_grad_kernel(float const *x,
+                                                   float const *d,
+                                                   float *grad,
+                                                   int const *offsets,
+                                                   int k_dim,
+                                                   int n_dim) {
+  __shared__ float x_tile[EXPERTS_TILE][EXPERTS_TILE + 1];
+  __shared__ float d_tile[EXPERTS_TILE][EXPERTS_TILE + 1];
+  int e = blockIdx.z;
+  int k = blockIdx.x * EXPERTS_TILE + threadIdx.x;
+  int j = blockIdx.y * EXPERTS_TILE + threadIdx.y;
+  int dj = blockIdx.y * EXPERTS_TILE + threadIdx.x;
+  int end = offsets[e + 1];
+  float sum = 0.0f;
+  for (int row_base = offsets[e]; row_base < end; row_base += EXPERTS_TILE) {
+    int row = row_base + threadIdx.y;
+    x_tile[threadIdx.y][threadIdx.x] =
+        row < end && k < k_dim ? x[(size_t)row * k_dim + k] : 0.0f;
+    d_tile[threadIdx.y][threadIdx.x] =
+        row < end && dj < n_dim ? d[(size_t)row * n_dim + dj] : 0.0f;
+    __syncthreads();
+    for (int t = 0; t < EXPERTS_TILE; t++) {
+      sum += x_tile[t][threadIdx.x] * d_tile[t][threadIdx.y];
+    }
+    __syncthreads();
+  }
+  if (k < k_dim && j < n_dim) {
+    grad[(size_t)e * k_dim * n_dim + (size_t)j * k_dim + k] += sum;
+  }
+}
+
+// Routes the rows evenly to the experts, in packed order
+__global__ void
+    experts_even_assign_kernel(int *exp_assign, int num_experts, int rows) {
+  CUDA_KERNEL_LOOP(i, rows) {
+    exp_assign[i] = (int)((long long)i * num_experts / rows);
+  }
+}
+
+/*static*/
+void Experts::forward_kernel_wrapper(ExpertsMeta const *m,
+                                     float const **inputs,
+                                     float **outputs,
+                                     float const *kernel,
+                                     float const *bias,
+                                     int in_dim,
+                                     int out_dim,
+                                     int rows) {
+  cudaStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  checkCUDA(cublasSetStream(m->handle.blas, stream));
+  cudaEvent_t t_start, t_end;
+  if (m->profiling) {
+    cudaEventCreate(&t_start);
+    cudaEventCreate(&t_end);
+    cudaEventRecord(t_start, stream);
+  }
+  int n = m->num_experts;
+  size_t expert_size = (size_t)out_dim * rows;
+  // The GEMMs write the activations before the softmax to the buffer of the
+  // meta when the backward pass needs them, and to the outputs otherwise
+  float *ptrs[NUM_PTR_ARRAYS * MAX_NUM_INPUTS];
+  float **dev_inputs = m->dev_ptrs;
+  float **dev_kernels = m->dev_ptrs + n;
+  float **dev_activations = m->dev_ptrs + 2 * n;
+  float **dev_outputs = m->dev_ptrs + 3 * n;
+  for (int i = 0; i < n; i++) {
+    ptrs[i] = const_cast<float *>(inputs[i]);
+    ptrs[n + i] = const_cast<float *>(kernel) + i * (size_t)in_dim * out_dim;
+    ptrs[2 * n + i] =
+        m->activations != nullptr ? m->activations + i * expert_size
+                                  : outputs[i];
+    ptrs[3 * n + i] = outputs[i];
+  }
+  checkCUDA(cudaMemcpyAsync(m->dev_ptrs,
+                            ptrs,
+                            4 * n * sizeof(float *),
+                            cudaMemcpyHostToDevice,
+                            stream));
+
+  float alpha = 1.0f, beta = 0.0f;
+  checkCUDA(cublasSgemmBatched(m->handle.blas,
+                               CUBLAS_OP_T,
+                               CUBLAS_OP_N,
+                               out_dim,
+                               rows,
+                               in_dim,
+                               &alpha,
+                               dev_kernels,
+                               in_dim,
+                               dev_inputs,
+                               in_dim,
+                               &beta,
+                               dev_activations,
+                               out_dim,
+                               n));
+  if (bias != nullptr || m->activation != AC_MODE_NONE) {
+    size_t num_elements = expert_size * n;
+    experts_bias_activation_kernel<<<GET_BLOCKS(num_elements),
+                                     CUDA_NUM_THREADS,
+                                     0,
+                                     stream>>>(
+        dev_activations, bias, m->activation, out_dim, rows, num_elements);
+  }
+  if (m->apply_softmax) {
+    experts_softmax_kernel<<<GET_BLOCKS(rows * n),
+                             CUDA_NUM_THREADS,
+                             0,
+                             stream>>>(
+        dev_activations, dev_outputs, out_dim, rows, rows * n);
+  }
+  if (m->profiling) {
+    cudaEventRecord(t_end, stream);
+    checkCUDA(cudaEventSynchronize(t_end));
+    float elapsed = 0;
+    checkCUDA(cudaEventElapsedTime(&elapsed, t_start, t_end));
+    cudaEventDestroy(t_start);
+    cudaEventDestroy(t_end);
+    printf("[Experts] forward time = %.2lfms\n", elapsed);
+  }
+}
+
+/*static*/
+void Experts::backward_kernel_wrapper(ExpertsMeta const *m,
+                                      float const **inputs,
+                                      float **input_grads,
+                                      float const **outputs,
+                                      float **output_grads,
+                                      float const *kernel,
+                                      float *kernel_grad,
+                                      float *bias_grad,
+                                      int in_dim,
+                                      int out_dim,
+                                      int rows) {
+  cudaStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  checkCUDA(cublasSetStream(m->handle.blas, stream));
+  cudaEvent_t t_start, t_end;
+  if (m->profiling) {
+    cudaEventCreate(&t_start);
+    cudaEventCreate(&t_end);
+    cudaEventRecord(t_start, stream);
+  }
+  int n = m->num_experts;
+  size_t expert_size = (size_t)out_dim * rows;
+  size_t kernel_size = (size_t)in_dim * out_dim;
+  float *ptrs[NUM_PTR_ARRAYS * MAX_NUM_INPUTS];
+  float **dev_inputs = m->dev_ptrs;
+  float **dev_kernels = m->dev_ptrs + n;
+  float **dev_activations = m->dev_ptrs + 2 * n;
+  float **dev_output_grads = m->dev_ptrs + 3 * n;
+  float **dev_input_grads = m->dev_ptrs + 4 * n;
+  float **dev_kernel_grads = m->dev_ptrs + 5 * n;
+  for (int i = 0; i < n; i++) {
+    ptrs[i] = const_cast<float *>(inputs[i]);
+    ptrs[n + i] = const_cast<float *>(kernel) + i * kernel_size;
+    ptrs[2 * n + i] = m->activations != nullptr
+                          ? m->activations + i * expert_size
+                          : const_cast<float *>(outputs[i]);
+    ptrs[3 * n + i] = output_grads[i];
+    ptrs[4 * n + i] = input_grads[i];
+    ptrs[5 * n + i] = kernel_grad + i * kernel_size;
+  }
+  checkCUDA(cudaMemcpyAsync(m->dev_ptrs,
+                            ptrs,
+                            NUM_PTR_ARRAYS * n * sizeof(float *),
+                            cudaMemcpyHostToDevice,
+                            stream));
+
+  // Like Softmax, the gradients of the softmax are passed through unchanged
+  if (m->activation != AC_MODE_NONE) {
+    size_t num_elements = expert_size * n;
+    experts_activation_backward_kernel<<<GET_BLOCKS(num_elements),
+                                         CUDA_NUM_THREADS,
+                                         0,
+                                         stream>>>(dev_output_grads,
+                                                   dev_activations,
+                                                   m->activation,
+                                                   expert_size,
+                                                   num_elements);
+  }
+  // NOTE: we use alpha=1 for all gradients to accumulate them
+  float alpha = 1.0f;
+  checkCUDA(cublasSgemmBatched(m->handle.blas,
+                               CUBLAS_OP_N,
+                               CUBLAS_OP_T,
+                               in_dim,
+                               out_dim,
+                               rows,
+                               &alpha,
+                               dev_inputs,
+                               in_dim,
+                               dev_output_grads,
+                               out_dim,
+                               &alpha,
+                               dev_kernel_grads,
+                               in_dim,
+                               n));
+  if (bias_grad != nullptr) {
+    experts_bias_backward_kernel<<<GET_BLOCKS(out_dim * n),
+                                   CUDA_NUM_THREADS,
+                                   0,
+                                   stream>>>(
+        dev_output_grads, bias_grad, out_dim, rows, out_dim * n);
+  }
+  checkCUDA(cublasSgemmBatched(m->handle.blas,
+                               CUBLAS_OP_N,
+                               CUBLAS_OP_N,
+                               in_dim,
+                               rows,
+                               out_dim,
+                               &alpha,
+                               dev_kernels,
+                               in_dim,
+                               dev_output_grads,
+                               out_dim,
+                               &alpha,
+                               dev_input_grads,
+                               in_dim,
+                               n));
+  if (m->profiling) {
+    cudaEventRecord(t_end, stream);
+    checkCUDA(cudaEventSynchronize(t_end));
+    float elapsed = 0;
+    checkCUDA(cudaEventElapsedTime(&elapsed, t_start, t_end));
+    cudaEventDestroy(t_start);
+    cudaEventDestroy(t_end);
+    printf("[Experts] backward time = %.2lfms\n", elapsed);
+  }
+}
+
+// Offsets of the experts in ExpertsMeta::dev_offsets, followed by those of
+// their tiles
+static void experts_get_offsets(ExpertsMeta const *m,
+                                int const *exp_assign,
+                                int rows,
+                                cudaStream_t stream) {
+  experts_offsets_kernel<<<1, CUDA_NUM_THREADS, 0, stream>>>(
+      exp_assign,
+      rows,
+      m->num_experts,
+      m->dev_offsets,
+      m->dev_offsets + m->num_experts + 1);
+}
+
+/*static*/
+void Experts::forward_dropless_kernel_wrapper(ExpertsMeta const *m,
+                                              float const *input,
+                                              int const *exp_assign,
+                                              float *output,
+                                              float const *kernel,
+                                              float const *bias,
+                                              int in_dim,
+                                              int out_dim,
+                                              int rows) {
+  cudaStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  checkCUDA(cublasSetStream(m->handle.blas, stream));
+  cudaEvent_t t_start, t_end;
+  if (m->profiling) {
+    cudaEventCreate(&t_start);
+    cudaEventCreate(&t_end);
+    cudaEventRecord(t_start, stream);
+  }
+  int n = m->num_experts;
+  size_t kernel_size = (size_t)in_dim * out_dim;
+  experts_get_offsets(m, exp_assign, rows, stream);
+  float *activations = m->activations != nullptr ? m->activations : output;
+
+  // The experts have at most this many tiles of rows in all
+  int max_tiles = (rows + EXPERTS_TILE - 1) / EXPERTS_TILE + n;
+  dim3 block(EXPERTS_TILE, EXPERTS_TILE);
+  dim3 grid((out_dim + EXPERTS_TILE - 1) / EXPERTS_TILE, max_tiles);
+  experts_grouped_gemm_kernel<<<grid, block, 0, stream>>>(
+      input,
+      kernel,
+      activations,
+      m->dev_offsets,
+      m->dev_offsets + n + 1,
+      n,
+      in_dim,
+      out_dim,
+      kernel_size,
+      1,
+      in_dim,
+      0.0f);
+  if (bias != nullptr || m->activation != AC_MODE_NONE) {
+    size_t num_elements = (size_t)out_dim * rows;
+    experts_packed_bias_activation_kernel<<<GET_BLOCKS(num_elements),
+                                            CUDA_NUM_THREADS,
+                                            0,
+                                            stream>>>(activations,
+                                                      bias,
+                                                      m->dev_offsets,
+                                                      m->activation,
+                                                      out_dim,
+                                                      num_elements);
+  }
+  if (m->apply_softmax) {
+    experts_packed_softmax_kernel<<<GET_BLOCKS(rows),
+                                    CUDA_NUM_THREADS,
+                                    0,
+                                    stream>>>(
+        activations, output, out_dim, rows);
+  }
+  if (m->profiling) {
+    cudaEventRecord(t_end, stream);
+    checkCUDA(cudaEventSynchronize(t_end));
+    float elapsed = 0;
+    checkCUDA(cudaEventElapsedTime(&elapsed, t_start, t_end));
+    cudaEventDestroy(t_start);
+    cudaEventDestroy(t_end);
+    printf("[Experts] forward time = %.2lfms\n", elapsed);
+  }
+}
+
+/*static*/
+void Experts::backward_dropless_kernel_wrapper(ExpertsMeta const *m,
+                                               float const *input,
+                                               float *input_grad,
+                                               float const *output,
+                                               float *output_grad,
+                                               int const *exp_assign,
+                                               float const *kernel,
+                                               float *kernel_grad,
+                                               float *bias_grad,
+                                               int in_dim,
+                                               int out_dim,
+                                               int rows) {
+  cudaStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  checkCUDA(cublasSetStream(m->handle.blas, stream));
+  cudaEvent_t t_start, t_end;
+  if (m->profiling) {
+    cudaEventCreate(&t_start);
+    cudaEventCreate(&t_end);
+    cudaEventRecord(t_start, stream);
+  }
+  int n = m->num_experts;
+  size_t kernel_size = (size_t)in_dim * out_dim;
+  experts_get_offsets(m, exp_assign, rows, stream);
+  float const *activations =
+      m->activations != nullptr ? m->activations : output;
+
+  // Like Softmax, the gradients of the softmax are passed through unchanged
+  if (m->activation != AC_MODE_NONE) {
+    size_t num_elements = (size_t)out_dim * rows;
+    experts_packed_activation_backward_kernel<<<GET_BLOCKS(num_elements),
+                                                CUDA_NUM_THREADS,
+                                                0,
+                                                stream>>>(
+        output_grad, activations, m->activation, num_elements);
+  }
+  if (bias_grad != nullptr) {
+    experts_packed_bias_backward_kernel<<<GET_BLOCKS(out_dim * n),
+                                          CUDA_NUM_THREADS,
+                                          0,
+                                          stream>>>(
+        output_grad, bias_grad, m->dev_offsets, out_dim, out_dim * n);
+  }
+  // NOTE: we accumulate all gradients
+  dim3 block(EXPERTS_TILE, EXPERTS_TILE);
+  dim3 weight_grid((in_dim + EXPERTS_TILE - 1) / EXPERTS_TILE,
+                   (out_dim + EXPERTS_TILE - 1) / EXPERTS_TILE,
+                   n);
+  experts_grouped_weight_grad_kernel<<<weight_grid, block, 0, stream>>>(
+      input, output_grad, kernel_grad, m->dev_offsets, in_dim, out_dim);
+  int max_tiles = (rows + EXPERTS_TILE - 1) / EXPERTS_TILE + n;
+  dim3 input_grid((in_dim + EXPERTS_TILE - 1) / EXPERTS_TILE, max_tiles);
+  experts_grouped_gemm_kernel<<<input_grid, block, 0, stream>>>(
+      output_grad,
+      kernel,
+      input_grad,
+      m->dev_offsets,
+      m->dev_offsets + n + 1,
+      n,
+      out_dim,
+      in_dim,
+      kernel_size,
+      in_dim,
+      1,
+      1.0f);
+  if (m->profiling) {
+    cudaEventRecord(t_end, stream);
+    checkCUDA(cudaEventSynchronize(t_end));
+    float elapsed = 0;
+    checkCUDA(cudaEventElapsedTime(&elapsed, t_start, t_end));
+    cudaEventDestroy(t_start);
+    cudaEventDestroy(t_end);
+    printf("[Experts] backward time = %.2lfms\n", elapsed);
+  }
+}
+
+/*static*/
+void Experts::even_assignment_kernel_wrapper(int *exp_assign,
+                                             int num_experts,
+                                             int rows) {
+  cudaStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  experts_even_assign_kernel<<<GET_BLOCKS(rows),
+                               CUDA_NUM_THREADS,
+                               0,
+                               stream>>>(exp_assign, num_experts, rows);
+}
+
+ExpertsMeta::ExpertsMeta(FFHandler handler, Experts const *experts, int rows)
+    : OpMeta(handler, experts), num_experts(experts->num_experts),
+      activation(experts->activation), use_bias(experts->use_bias),
+      apply_softmax(experts->apply_softmax), dropless(experts->dropless),
+      activations(nullptr), dev_offsets(nullptr) {
+  assert(num_experts <= MAX_NUM_INPUTS);
+  checkCUDA(
+      cudaMalloc(&dev_ptrs, NUM_PTR_ARRAYS * num_experts * sizeof(float *)));
+  // The softmax overwrites the activations the backward pass differentiates;
+  // a dropless layer keeps the packed rows of all experts in one buffer
+  if (apply_softmax && activation != AC_MODE_NONE) {
+    checkCUDA(cudaMalloc(&activations,
+                         (size_t)(dropless ? 1 : num_experts) *
+                             experts->out_dim * rows * sizeof(float)));
+  }
+  if (dropless) {
+    checkCUDA(
+        cudaMalloc(&dev_offsets, 2 * (num_experts + 1) * sizeof(int)));
+  }
+}
+
+ExpertsMeta::~ExpertsMeta(void) {
+  checkCUDA(cudaFree(dev_ptrs));
+  if (activations != nullptr) {
+    checkCUDA(cudaFree(activations));
+  }
+  if (dev_offsets != nullptr) {
+    checkCUDA(cudaFree(dev_offsets));
+  }
+}
+
+}; // namespace FlexFlow
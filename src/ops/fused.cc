@@ -53,6 +53,8 @@ FusedOp::FusedOp(FFModel &model, Op *op)
          0 /*weights*/,
          0 /*outputs*/) {
   numInputs = 0;
+  op_input_source.resize(op->numInputs);
+  op_input_idx.resize(op->numInputs);
   for (int i = 0; i < op->numInputs; i++) {
     bool found = false;
     // we also need to check region duplicate for the first op in a fused op
@@ -95,25 +97,36 @@ FusedOp::FusedOp(FFModel &model, Op *op)
     output_data_types[i] = op->outputs[i]->data_type;
   }
   numOperators = 1;
-  op_num_inputs[0] = op->numInputs;
-  op_num_weights[0] = op->numWeights;
-  op_num_outputs[0] = op->numOutputs;
-  op_op_type[0] = op->op_type;
-  operators[0] = op;
+  op_num_inputs.push_back(op->numInputs);
+  op_num_weights.push_back(op->numWeights);
+  op_num_outputs.push_back(op->numOutputs);
+  op_op_type.push_back(op->op_type);
+  operators.push_back(op);
   // for (int i = 0; i < numInputs; i++) {
   //   op_input_source[i] = SOURCE_INPUT;
   //   op_input_idx[i] = i;
   // }
   for (int i = 0; i < numWeights; i++) {
-    op_weight_source[i] = SOURCE_WEIGHT;
-    op_weight_idx[i] = i;
+    op_weight_source.push_back(SOURCE_WEIGHT);
+    op_weight_idx.push_back(i);
   }
   for (int i = 0; i < numOutputs; i++) {
-    op_output_source[i] = SOURCE_OUTPUT;
-    op_output_idx[i] = i;
+    op_output_source.push_back(SOURCE_OUTPUT);
+    op_output_idx.push_back(i);
   }
 }
 
+static bool has_region(ParallelTensor const tensors[],
+                       int num_tensors,
+                       LogicalRegion const &region) {
+  for (int i = 0; i < num_tensors; i++) {
+    if (tensors[i]->region == region) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool FusedOp::add_operator(FFModel &model, Op *op) {
   // Context ctx = model.config.lg_ctx;
   // Runtime* runtime = model.config.lg_hlr;
@@ -139,22 +152,44 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
   } else {
     return false;
   }
-  int input_offset = 0, weight_offset = 0, output_offset = 0;
-  for (int i = 0; i < numOperators; i++) {
-    input_offset += op_num_inputs[i];
-    weight_offset += op_num_weights[i];
-    output_offset += op_num_outputs[i];
+  // Check the #inputs, #weights and #outputs limits before changing anything,
+  // so that a FusedOp op cannot be added to is left as it was
+  int new_inputs = 0, new_weights = 0, new_outputs = 0;
+  for (int i = 0; i < op->numInputs; i++) {
+    LogicalRegion region = op->inputs[i]->region;
+    if (!has_region(inputs, numInputs, region) &&
+        !has_region(outputs, numOutputs, region) &&
+        !has_region(op->inputs, i, region)) {
+      new_inputs++;
+    }
+  }
+  for (int i = 0; i < op->numWeights; i++) {
+    LogicalRegion region = op->weights[i]->region;
+    if (!has_region(weights, numWeights, region)) {
+      new_weights++;
+    }
   }
-  if ((input_offset + op->numInputs > MAX_NUM_FUSED_TENSORS) ||
-      (weight_offset + op->numWeights > MAX_NUM_FUSED_TENSORS) ||
-      (output_offset + op->numOutputs > MAX_NUM_FUSED_TENSORS)) {
-    fprintf(stderr, "Cannot fuse. Consider increase MAX_NUM_FUSED_TENSORS\n");
+  for (int i = 0; i < op->numOutputs; i++) {
+    if (!has_region(outputs, numOutputs, op->outputs[i]->region)) {
+      new_outputs++;
+    }
+  }
+  if (numInputs + new_inputs > MAX_NUM_INPUTS) {
+    fprintf(stderr,
+            "Reach to the #inputs limit during fusion.\n"
+            "Consider increase MAX_NUM_INPUTS to allow more fusions.\n");
     return false;
   }
-  if (numOperators + 1 > MAX_NUM_FUSED_OPERATORS) {
-    fprintf(
-        stderr,
-        "Reach to the fusion limit. Consider increase MAX_NUM_FUSED_OPERATORS");
+  if (numWeights + new_weights > MAX_NUM_WEIGHTS) {
+    fprintf(stderr,
+            "Reach to the #weights limit during fusion.\n"
+            "Consider increase MAX_NUM_WEIGHTS to allow more fusions.\n");
+    return false;
+  }
+  if (numOutputs + new_outputs > MAX_NUM_OUTPUTS) {
+    fprintf(stderr,
+            "Reach to the #outputs limit during fusion.\n"
+            "Consider increase MAX_NUM_OUTPUTS to allow more fusions.\n");
     return false;
   }
   // Set inputs
@@ -165,8 +200,8 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
         // This input is one of my inputs
         assert(!found);
         assert(inputs[j]->region != LogicalRegion::NO_REGION);
-        op_input_source[input_offset + i] = SOURCE_INPUT;
-        op_input_idx[input_offset + i] = j;
+        op_input_source.push_back(SOURCE_INPUT);
+        op_input_idx.push_back(j);
         found = true;
         break;
       }
@@ -176,8 +211,8 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
         // This input is one of my outputs
         assert(!found);
         assert(outputs[j]->region != LogicalRegion::NO_REGION);
-        op_input_source[input_offset + i] = SOURCE_OUTPUT;
-        op_input_idx[input_offset + i] = j;
+        op_input_source.push_back(SOURCE_OUTPUT);
+        op_input_idx.push_back(j);
         found = true;
         break;
       }
@@ -189,8 +224,8 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
       input_data_types[numInputs] = op->inputs[i]->data_type;
       // input_lps[numInputs] = op->input_lps[i];
       // input_grad_lps[numInputs] = op->input_grad_lps[i];
-      op_input_source[input_offset + i] = SOURCE_INPUT;
-      op_input_idx[input_offset + i] = numInputs;
+      op_input_source.push_back(SOURCE_INPUT);
+      op_input_idx.push_back(numInputs);
       numInputs += 1;
     }
   }
@@ -201,8 +236,8 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
       if (weights[j]->region == op->weights[i]->region) {
         assert(!found);
         assert(weights[j]->region != LogicalRegion::NO_REGION);
-        op_weight_source[weight_offset + i] = SOURCE_WEIGHT;
-        op_weight_idx[weight_offset + i] = j;
+        op_weight_source.push_back(SOURCE_WEIGHT);
+        op_weight_idx.push_back(j);
         found = true;
         break;
       }
@@ -214,8 +249,8 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
       // weights[numWeights]->owner_op = this;
       // weights[numWeights]->owner_idx = numWeights;
       weight_data_types[numWeights] = op->weights[i]->data_type;
-      op_weight_source[weight_offset + i] = SOURCE_WEIGHT;
-      op_weight_idx[weight_offset + i] = numWeights;
+      op_weight_source.push_back(SOURCE_WEIGHT);
+      op_weight_idx.push_back(numWeights);
       numWeights += 1;
     }
   }
@@ -226,8 +261,8 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
       if (outputs[j]->region == op->outputs[i]->region) {
         assert(!found);
         found = true;
-        op_output_source[output_offset + i] = SOURCE_OUTPUT;
-        op_output_idx[output_offset + i] = j;
+        op_output_source.push_back(SOURCE_OUTPUT);
+        op_output_idx.push_back(j);
       }
     }
     if (found) {
@@ -237,40 +272,93 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
     outputs[numOutputs]->owner_op = this;
     outputs[numOutputs]->owner_idx = numOutputs;
     output_data_types[numOutputs] = op->outputs[i]->data_type;
-    op_output_source[output_offset + i] = SOURCE_OUTPUT;
-    op_output_idx[output_offset + i] = numOutputs;
+    op_output_source.push_back(SOURCE_OUTPUT);
+    op_output_idx.push_back(numOutputs);
     numOutputs += 1;
   }
   assert(op->numInputs > 0);
   assert(op->numWeights >= 0);
   assert(op->numOutputs > 0);
-  op_num_inputs[numOperators] = op->numInputs;
-  op_num_weights[numOperators] = op->numWeights;
-  op_num_outputs[numOperators] = op->numOutputs;
-  op_op_type[numOperators] = op->op_type;
-  operators[numOperators] = op;
+  assert(numInputs <= MAX_NUM_INPUTS);
+  assert(numWeights <= MAX_NUM_WEIGHTS);
+  assert(numOutputs <= MAX_NUM_OUTPUTS);
+  op_num_inputs.push_back(op->numInputs);
+  op_num_weights.push_back(op->numWeights);
+  op_num_outputs.push_back(op->numOutputs);
+  op_op_type.push_back(op->op_type);
+  operators.push_back(op);
   numOperators += 1;
-  assert(numOperators <= MAX_NUM_FUSED_OPERATORS);
-  if (numInputs > MAX_NUM_INPUTS) {
-    fprintf(stderr,
-            "Reach to the #inputs limit during fusion.\n"
-            "Consider increase MAX_NUM_INPUTS to allow more fusions.\n");
-    return false;
-  }
-  if (numWeights > MAX_NUM_WEIGHTS) {
-    fprintf(stderr,
-            "Reach to the #weights limit during fusion.\n"
-            "Consider increase MAX_NUM_WEIGHTS to allow more fusions.\n");
-    return false;
-  }
-  if (numOutputs > MAX_NUM_OUTPUTS) {
-    fprintf(stderr,
-            "Reach to the #outputs limit during fusion.\n"
-            "Consider increase MAX_NUM_OUTPUTS to allow more fusions.\n");
-  }
   return true;
 }
 
+void FusedOp::serialize_layout(Legion::Serializer &sez) const {
+  sez.serialize(iter_config);
+  sez.serialize(numInputs);
+  sez.serialize(numWeights);
+  sez.serialize(numOutputs);
+  sez.serialize(numOperators);
+  sez.serialize(input_data_types, numInputs * sizeof(DataType));
+  sez.serialize(weight_data_types, numWeights * sizeof(DataType));
+  sez.serialize(output_data_types, numOutputs * sizeof(DataType));
+  sez.serialize(op_num_inputs.data(), numOperators * sizeof(int));
+  sez.serialize(op_num_weights.data(), numOperators * sizeof(int));
+  sez.serialize(op_num_outputs.data(), numOperators * sizeof(int));
+  sez.serialize(op_op_type.data(), numOperators * sizeof(OperatorType));
+  sez.serialize(op_input_source.size());
+  sez.serialize(op_input_source.data(),
+                op_input_source.size() * sizeof(SourceType));
+  sez.serialize(op_input_idx.data(), op_input_idx.size() * sizeof(int));
+  sez.serialize(op_weight_source.size());
+  sez.serialize(op_weight_source.data(),
+                op_weight_source.size() * sizeof(SourceType));
+  sez.serialize(op_weight_idx.data(), op_weight_idx.size() * sizeof(int));
+  sez.serialize(op_output_source.size());
+  sez.serialize(op_output_source.data(),
+                op_output_source.size() * sizeof(SourceType));
+  sez.serialize(op_output_idx.data(), op_output_idx.size() * sizeof(int));
+}
+
+void FusedOpLayout::deserialize(Legion::Deserializer &dez) {
+  dez.deserialize(iter_config);
+  dez.deserialize(numInputs);
+  dez.deserialize(numWeights);
+  dez.deserialize(numOutputs);
+  dez.deserialize(numOperators);
+  assert(numInputs <= MAX_NUM_INPUTS);
+  assert(numWeights <= MAX_NUM_WEIGHTS);
+  assert(numOutputs <= MAX_NUM_OUTPUTS);
+  dez.deserialize(input_data_types, numInputs * sizeof(DataType));
+  dez.deserialize(weight_data_types, numWeights * sizeof(DataType));
+  dez.deserialize(output_data_types, numOutputs * sizeof(DataType));
+  op_num_inputs.resize(numOperators);
+  op_num_weights.resize(numOperators);
+  op_num_outputs.resize(numOperators);
+  op_op_type.resize(numOperators);
+  dez.deserialize(op_num_inputs.data(), numOperators * sizeof(int));
+  dez.deserialize(op_num_weights.data(), numOperators * sizeof(int));
+  dez.deserialize(op_num_outputs.data(), numOperators * sizeof(int));
+  dez.deserialize(op_op_type.data(), numOperators * sizeof(OperatorType));
+  size_t num_tensors;
+  dez.deserialize(num_tensors);
+  op_input_source.resize(num_tensors);
+  op_input_idx.resize(num_tensors);
+  dez.deserialize(op_input_source.data(),
+                  num_tensors * sizeof(FusedOp::SourceType));
+  dez.deserialize(op_input_idx.data(), num_tensors * sizeof(int));
+  dez.deserialize(num_tensors);
+  op_weight_source.resize(num_tensors);
+  op_weight_idx.resize(num_tensors);
+  dez.deserialize(op_weight_source.data(),
+                  num_tensors * sizeof(FusedOp::SourceType));
+  dez.deserialize(op_weight_idx.data(), num_tensors * sizeof(int));
+  dez.deserialize(num_tensors);
+  op_output_source.resize(num_tensors);
+  op_output_idx.resize(num_tensors);
+  dez.deserialize(op_output_source.data(),
+                  num_tensors * sizeof(FusedOp::SourceType));
+  dez.deserialize(op_output_idx.data(), num_tensors * sizeof(int));
+}
+
 void FusedOp::init(FFModel const &ff) {
   assert(check_output_input_weight_same_parallel_is());
   parallel_is = outputs[0]->parallel_is;
@@ -281,21 +369,23 @@ void FusedOp::init(FFModel const &ff) {
   Domain domain = runtime->get_index_space_domain(ctx, parallel_is);
   for (int i = 0; i < numOperators; i++) {
     operators[i]->init(ff);
-    for (size_t j = 0; j < domain.get_volume(); j++) {
-      fused_meta[j].meta[i] = operators[i]->meta[j];
-    }
-  }
-  for (size_t j = 0; j < domain.get_volume(); j++) {
-    fused_meta[j].numOperators = numOperators;
   }
+  // Each point gets the OpMetas of the fused operators on its device; the
+  // argument map copies them
+  std::vector<OpMeta *> point_metas(numOperators);
   switch (domain.get_dim()) {
 #define DIMFUNC(DIM)                                                           \
   case DIM: {                                                                  \
     Rect<DIM> rect = domain;                                                   \
     int idx = 0;                                                               \
     for (PointInRectIterator<DIM> it(rect); it(); it++) {                      \
+      for (int i = 0; i < numOperators; i++) {                                 \
+        point_metas[i] = operators[i]->meta[idx];                              \
+      }                                                                        \
+      idx++;                                                                   \
       argmap.set_point(*it,                                                    \
-                       TaskArgument(&fused_meta[idx++], sizeof(FusedOpMeta))); \
+                       TaskArgument(point_metas.data(),                        \
+                                    point_metas.size() * sizeof(OpMeta *)));   \
     }                                                                          \
     break;                                                                     \
   }
@@ -304,9 +394,11 @@ void FusedOp::init(FFModel const &ff) {
     default:
       assert(false);
   }
+  Legion::Serializer sez;
+  serialize_layout(sez);
   IndexLauncher launcher(FUSEDOP_INIT_TASK_ID,
                          parallel_is,
-                         TaskArgument(this, sizeof(FusedOp)),
+                         TaskArgument(sez.get_buffer(), sez.get_used_bytes()),
                          argmap,
                          Predicate::TRUE_PRED,
                          false /*must*/,
@@ -389,7 +481,7 @@ void FusedOp::backward(FFModel const &ff) {
   set_argumentmap_for_backward(ff, argmap);
   IndexLauncher launcher(FUSEDOP_BWD_TASK_ID,
                          parallel_is,
-                         TaskArgument(this, sizeof(FusedOp)),
+                         TaskArgument(NULL, 0),
                          argmap,
                          Predicate::TRUE_PRED,
                          false /*must*/,
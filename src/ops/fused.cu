@@ -48,14 +48,13 @@ OpMeta *FusedOp::init_task(Task const *task,
                            std::vector<PhysicalRegion> const &regions,
                            Context ctx,
                            Runtime *runtime) {
-  FusedOp const *fused = (FusedOp *)task->args;
-  FusedOpMeta const *metas = (FusedOpMeta *)task->local_args;
   FusedOpMeta *local_meta = new FusedOpMeta();
-  memcpy(local_meta, metas, sizeof(FusedOpMeta));
-  local_meta->fused_op = (FusedOp *)malloc(sizeof(FusedOp));
-  memcpy(static_cast<void *>(local_meta->fused_op),
-         static_cast<void const *>(fused),
-         sizeof(FusedOp));
+  Legion::Deserializer dez(task->args, task->arglen);
+  local_meta->fused_op.deserialize(dez);
+  OpMeta *const *metas = (OpMeta *const *)task->local_args;
+  local_meta->numOperators = task->local_arglen / sizeof(OpMeta *);
+  assert(local_meta->numOperators == local_meta->fused_op.numOperators);
+  local_meta->meta.assign(metas, metas + local_meta->numOperators);
   return ((OpMeta *)local_meta);
 }
 
@@ -70,7 +69,7 @@ __host__ void FusedOp::forward_task(Task const *task,
                                     Runtime *runtime) {
   // const FusedOp* fused = (FusedOp*) task->args;
   FusedOpMeta const *metas = *((FusedOpMeta **)task->local_args);
-  FusedOp const *fused = metas->fused_op;
+  FusedOpLayout const *fused = &metas->fused_op;
   assert(metas->numOperators == fused->numOperators);
   assert(regions.size() == task->regions.size());
   assert((int)regions.size() ==
@@ -466,7 +465,7 @@ __host__ void FusedOp::backward_task(Task const *task,
                                      Runtime *runtime) {
   // const FusedOp* fused = (FusedOp*) task->args;
   FusedOpMeta const *metas = *((FusedOpMeta **)task->local_args);
-  FusedOp const *fused = metas->fused_op;
+  FusedOpLayout const *fused = &metas->fused_op;
 
   assert(metas->numOperators == fused->numOperators);
   assert(regions.size() == task->regions.size());
@@ -17,6 +17,7 @@
 #include "flexflow/ops/groupby.h"
 #include "flexflow/utils/hash_utils.h"
 #include "legion/legion_utilities.h"
+#include <algorithm>
 #include <math.h>
 #include <stdio.h>
 
@@ -74,6 +75,7 @@ void FFModel::group_by(const Tensor input,
   }
   li->add_int_property("n", n);
   li->add_float_property("alpha", alpha);
+  li->add_int_property("dropless", false);
   layers.push_back(li);
   for (int i = 0; i < n; i++) {
     assert(li->outputs[i] != nullptr);
@@ -82,6 +84,39 @@ void FFModel::group_by(const Tensor input,
   }
 }
 
+Tensor FFModel::group_by_dropless(const Tensor input,
+                                  const Tensor assign,
+                                  int n,
+                                  char const *name) {
+  Layer *li = new Layer(this,
+                        OP_GROUP_BY,
+                        DT_FLOAT,
+                        name,
+                        2 /*inputs*/,
+                        0 /*weights*/,
+                        1 /*outputs*/,
+                        input,
+                        assign);
+  {
+    int k = assign->dims[0];
+    int num_dims = input->num_dims;
+    int dims[num_dims];
+    for (int i = 0; i < num_dims - 1; i++) {
+      dims[i] = input->dims[i];
+    }
+    // Every token is routed to k experts, so the packed tokens of all experts
+    // fill exactly k rows per sample
+    dims[num_dims - 1] = k * input->dims[num_dims - 1];
+    li->outputs[0] = create_tensor_legion_ordering(
+        num_dims, dims, input->data_type, li, 0, true /*create_grad*/);
+  }
+  li->add_int_property("n", n);
+  li->add_float_property("alpha", 0.0f);
+  li->add_int_property("dropless", true);
+  layers.push_back(li);
+  return li->outputs[0];
+}
+
 Op *Group_by::create_operator_from_layer(
     FFModel &model,
     Layer const *layer,
@@ -92,13 +127,17 @@ Op *Group_by::create_operator_from_layer(
   float value2;
   layer->get_float_property("alpha", value2);
   float alpha = value2;
-  return new Group_by(model, inputs[0], inputs[1], n, alpha, layer->name);
+  layer->get_int_property("dropless", value1);
+  bool dropless = (bool)value1;
+  return new Group_by(
+      model, inputs[0], inputs[1], n, alpha, dropless, layer->name);
 }
 
 Group_byParams Group_by::get_params() const {
   Group_byParams params;
   params.n = this->n;
   params.alpha = this->alpha;
+  params.dropless = this->dropless;
   return params;
 }
 
@@ -109,7 +148,8 @@ bool Group_byParams::is_valid(
 }
 
 bool operator==(Group_byParams const &lhs, Group_byParams const &rhs) {
-  return lhs.n == rhs.n && lhs.alpha == rhs.alpha;
+  return lhs.n == rhs.n && lhs.alpha == rhs.alpha &&
+         lhs.dropless == rhs.dropless;
 }
 
 Group_by::Group_by(FFModel &model,
@@ -117,6 +157,7 @@ Group_by::Group_by(FFModel &model,
                    const ParallelTensor _assign,
                    int _n,
                    float _alpha,
+                   bool _dropless,
                    char const *name)
     : Op(model,
          OP_GROUP_BY,
@@ -124,10 +165,10 @@ Group_by::Group_by(FFModel &model,
          name,
          2 /*inputs*/,
          0 /*weights*/,
-         _n /*outputs*/,
+         _dropless ? 1 : _n /*outputs*/,
          _input,
          _assign),
-      n(_n), alpha(_alpha) {
+      n(_n), alpha(_alpha), dropless(_dropless) {
   assert(_input->dims[1] == _assign->dims[1]);
   assert(n > 0);
   assert(inputs[0] != nullptr);
@@ -139,10 +180,16 @@ Group_by::Group_by(FFModel &model,
   for (int i = 0; i < num_dims; i++) {
     dims[i] = inputs[0]->dims[i];
   }
-  // replace batch size with max expert size
-  dims[num_dims - 2].size = (int)ceil(alpha * k / n * inputs[0]->dims[1].size);
+  if (dropless) {
+    // replace batch size with the packed tokens of all experts
+    dims[num_dims - 2].size = k * inputs[0]->dims[1].size;
+  } else {
+    // replace batch size with max expert size
+    dims[num_dims - 2].size =
+        (int)ceil(alpha * k / n * inputs[0]->dims[1].size);
+  }
 
-  for (int i = 0; i < n; i++) {
+  for (int i = 0; i < numOutputs; i++) {
     outputs[i] = model.create_parallel_tensor_legion_ordering(
         num_dims, dims, DT_FLOAT, this, i /*owner_idx*/);
     assert(outputs[i] != nullptr);
@@ -155,14 +202,25 @@ Group_by::Group_by(FFModel &model,
                    Group_by const &other,
                    const ParallelTensor input,
                    const ParallelTensor assign)
-    : Group_by(model, input, assign, other.n, other.alpha, other.name) {}
+    : Group_by(model,
+               input,
+               assign,
+               other.n,
+               other.alpha,
+               other.dropless,
+               other.name) {}
 
 Group_by::Group_by(FFModel &model,
                    Group_byParams const &params,
                    std::pair<ParallelTensor, ParallelTensor> const &inputs,
                    char const *name)
-    : Group_by(
-          model, inputs.first, inputs.second, params.n, params.alpha, name) {}
+    : Group_by(model,
+               inputs.first,
+               inputs.second,
+               params.n,
+               params.alpha,
+               params.dropless,
+               name) {}
 
 void Group_by::init(FFModel const &ff) {
   assert(check_output_input_weight_same_parallel_is());
@@ -195,7 +253,7 @@ void Group_by::init(FFModel const &ff) {
   launcher.add_field(1, FID_DATA);
 
   // output
-  for (int i = 0; i < n; i++) {
+  for (int i = 0; i < numOutputs; i++) {
     launcher.add_region_requirement(RegionRequirement(outputs[i]->part,
                                                       0 /*projection id*/,
                                                       WRITE_ONLY,
@@ -216,6 +274,7 @@ OpMeta *Group_by::init_task(Task const *task,
   FFHandler handle = *((FFHandler *)task->local_args);
   GroupByMeta *m = new GroupByMeta(handle, gb->n);
   m->profiling = gb->profiling;
+  m->dropless = gb->dropless;
   return m;
 }
 
@@ -249,7 +308,7 @@ void Group_by::forward(FFModel const &ff) {
   launcher.add_field(1, FID_DATA);
 
   // output
-  for (int i = 0; i < n; i++) {
+  for (int i = 0; i < numOutputs; i++) {
     launcher.add_region_requirement(RegionRequirement(outputs[i]->part,
                                                       0 /*projection id*/,
                                                       WRITE_ONLY,
@@ -269,9 +328,10 @@ void Group_by::forward_task(Task const *task,
   Group_by const *gb = (Group_by *)task->args;
   int n = gb->n;
   float alpha = gb->alpha;
+  int num_outputs = gb->dropless ? 1 : n;
 
-  assert((int)regions.size() == n + 2);
-  assert((int)task->regions.size() == n + 2);
+  assert((int)regions.size() == num_outputs + 2);
+  assert((int)task->regions.size() == num_outputs + 2);
 
   GroupByMeta const *m = *((GroupByMeta **)task->local_args);
 
@@ -296,9 +356,10 @@ void Group_by::forward_task(Task const *task,
   // Create a vector of n outputs, where n is the number of experts.
   // Each entry in the "outputs" vector points to the Legion tensor that will
   // contain the tockens dispatched to the corresponding expert
-  float *outputs[n];
-  int exp_output_rows = (int)ceil(alpha * k / n * batch_size);
-  for (int i = 0; i < n; i++) {
+  float *outputs[num_outputs];
+  int exp_output_rows = gb->dropless ? k * batch_size
+                                     : (int)ceil(alpha * k / n * batch_size);
+  for (int i = 0; i < num_outputs; i++) {
     Domain out_domain = runtime->get_index_space_domain(
         ctx, task->regions[i + 2].region.get_index_space());
     outputs[i] = helperGetTensorPointerWO<float>(
@@ -352,7 +413,7 @@ void Group_by::backward(FFModel const &ff) {
   launcher.add_field(1, FID_DATA);
 
   // output grad
-  for (int i = 0; i < n; i++) {
+  for (int i = 0; i < numOutputs; i++) {
     launcher.add_region_requirement(RegionRequirement(outputs[i]->part_grad,
                                                       0 /*projection id*/,
                                                       WRITE_ONLY,
@@ -373,9 +434,10 @@ void Group_by::backward_task(Task const *task,
   Group_by const *gb = (Group_by *)task->args;
   int n = gb->n;
   float alpha = gb->alpha;
+  int num_outputs = gb->dropless ? 1 : n;
 
-  assert((int)regions.size() == n + 2);
-  assert((int)task->regions.size() == n + 2);
+  assert((int)regions.size() == num_outputs + 2);
+  assert((int)task->regions.size() == num_outputs + 2);
 
   // get input and assign regions
   AccessorWO<float, 3> const acc_input_grad(regions[0], FID_DATA);
@@ -395,9 +457,10 @@ void Group_by::backward_task(Task const *task,
   int data_dim = input_cols;
 
   // get output
-  float *output_grads[n];
-  int exp_output_rows = (int)ceil(alpha * k / n * batch_size);
-  for (int i = 0; i < n; i++) {
+  float *output_grads[num_outputs];
+  int exp_output_rows = gb->dropless ? k * batch_size
+                                     : (int)ceil(alpha * k / n * batch_size);
+  for (int i = 0; i < num_outputs; i++) {
     Domain out_domain = runtime->get_index_space_domain(
         ctx, task->regions[i + 2].region.get_index_space());
     output_grads[i] = helperGetTensorPointerRW<float>(
@@ -420,9 +483,95 @@ void Group_by::backward_task(Task const *task,
                                     data_dim);
 }
 
+FutureMap Group_by::compute_routing_metrics(FFModel const &ff) const {
+  ArgumentMap argmap;
+  Context ctx = ff.config.lg_ctx;
+  Runtime *runtime = ff.config.lg_hlr;
+  IndexLauncher launcher(GROUP_BY_METRICS_TASK_ID,
+                         parallel_is,
+                         TaskArgument(this, sizeof(Group_by)),
+                         argmap,
+                         Predicate::TRUE_PRED,
+                         false /*must*/,
+                         0 /*mapper_id*/,
+                         outputs[0]->machine_view.hash());
+  // assign
+  launcher.add_region_requirement(RegionRequirement(inputs[1]->part,
+                                                    0 /*projection id*/,
+                                                    READ_ONLY,
+                                                    EXCLUSIVE,
+                                                    inputs[1]->region));
+  launcher.add_field(0, FID_DATA);
+  return runtime->execute_index_space(ctx, launcher);
+}
+
+/*
+  regions[0](I): assign
+*/
+PerfMetrics
+    Group_by::routing_metrics_task(Task const *task,
+                                   std::vector<PhysicalRegion> const &regions,
+                                   Context ctx,
+                                   Runtime *runtime) {
+  Group_by const *gb = (Group_by *)task->args;
+  assert(regions.size() == 1);
+  assert(task->regions.size() == 1);
+  AccessorRO<int, 3> const acc_assign(regions[0], FID_DATA);
+  Rect<3> rect_assign = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  int k = rect_assign.hi[0] - rect_assign.lo[0] + 1;
+  int batch_size = rect_assign.hi[1] - rect_assign.lo[1] + 1;
+  return Group_by::routing_metrics_kernel_wrapper(acc_assign.ptr(rect_assign),
+                                                  gb->n,
+                                                  k,
+                                                  gb->alpha,
+                                                  gb->dropless,
+                                                  batch_size);
+}
+
+/*static*/
+void Group_by::get_expert_offsets(int const *exp_assign,
+                                  int num_assignments,
+                                  int n,
+                                  int *offsets) {
+  std::fill(offsets, offsets + n + 1, 0);
+  for (int i = 0; i < num_assignments; i++) {
+    assert(exp_assign[i] >= 0 && exp_assign[i] < n);
+    offsets[exp_assign[i] + 1]++;
+  }
+  for (int i = 0; i < n; i++) {
+    offsets[i + 1] += offsets[i];
+  }
+}
+
+/*static*/
+PerfMetrics Group_by::get_routing_metrics(int const *exp_assign,
+                                          int n,
+                                          int k,
+                                          float alpha,
+                                          bool dropless,
+                                          int batch_size) {
+  std::vector<int> offsets(n + 1);
+  get_expert_offsets(exp_assign, k * batch_size, n, offsets.data());
+  int capacity = dropless ? k * batch_size
+                          : (int)ceil(alpha * k / n * batch_size);
+  PerfMetrics perf;
+  int peak = 0;
+  for (int i = 0; i < n; i++) {
+    int count = offsets[i + 1] - offsets[i];
+    peak = std::max(peak, count);
+    perf.dropped_tokens += std::max(0, count - capacity);
+  }
+  perf.routed_tokens = k * batch_size;
+  perf.expert_peak_load = (float)peak * n;
+  perf.max_load_imbalance = perf.expert_peak_load / perf.routed_tokens;
+  return perf;
+}
+
 void Group_by::serialize(Legion::Serializer &sez) const {
   sez.serialize(this->n);
   sez.serialize(this->alpha);
+  sez.serialize(this->dropless);
 }
 
 Node Group_by::deserialize(FFModel &ff,
@@ -432,11 +581,14 @@ Node Group_by::deserialize(FFModel &ff,
   assert(num_inputs == 2);
   int n;
   float alpha;
+  bool dropless;
   dez.deserialize(n);
   dez.deserialize(alpha);
+  dez.deserialize(dropless);
   Group_byParams params;
   params.n = n;
   params.alpha = alpha;
+  params.dropless = dropless;
   return ff.get_or_create_node<Group_by>(std::make_pair(inputs[0], inputs[1]),
                                          params);
 }
@@ -467,6 +619,7 @@ bool Group_by::measure_operator_cost(Simulator *sim,
   }
 
   GroupByMeta *m = new GroupByMeta(sim->handler, n);
+  m->dropless = dropless;
 
   // allocate
   sim->free_all();
@@ -529,6 +682,7 @@ size_t hash<FlexFlow::Group_byParams>::operator()(
   size_t key = 0;
   hash_combine(key, params.n);
   hash_combine(key, params.alpha);
+  hash_combine(key, params.dropless);
   return key;
 }
 }; // namespace std
@@ -25,6 +25,25 @@
 
 namespace FlexFlow {
 
+// Points expert_rows at the rows of every expert in buffer, where the tokens
+// of all experts are packed one expert after the other
+__device__ void gb_pack_expert_rows(int const *exp_assign,
+                                    float *buffer,
+                                    float **expert_rows,
+                                    int n,
+                                    int num_assignments,
+                                    int data_dim) {
+  int expert_count[MAX_N] = {0};
+  for (int i = 0; i < num_assignments; i++) {
+    expert_count[exp_assign[i]]++;
+  }
+  int offset = 0;
+  for (int i = 0; i < n; i++) {
+    expert_rows[i] = buffer + offset * data_dim;
+    offset += expert_count[i];
+  }
+}
+
 __global__ void
     gb_forward_kernel(float const *input,
                       int const *exp_assign,
@@ -32,6 +51,7 @@ __global__ void
                       int n,       // num experts
                       int k,       // chosen experts
                       float alpha, // factor additional memory assigned
+                      bool dropless,
                       int batch_size,
                       int data_dim) {
   __shared__ float
@@ -45,6 +65,18 @@ __global__ void
         ceil(alpha * k / n * batch_size); // This is the max expert capacity
     int expert_idx[MAX_N] = {
         0}; // This is the number of tokens assigned to each expert
+    float *expert_rows[MAX_N];
+    if (dropless) {
+      // no expert can receive more than all the tokens, which are packed one
+      // expert after the other in outputs[0]
+      exp_tensor_rows = k * batch_size;
+      gb_pack_expert_rows(
+          exp_assign, outputs[0], expert_rows, n, k * batch_size, data_dim);
+    } else {
+      for (int i = 0; i < n; i++) {
+        expert_rows[i] = outputs[i];
+      }
+    }
     // Iterate through flattened assign tensor, which has shape (k, batch_size)
     for (int i = 0; i < k * batch_size; i++) {
       // Get pointer to chosen expert predictions
@@ -57,10 +89,11 @@ __global__ void
         continue;
       }
       // chosen_exp_preds[i] is the pointer to the location in the outputs
-      // tensor's memory where we should copy the i-th tensor. outputs[expert]
-      // points us to the assigned expert's (DATA_DIM, expert capacity) tensor
-      // block expert_idx[expert] * data_dim is the offset within the block
-      chosen_exp_preds[i] = outputs[expert] + expert_idx[expert] * data_dim;
+      // tensor's memory where we should copy the i-th tensor.
+      // expert_rows[expert] points us to the assigned expert's (DATA_DIM,
+      // expert capacity) tensor block expert_idx[expert] * data_dim is the
+      // offset within the block
+      chosen_exp_preds[i] = expert_rows[expert] + expert_idx[expert] * data_dim;
       expert_idx[expert]++;
     }
   }
@@ -84,6 +117,7 @@ __global__ void
                        int n,       // num experts
                        int k,       // chosen experts
                        float alpha, // factor additional memory assigned
+                       bool dropless,
                        int batch_size,
                        int data_dim) {
   __shared__ float *chosen_exp_grads[MAX_K * MAX_BATCH_SIZE];
@@ -92,6 +126,20 @@ __global__ void
   if (blockIdx.x * blockDim.x + threadIdx.x == 0) {
     int exp_tensor_rows = ceil(alpha * k / n * batch_size);
     int expert_idx[MAX_N] = {0};
+    float *expert_rows[MAX_N];
+    if (dropless) {
+      exp_tensor_rows = k * batch_size;
+      gb_pack_expert_rows(exp_assign,
+                          output_grads[0],
+                          expert_rows,
+                          n,
+                          k * batch_size,
+                          data_dim);
+    } else {
+      for (int i = 0; i < n; i++) {
+        expert_rows[i] = output_grads[i];
+      }
+    }
     for (int i = 0; i < k * batch_size; i++) {
       // Get pointer to chosen expert predictions
       int expert = exp_assign[i];
@@ -100,8 +148,7 @@ __global__ void
         chosen_exp_grads[i] = 0;
         continue;
       }
-      chosen_exp_grads[i] =
-          output_grads[expert] + expert_idx[expert] * data_dim;
+      chosen_exp_grads[i] = expert_rows[expert] + expert_idx[expert] * data_dim;
       expert_idx[expert]++;
     }
   }
@@ -133,8 +180,11 @@ void Group_by::forward_kernel_wrapper(
   checkCUDA(get_legion_stream(&stream));
 
   // call forward kernel
-  hipMemcpy(
-      m->dev_region_ptrs, outputs, n * sizeof(float *), hipMemcpyHostToDevice);
+  int num_outputs = m->dropless ? 1 : n;
+  hipMemcpy(m->dev_region_ptrs,
+            outputs,
+            num_outputs * sizeof(float *),
+            hipMemcpyHostToDevice);
 
   hipLaunchKernelGGL(gb_forward_kernel,
                      GET_BLOCKS(batch_size * k * data_dim),
@@ -147,6 +197,7 @@ void Group_by::forward_kernel_wrapper(
                      n,
                      k,
                      alpha,
+                     m->dropless,
                      batch_size,
                      data_dim);
 }
@@ -166,9 +217,10 @@ void Group_by::backward_kernel_wrapper(
   checkCUDA(get_legion_stream(&stream));
 
   // call forward kernel
+  int num_outputs = m->dropless ? 1 : n;
   hipMemcpy(m->dev_region_ptrs,
             output_grads,
-            n * sizeof(float *),
+            num_outputs * sizeof(float *),
             hipMemcpyHostToDevice);
 
   hipLaunchKernelGGL(gb_backward_kernel,
@@ -182,11 +234,33 @@ void Group_by::backward_kernel_wrapper(
                      n,
                      k,
                      alpha,
+                     m->dropless,
                      batch_size,
                      data_dim);
 }
 
-GroupByMeta::GroupByMeta(FFHandler handler, int n) : OpMeta(handler) {
+/*static*/
+PerfMetrics Group_by::routing_metrics_kernel_wrapper(int const *exp_assign,
+                                                     int n,
+                                                     int k,
+                                                     float alpha,
+                                                     bool dropless,
+                                                     int batch_size) {
+  hipStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  std::vector<int> host_assign(k * batch_size);
+  checkCUDA(hipMemcpyAsync(host_assign.data(),
+                           exp_assign,
+                           host_assign.size() * sizeof(int),
+                           hipMemcpyDeviceToHost,
+                           stream));
+  checkCUDA(hipStreamSynchronize(stream));
+  return get_routing_metrics(
+      host_assign.data(), n, k, alpha, dropless, batch_size);
+}
+
+GroupByMeta::GroupByMeta(FFHandler handler, int n)
+    : OpMeta(handler), dropless(false) {
   checkCUDA(hipMalloc(&dev_region_ptrs, n * sizeof(float *)));
 }
 GroupByMeta::~GroupByMeta(void) {
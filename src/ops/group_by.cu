@@ -24,6 +24,25 @@
 
 namespace FlexFlow {
 
+// Points expert_rows at the rows of every expert in buffer, where the tokens
+// of all experts are packed one expert after the other
+__device__ void gb_pack_expert_rows(int const *exp_assign,
+                                    float *buffer,
+                                    float **expert_rows,
+                                    int n,
+                                    int num_assignments,
+                                    int data_dim) {
+  int expert_count[MAX_N] = {0};
+  for (int i = 0; i < num_assignments; i++) {
+    expert_count[exp_assign[i]]++;
+  }
+  int offset = 0;
+  for (int i = 0; i < n; i++) {
+    expert_rows[i] = buffer + offset * data_dim;
+    offset += expert_count[i];
+  }
+}
+
 __global__ void
     gb_forward_kernel(float const *input,
                       int const *exp_assign,
@@ -31,6 +50,7 @@ __global__ void
                       int n,       // num experts
                       int k,       // chosen experts
                       float alpha, // factor additional memory assigned
+                      bool dropless,
                       int batch_size,
                       int data_dim) {
   __shared__ float *chosen_exp_preds[MAX_K * MAX_BATCH_SIZE];
@@ -39,6 +59,17 @@ __global__ void
   if (threadIdx.x == 0) {
     int exp_tensor_rows = ceil(alpha * k / n * batch_size);
     int expert_idx[MAX_N] = {0};
+    float *expert_rows[MAX_N];
+    if (dropless) {
+      // no expert can receive more than all the tokens
+      exp_tensor_rows = k * batch_size;
+      gb_pack_expert_rows(
+          exp_assign, outputs[0], expert_rows, n, k * batch_size, data_dim);
+    } else {
+      for (int i = 0; i < n; i++) {
+        expert_rows[i] = outputs[i];
+      }
+    }
     for (int i = 0; i < k * batch_size; i++) {
       // Get pointer to chosen expert predictions
       int expert = exp_assign[i];
@@ -47,7 +78,7 @@ __global__ void
         chosen_exp_preds[i] = 0;
         continue;
       }
-      chosen_exp_preds[i] = outputs[expert] + expert_idx[expert] * data_dim;
+      chosen_exp_preds[i] = expert_rows[expert] + expert_idx[expert] * data_dim;
       expert_idx[expert]++;
     }
   }
@@ -70,6 +101,7 @@ __global__ void
                        int n,       // num experts
                        int k,       // chosen experts
                        float alpha, // factor additional memory assigned
+                       bool dropless,
                        int batch_size,
                        int data_dim) {
   __shared__ float *chosen_exp_grads[MAX_K * MAX_BATCH_SIZE];
@@ -81,6 +113,20 @@ __global__ void
   if (threadIdx.x == 0) {
     int exp_tensor_rows = ceil(alpha * k / n * batch_size);
     int expert_idx[MAX_N] = {0};
+    float *expert_rows[MAX_N];
+    if (dropless) {
+      exp_tensor_rows = k * batch_size;
+      gb_pack_expert_rows(exp_assign,
+                          output_grads[0],
+                          expert_rows,
+                          n,
+                          k * batch_size,
+                          data_dim);
+    } else {
+      for (int i = 0; i < n; i++) {
+        expert_rows[i] = output_grads[i];
+      }
+    }
     for (int i = 0; i < k * batch_size; i++) {
       // Get pointer to chosen expert predictions
       int expert = exp_assign[i];
@@ -89,8 +135,7 @@ __global__ void
         chosen_exp_grads[i] = nullptr;
         continue;
       }
-      chosen_exp_grads[i] =
-          output_grads[expert] + expert_idx[expert] * data_dim;
+      chosen_exp_grads[i] = expert_rows[expert] + expert_idx[expert] * data_dim;
       expert_idx[expert]++;
     }
   }
@@ -126,17 +171,25 @@ void Group_by::forward_kernel_wrapper(
     cudaEventRecord(t_start, stream);
   }
   // call forward kernel
+  int num_outputs = m->dropless ? 1 : n;
   cudaMemcpyAsync(m->dev_region_ptrs,
                   outputs,
-                  n * sizeof(float *),
+                  num_outputs * sizeof(float *),
                   cudaMemcpyHostToDevice,
                   stream);
 
   gb_forward_kernel<<<GET_BLOCKS(batch_size * k * data_dim),
                       min(CUDA_NUM_THREADS, (int)(batch_size * k * data_dim)),
                       0,
-                      stream>>>(
-      input, exp_assign, m->dev_region_ptrs, n, k, alpha, batch_size, data_dim);
+                      stream>>>(input,
+                                exp_assign,
+                                m->dev_region_ptrs,
+                                n,
+                                k,
+                                alpha,
+                                m->dropless,
+                                batch_size,
+                                data_dim);
   if (m->profiling) {
     cudaEventRecord(t_end, stream);
     checkCUDA(cudaEventSynchronize(t_end));
@@ -169,9 +222,10 @@ void Group_by::backward_kernel_wrapper(
   }
 
   // call forward kernel
+  int num_outputs = m->dropless ? 1 : n;
   cudaMemcpyAsync(m->dev_region_ptrs,
                   output_grads,
-                  n * sizeof(float *),
+                  num_outputs * sizeof(float *),
                   cudaMemcpyHostToDevice,
                   stream);
   gb_backward_kernel<<<GET_BLOCKS(batch_size * k * data_dim),
@@ -183,6 +237,7 @@ void Group_by::backward_kernel_wrapper(
                                  n,
                                  k,
                                  alpha,
+                                 m->dropless,
                                  batch_size,
                                  data_dim);
   if (m->profiling) {
@@ -196,7 +251,28 @@ void Group_by::backward_kernel_wrapper(
   }
 }
 
-GroupByMeta::GroupByMeta(FFHandler handler, int n) : OpMeta(handler) {
+/*static*/
+PerfMetrics Group_by::routing_metrics_kernel_wrapper(int const *exp_assign,
+                                                     int n,
+                                                     int k,
+                                                     float alpha,
+                                                     bool dropless,
+                                                     int batch_size) {
+  cudaStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  std::vector<int> host_assign(k * batch_size);
+  checkCUDA(cudaMemcpyAsync(host_assign.data(),
+                            exp_assign,
+                            host_assign.size() * sizeof(int),
+                            cudaMemcpyDeviceToHost,
+                            stream));
+  checkCUDA(cudaStreamSynchronize(stream));
+  return get_routing_metrics(
+      host_assign.data(), n, k, alpha, dropless, batch_size);
+}
+
+GroupByMeta::GroupByMeta(FFHandler handler, int n)
+    : OpMeta(handler), dropless(false) {
   checkCUDA(cudaMalloc(&dev_region_ptrs, n * sizeof(float *)));
 }
 GroupByMeta::~GroupByMeta(void) {
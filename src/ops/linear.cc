@@ -3,6 +3,7 @@
 #include "flexflow/model.h"
 #include "flexflow/ops/kernels/linear_kernels.h"
 #include "flexflow/utils/hash_utils.h"
+#include "flexflow/utils/random_utils.h"
 #include "legion/legion_utilities.h"
 
 namespace FlexFlow {
@@ -743,7 +744,7 @@ ParallelConfig Linear::get_random_parallel_config(FFModel const &ff) const {
     }
   }
   assert(batch_candidates.size() > 0);
-  int idx = std::rand() % batch_candidates.size();
+  int idx = randi() % batch_candidates.size();
   int num_par_c = channel_candidates[idx];
   int num_par_b = batch_candidates[idx];
   ParallelConfig pc;
@@ -754,7 +755,7 @@ ParallelConfig Linear::get_random_parallel_config(FFModel const &ff) const {
   for (int i = 1; i < pc.nDims - 1; i++) {
     pc.dim[i] = 1;
   }
-  int start_idx = std::rand() % (total_devices - num_par_c * num_par_b + 1);
+  int start_idx = randi() % (total_devices - num_par_c * num_par_b + 1);
   start_idx = start_idx - start_idx % num_par_c;
   for (int i = 0; i < num_par_c * num_par_b; i++) {
     pc.device_ids[i] = start_idx + i;
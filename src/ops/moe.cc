@@ -22,21 +22,41 @@ Tensor FFModel::moe(const Tensor input,
                     int num_select,
                     int expert_hidden_size,
                     float alpha,
-                    float lambda) {
+                    float lambda,
+                    bool dropless) {
   // MoE model
   Tensor gate_preds = dense(input, num_exp, AC_MODE_RELU);
   Tensor topK_output[2];
   top_k(gate_preds, topK_output, num_select, false);
-  Tensor exp_tensors[num_exp];
-  group_by(input, topK_output[1], exp_tensors, num_exp, alpha);
   Tensor agg_inputs[num_exp + 4];
   agg_inputs[0] = softmax(topK_output[0]); // gate preds
   agg_inputs[1] = topK_output[1];          // gate assign
   agg_inputs[2] = topK_output[1];          // gate assign TopK (for cache)
   agg_inputs[3] = gate_preds;              // full gate preds
+  if (dropless) {
+    // every token reaches its experts, whatever the load; alpha is unused
+    Tensor packed = group_by_dropless(input, topK_output[1], num_exp);
+    agg_inputs[4] = experts_dropless(packed,
+                                     topK_output[1],
+                                     num_exp,
+                                     expert_hidden_size,
+                                     AC_MODE_RELU,
+                                     true /*use_bias*/,
+                                     true /*apply_softmax*/);
+    return aggregate_dropless(agg_inputs, num_exp, lambda);
+  }
+  Tensor exp_tensors[num_exp];
+  group_by(input, topK_output[1], exp_tensors, num_exp, alpha);
+  Tensor exp_preds[num_exp];
+  experts(exp_tensors,
+          exp_preds,
+          num_exp,
+          expert_hidden_size,
+          AC_MODE_RELU,
+          true /*use_bias*/,
+          true /*apply_softmax*/);
   for (int i = 0; i < num_exp; i++) {
-    Tensor exp_pred = dense(exp_tensors[i], expert_hidden_size, AC_MODE_RELU);
-    agg_inputs[i + 4] = softmax(exp_pred);
+    agg_inputs[i + 4] = exp_preds[i];
   }
   Tensor coop_output = aggregate(agg_inputs, num_exp, lambda);
   // get_metrics();
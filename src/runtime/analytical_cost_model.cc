@@ -0,0 +1,207 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/analytical_cost_model.h"
+#include "flexflow/ffconst_utils.h"
+#include "flexflow/ops/attention.h"
+#include "flexflow/ops/conv_2d.h"
+#include "flexflow/ops/embedding.h"
+#include "flexflow/ops/experts.h"
+#include "flexflow/ops/linear.h"
+#include <algorithm>
+
+namespace FlexFlow {
+
+LegionRuntime::Logger::Category log_cost_model("cost_model");
+
+AnalyticalCostModel::AnalyticalCostModel(MachineModel const *_machine,
+                                         CompMode _comp_mode)
+    : machine(_machine), comp_mode(_comp_mode) {}
+
+double AnalyticalCostModel::get_flops_per_output_element(Op const *op) {
+  switch (op->op_type) {
+    case OP_LINEAR: {
+      // One multiply-add per input channel
+      return 2.0 * op->inputs[0]->dims[0].size;
+    }
+    case OP_CONV2D: {
+      Conv2D const *conv = (Conv2D const *)op;
+      return 2.0 * conv->kernel_h * conv->kernel_w *
+             (op->inputs[0]->dims[Conv2DInput::CHANNEL].size / conv->groups);
+    }
+    case OP_BATCHMATMUL: {
+      // The reduction dimension is the innermost dimension of the first input
+      return 2.0 * op->inputs[0]->dims[0].size;
+    }
+    case OP_MULTIHEAD_ATTENTION: {
+      MultiHeadAttention const *attn = (MultiHeadAttention const *)op;
+      double qo = attn->qoSeqLength, kv = attn->kvSeqLength;
+      // Q/K/V projections, QK^T, attention-weighted V, and output projection
+      double flops_per_sample =
+          2.0 * attn->num_heads *
+          (qo * attn->qSize * attn->qProjSize +
+           kv * attn->kSize * attn->kProjSize +
+           kv * attn->vSize * attn->vProjSize + qo * kv * attn->kProjSize +
+           qo * kv * attn->vProjSize + qo * attn->vProjSize * attn->oProjSize);
+      return flops_per_sample / (qo * attn->oProjSize);
+    }
+    case OP_EMBEDDING: {
+      Embedding const *embed = (Embedding const *)op;
+      return embed->aggr == AGGR_MODE_NONE ? 1.0
+                                           : (double)op->inputs[0]->dims[0].size;
+    }
+    case OP_EXPERTS: {
+      // Only outputs[0] is counted, so account for the work of every expert;
+      // a dropless layer packs the rows of all experts in outputs[0]
+      return 2.0 * op->inputs[0]->dims[0].size * op->numOutputs;
+    }
+    default: {
+      // Element-wise and data movement operators are bound by memory
+      return 1.0;
+    }
+  }
+}
+
+size_t AnalyticalCostModel::get_weight_volume_per_device(Op const *op) {
+  size_t volume = 0;
+  bool allocated = false;
+  for (int i = 0; i < op->numWeights; i++) {
+    if (op->weights[i] != nullptr) {
+      ParallelTensorShape shape = op->weights[i]->get_shape();
+      volume += shape.get_piece_size() / data_type_size(shape.data_type);
+      allocated = true;
+    }
+  }
+  if (allocated) {
+    return volume;
+  }
+  // Operators created during the search do not allocate their weights
+  switch (op->op_type) {
+    case OP_LINEAR: {
+      Linear const *linear = (Linear const *)op;
+      ParallelDim const &in_c = op->inputs[0]->dims[0];
+      ParallelDim const &out_c = op->outputs[0]->dims[0];
+      volume = (size_t)(in_c.size / in_c.degree) * (out_c.size / out_c.degree);
+      if (linear->use_bias) {
+        volume += out_c.size / out_c.degree;
+      }
+      return volume;
+    }
+    case OP_CONV2D: {
+      Conv2D const *conv = (Conv2D const *)op;
+      ParallelDim const &in_c = op->inputs[0]->dims[Conv2DInput::CHANNEL];
+      ParallelDim const &out_c = op->outputs[0]->dims[Conv2DOutput::CHANNEL];
+      volume = (size_t)conv->kernel_h * conv->kernel_w *
+               (in_c.size / in_c.degree / conv->groups) *
+               (out_c.size / out_c.degree);
+      if (conv->use_bias) {
+        volume += out_c.size / out_c.degree;
+      }
+      return volume;
+    }
+    case OP_MULTIHEAD_ATTENTION: {
+      MultiHeadAttention const *attn = (MultiHeadAttention const *)op;
+      return (size_t)attn->num_heads *
+             ((size_t)attn->qSize * attn->qProjSize +
+              (size_t)attn->kSize * attn->kProjSize +
+              (size_t)attn->vSize * attn->vProjSize +
+              (size_t)attn->vProjSize * attn->oProjSize);
+    }
+    case OP_EMBEDDING: {
+      Embedding const *embed = (Embedding const *)op;
+      ParallelDim const &out_c = op->outputs[0]->dims[0];
+      return (size_t)embed->num_entries * (out_c.size / out_c.degree);
+    }
+    case OP_EXPERTS: {
+      Experts const *experts = (Experts const *)op;
+      return (size_t)experts->num_experts * experts->out_dim *
+             (experts->in_dim + (experts->use_bias ? 1 : 0));
+    }
+    default:
+      return 0;
+  }
+}
+
+float AnalyticalCostModel::estimate_kernel_time(double flops,
+                                                double bytes) const {
+  double compute_time =
+      flops / (machine->get_gpu_peak_flops() * COMPUTE_EFFICIENCY);
+  double memory_time =
+      bytes / (machine->get_gpu_fb_mem_bandwidth() * MEMORY_EFFICIENCY);
+  return (float)std::max(compute_time, memory_time) + KERNEL_LAUNCH_OVERHEAD;
+}
+
+bool AnalyticalCostModel::estimate_operator_cost(
+    Op const *op, MachineView const &view, CostMetrics &cost_metrics) const {
+  cost_metrics = CostMetrics();
+  if (op->is_parallel_op() || op->op_type == OP_INPUT ||
+      op->op_type == OP_WEIGHT || op->op_type == OP_NOOP) {
+    // These are costed as transfers by the simulator
+    return true;
+  }
+  if (op->numOutputs == 0) {
+    return false;
+  }
+
+  size_t inputs_bytes = 0, outputs_bytes = 0;
+  for (int i = 0; i < op->numInputs; i++) {
+    inputs_bytes += op->inputs[i]->get_shape().get_piece_size();
+  }
+  for (int i = 0; i < op->numOutputs; i++) {
+    outputs_bytes += op->outputs[i]->get_shape().get_piece_size();
+  }
+  size_t weights_bytes = 0;
+  size_t weights_volume = get_weight_volume_per_device(op);
+  if (weights_volume > 0) {
+    weights_bytes = weights_volume * data_type_size(op->data_type);
+  }
+
+  // Replicas of the output each compute a partial result (e.g. a linear
+  // layer partitioned along its input channels), so split the work by them
+  ParallelTensorShape output_shape = op->outputs[0]->get_shape();
+  double output_elements = (double)output_shape.get_piece_size() /
+                           data_type_size(output_shape.data_type) /
+                           output_shape.get_num_replicas();
+  double forward_flops = get_flops_per_output_element(op) * output_elements;
+  double forward_bytes = inputs_bytes + outputs_bytes + weights_bytes;
+
+  cost_metrics.forward_time = estimate_kernel_time(forward_flops, forward_bytes);
+  cost_metrics.inputs_memory = inputs_bytes;
+  cost_metrics.outputs_memory = outputs_bytes;
+  cost_metrics.weights_memory = weights_bytes;
+  if (comp_mode == COMP_MODE_TRAINING) {
+    // Operators with weights compute both the input and the weight gradients
+    double backward_flops =
+        weights_bytes > 0 ? 2 * forward_flops : forward_flops;
+    // Read the output gradients and the forward tensors, write the gradients
+    double backward_bytes = 2 * forward_bytes;
+    cost_metrics.backward_time =
+        estimate_kernel_time(backward_flops, backward_bytes);
+    cost_metrics.inputs_memory += inputs_bytes;
+    cost_metrics.outputs_memory += outputs_bytes;
+    cost_metrics.weights_memory += weights_bytes;
+  }
+  log_cost_model.debug("[Estimate %s] name(%s) flops(%.0lf) bytes(%.0lf) "
+                       "forward_time(%.4lf) backward_time(%.4lf)",
+                       get_operator_type_name(op->op_type).c_str(),
+                       op->name,
+                       forward_flops,
+                       forward_bytes,
+                       cost_metrics.forward_time,
+                       cost_metrics.backward_time);
+  return true;
+}
+
+}; // namespace FlexFlow
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "flexflow/simulator.h"
+namespace FlexFlow {
+
+static int node_of(MachineModel *machine, int gpu) {
+  return machine->get_gpu(gpu)->node_id;
+}
+
+// Reduce-scatter and all-gather around gpus[0] -> gpus[1] -> ... -> gpus[0];
+// every link carries (n - 1) chunks of message_size / n
+static void append_ring_phases(std::vector<CollectivePhase> &phases,
+                               std::vector<int> const &gpus,
+                               size_t message_size) {
+  int n = gpus.size();
+  if (n <= 1) {
+    return;
+  }
+  CollectivePhase phase;
+  phase.num_steps = n - 1;
+  size_t size = message_size * (n - 1) / n;
+  for (int i = 0; i < n; i++) {
+    phase.transfers.push_back({gpus[i], gpus[(i + 1) % n], size});
+  }
+  // reduce-scatter
+  phases.push_back(phase);
+  // all-gather
+  phases.push_back(phase);
+}
+
+// Each half of the message is reduced up and broadcast down its own binary
+// tree; the second tree numbers the ranks backwards, so that the leaves of
+// one tree are the interior nodes of the other
+static void append_tree_phases(std::vector<CollectivePhase> &phases,
+                               std::vector<int> const &gpus,
+                               size_t message_size) {
+  int n = gpus.size();
+  if (n <= 1) {
+    return;
+  }
+  int depth = 0;
+  while ((2 << depth) <= n) {
+    depth++;
+  }
+  CollectivePhase reduce, broadcast;
+  reduce.num_steps = broadcast.num_steps = depth;
+  size_t size = (message_size + 1) / 2;
+  for (int tree = 0; tree < 2; tree++) {
+    for (int p = 1; p < n; p++) {
+      int parent = (p - 1) / 2;
+      int child_gpu = tree == 0 ? gpus[p] : gpus[n - 1 - p];
+      int parent_gpu = tree == 0 ? gpus[parent] : gpus[n - 1 - parent];
+      reduce.transfers.push_back({child_gpu, parent_gpu, size});
+      broadcast.transfers.push_back({parent_gpu, child_gpu, size});
+    }
+  }
+  phases.push_back(reduce);
+  phases.push_back(broadcast);
+}
+
+// Returns false if the hierarchical plan does not apply, i.e. unless gpus span
+// more than one node with the same number (> 1) of them on every node
+static bool append_hierarchical_phases(std::vector<CollectivePhase> &phases,
+                                       std::vector<int> const &gpus,
+                                       size_t message_size,
+                                       MachineModel *machine) {
+  std::map<int, std::vector<int>> groups;
+  for (int gpu : gpus) {
+    groups[node_of(machine, gpu)].push_back(gpu);
+  }
+  int m = groups.size();
+  int g = groups.begin()->second.size();
+  if (m <= 1 || g <= 1) {
+    return false;
+  }
+  for (auto const &group : groups) {
+    if ((int)group.second.size() != g) {
+      return false;
+    }
+  }
+  // reduce-scatter within each node
+  CollectivePhase intra;
+  intra.num_steps = g - 1;
+  size_t intra_size = message_size * (g - 1) / g;
+  for (auto const &group : groups) {
+    for (int i = 0; i < g; i++) {
+      intra.transfers.push_back(
+          {group.second[i], group.second[(i + 1) % g], intra_size});
+    }
+  }
+  phases.push_back(intra);
+  // the GPUs with the same local rank allreduce their shard across nodes
+  CollectivePhase inter;
+  inter.num_steps = 2 * (m - 1);
+  size_t inter_size = 2 * (message_size / g) * (m - 1) / m;
+  for (int i = 0; i < g; i++) {
+    std::vector<int> ring;
+    for (auto const &group : groups) {
+      ring.push_back(group.second[i]);
+    }
+    for (int j = 0; j < m; j++) {
+      inter.transfers.push_back({ring[j], ring[(j + 1) % m], inter_size});
+    }
+  }
+  phases.push_back(inter);
+  // all-gather within each node
+  phases.push_back(intra);
+  return true;
+}
+
+static void append_parameter_server_phases(
+    std::vector<CollectivePhase> &phases,
+    std::vector<int> const &gpus,
+    size_t message_size) {
+  CollectivePhase gather, scatter;
+  gather.num_steps = scatter.num_steps = 1;
+  for (size_t i = 1; i < gpus.size(); i++) {
+    gather.transfers.push_back({gpus[i], gpus[0], message_size});
+    scatter.transfers.push_back({gpus[0], gpus[i], message_size});
+  }
+  phases.push_back(gather);
+  phases.push_back(scatter);
+}
+
+std::vector<CollectivePhase> plan_allreduce(AllReduceAlgorithm algorithm,
+                                            std::vector<int> const &gpus,
+                                            size_t message_size,
+                                            MachineModel *machine) {
+  std::vector<CollectivePhase> phases;
+  if (gpus.size() <= 1) {
+    return phases;
+  }
+  switch (algorithm) {
+    case ALLREDUCE_RING:
+      append_ring_phases(phases, gpus, message_size);
+      break;
+    case ALLREDUCE_TREE:
+      append_tree_phases(phases, gpus, message_size);
+      break;
+    case ALLREDUCE_HIERARCHICAL:
+      if (!append_hierarchical_phases(phases, gpus, message_size, machine)) {
+        append_ring_phases(phases, gpus, message_size);
+      }
+      break;
+    case ALLREDUCE_PARAMETER_SERVER:
+      append_parameter_server_phases(phases, gpus, message_size);
+      break;
+    case ALLREDUCE_AUTO: {
+      float best_time = std::numeric_limits<float>::max();
+      for (AllReduceAlgorithm candidate :
+           {ALLREDUCE_RING, ALLREDUCE_TREE, ALLREDUCE_HIERARCHICAL}) {
+        std::vector<CollectivePhase> plan =
+            plan_allreduce(candidate, gpus, message_size, machine);
+        float time = estimate_collective_time(plan, machine);
+        if (time < best_time) {
+          best_time = time;
+          phases.swap(plan);
+        }
+      }
+      break;
+    }
+    default:
+      assert(false && "Unknown allreduce algorithm");
+  }
+  return phases;
+}
+
+float collective_phase_latency(CollectivePhase const &phase,
+                               MachineModel *machine) {
+  if (phase.transfers.empty()) {
+    return 0.0f;
+  }
+  for (CollectivePhase::Transfer const &t : phase.transfers) {
+    if (node_of(machine, t.src_gpu) != node_of(machine, t.dst_gpu)) {
+      return machine->get_inter_node_gpu_latency();
+    }
+  }
+  return machine->get_intra_node_gpu_latency();
+}
+
+float estimate_collective_time(std::vector<CollectivePhase> const &phases,
+                               MachineModel *machine) {
+  float intra_bw = machine->get_intra_node_gpu_bandwidth();
+  float inter_bw = machine->get_inter_node_gpu_bandwidth();
+  float total = 0.0f;
+  for (CollectivePhase const &phase : phases) {
+    // a GPU injects and absorbs its NVLink traffic at the intra-node
+    // bandwidth, and all GPUs of a node share its NIC
+    std::map<int, size_t> gpu_egress, gpu_ingress;
+    std::map<int, size_t> node_egress, node_ingress;
+    for (CollectivePhase::Transfer const &t : phase.transfers) {
+      int src_node = node_of(machine, t.src_gpu);
+      int dst_node = node_of(machine, t.dst_gpu);
+      if (src_node == dst_node) {
+        gpu_egress[t.src_gpu] += t.size;
+        gpu_ingress[t.dst_gpu] += t.size;
+      } else {
+        node_egress[src_node] += t.size;
+        node_ingress[dst_node] += t.size;
+      }
+    }
+    float intra_time = 0.0f, inter_time = 0.0f;
+    for (auto const &e : gpu_egress) {
+      intra_time = std::max(intra_time, e.second / intra_bw);
+    }
+    for (auto const &e : gpu_ingress) {
+      intra_time = std::max(intra_time, e.second / intra_bw);
+    }
+    for (auto const &e : node_egress) {
+      inter_time = std::max(inter_time, e.second / inter_bw);
+    }
+    for (auto const &e : node_ingress) {
+      inter_time = std::max(inter_time, e.second / inter_bw);
+    }
+    total += phase.num_steps * collective_phase_latency(phase, machine) +
+             std::max(intra_time, inter_time);
+  }
+  return total;
+}
+
+}; // namespace FlexFlow
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "flexflow/simulator.h"
+namespace FlexFlow {
+
+void FlowLevelNetwork::start_flow(
+    SimTask *task, Route const &route, float size, float latency, float now) {
+  assert(!route.empty());
+  drain(now);
+  Flow flow;
+  flow.task = task;
+  flow.remaining = size;
+  flow.rate = 0.0;
+  flow.latency = latency;
+  for (CommDevice *link : route) {
+    auto it = link_ids.find(link);
+    if (it == link_ids.end()) {
+      assert(link->bandwidth > 0);
+      it = link_ids.emplace(link, (int)link_bandwidth.size()).first;
+      link_bandwidth.push_back(link->bandwidth);
+    }
+    flow.links.push_back(it->second);
+  }
+  flows.push_back(flow);
+  update_rates();
+}
+
+float FlowLevelNetwork::next_completion_time() const {
+  return next_completion;
+}
+
+void FlowLevelNetwork::advance(
+    float now, std::vector<std::pair<SimTask *, float>> &finished) {
+  drain(now);
+  // a flow is done once what is left would take it less than the rounding
+  // error of a float time to send
+  double eps = std::max(clock, 1.0) * 1e-6;
+  size_t num_active = 0;
+  next_completion = std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < flows.size(); i++) {
+    if (flows[i].remaining <= flows[i].rate * eps) {
+      finished.emplace_back(flows[i].task, clock + flows[i].latency);
+    } else {
+      next_completion = std::min(
+          next_completion, clock + flows[i].remaining / flows[i].rate);
+      if (num_active != i) {
+        flows[num_active] = std::move(flows[i]);
+      }
+      num_active++;
+    }
+  }
+  if (num_active < flows.size()) {
+    flows.resize(num_active);
+    update_rates();
+  }
+}
+
+void FlowLevelNetwork::clear() {
+  flows.clear();
+  link_ids.clear();
+  link_bandwidth.clear();
+  clock = 0.0;
+  next_completion = std::numeric_limits<double>::infinity();
+}
+
+void FlowLevelNetwork::drain(double now) {
+  if (now <= clock) {
+    return;
+  }
+  double elapsed = now - clock;
+  for (Flow &flow : flows) {
+    flow.remaining = std::max(flow.remaining - flow.rate * elapsed, 0.0);
+  }
+  clock = now;
+}
+
+// Progressive filling: the link that offers the smallest fair share to its
+// unfrozen flows fixes their rate, which is taken out of the other links on
+// their routes, until every flow is frozen
+void FlowLevelNetwork::update_rates() {
+  next_completion = std::numeric_limits<double>::infinity();
+  if (flows.empty()) {
+    return;
+  }
+  size_t num_links = link_bandwidth.size();
+  capacity.assign(link_bandwidth.begin(), link_bandwidth.end());
+  num_unfrozen.assign(num_links, 0);
+  for (Flow &flow : flows) {
+    flow.rate = -1.0;
+    for (int l : flow.links) {
+      num_unfrozen[l]++;
+    }
+  }
+  // the flows of every link, in CSR form
+  link_flow_offsets.assign(num_links + 1, 0);
+  for (size_t l = 0; l < num_links; l++) {
+    link_flow_offsets[l + 1] = link_flow_offsets[l] + num_unfrozen[l];
+  }
+  link_flows.resize(link_flow_offsets[num_links]);
+  for (size_t f = 0; f < flows.size(); f++) {
+    for (int l : flows[f].links) {
+      link_flows[link_flow_offsets[l + 1] - num_unfrozen[l]--] = f;
+    }
+  }
+  for (Flow const &flow : flows) {
+    for (int l : flow.links) {
+      num_unfrozen[l]++;
+    }
+  }
+  // min-heap of (fair share, link); an entry whose share is no longer the
+  // link's current one is stale
+  auto share_of = [&](int l) {
+    return std::max(capacity[l], 0.0) / num_unfrozen[l];
+  };
+  auto later = [](std::pair<double, int> const &a,
+                  std::pair<double, int> const &b) { return a > b; };
+  heap.clear();
+  for (size_t l = 0; l < num_links; l++) {
+    if (num_unfrozen[l] > 0) {
+      heap.emplace_back(share_of(l), l);
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), later);
+  touched_round.assign(num_links, 0);
+  int round = 0;
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    double share = heap.back().first;
+    int l = heap.back().second;
+    heap.pop_back();
+    if (num_unfrozen[l] == 0 || share != share_of(l)) {
+      continue;
+    }
+    for (int i = link_flow_offsets[l]; i < link_flow_offsets[l + 1]; i++) {
+      Flow &flow = flows[link_flows[i]];
+      if (flow.rate >= 0) {
+        continue;
+      }
+      flow.rate = share;
+      for (int other : flow.links) {
+        capacity[other] -= share;
+        num_unfrozen[other]--;
+      }
+    }
+    // re-rank the links that lost flows, once each
+    round++;
+    touched_round[l] = round;
+    for (int i = link_flow_offsets[l]; i < link_flow_offsets[l + 1]; i++) {
+      for (int other : flows[link_flows[i]].links) {
+        if (touched_round[other] != round && num_unfrozen[other] > 0) {
+          touched_round[other] = round;
+          heap.emplace_back(share_of(other), other);
+          std::push_heap(heap.begin(), heap.end(), later);
+        }
+      }
+    }
+  }
+  for (Flow const &flow : flows) {
+    assert(flow.rate > 0);
+    next_completion =
+        std::min(next_completion, clock + flow.remaining / flow.rate);
+  }
+}
+
+}; // namespace FlexFlow
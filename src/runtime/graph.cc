@@ -13,8 +13,10 @@
  * limitations under the License.
  */
 #include "flexflow/graph.h"
+#include "flexflow/analytical_cost_model.h"
 #include "flexflow/dominators.h"
 #include "flexflow/ffconst_utils.h"
+#include "flexflow/operator_cost_database.h"
 #include "flexflow/ops/aggregate.h"
 #include "flexflow/ops/attention.h"
 #include "flexflow/ops/batch_matmul.h"
@@ -25,6 +27,7 @@
 #include "flexflow/ops/element_binary.h"
 #include "flexflow/ops/element_unary.h"
 #include "flexflow/ops/embedding.h"
+#include "flexflow/ops/experts.h"
 #include "flexflow/ops/flat.h"
 #include "flexflow/ops/gather.h"
 #include "flexflow/ops/groupby.h"
@@ -43,9 +46,11 @@
 #include "flexflow/parallel_ops/partition.h"
 #include "flexflow/parallel_ops/reduction.h"
 #include "flexflow/parallel_ops/replicate.h"
+#include "flexflow/utils/compact_serializer.h"
 #include "flexflow/utils/disjoint_set.h"
 #include "legion.h"
 #include "legion/legion_utilities.h"
+#include <cinttypes>
 
 namespace FlexFlow::PCG {
 
@@ -121,6 +126,8 @@ T SearchHelper::find_optimal_sequence_graph_time(
   std::unique_ptr<Graph> pre_graph;
   std::unique_ptr<Graph> post_graph;
   std::tie(pre_graph, post_graph) = g->split_at_node(bn_node);
+  this->split_imm_post_dominators(
+      g, bn_node, pre_graph.get(), post_graph.get());
 
   T optimal = this->infinity<T>();
 
@@ -133,7 +140,7 @@ T SearchHelper::find_optimal_sequence_graph_time(
   // this case since parallel_op does not trigger computation
   if (bn_node.ptr->is_parallel_op()) {
     bool found = false;
-    auto const &inList = g->inEdges.find(sink.node)->second;
+    auto const &inList = g->get_in_edges(sink.node);
     for (auto const &e : inList) {
       if (e.srcOp == bn_node) {
         found = true;
@@ -184,6 +191,76 @@ void SearchHelper::clear_cache() {
   cached_operator_valid_views.clear();
 }
 
+std::unordered_map<Node, Node> const &
+    SearchHelper::get_imm_post_dominators(Graph const *graph) const {
+  using FlexFlow::PCG::Utils::imm_post_dominators;
+  using FlexFlow::PCG::Utils::MultisourceGraphStructure;
+
+  size_t hash = graph->hash();
+  auto it = this->cached_imm_post_dominators.find(hash);
+  if (it != this->cached_imm_post_dominators.end()) {
+    this->dominator_cache_stats.num_hits++;
+    return it->second;
+  }
+  this->dominator_cache_stats.num_misses++;
+  return this->cached_imm_post_dominators
+      .emplace(hash,
+               imm_post_dominators<Graph, MultisourceGraphStructure<Graph>>(
+                   *graph))
+      .first->second;
+}
+
+Node SearchHelper::find_bottleneck_node(Graph const *graph,
+                                        Node const &sink_node,
+                                        Node const &source_node) const {
+  return find_bottleneck_node_from_ipd(
+      *graph, this->get_imm_post_dominators(graph), sink_node, source_node);
+}
+
+void SearchHelper::split_imm_post_dominators(Graph const *graph,
+                                             Node const &bottleneck,
+                                             Graph const *pre_graph,
+                                             Graph const *post_graph) const {
+  using FlexFlow::PCG::Utils::nodes;
+
+  auto it = this->cached_imm_post_dominators.find(graph->hash());
+  if (it == this->cached_imm_post_dominators.end()) {
+    return;
+  }
+  // References into an unordered_map survive the insertions below
+  std::unordered_map<Node, Node> const &ipd = it->second;
+
+  size_t pre_hash = pre_graph->hash();
+  if (this->cached_imm_post_dominators.find(pre_hash) ==
+      this->cached_imm_post_dominators.end()) {
+    // The bottleneck is the sink of pre_graph; the roots are unchanged
+    std::unordered_map<Node, Node> pre_ipd;
+    for (Node const &node : nodes(*pre_graph)) {
+      pre_ipd[node] = (node == bottleneck) ? node : ipd.at(node);
+    }
+    pre_ipd[Node::INVALID_NODE] = ipd.at(Node::INVALID_NODE);
+    this->cached_imm_post_dominators.emplace(pre_hash, std::move(pre_ipd));
+    this->dominator_cache_stats.num_derived++;
+  }
+
+  size_t post_hash = post_graph->hash();
+  if (this->cached_imm_post_dominators.find(post_hash) ==
+      this->cached_imm_post_dominators.end()) {
+    // The bottleneck is the only root of post_graph
+    std::unordered_map<Node, Node> post_ipd;
+    for (Node const &node : nodes(*post_graph)) {
+      post_ipd[node] = ipd.at(node);
+    }
+    post_ipd[Node::INVALID_NODE] = bottleneck;
+    this->cached_imm_post_dominators.emplace(post_hash, std::move(post_ipd));
+    this->dominator_cache_stats.num_derived++;
+  }
+}
+
+DominatorCacheStats const &SearchHelper::get_dominator_cache_stats() const {
+  return this->dominator_cache_stats;
+}
+
 template <typename T>
 T SearchHelper::execute_nonsequence_split(
     std::unique_ptr<Graph> const &first_graph,
@@ -322,50 +399,72 @@ T SearchHelper::find_optimal_nonsequence_graph_time(
 
 Graph::Graph(FFModel *_model) : model(_model), search(_model->search) {}
 
+// The terms of Graph::hash are summed, so each of them has to be well mixed
+static size_t mix_graph_hash_term(size_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static size_t node_hash_term(Node const &node) {
+  return mix_graph_hash_term((size_t)node.ptr);
+}
+
+static size_t edge_hash_term(Edge const &e) {
+  size_t edge_hash = 17;
+  edge_hash = edge_hash * 31 + std::hash<size_t>()((size_t)e.srcOp.ptr);
+  edge_hash = edge_hash * 31 + std::hash<size_t>()((size_t)e.dstOp.ptr);
+  edge_hash = edge_hash * 31 + std::hash<int>()(e.srcIdx);
+  edge_hash = edge_hash * 31 + std::hash<int>()(e.dstIdx);
+  return mix_graph_hash_term(edge_hash);
+}
+
 void Graph::add_edge(Node const &srcOp,
                      Node const &dstOp,
                      int srcIdx,
                      int dstIdx) {
-  if (inEdges.find(dstOp) == inEdges.end()) {
-    inEdges[dstOp];
-  }
-  if (outEdges.find(srcOp) == outEdges.end()) {
-    outEdges[srcOp];
-  }
-  Edge e(srcOp, dstOp, srcIdx, dstIdx);
-  inEdges[srcOp];
-  outEdges[dstOp];
-  inEdges[dstOp].insert(e);
-  outEdges[srcOp].insert(e);
+  this->add_edge(Edge(srcOp, dstOp, srcIdx, dstIdx));
 }
 
 void Graph::add_node(Node const &node) {
+  if (inEdges.find(node) == inEdges.end()) {
+    hash_value += node_hash_term(node);
+  }
   inEdges[node];
   outEdges[node];
 }
 
 void Graph::add_edge(Edge const &e) {
-  inEdges[e.srcOp];
-  outEdges[e.dstOp];
+  this->add_node(e.srcOp);
+  this->add_node(e.dstOp);
 
-  inEdges[e.dstOp].insert(e);
+  if (inEdges[e.dstOp].insert(e).second) {
+    hash_value += edge_hash_term(e);
+  }
   outEdges[e.srcOp].insert(e);
 }
 
 void Graph::remove_edge(Edge const &e, bool remove_node_if_unused) {
-  assert(outEdges[e.srcOp].find(e) != outEdges[e.srcOp].end());
-  assert(inEdges[e.dstOp].find(e) != inEdges[e.dstOp].end());
-  assert(outEdges[e.srcOp].erase(e) == 1);
-  assert(inEdges[e.dstOp].erase(e) == 1);
+  size_t num_out_erased = outEdges.at(e.srcOp).erase(e);
+  size_t num_in_erased = inEdges.at(e.dstOp).erase(e);
+  assert(num_out_erased == 1);
+  assert(num_in_erased == 1);
+  hash_value -= edge_hash_term(e);
   if (remove_node_if_unused) {
-    if ((outEdges[e.srcOp].size() == 0) && (inEdges[e.srcOp].size() == 0)) {
-      outEdges.erase(e.srcOp);
-      inEdges.erase(e.srcOp);
-    }
-    if ((outEdges[e.dstOp].size() == 0) && (inEdges[e.dstOp].size() == 0)) {
-      outEdges.erase(e.dstOp);
-      inEdges.erase(e.dstOp);
-    }
+    auto remove_if_unused = [&](Node const &node) {
+      auto const &it = inEdges.find(node);
+      if (it != inEdges.end() && it->second.empty() &&
+          outEdges.at(node).empty()) {
+        inEdges.erase(it);
+        outEdges.erase(node);
+        hash_value -= node_hash_term(node);
+      }
+    };
+    remove_if_unused(e.srcOp);
+    remove_if_unused(e.dstOp);
   }
 }
 
@@ -465,7 +564,7 @@ void Graph::print_dot(std::ostream &s) const {
   s << std::endl;
 }
 
-bool Graph::has_loop(void) {
+bool Graph::has_loop(void) const {
   std::unordered_map<Node, int> todos;
   std::vector<Node> opList;
   for (auto const &it : inEdges) {
@@ -478,7 +577,7 @@ bool Graph::has_loop(void) {
   size_t i = 0;
   while (i < opList.size()) {
     Node op = opList[i++];
-    auto const &outList = outEdges[op];
+    auto const &outList = outEdges.at(op);
     for (auto const &it2 : outList) {
       todos[it2.dstOp]--;
       if (todos[it2.dstOp] == 0) {
@@ -604,23 +703,23 @@ std::vector<MachineView> SearchHelper::get_valid_machine_views(
   return valid_views;
 }
 
-Node Graph::find_bottleneck_node(Node const &sink_node,
-                                 Node const &source_node) const {
-  using FlexFlow::PCG::Utils::GraphStructure;
-  using FlexFlow::PCG::Utils::imm_post_dominators;
-  using FlexFlow::PCG::Utils::MultisourceGraphStructure;
+/**
+ * @brief Bottleneck of the (source, sink) subproblem given the immediate
+ * post-dominators of graph computed over MultisourceGraphStructure.
+ */
+static Node find_bottleneck_node_from_ipd(
+    Graph const &graph,
+    std::unordered_map<Node, Node> const &ipd,
+    Node const &sink_node,
+    Node const &source_node) {
   using FlexFlow::PCG::Utils::roots;
 
   Node source(source_node);
-  std::unordered_map<Node, Node> ipd;
-  std::unordered_set<Node> graph_roots = roots(*this);
-  if (source_node != Node::INVALID_NODE) {
-    ipd = imm_post_dominators(*this);
-  } else if (graph_roots.size() == 1) {
-    ipd = imm_post_dominators(*this);
-    source = *graph_roots.begin();
-  } else {
-    ipd = imm_post_dominators<Graph, MultisourceGraphStructure<Graph>>(*this);
+  if (source_node == Node::INVALID_NODE) {
+    std::unordered_set<Node> graph_roots = roots(graph);
+    if (graph_roots.size() == 1) {
+      source = *graph_roots.begin();
+    }
   }
 
   Node bn_node = ipd.at(source);
@@ -631,6 +730,18 @@ Node Graph::find_bottleneck_node(Node const &sink_node,
   return bn_node;
 }
 
+Node Graph::find_bottleneck_node(Node const &sink_node,
+                                 Node const &source_node) const {
+  using FlexFlow::PCG::Utils::imm_post_dominators;
+  using FlexFlow::PCG::Utils::MultisourceGraphStructure;
+
+  // The virtual source does not change the post-dominators of real nodes, so
+  // a single computation serves all three kinds of source
+  std::unordered_map<Node, Node> ipd =
+      imm_post_dominators<Graph, MultisourceGraphStructure<Graph>>(*this);
+  return find_bottleneck_node_from_ipd(*this, ipd, sink_node, source_node);
+}
+
 void Edge::replace_node(Node const &currentOp, Node const &replaceWith) {
   if (this->srcOp == currentOp) {
     this->srcOp = replaceWith;
@@ -669,7 +780,7 @@ void Graph::remove_node(Node const &node, bool purge_edges) {
     for (auto const &e : out_edges) {
       this->remove_edge(e, false /*remove_node_if_unused*/);
     }
-    std::unordered_set<Edge> in_edges = this->outEdges.at(node);
+    std::unordered_set<Edge> in_edges = this->inEdges.at(node);
     for (auto const &e : in_edges) {
       this->remove_edge(e, false /*remove_node_if_unused*/);
     }
@@ -677,10 +788,73 @@ void Graph::remove_node(Node const &node, bool purge_edges) {
     assert(this->inEdges.at(node).empty());
     assert(this->outEdges.at(node).empty());
   }
-  this->inEdges.erase(node);
+  if (this->inEdges.erase(node) > 0) {
+    hash_value -= node_hash_term(node);
+  }
   this->outEdges.erase(node);
 }
 
+size_t GraphRewrite::hash(Graph const &base) const {
+  size_t hash_value = base.hash();
+  // Change in the number of edges of every node the rewrite touches
+  std::unordered_map<Node, int> degree_changes;
+  for (Edge const &e : removed_edges) {
+    hash_value -= edge_hash_term(e);
+    degree_changes[e.srcOp]--;
+    degree_changes[e.dstOp]--;
+  }
+  for (Edge const &e : added_edges) {
+    hash_value += edge_hash_term(e);
+    degree_changes[e.srcOp]++;
+    degree_changes[e.dstOp]++;
+  }
+  for (Node const &node : edgeless_nodes) {
+    degree_changes[node];
+  }
+  for (auto const &kv : degree_changes) {
+    Node const &node = kv.first;
+    auto const &it = base.get_in_edges().find(node);
+    bool in_base = it != base.get_in_edges().end();
+    int degree = kv.second;
+    if (in_base) {
+      degree += it->second.size() + base.get_out_edges(node).size();
+    }
+    if (in_base && degree == 0) {
+      hash_value -= node_hash_term(node);
+    } else if (!in_base && degree > 0) {
+      hash_value += node_hash_term(node);
+    }
+  }
+  return hash_value;
+}
+
+Graph *GraphRewrite::apply(Graph const &base) const {
+  Graph *graph = new Graph(base);
+  for (Edge const &e : removed_edges) {
+    graph->remove_edge(e, false /*remove_node_if_unused*/);
+  }
+  for (Edge const &e : added_edges) {
+    assert(!graph->has_edge(e));
+    graph->add_edge(e);
+  }
+  auto remove_if_edgeless = [&](Node const &node) {
+    auto const &it = graph->get_in_edges().find(node);
+    if (it != graph->get_in_edges().end() && it->second.empty() &&
+        graph->get_out_edges(node).empty()) {
+      graph->remove_node(node);
+    }
+  };
+  for (Edge const &e : removed_edges) {
+    remove_if_edgeless(e.srcOp);
+    remove_if_edgeless(e.dstOp);
+  }
+  for (Node const &node : edgeless_nodes) {
+    remove_if_edgeless(node);
+  }
+  assert(graph->hash() == this->hash(base));
+  return graph;
+}
+
 /*static*/
 Graph Graph::singleton(FFModel *model, Node const &node) {
   Graph g(model);
@@ -1441,7 +1615,7 @@ T SearchHelper::estimate_xfer_cost(Graph const *graph,
   T result = this->empty<T>();
 
   if (source.node != Node::INVALID_NODE) {
-    auto const &inList = graph->inEdges.find(sink.node)->second;
+    auto const &inList = graph->get_in_edges(sink.node);
     float op_cost = 0.0f;
     for (auto const &it2 : inList) {
       assert(it2.srcOp == source.node);
@@ -1479,7 +1653,7 @@ GraphCostResultWithMemory
 
   if (source.node != Node::INVALID_NODE) {
     // Get the in-edges of the sink node
-    auto const &inList = graph->inEdges.find(sink.node)->second;
+    auto const &inList = graph->get_in_edges(sink.node);
     float op_cost = 0.0f; // run time cost
     for (auto const &it2 : inList) {
       // For all edges between source node and sink node
@@ -1605,9 +1779,10 @@ T SearchHelper::graph_cost(Graph const *graph,
     graph->print_dot();
   }
 
-  assert(graph->inEdges.find(sink.node) != graph->inEdges.end());
+  assert(graph->get_in_edges().find(sink.node) != graph->get_in_edges().end());
   if (source.node != Node::INVALID_NODE) {
-    assert(graph->outEdges.find(source.node) != graph->outEdges.end());
+    assert(graph->get_out_edges().find(source.node) !=
+           graph->get_out_edges().end());
   }
 
   size_t hash = dp_state_hash(
@@ -1621,14 +1796,15 @@ T SearchHelper::graph_cost(Graph const *graph,
     // cached_graph_costs does not include sink_compute_time
     result = from_cache.second;
   } else {
-    if (graph->inEdges.size() <= 2) {
+    if (graph->get_in_edges().size() <= 2) {
       // When there are no more than 2 nodes in the graph
       result = this->estimate_xfer_cost<T>(graph, source, sink);
       this->logger->debug()
           << "[PCG::SearchHelper::graph_cost] Estimated xfer cost is "
           << this->get_cost(result);
     } else {
-      Node bn_node = graph->find_bottleneck_node(sink.node, source.node);
+      Node bn_node =
+          this->find_bottleneck_node(graph, sink.node, source.node);
       if (bn_node != Node::INVALID_NODE) {
         // We found a bottleneck node
         this->logger->debug() << "Found bn_node = " << bn_node.guid;
@@ -1642,7 +1818,7 @@ T SearchHelper::graph_cost(Graph const *graph,
       } else {
         // sink node must have multiple branches
         // otherwise we should not be here
-        assert(graph->inEdges.find(sink.node)->second.size() > 1);
+        assert(graph->get_in_edges(sink.node).size() > 1);
 
         result = this->find_optimal_nonsequence_graph_time<T>(
             graph,
@@ -1843,21 +2019,10 @@ T Graph::generic_optimal_cost() const {
 }
 
 size_t Graph::hash(void) const {
-  // Graph hash should be additive and independent to the ordering of the nodes
-  size_t total_hash = 0;
-  for (auto const &it : inEdges) {
-    auto const &inList = it.second;
-    size_t node_hash = std::hash<size_t>()((size_t)it.first.ptr);
-    for (auto const &e : inList) {
-      size_t edge_hash = 17;
-      edge_hash = edge_hash * 31 + std::hash<size_t>()((size_t)e.srcOp.ptr);
-      edge_hash = edge_hash * 31 + std::hash<int>()(e.srcIdx);
-      edge_hash = edge_hash * 31 + std::hash<int>()(e.dstIdx);
-      node_hash *= edge_hash;
-    }
-    total_hash += node_hash;
-  }
-  return total_hash;
+  // Graph hash should be additive and independent to the ordering of the
+  // nodes; it is maintained incrementally as nodes and edges are added and
+  // removed
+  return hash_value;
 }
 
 size_t dp_state_hash(Graph const *graph,
@@ -1900,10 +2065,18 @@ std::pair<std::unique_ptr<Graph>, std::unordered_map<Node, MachineView>>
                                     model->config.workersPerNode,
                                     model->config.cpusPerNode,
                                     model->all_valid_views);
-  Memory gpu_mem = Machine::MemoryQuery(Machine::get_machine())
-                       .only_kind(Memory::GPU_FB_MEM)
-                       .best_affinity_to(task->target_proc)
-                       .first();
+  // With --analytical-cost-model the task may run on a CPU, and then takes
+  // the size of the framebuffer of any GPU.
+  // TODO: planning on a host without GPUs also needs FFModel to skip the
+  // FF_INIT_TASK of its handlers, and the size of the GPU memory to come
+  // from the config
+  Machine::MemoryQuery gpu_mems(Machine::get_machine());
+  gpu_mems.only_kind(Memory::GPU_FB_MEM);
+  if (task->target_proc.kind() == Processor::TOC_PROC) {
+    gpu_mems.best_affinity_to(task->target_proc);
+  }
+  Memory gpu_mem = gpu_mems.first();
+  assert(gpu_mem.exists() && "the machine model needs a GPU memory");
   MachineModel *machine;
   if (model->config.machine_model_version == 0) {
     machine =
@@ -1914,22 +2087,44 @@ std::pair<std::unique_ptr<Graph>, std::unordered_map<Node, MachineView>>
              !model->config.machine_model_file.empty()) {
     machine = (MachineModel *)new EnhancedMachineModel(
         model->config.machine_model_file, gpu_mem.capacity());
+  } else if (model->config.machine_model_version == 2 and
+             !model->config.machine_model_file.empty()) {
+    machine = (MachineModel *)NetworkedMachineModel::from_config_file(
+        model->config.machine_model_file, gpu_mem.capacity());
   } else {
     assert(false &&
            "machine model creation error: currently only support "
-           "machine-model-version = 0 or 1. When machine-model-version = 1, "
-           "machine-model-file should not be empty.");
+           "machine-model-version = 0, 1 or 2. When machine-model-version = "
+           "1 or 2, machine-model-file should not be empty.");
+  }
+  if (model->config.gpu_peak_tflops > 0) {
+    machine->gpu_peak_flops = model->config.gpu_peak_tflops * 1e9f;
+  }
+  if (model->config.gpu_fb_mem_bandwidth > 0) {
+    machine->gpu_fb_mem_bandwidth =
+        model->config.gpu_fb_mem_bandwidth * 1024 * 1024;
   }
   // Assume this task is running on GPU0
   if (!cached_simulator) {
     cached_simulator = std::make_shared<Simulator>(
         model, model->handlers[0], gpu_mem, machine);
+    if (!model->config.cost_database_file.empty()) {
+      cached_simulator->cost_database = std::make_shared<OperatorCostDatabase>(
+          model->config.cost_database_file);
+      log_graph.print("Loaded %zu operator costs from %s",
+                      cached_simulator->cost_database->size(),
+                      model->config.cost_database_file.c_str());
+    }
   } else {
     // Update simulator with the new stuff
     cached_simulator->handler = model->handlers[0];
     cached_simulator->memory = gpu_mem;
     cached_simulator->machine = machine;
   }
+  if (model->config.analytical_cost_model) {
+    cached_simulator->cost_model = std::make_shared<AnalyticalCostModel>(
+        machine, model->config.computationMode);
+  }
   model->simulator = cached_simulator.get();
 
   // Perform the search
@@ -1959,23 +2154,69 @@ std::pair<std::unique_ptr<Graph>, std::unordered_map<Node, MachineView>>
         model->config.numNodes * model->config.workersPerNode;
     data_parallel_view.stride[0] = 1;
     data_parallel_view.start_device_id = 0;
-    for (auto const &node : curr_best_graph->inEdges) {
+    for (auto const &node : curr_best_graph->get_in_edges()) {
       curr_optimal_views[node.first] = data_parallel_view;
     }
   } else {
+    MemoryOptimConfig mem_config{lambda.first};
+    mem_config.mem_search_algo = model->config.memory_search_algo;
     // Main step to optimize the PCG of an FFModel
     model->graph_optimize(model->config.search_budget,
                           model->config.only_data_parallel,
                           curr_best_graph,
                           curr_optimal_views,
                           perform_memory_search,
-                          MemoryOptimConfig{lambda.first},
+                          mem_config,
                           lambda.second);
   }
   // Return the best result of the current search
   return std::make_pair(std::move(curr_best_graph), curr_optimal_views);
 };
 
+/**
+ * @brief Peak memory of each device in MB when the memory of an operator is
+ * only counted while it is live. See LivenessMemoryModel.
+ */
+std::unordered_map<int, float> per_device_live_memory(
+    Graph *curr_graph,
+    std::unordered_map<Node, MachineView> &curr_views,
+    std::shared_ptr<Simulator> const cached_simulator,
+    bool training) {
+  using FlexFlow::PCG::Utils::topo_sort;
+
+  std::vector<Node> topo_sorted;
+  topo_sort(*curr_graph, &topo_sorted);
+
+  LivenessMemoryModel liveness;
+  std::unordered_map<Node, int> node_to_index;
+  for (auto const &node : topo_sorted) {
+    auto view = curr_views.find(node);
+    if (view == curr_views.end()) {
+      continue;
+    }
+    CostMetrics op_cost =
+        cached_simulator->measure_operator_cost(node.ptr, view->second);
+    std::vector<int> producers;
+    for (auto const &edge : curr_graph->get_in_edges(node)) {
+      auto producer = node_to_index.find(edge.srcOp);
+      if (producer != node_to_index.end()) {
+        producers.push_back(producer->second);
+      }
+    }
+    node_to_index[node] = liveness.add_op(view->second.device_ids(),
+                                          op_cost.weights_memory,
+                                          op_cost.outputs_memory,
+                                          producers);
+  }
+
+  std::unordered_map<int, float> device_to_mem{};
+  for (auto const &d : liveness.peak_memory(training)) {
+    // Same rounding as CostMetrics::total_memory_in_mb
+    device_to_mem[d.first] = (float)(d.second / 1e4) / 1e2;
+  }
+  return device_to_mem;
+}
+
 /**
  * @brief Analyze the per-device memory cost and compare with the memory
  * threshold of each device.
@@ -1985,7 +2226,9 @@ bool is_valid_strategy(
     Graph *curr_graph,
     std::unordered_map<Node, MachineView> &curr_views,
     std::shared_ptr<Simulator> const cached_simulator,
-    float memory_threshold) {
+    float memory_threshold,
+    MemoryUsageType usage_type,
+    bool training) {
   std::cout << "try to check valid for lambda " << lambdas_results.back().first
             << std::endl;
   assert(cached_simulator.get() != nullptr &&
@@ -1994,16 +2237,22 @@ bool is_valid_strategy(
   // Analyze the strategy and update max_per_device_mem_all_deivces in the
   // lambda_result.
   std::unordered_map<int, float> device_to_mem{};
-  for (auto const &view : curr_views) {
-    CostMetrics op_cost =
-        cached_simulator->measure_operator_cost(view.first.ptr, view.second);
-    float node_mem_as_mb = op_cost.total_memory_in_mb();
-
-    for (auto const d_id : view.second.device_ids()) {
-      if (device_to_mem.find(d_id) == device_to_mem.end()) {
-        device_to_mem.emplace(std::make_pair(d_id, node_mem_as_mb));
-      } else {
-        device_to_mem[d_id] += node_mem_as_mb;
+  if (usage_type == MemoryUsageType::PER_DEVICE_LIVENESS) {
+    device_to_mem = per_device_live_memory(
+        curr_graph, curr_views, cached_simulator, training);
+  } else {
+    assert(usage_type == MemoryUsageType::PER_DEVICE_MAX);
+    for (auto const &view : curr_views) {
+      CostMetrics op_cost =
+          cached_simulator->measure_operator_cost(view.first.ptr, view.second);
+      float node_mem_as_mb = op_cost.total_memory_in_mb();
+
+      for (auto const d_id : view.second.device_ids()) {
+        if (device_to_mem.find(d_id) == device_to_mem.end()) {
+          device_to_mem.emplace(std::make_pair(d_id, node_mem_as_mb));
+        } else {
+          device_to_mem[d_id] += node_mem_as_mb;
+        }
       }
     }
   }
@@ -2051,6 +2300,8 @@ GraphOptimalViewSerialized
   auto model_config = (*((FFModel **)task->args))->config;
   bool perform_memory_search = model_config.perform_memory_search;
   float memory_threshold = model_config.device_mem;
+  MemoryUsageType memory_usage_type = model_config.memory_usage_type;
+  bool training = model_config.computationMode == COMP_MODE_TRAINING;
   bool only_data_parallel = model_config.only_data_parallel;
 
   std::vector<std::pair<float, MemorySearchResult>> lambdas{};
@@ -2072,11 +2323,38 @@ GraphOptimalViewSerialized
   int best_lambda_index = -1;
   int binary_search_budget = 10;
 
-  if (perform_memory_search && !is_valid_strategy(lambdas,
+  if (perform_memory_search &&
+      model_config.memory_search_algo == MemorySearchAlgo::PARETO) {
+    // The search found every strategy that no other one beats in both run
+    // time and memory, fastest first; take the first one that fits
+    FFModel *model = *((FFModel **)task->args);
+    for (size_t i = 0; !has_valid_strategy; i++) {
+      if (i > 0) {
+        lambdas.emplace_back(std::make_pair(1.0, MemorySearchResult{}));
+        if (!model->get_pareto_strategy(
+                i, best_graph, optimal_views, lambdas.back().second)) {
+          lambdas.pop_back();
+          break;
+        }
+      }
+      if (is_valid_strategy(lambdas,
+                            best_graph.get(),
+                            optimal_views,
+                            cached_simulator,
+                            memory_threshold,
+                            memory_usage_type,
+                            training)) {
+        has_valid_strategy = true;
+        best_lambda_index = i;
+      }
+    }
+  } else if (perform_memory_search && !is_valid_strategy(lambdas,
                                                   best_graph.get(),
                                                   optimal_views,
                                                   cached_simulator,
-                                                  memory_threshold)) {
+                                                  memory_threshold,
+                                                  memory_usage_type,
+                                                  training)) {
     // Not found the strategy; need to do binary search
     lambdas.emplace_back(std::make_pair(0.0, MemorySearchResult{}));
     try_result = try_one_lambda(
@@ -2088,7 +2366,9 @@ GraphOptimalViewSerialized
                            best_graph.get(),
                            optimal_views,
                            cached_simulator,
-                           memory_threshold)) {
+                           memory_threshold,
+                           memory_usage_type,
+                           training)) {
       // Cannot find a valid strategy
       has_valid_strategy = false;
     } else {
@@ -2113,7 +2393,9 @@ GraphOptimalViewSerialized
                                try_result.first.get(),
                                try_result.second,
                                cached_simulator,
-                               memory_threshold)) {
+                               memory_threshold,
+                               memory_usage_type,
+                               training)) {
           upper = mid;
         } else {
           // Found a better and valid strategy
@@ -2161,12 +2443,19 @@ GraphOptimalViewSerialized
 
   // Following lines are to serialize the optimized PCG.
   // Only need best_graph and optimal_views below.
-  Serializer sez;
-  // First serialize graph
-  sez.serialize(best_graph->inEdges.size());
+  // The PCG is encoded as:
+  //   MAGIC, VERSION
+  //   the distinct shapes of the input tensors
+  //   the distinct MachineViews
+  //   the nodes in topological order: op type, in-edges (source node by its
+  //   distance to the node in that order), shape and view by their index
+  //   the op-specific parameters of all nodes, back to back
+  // Integers are varints and nodes are referenced by index, so that the
+  // encoding is compact and decoding needs no guid lookups. The op-specific
+  // parameters use the Legion Serializer format read by Op::deserialize.
   std::unordered_map<Node, int> todos;
   std::vector<Node> opList;
-  for (auto const &it : best_graph->inEdges) {
+  for (auto const &it : best_graph->get_in_edges()) {
     auto const &inList = it.second;
     todos[it.first] = (int)inList.size();
     if (todos[it.first] == 0) {
@@ -2176,37 +2465,91 @@ GraphOptimalViewSerialized
   size_t node_idx = 0;
   while (node_idx < opList.size()) {
     Node cur_node = opList[node_idx++];
-    auto const &outList = best_graph->outEdges[cur_node];
+    auto const &outList = best_graph->get_out_edges(cur_node);
     for (auto const &e : outList) {
       todos[e.dstOp]--;
       if (todos[e.dstOp] == 0) {
         opList.push_back(e.dstOp);
       }
     }
-    auto const &inList = best_graph->inEdges[cur_node];
-    sez.serialize(inList.size());
-    for (auto const &e : inList) {
-      sez.serialize(e.srcOp.guid);
-      assert(e.dstOp.guid == cur_node.guid);
-      sez.serialize(e.srcIdx);
-      sez.serialize(e.dstIdx);
+  }
+  assert(node_idx == best_graph->get_in_edges().size());
+  std::unordered_map<Node, size_t> node_to_idx;
+  std::vector<ParallelTensorShape> shapes;
+  std::unordered_map<ParallelTensorShape, size_t> shape_to_idx;
+  std::vector<MachineView> views;
+  std::unordered_map<MachineView, size_t> view_to_idx;
+  for (Node const &node : opList) {
+    node_to_idx.emplace(node, node_to_idx.size());
+    if (node.ptr->op_type == OP_INPUT) {
+      ParallelTensorShape shape = node.ptr->outputs[0]->get_shape();
+      if (shape_to_idx.emplace(shape, shapes.size()).second) {
+        shapes.push_back(shape);
+      }
     }
-    sez.serialize((size_t)10101010); // safe guard for the end of inedges
+    auto view = optimal_views.find(node);
+    if (view != optimal_views.end() &&
+        view_to_idx.emplace(view->second, views.size()).second) {
+      views.push_back(view->second);
+    }
+  }
+  printf("optimal_views.size = %zu\n", optimal_views.size());
+
+  CompactSerializer csez;
+  csez.write_bytes(GraphOptimalViewSerialized::MAGIC,
+                   sizeof(GraphOptimalViewSerialized::MAGIC));
+  csez.write_varint(GraphOptimalViewSerialized::VERSION);
+  csez.write_varint(shapes.size());
+  for (ParallelTensorShape const &shape : shapes) {
+    csez.write_varint(shape.data_type);
+    csez.write_varint(shape.num_dims);
+    for (int i = 0; i < shape.num_dims; i++) {
+      csez.write_varint(shape.dims[i].size);
+      csez.write_signed_varint(shape.dims[i].degree);
+      csez.write_signed_varint(shape.dims[i].parallel_idx);
+      csez.write_varint(shape.dims[i].is_replica_dim);
+    }
+  }
+  csez.write_varint(views.size());
+  for (MachineView const &view : views) {
+    csez.write_varint(view.device_type);
+    csez.write_varint(view.ndims);
+    csez.write_varint(view.start_device_id);
+    for (int i = 0; i < view.ndims; i++) {
+      csez.write_varint(view.dim[i]);
+      csez.write_varint(view.stride[i]);
+    }
+  }
+  csez.write_varint(opList.size());
+  Serializer sez;
+  for (node_idx = 0; node_idx < opList.size(); node_idx++) {
+    Node const &cur_node = opList[node_idx];
     Op const *op = cur_node.ptr;
     assert(op != NULL);
-    sez.serialize(cur_node.guid);
-    sez.serialize(op->op_type);
+    csez.write_varint(op->op_type);
+    // In-edges in the order of the op's inputs
+    auto const &inList = best_graph->get_in_edges(cur_node);
+    std::vector<Edge const *> inputs(inList.size(), nullptr);
+    for (auto const &e : inList) {
+      assert(e.dstOp.guid == cur_node.guid);
+      assert(e.dstIdx < (int)inputs.size() && inputs[e.dstIdx] == nullptr);
+      inputs[e.dstIdx] = &e;
+    }
+    csez.write_varint(inputs.size());
+    for (Edge const *e : inputs) {
+      csez.write_varint(node_idx - node_to_idx.at(e->srcOp));
+      csez.write_varint(e->srcIdx);
+    }
+    auto view = optimal_views.find(cur_node);
+    csez.write_varint(view == optimal_views.end()
+                          ? 0
+                          : view_to_idx.at(view->second) + 1);
     switch (op->op_type) {
       case OP_INPUT: {
         assert(op->numOutputs == 1);
         NoOp *noop = (NoOp *)op;
-        sez.serialize(noop->op_type);
-        sez.serialize(noop->input_tensor_guid);
-        sez.serialize(noop->outputs[0]->data_type);
-        sez.serialize(noop->outputs[0]->num_dims);
-        for (int i = 0; i < noop->outputs[0]->num_dims; i++) {
-          sez.serialize(noop->outputs[0]->dims[i]);
-        }
+        csez.write_varint(noop->input_tensor_guid);
+        csez.write_varint(shape_to_idx.at(noop->outputs[0]->get_shape()));
         break;
       }
       case OP_NOOP: {
@@ -2240,7 +2583,6 @@ GraphOptimalViewSerialized
       case OP_EW_MUL:
       case OP_EW_MAX:
       case OP_EW_MIN: {
-        sez.serialize(op->op_type);
         break;
       }
       case OP_MULTIHEAD_ATTENTION: {
@@ -2297,26 +2639,42 @@ GraphOptimalViewSerialized
         op->serialize(sez);
       }
     }
-    sez.serialize((size_t)12345678); // safe guard for the end of an op
   }
-  assert(node_idx == best_graph->inEdges.size());
-  // Second, serialize optimal machine view
-  printf("optimal_views.size = %zu\n", optimal_views.size());
-  sez.serialize(optimal_views.size());
   for (auto const &it : optimal_views) {
-    sez.serialize((size_t)98765432); // safe guard
-    sez.serialize(it.first.guid);
-    sez.serialize(it.second);
+    // Every view must belong to a node of the graph to be restored
+    assert(node_to_idx.find(it.first) != node_to_idx.end());
   }
-  assert(sez.get_used_bytes() < GraphOptimalViewSerialized::buffer_size);
+  csez.write_varint(sez.get_used_bytes());
+  csez.write_bytes(sez.get_buffer(), sez.get_used_bytes());
   GraphOptimalViewSerialized ret;
-  ret.total_bytes = sez.get_used_bytes();
-  memcpy(ret.data, sez.get_buffer(), ret.total_bytes);
+  ret.data.swap(csez.get_buffer());
   // Deallocate best_graph
   // delete best_graph;
   return ret;
 }
 
+// MAGIC is ODR-used, which needs a namespace-scope definition before C++17
+constexpr char GraphOptimalViewSerialized::MAGIC[4];
+
+size_t GraphOptimalViewSerialized::legion_buffer_size(void) const {
+  return sizeof(size_t) + data.size();
+}
+
+size_t GraphOptimalViewSerialized::legion_serialize(void *buffer) const {
+  size_t num_bytes = data.size();
+  memcpy(buffer, &num_bytes, sizeof(size_t));
+  memcpy(static_cast<char *>(buffer) + sizeof(size_t), data.data(), num_bytes);
+  return sizeof(size_t) + num_bytes;
+}
+
+size_t GraphOptimalViewSerialized::legion_deserialize(void const *buffer) {
+  size_t num_bytes;
+  memcpy(&num_bytes, buffer, sizeof(size_t));
+  char const *bytes = static_cast<char const *>(buffer) + sizeof(size_t);
+  data.assign(bytes, bytes + num_bytes);
+  return sizeof(size_t) + num_bytes;
+}
+
 }; // namespace FlexFlow::PCG
 
 namespace FlexFlow {
@@ -2367,7 +2725,7 @@ float FFModel::graph_cost(Graph const *graph,
                           MachineResource const &resources,
                           bool include_sink_compute_time,
                           bool constructing_optimal_view) {
-  assert(!graph->inEdges.empty());
+  assert(!graph->get_in_edges().empty());
 
   return this->search->graph_cost<float>(graph,
                                          {source_node, source_view},
@@ -2397,65 +2755,105 @@ void FFModel::construct_optimal_view(
 }
 
 void FFModel::deserialize_graph_optimal_view(
-    Legion::Deserializer &dez,
+    PCG::GraphOptimalViewSerialized const &serialized,
     Graph *graph,
     std::unordered_map<Node, MachineView> &optimal_views) {
-  // Deserializer dez(serialized.data, serialized.total_bytes);
-  std::unordered_map<size_t, Node> guid_to_nodes;
-  size_t num_nodes;
-  dez.deserialize(num_nodes);
-  // best_graph = new Graph(this);
-  for (size_t node_idx = 0; node_idx < num_nodes; node_idx++) {
+  // See Graph::graph_optimize_task for the encoding
+  CompactDeserializer cdez(serialized.data.data(), serialized.data.size());
+  char magic[sizeof(PCG::GraphOptimalViewSerialized::MAGIC)];
+  cdez.read_bytes(magic, sizeof(magic));
+  assert(memcmp(magic, PCG::GraphOptimalViewSerialized::MAGIC, sizeof(magic)) ==
+         0);
+  uint64_t version = cdez.read_varint();
+  if (version != PCG::GraphOptimalViewSerialized::VERSION) {
+    fprintf(stderr,
+            "Unsupported version %" PRIu64 " of the serialized PCG\n",
+            version);
+    assert(false);
+  }
+  std::vector<ParallelTensorShape> shapes(cdez.read_varint());
+  for (ParallelTensorShape &shape : shapes) {
+    shape.data_type = static_cast<DataType>(cdez.read_varint());
+    shape.num_dims = static_cast<int>(cdez.read_varint());
+    assert(shape.num_dims <= MAX_TENSOR_DIM);
+    for (int i = 0; i < shape.num_dims; i++) {
+      shape.dims[i].size = static_cast<int>(cdez.read_varint());
+      shape.dims[i].degree = static_cast<int>(cdez.read_signed_varint());
+      shape.dims[i].parallel_idx = static_cast<int>(cdez.read_signed_varint());
+      shape.dims[i].is_replica_dim = cdez.read_varint() != 0;
+    }
+  }
+  std::vector<MachineView> views(cdez.read_varint());
+  for (MachineView &view : views) {
+    view.device_type =
+        static_cast<MachineView::DeviceType>(cdez.read_varint());
+    view.ndims = static_cast<int>(cdez.read_varint());
+    assert(view.ndims <= MAX_TENSOR_DIM);
+    view.start_device_id = static_cast<int>(cdez.read_varint());
+    for (int i = 0; i < view.ndims; i++) {
+      view.dim[i] = static_cast<int>(cdez.read_varint());
+      view.stride[i] = static_cast<int>(cdez.read_varint());
+    }
+  }
+  std::vector<Node> nodes(cdez.read_varint());
+  // The op-specific parameters follow the nodes; find them by first decoding
+  // the nodes' structure
+  struct NodeRecord {
+    OperatorType op_type;
+    size_t num_inputs, first_input, view_idx;
+    size_t input_tensor_guid, shape_idx;
+  };
+  std::vector<NodeRecord> records(nodes.size());
+  std::vector<std::pair<size_t, int>> record_inputs;
+  for (size_t node_idx = 0; node_idx < nodes.size(); node_idx++) {
+    NodeRecord &record = records[node_idx];
+    record.op_type = static_cast<OperatorType>(cdez.read_varint());
+    record.num_inputs = cdez.read_varint();
+    assert(record.num_inputs <= MAX_NUM_INPUTS);
+    record.first_input = record_inputs.size();
+    for (size_t j = 0; j < record.num_inputs; j++) {
+      uint64_t distance = cdez.read_varint();
+      assert(distance >= 1 && distance <= node_idx);
+      int src_idx = static_cast<int>(cdez.read_varint());
+      record_inputs.emplace_back(node_idx - distance, src_idx);
+    }
+    record.view_idx = cdez.read_varint();
+    assert(record.view_idx <= views.size());
+    if (record.op_type == OP_INPUT) {
+      record.input_tensor_guid = cdez.read_varint();
+      record.shape_idx = cdez.read_varint();
+      assert(record.shape_idx < shapes.size());
+    }
+  }
+  size_t params_bytes = cdez.read_varint();
+  Deserializer dez(cdez.skip_bytes(params_bytes), params_bytes);
+  assert(cdez.get_remaining_bytes() == 0);
+  for (size_t node_idx = 0; node_idx < nodes.size(); node_idx++) {
+    NodeRecord const &record = records[node_idx];
     Edge inedges[MAX_NUM_INPUTS];
     ParallelTensor inputs[MAX_NUM_INPUTS];
-    size_t num_inputs;
-    dez.deserialize(num_inputs);
+    size_t num_inputs = record.num_inputs;
     for (size_t j = 0; j < num_inputs; j++) {
-      size_t src_guid;
-      int src_idx, dst_idx;
-      dez.deserialize(src_guid);
-      assert(guid_to_nodes.find(src_guid) != guid_to_nodes.end());
-      dez.deserialize(src_idx);
-      dez.deserialize(dst_idx);
-      assert(dst_idx < (int)num_inputs);
-      inedges[dst_idx].srcOp = guid_to_nodes[src_guid];
-      inedges[dst_idx].srcIdx = src_idx;
-      inedges[dst_idx].dstIdx = dst_idx;
-      inputs[dst_idx] = inedges[dst_idx].srcOp.ptr->outputs[src_idx];
-    }
-    {
-      size_t safecode;
-      dez.deserialize(safecode);
-      assert(safecode == 10101010);
+      auto const &input = record_inputs[record.first_input + j];
+      inedges[j].srcOp = nodes[input.first];
+      inedges[j].srcIdx = input.second;
+      inedges[j].dstIdx = j;
+      inputs[j] = inedges[j].srcOp.ptr->outputs[input.second];
     }
     Node node = Node::INVALID_NODE;
-    size_t guid;
-    OperatorType op_type;
-    dez.deserialize(guid);
-    dez.deserialize(op_type);
+    OperatorType op_type = record.op_type;
     switch (op_type) {
       case OP_INPUT: {
         assert(num_inputs == 0);
-        int num_dims;
-        ParallelDim dims[MAX_TENSOR_DIM];
-        OperatorType op_type;
-        dez.deserialize(op_type);
-        size_t input_tensor_guid;
-        dez.deserialize(input_tensor_guid);
-        DataType data_type;
-        dez.deserialize(data_type);
-        dez.deserialize(num_dims);
-        for (int i = 0; i < num_dims; i++) {
-          dez.deserialize(dims[i]);
-        }
+        ParallelTensorShape const &shape = shapes[record.shape_idx];
         ParallelTensor t =
-            create_parallel_tensor_legion_ordering(num_dims,
-                                                   dims,
-                                                   data_type,
+            create_parallel_tensor_legion_ordering(shape.num_dims,
+                                                   shape.dims,
+                                                   shape.data_type,
                                                    nullptr,
                                                    0,
                                                    true /*create_grad*/,
-                                                   input_tensor_guid);
+                                                   record.input_tensor_guid);
         node.ptr = t->owner_op;
         node.guid = node_global_guid++;
         break;
@@ -2523,8 +2921,6 @@ void FFModel::deserialize_graph_optimal_view(
       case OP_EW_MAX:
       case OP_EW_MIN: {
         assert(num_inputs == 2);
-        OperatorType op_type;
-        dez.deserialize(op_type);
         node = get_or_create_node<ElementBinary>({inputs[0], inputs[1]},
                                                  {op_type});
         break;
@@ -2611,16 +3007,23 @@ void FFModel::deserialize_graph_optimal_view(
         node = Group_by::deserialize(*this, dez, inputs, num_inputs);
         break;
       }
+      case OP_EXPERTS: {
+        node = Experts::deserialize(*this, dez, inputs, num_inputs);
+        break;
+      }
       case OP_AGGREGATE: {
         // node = Aggregate::deserialize(*this, dez, inputs, num_inputs);
         int n;
         float lambda_bal;
+        bool dropless;
         dez.deserialize(n);
         dez.deserialize(lambda_bal);
-        assert(num_inputs == n + 4);
+        dez.deserialize(dropless);
+        assert(num_inputs == (dropless ? 1 : n) + 4);
         AggregateParams params;
         params.n = n;
         params.lambda_bal = lambda_bal;
+        params.dropless = dropless;
         node = get_or_create_node<Aggregate>(
             {std::begin(inputs), std::begin(inputs) + num_inputs}, params);
         break;
@@ -2706,33 +3109,18 @@ void FFModel::deserialize_graph_optimal_view(
         assert(false && "Unsupported operator type");
       }
     }
-    {
-      size_t safecode;
-      dez.deserialize(safecode);
-      assert(safecode == 12345678);
-    }
     assert(node.ptr != nullptr);
-    guid_to_nodes[guid] = node;
+    nodes[node_idx] = node;
     for (size_t i = 0; i < num_inputs; i++) {
       inedges[i].dstOp = node;
       graph->add_edge(inedges[i]);
     }
-  }
-  // Second, deserialize optimal machine view
-  size_t num_views;
-  dez.deserialize(num_views);
-  printf("views.size() = %zu\n", num_views);
-  for (size_t i = 0; i < num_views; i++) {
-    size_t safecode, guid;
-    MachineView view;
-    dez.deserialize(safecode);
-    assert(safecode == 98765432);
-    dez.deserialize(guid);
-    assert(guid_to_nodes.find(guid) != guid_to_nodes.end());
-    dez.deserialize(view);
-    optimal_views[guid_to_nodes[guid]] = view;
+    if (record.view_idx > 0) {
+      optimal_views[node] = views[record.view_idx - 1];
+    }
   }
   assert(dez.get_remaining_bytes() == 0);
+  printf("views.size() = %zu\n", optimal_views.size());
   printf("Deserialized Views...\n");
   for (auto const &it : optimal_views) {
     printf("node[%zu]: type(%s) view(%d %d %d) ",
@@ -2741,7 +3129,7 @@ void FFModel::deserialize_graph_optimal_view(
            it.second.ndims,
            it.second.dim[0],
            it.second.start_device_id);
-    auto const &list = graph->inEdges.at(it.first);
+    auto const &list = graph->get_in_edges(it.first);
     for (auto const &it2 : list) {
       Edge e = it2;
       printf(" inEdge(node(%zu) idx(%d))", e.srcOp.guid, e.srcIdx);
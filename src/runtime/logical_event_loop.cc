@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "flexflow/simulator.h"
+namespace FlexFlow {
+
+// Only nominal devices stand for a route through the network; a transfer
+// placed on a physical link (e.g. an NVLink of a collective) stays on it
+static Route expand_comm_device(SimTask const *task) {
+  CommDevice *device = static_cast<CommDevice *>(task->device);
+  if (device->comm_type != CommDevice::NW_NOMINAL) {
+    return {device};
+  }
+  return static_cast<NominalCommDevice *>(device)->expand_to_physical(
+      task->id);
+}
+
+// Finds the time of device in device_times, which starts at 0; threads may
+// look up devices that are already in device_times concurrently
+static float &device_time(std::map<Device *, float> &device_times,
+                          Device *device) {
+  auto it = device_times.find(device);
+  if (it == device_times.end()) {
+    it = device_times.emplace(device, 0.0f).first;
+  }
+  return it->second;
+}
+
+LogicalEventLoop::LogicalEventLoop(TaskManager *_task_manager,
+                                   MachineModel *_machine,
+                                   AllReduceAlgorithm _allreduce_algorithm,
+                                   bool _segment_transfer,
+                                   size_t _segment_size,
+                                   FlowLevelNetwork *_flow_network,
+                                   SimulatorThreadPool *_thread_pool)
+    : task_manager(_task_manager), machine(_machine),
+      allreduce_algorithm(_allreduce_algorithm),
+      segment_transfer(_segment_transfer), segment_size(_segment_size),
+      flow_network(_flow_network), thread_pool(_thread_pool) {}
+
+float LogicalEventLoop::run() {
+#ifdef WRITE_NETWORK_TRANSFER
+  return run_serial();
+#else
+  if (thread_pool == nullptr || flow_network != nullptr) {
+    return run_serial();
+  }
+  return run_windows();
+#endif
+}
+
+void LogicalEventLoop::run_task(
+    WindowTask &w, std::map<Device *, float> &device_times) const {
+  SimTask *task = w.task;
+  w.finished = true;
+  if (task->type == SimTask::TASK_NOMINAL_COMM) {
+    if (!segment_transfer) {
+      w.end_time = route_transfer(task, w.route, device_times);
+    } else {
+      w.end_time =
+          route_transfer_seg(task, w.route, device_times, w.finished);
+    }
+  } else if (task->type == SimTask::TASK_BARRIER && task->device == nullptr) {
+    // collective phase boundary: occupies no device
+    w.end_time = task->ready_time + task->run_time;
+  } else {
+    float &time = device_time(device_times, task->device);
+    w.end_time = std::max(time, task->ready_time) + task->run_time;
+    time = w.end_time;
+  }
+}
+
+float LogicalEventLoop::run_serial() {
+  std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
+      ready_queue;
+  for (size_t i = 0; i < task_manager->global_task_id; i++) {
+    if (task_manager->tasks[i].counter == 0) {
+      ready_queue.push(&task_manager->tasks[i]);
+    }
+  }
+
+  float sim_time = 0.0f;
+  std::map<Device *, float> device_times;
+  size_t idx = 0;
+  auto finish_task = [&](SimTask *task, float end_time) {
+    if (end_time > sim_time) {
+      sim_time = end_time;
+    }
+    for (size_t i = 0; i < task->num_next_tasks; i++) {
+      SimTask *next = task->next_tasks[i];
+      if (end_time > next->ready_time) {
+        next->ready_time = end_time;
+      }
+      next->counter--;
+      if (next->counter == 0) {
+        ready_queue.push(next);
+      }
+    }
+    idx++;
+  };
+  if (flow_network != nullptr) {
+    flow_network->clear();
+  }
+  std::vector<std::pair<SimTask *, float>> finished_flows;
+  while (!ready_queue.empty() ||
+         (flow_network != nullptr && !flow_network->empty())) {
+    // Flows that finish before the next task is ready release their
+    // successors first
+    if (flow_network != nullptr && !flow_network->empty() &&
+        (ready_queue.empty() || flow_network->next_completion_time() <=
+                                    ready_queue.top()->ready_time)) {
+      finished_flows.clear();
+      flow_network->advance(flow_network->next_completion_time(),
+                            finished_flows);
+      for (auto const &flow : finished_flows) {
+        flow.first->run_time = flow.second - flow.first->ready_time;
+        finish_task(flow.first, flow.second);
+      }
+      continue;
+    }
+    // Find the task with the earliest start time
+    SimTask *cur_task = ready_queue.top();
+    ready_queue.pop();
+    if (cur_task->type == SimTask::TASK_ALLREDUCE) {
+      expand_allreduce(cur_task, ready_queue);
+      idx++;
+      continue;
+    }
+    WindowTask w;
+    w.task = cur_task;
+    if (cur_task->type == SimTask::TASK_NOMINAL_COMM) {
+      w.route = expand_comm_device(cur_task);
+    }
+    if (cur_task->type == SimTask::TASK_NOMINAL_COMM &&
+        flow_network != nullptr) {
+      float latency = w.route.size() * machine->get_inter_node_gpu_latency();
+      if (w.route.empty() || cur_task->xfer_size == 0) {
+        finish_task(cur_task, cur_task->ready_time + latency);
+      } else {
+        flow_network->start_flow(cur_task,
+                                 w.route,
+                                 cur_task->xfer_size,
+                                 latency,
+                                 cur_task->ready_time);
+      }
+      continue;
+    }
+    run_task(w, device_times);
+    if (!w.finished) {
+      ready_queue.push(cur_task);
+      continue;
+    }
+    finish_task(cur_task, w.end_time);
+  }
+  assert(idx == task_manager->global_task_id);
+  return sim_time;
+}
+
+float LogicalEventLoop::run_windows() {
+  std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
+      ready_queue;
+  for (size_t i = 0; i < task_manager->global_task_id; i++) {
+    if (task_manager->tasks[i].counter == 0) {
+      ready_queue.push(&task_manager->tasks[i]);
+    }
+  }
+
+  float sim_time = 0.0f;
+  std::map<Device *, float> device_times;
+  size_t idx = 0;
+  auto finish_task = [&](SimTask *task, float end_time) {
+    if (end_time > sim_time) {
+      sim_time = end_time;
+    }
+    for (size_t i = 0; i < task->num_next_tasks; i++) {
+      SimTask *next = task->next_tasks[i];
+      if (end_time > next->ready_time) {
+        next->ready_time = end_time;
+      }
+      next->counter--;
+      if (next->counter == 0) {
+        ready_queue.push(next);
+      }
+    }
+    idx++;
+  };
+  float const latency = machine->get_inter_node_gpu_latency();
+  std::vector<WindowTask> window;
+  // Union-find over the tasks of the window that share a device
+  std::vector<int> parent;
+  std::unordered_map<Device *, int> device_owner;
+  std::vector<int> component_of;
+  std::vector<std::vector<int>> components;
+  auto find = [&](int i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+  auto add_device = [&](Device *device, int i) {
+    // inserted here so that the threads only look devices up
+    device_times.emplace(device, 0.0f);
+    auto it = device_owner.emplace(device, i);
+    if (!it.second) {
+      int a = find(i), b = find(it.first->second);
+      parent[std::max(a, b)] = std::min(a, b);
+    }
+  };
+  while (!ready_queue.empty()) {
+    // Every task a task of the window releases is ready at or after its
+    // ready time plus lookahead, hence after the whole window
+    window.clear();
+    float horizon = std::numeric_limits<float>::infinity();
+    while (!ready_queue.empty() && ready_queue.top()->ready_time < horizon) {
+      SimTask *task = ready_queue.top();
+      ready_queue.pop();
+      WindowTask w;
+      w.task = task;
+      float lookahead = task->run_time;
+      if (task->type == SimTask::TASK_ALLREDUCE) {
+        lookahead = 0.0f;
+      } else if (task->type == SimTask::TASK_NOMINAL_COMM) {
+        w.route = expand_comm_device(task);
+        lookahead = w.route.empty() ? 0.0f : latency;
+      }
+      window.push_back(std::move(w));
+      horizon = std::min(horizon, task->ready_time + lookahead);
+      // the task may release one that comes before the next of the queue
+      if (horizon <= task->ready_time) {
+        break;
+      }
+    }
+
+    int n = window.size();
+    parent.resize(n);
+    std::iota(parent.begin(), parent.end(), 0);
+    device_owner.clear();
+    for (int i = 0; i < n; i++) {
+      SimTask *task = window[i].task;
+      if (task->type == SimTask::TASK_NOMINAL_COMM) {
+        for (CommDevice *link : window[i].route) {
+          add_device(link, i);
+        }
+      } else if (task->type != SimTask::TASK_ALLREDUCE &&
+                 !(task->type == SimTask::TASK_BARRIER &&
+                   task->device == nullptr)) {
+        add_device(task->device, i);
+      }
+    }
+    // Components keep the tasks in queue order
+    components.clear();
+    component_of.assign(n, -1);
+    for (int i = 0; i < n; i++) {
+      int root = find(i);
+      if (component_of[root] < 0) {
+        component_of[root] = components.size();
+        components.emplace_back();
+      }
+      components[component_of[root]].push_back(i);
+    }
+    auto run_component = [&](int c) {
+      for (int i : components[c]) {
+        if (window[i].task->type != SimTask::TASK_ALLREDUCE) {
+          run_task(window[i], device_times);
+        }
+      }
+    };
+    if (components.size() > 1) {
+      thread_pool->parallel_for(components.size(), run_component);
+    } else {
+      run_component(0);
+    }
+
+    for (WindowTask const &w : window) {
+      if (w.task->type == SimTask::TASK_ALLREDUCE) {
+        expand_allreduce(w.task, ready_queue);
+        idx++;
+      } else if (!w.finished) {
+        ready_queue.push(w.task);
+      } else {
+        finish_task(w.task, w.end_time);
+      }
+    }
+  }
+  assert(idx == task_manager->global_task_id);
+  return sim_time;
+}
+
+float LogicalEventLoop::route_transfer(
+    SimTask *transfer_task,
+    Route const &route,
+    std::map<Device *, float> &device_times) const {
+  float curr_task_start_time;
+  float curr_task_finish_time;
+  float curr_task_run_time = 0;
+  float curr_task_ready_time = transfer_task->ready_time;
+  float xfer_size = transfer_task->xfer_size;
+
+  float final_start_time = 0;
+  float final_finish_time = 0;
+
+  for (unsigned int i = 0; i < route.size(); i++) {
+    CommDevice *latency_task_device = route[i];
+    float &device_ready_time = device_time(device_times, latency_task_device);
+    float latency_task_run_time = machine->get_inter_node_gpu_latency();
+    float latency_task_ready_time;
+    float latency_task_start_time;
+    if (i == 0) {
+      latency_task_ready_time = curr_task_ready_time + curr_task_run_time;
+      latency_task_start_time =
+          std::max(device_ready_time, latency_task_ready_time);
+      final_start_time = latency_task_start_time;
+    } else {
+      latency_task_ready_time = curr_task_finish_time;
+      latency_task_start_time =
+          std::max(device_ready_time, latency_task_ready_time);
+    }
+    float latency_task_finish_time =
+        latency_task_start_time + latency_task_run_time;
+    float dram_to_dram_run_time = xfer_size / latency_task_device->bandwidth;
+
+    float dram_to_dram_start_time = latency_task_finish_time;
+    float dram_to_dram_finish_time =
+        dram_to_dram_start_time + dram_to_dram_run_time;
+    device_ready_time = dram_to_dram_finish_time;
+
+    if (dram_to_dram_finish_time > final_finish_time) {
+      final_finish_time = dram_to_dram_finish_time;
+    }
+
+    curr_task_ready_time = latency_task_ready_time;
+    curr_task_start_time = latency_task_start_time;
+    curr_task_finish_time = latency_task_finish_time;
+    curr_task_run_time = latency_task_run_time;
+
+#ifdef DEBUG_PRINT
+    printf("\texpand: route[%u] run_time(%.4lf) ready_time(%.4lf) "
+           "start_time(%.4lf) device(%s)\n",
+           i,
+           curr_task_run_time,
+           curr_task_ready_time,
+           curr_task_start_time,
+           (latency_task_device->name).c_str());
+    printf("\t\td2d: run_time(%.4lf) start_time(%.4lf) device(%s)\n",
+           dram_to_dram_run_time,
+           dram_to_dram_start_time,
+           (latency_task_device->name).c_str());
+#endif
+  }
+
+#ifdef WRITE_NETWORK_TRANSFER
+  auto *nw = static_cast<NominalCommDevice *>(transfer_task->device);
+  network_transfer_log << nw->device_id / machine->get_total_devs() << ", "
+                       << nw->device_id % machine->get_total_devs() << ", "
+                       << xfer_size << ", " << final_start_time << ", "
+                       << final_finish_time << std::endl;
+#endif
+
+  transfer_task->run_time = final_finish_time - final_start_time;
+  return final_finish_time;
+}
+
+float LogicalEventLoop::route_transfer_seg(
+    SimTask *transfer_task,
+    Route const &route,
+    std::map<Device *, float> &device_times,
+    bool &finished) const {
+  float curr_task_start_time;
+  float curr_task_finish_time;
+  float curr_task_run_time = 0;
+  float curr_task_ready_time = transfer_task->ready_time;
+  float xfer_size = transfer_task->xfer_left > segment_size
+                        ? segment_size
+                        : transfer_task->xfer_left;
+  transfer_task->xfer_left = transfer_task->xfer_left > segment_size
+                                 ? transfer_task->xfer_left - segment_size
+                                 : 0;
+  finished = transfer_task->xfer_left == 0;
+
+  float final_start_time = 0;
+  float final_finish_time = 0;
+  float final_first_seg_finish_time = 0;
+
+  for (unsigned int i = 0; i < route.size(); i++) {
+    CommDevice *latency_task_device = route[i];
+    float &device_ready_time = device_time(device_times, latency_task_device);
+    float latency_task_run_time = machine->get_inter_node_gpu_latency();
+    float latency_task_ready_time;
+    float latency_task_start_time;
+    if (i == 0) {
+      latency_task_ready_time = curr_task_ready_time + curr_task_run_time;
+      latency_task_start_time =
+          std::max(device_ready_time, latency_task_ready_time);
+      final_start_time = latency_task_start_time;
+    } else {
+      latency_task_ready_time = curr_task_finish_time;
+      latency_task_start_time =
+          std::max(device_ready_time, latency_task_ready_time);
+    }
+    float latency_task_finish_time =
+        latency_task_start_time + latency_task_run_time;
+    float dram_to_dram_run_time = xfer_size / latency_task_device->bandwidth;
+
+    float dram_to_dram_start_time = latency_task_finish_time;
+    float dram_to_dram_finish_time =
+        dram_to_dram_start_time + dram_to_dram_run_time;
+    if (i == 0) {
+      final_first_seg_finish_time = dram_to_dram_finish_time;
+    }
+    device_ready_time = dram_to_dram_finish_time;
+
+    if (dram_to_dram_finish_time > final_finish_time) {
+      final_finish_time = dram_to_dram_finish_time;
+    }
+
+    curr_task_ready_time = latency_task_ready_time;
+    curr_task_start_time = latency_task_start_time;
+    curr_task_finish_time = latency_task_finish_time;
+    curr_task_run_time = latency_task_run_time;
+
+#ifdef DEBUG_PRINT
+    printf("\texpand: route[%u] run_time(%.4lf) ready_time(%.4lf) "
+           "start_time(%.4lf) device(%s)\n",
+           i,
+           curr_task_run_time,
+           curr_task_ready_time,
+           curr_task_start_time,
+           (latency_task_device->name).c_str());
+    printf("\t\td2d: run_time(%.4lf) start_time(%.4lf) device(%s)\n",
+           dram_to_dram_run_time,
+           dram_to_dram_start_time,
+           (latency_task_device->name).c_str());
+#endif
+  }
+
+#ifdef WRITE_NETWORK_TRANSFER
+  auto *nw = static_cast<NominalCommDevice *>(transfer_task->device);
+  network_transfer_log << nw->device_id / machine->get_total_devs() << ", "
+                       << nw->device_id % machine->get_total_devs() << ", "
+                       << xfer_size << ", " << final_start_time << ", "
+                       << final_finish_time << std::endl;
+#endif
+  if (!finished) {
+    transfer_task->ready_time = final_first_seg_finish_time;
+  }
+
+  transfer_task->run_time = final_finish_time - final_start_time;
+  return final_finish_time;
+}
+
+void LogicalEventLoop::expand_allreduce(
+    SimTask *allreduce_task,
+    std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
+        &ready_queue) {
+
+  int n_participants = allreduce_task->num_next_tasks;
+  if (n_participants == 1) {
+    return;
+  }
+
+  // recall that next_task stores node group in this case
+  std::vector<int> gpus(n_participants);
+  for (int i = 0; i < n_participants; i++) {
+    gpus[i] = reinterpret_cast<uint64_t>(allreduce_task->next_tasks[i]);
+  }
+  std::vector<CollectivePhase> phases = plan_allreduce(
+      allreduce_algorithm, gpus, allreduce_task->xfer_size, machine);
+
+  SimTask *final_task = new_update_task_unrecorded();
+  final_task->device = machine->get_gpu(gpus[0]);
+
+  // Every phase ends in a device-less barrier that waits for its transfers
+  // and adds the latency of the steps after the first one, which its comm
+  // tasks already pay; the next phase starts from that barrier
+  SimTask *prev_barrier = nullptr;
+  for (CollectivePhase const &phase : phases) {
+    SimTask *barrier = new_barrier_task_unrecorded();
+    barrier->run_time = std::max(phase.num_steps - 1, 0) *
+                        collective_phase_latency(phase, machine);
+    for (CollectivePhase::Transfer const &t : phase.transfers) {
+      std::vector<CommDevice *> path =
+          machine->get_comm_path(machine->get_gpu_fb_mem(t.src_gpu),
+                                 machine->get_gpu_fb_mem(t.dst_gpu));
+      for (CommDevice *d : path) {
+        SimTask *task = new_comm_task_unrecorded();
+        task->device = d;
+        task->run_time = 0;
+        task->xfer_size = t.size;
+        task->xfer_left = t.size;
+        task->add_next_task(barrier);
+        if (prev_barrier == nullptr) {
+          task->ready_time = allreduce_task->ready_time;
+          ready_queue.push(task);
+        } else {
+          prev_barrier->add_next_task(task);
+        }
+      }
+    }
+    if (barrier->counter == 0) {
+      if (prev_barrier == nullptr) {
+        barrier->ready_time = allreduce_task->ready_time;
+        ready_queue.push(barrier);
+      } else {
+        prev_barrier->add_next_task(barrier);
+      }
+    }
+    prev_barrier = barrier;
+  }
+  if (prev_barrier == nullptr) {
+    final_task->ready_time = allreduce_task->ready_time;
+    ready_queue.push(final_task);
+  } else {
+    prev_barrier->add_next_task(final_task);
+  }
+}
+
+SimTask *LogicalEventLoop::new_comm_task_unrecorded() {
+  SimTask *task = task_manager->new_task();
+  task->type = SimTask::TASK_NOMINAL_COMM;
+  task->store = false;
+  return task;
+}
+
+SimTask *LogicalEventLoop::new_update_task_unrecorded() {
+  SimTask *task = task_manager->new_task();
+  task->type = SimTask::TASK_UPDATE;
+  task->store = false;
+  return task;
+}
+
+SimTask *LogicalEventLoop::new_barrier_task_unrecorded() {
+  SimTask *task = task_manager->new_task();
+  task->type = SimTask::TASK_BARRIER;
+  task->device = nullptr;
+  task->store = false;
+  return task;
+}
+
+}; // namespace FlexFlow
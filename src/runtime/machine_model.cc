@@ -2,59 +2,10 @@
 
 #include <algorithm>
 #include <functional>
-#include <thread>
+#include <memory>
 #include <vector>
 namespace FlexFlow {
 
-/// @param[in] nb_elements : size of your for loop
-/// @param[in] functor(start, end) :
-/// your function processing a sub chunk of the for loop.
-/// "start" is the first index to process (included) until the index "end"
-/// (excluded)
-/// @code
-///     for(int i = start; i < end; ++i)
-///         computation(i);
-/// @endcode
-/// @param use_threads : enable / disable threads.
-///
-///
-static void parallel_for(unsigned nb_elements,
-                         std::function<void(int start, int end)> functor,
-                         bool use_threads = true) {
-  // -------
-  unsigned nb_threads_hint = std::thread::hardware_concurrency();
-  unsigned nb_threads = nb_threads_hint == 0 ? 8 : (nb_threads_hint);
-
-  unsigned batch_size = nb_elements / nb_threads;
-  unsigned batch_remainder = nb_elements % nb_threads;
-
-  std::vector<std::thread> my_threads(nb_threads);
-
-  if (use_threads) {
-    // Multithread execution
-    for (unsigned i = 0; i < nb_threads; ++i) {
-      int start = i * batch_size;
-      my_threads[i] = std::thread(functor, start, start + batch_size);
-    }
-  } else {
-    // Single thread execution (for easy debugging)
-    for (unsigned i = 0; i < nb_threads; ++i) {
-      int start = i * batch_size;
-      functor(start, start + batch_size);
-    }
-  }
-
-  // Deform the elements left
-  int start = nb_threads * batch_size;
-  functor(start, start + batch_remainder);
-
-  // Wait for the other thread to finish their task
-  if (use_threads) {
-    std::for_each(
-        my_threads.begin(), my_threads.end(), std::mem_fn(&std::thread::join));
-  }
-}
-
 SimpleMachineModel::SimpleMachineModel(int num_nodes,
                                        int num_gpus_per_node,
                                        size_t capacity) {
@@ -303,6 +254,12 @@ EnhancedMachineModel::EnhancedMachineModel(std::string file,
         } else if (words[0] == "nvlink_bandwidth") {
           nvlink_bandwidth = stof(words[2]);
           printf("nvlink_bandwidth = %f\n", nvlink_bandwidth);
+        } else if (words[0] == "gpu_peak_tflops") {
+          gpu_peak_flops = stof(words[2]) * 1e9f;
+          printf("gpu_peak_tflops = %s\n", words[2].c_str());
+        } else if (words[0] == "gpu_fb_mem_bandwidth") {
+          gpu_fb_mem_bandwidth = stof(words[2]) * 1024 * 1024;
+          printf("gpu_fb_mem_bandwidth = %s\n", words[2].c_str());
         } else if (words[0] == "intra_socket_sys_mem_to_sys_mem") {
           printf("intra_socket_sys_mem_to_sys_mem = ");
           for (size_t i = 2; i < words.size(); i++) {
@@ -710,6 +667,10 @@ void EnhancedMachineModel::attach_nvlink(MemDevice *src_mem,
   }
 }
 
+int EnhancedMachineModel::get_num_cpus() const {
+  return num_cpus;
+}
+
 CompDevice *EnhancedMachineModel::get_cpu(int device_id) const {
   return get_cpu(device_id / num_cpus_per_socket,
                  device_id % num_cpus_per_socket);
@@ -746,6 +707,10 @@ MemDevice *EnhancedMachineModel::get_sys_mem(int socket_id) const {
   return sys_mems[socket_id];
 }
 
+MemDevice *EnhancedMachineModel::get_cpu_mem(int device_id) const {
+  return sys_mems[get_cpu(device_id)->socket_id];
+}
+
 MemDevice *EnhancedMachineModel::get_z_copy_mem(int socket_id) const {
   return z_copy_mems[socket_id];
 }
@@ -1036,24 +1001,15 @@ NetworkedMachineModel::NetworkedMachineModel(int num_nodes,
   }
   // }
 
-  // network links
+  // network links; only connected pairs get a device, since large fabrics
+  // are sparse
   total_devs = num_nodes + num_switches;
   for (int i = 0; i < total_devs; i++) {
     for (int j = 0; j < total_devs; j++) {
-      // if (conn_matrix[i * total_devs + j] > 0) {
-      int device_id = i * total_devs + j;
-      std::string link_name =
-          "LINK " + std::to_string(i) + "-" + std::to_string(j);
-      ids_to_nw_comm_device[device_id] =
-          new CommDevice(link_name,
-                         CommDevice::NW_COMM,
-                         -1,
-                         -1,
-                         device_id,
-                         0,
-                         conn_matrix[i * total_devs + j] * link_bandwidth);
+      if (conn_matrix[i * total_devs + j] > 0) {
+        add_link_device(i, j);
+      }
     }
-    // }
   }
 
   routing_strategy = new ShortestPathNetworkRoutingStrategy(
@@ -1061,6 +1017,93 @@ NetworkedMachineModel::NetworkedMachineModel(int num_nodes,
   update_route();
 }
 
+NetworkedMachineModel *
+    NetworkedMachineModel::from_config_file(std::string const &file,
+                                            size_t capacity) {
+  std::map<std::string, std::vector<std::string>> values;
+  std::ifstream machine_config(file);
+  assert(machine_config.good() && "cannot open the machine model file");
+  std::string line;
+  while (std::getline(machine_config, line)) {
+    if (!line.empty() && line[0] != '#') {
+      std::istringstream iss(line);
+      std::vector<std::string> words{std::istream_iterator<std::string>{iss},
+                                     std::istream_iterator<std::string>{}};
+      if (words.size() >= 3) {
+        values[words[0]].assign(words.begin() + 2, words.end());
+        printf("%s =", words[0].c_str());
+        for (size_t i = 2; i < words.size(); i++) {
+          printf(" %s", words[i].c_str());
+        }
+        printf("\n");
+      }
+    }
+  }
+  auto get_int = [&](std::string const &key, int default_value) {
+    auto it = values.find(key);
+    return it == values.end() ? default_value : stoi(it->second[0]);
+  };
+  auto get_float = [&](std::string const &key, float default_value) {
+    auto it = values.find(key);
+    return it == values.end() ? default_value : stof(it->second[0]);
+  };
+
+  std::string topology =
+      values.count("topology") ? values["topology"][0] : "bigswitch";
+  std::unique_ptr<NetworkTopologyGenerator> generator;
+  if (topology == "fattree") {
+    generator.reset(new FatTreeTopologyGenerator(
+        get_int("fattree_k", 4), get_int("fattree_oversubscription", 1)));
+  } else if (topology == "dragonfly") {
+    generator.reset(new DragonflyTopologyGenerator(
+        get_int("dragonfly_routers_per_group", 4),
+        get_int("dragonfly_nodes_per_router", 2),
+        get_int("dragonfly_global_links_per_router", 2),
+        get_int("dragonfly_local_link_width", 1),
+        get_int("dragonfly_global_link_width", 1)));
+  } else if (topology == "torus") {
+    std::vector<int> dims;
+    for (std::string const &d : values["torus_dims"]) {
+      dims.push_back(stoi(d));
+    }
+    generator.reset(
+        new TorusTopologyGenerator(dims, get_int("torus_link_width", 1)));
+  } else if (topology == "bigswitch") {
+    generator.reset(
+        new BigSwitchNetworkTopologyGenerator(get_int("num_nodes", 1)));
+  } else if (topology == "fc") {
+    generator.reset(new FCTopologyGenerator(get_int("num_nodes", 1)));
+  } else {
+    printf("Unknown network topology: %s\n", topology.c_str());
+    assert(false);
+  }
+
+  // latencies are in ms and bandwidths in GB/s, as in the EnhancedMachineModel
+  NetworkedMachineModel *machine = new NetworkedMachineModel(
+      generator->get_num_nodes(),
+      get_int("num_gpus_per_node", 1),
+      generator->get_num_switches(),
+      get_float("network_latency", 0.001f),
+      generator->generate_topology(),
+      capacity,
+      get_float("link_bandwidth", 12.5f) * 1024 * 1024);
+  if (values.count("nvlink_bandwidth")) {
+    machine->inter_gpu_bandwidth =
+        get_float("nvlink_bandwidth", 0.0f) * 1024 * 1024;
+    for (auto const &kv : machine->ids_to_inter_gpu_comm_device) {
+      kv.second->bandwidth = machine->inter_gpu_bandwidth;
+    }
+  }
+  if (values.count("gpu_peak_tflops")) {
+    machine->gpu_peak_flops = get_float("gpu_peak_tflops", 0.0f) * 1e9f;
+  }
+  if (values.count("gpu_fb_mem_bandwidth")) {
+    machine->gpu_fb_mem_bandwidth =
+        get_float("gpu_fb_mem_bandwidth", 0.0f) * 1024 * 1024;
+  }
+  return machine;
+}
+
 NetworkedMachineModel::~NetworkedMachineModel() {
   delete routing_strategy;
 }
@@ -1070,38 +1113,44 @@ int NetworkedMachineModel::get_version() const {
 }
 
 void NetworkedMachineModel::update_route() {
-  // nominal network links
-  int total_devs = num_nodes + num_switches;
-  for (int i = 0; i < num_nodes; i++) {
-    for (int j = 0; j < num_nodes; j++) {
-      int device_id = i * total_devs + j;
-      std::string link_name =
-          "NOMINAL " + std::to_string(i) + "-" + std::to_string(j);
-      if (ids_to_nw_nominal_device.find(device_id) ==
-          ids_to_nw_nominal_device.end()) {
-        ids_to_nw_nominal_device[device_id] = new NominalCommDevice(
-            link_name, device_id, total_devs, routing_strategy);
-      }
-      ids_to_nw_nominal_device[device_id]->reset();
-      // ids_to_nw_nominal_device[device_id]->set_physical_paths(routing_strategy->get_routes(i,
-      // j));
-    }
+  // Routes are computed lazily, when a nominal device is first expanded, so
+  // only the pairs that actually communicate are ever routed
+  routing_strategy->clear();
+  std::lock_guard<std::mutex> lock(nominal_device_mutex);
+  for (auto const &kv : ids_to_nw_nominal_device) {
+    kv.second->reset();
   }
+}
 
-  // std::vector<int> indicies(num_nodes);
-  // std::iota(ivec.begin(), ivec.end(), 0);
-
-  // for (int i = 0; i < num_nodes; i++) {
-  parallel_for(num_nodes, [&](int start, int end) {
-    for (int i = start; i < end; i++) {
-      // std::cerr << "node i " << i << std::endl;
-      auto all_routes = routing_strategy->get_routes_from_src(i);
-      for (int j = 0; j < num_nodes; j++) {
-        ids_to_nw_nominal_device[i * total_devs + j]->set_physical_paths(
-            all_routes[j]);
-      }
-    }
-  });
+void NetworkedMachineModel::add_link_device(int src, int dst) {
+  int device_id = src * total_devs + dst;
+  std::string link_name =
+      "LINK " + std::to_string(src) + "-" + std::to_string(dst);
+  ids_to_nw_comm_device[device_id] =
+      new CommDevice(link_name,
+                     CommDevice::NW_COMM,
+                     -1,
+                     -1,
+                     device_id,
+                     0,
+                     conn_matrix[device_id] * link_bandwidth);
+}
+
+NominalCommDevice *
+    NetworkedMachineModel::get_nominal_device(int src_node,
+                                              int dst_node) const {
+  int device_id = src_node * total_devs + dst_node;
+  std::lock_guard<std::mutex> lock(nominal_device_mutex);
+  auto it = ids_to_nw_nominal_device.find(device_id);
+  if (it != ids_to_nw_nominal_device.end()) {
+    return it->second;
+  }
+  std::string link_name =
+      "NOMINAL " + std::to_string(src_node) + "-" + std::to_string(dst_node);
+  NominalCommDevice *device = new NominalCommDevice(
+      link_name, device_id, total_devs, routing_strategy);
+  ids_to_nw_nominal_device[device_id] = device;
+  return device;
 }
 
 CompDevice *NetworkedMachineModel::get_gpu(int device_id) const {
@@ -1139,6 +1188,16 @@ void NetworkedMachineModel::set_routing_strategy(NetworkRoutingStrategy *rs) {
   routing_strategy = rs;
 }
 
+// Without pipelining, every transfer between two memories is one flow
+static size_t get_flow_id(MemDevice const *src_mem, MemDevice const *tar_mem) {
+  size_t flow_id = 0;
+  hash_combine(flow_id, static_cast<int>(src_mem->mem_type));
+  hash_combine(flow_id, src_mem->device_id);
+  hash_combine(flow_id, static_cast<int>(tar_mem->mem_type));
+  hash_combine(flow_id, tar_mem->device_id);
+  return flow_id;
+}
+
 std::vector<CommDevice *>
     NetworkedMachineModel::get_comm_path(MemDevice *src_mem,
                                          MemDevice *tar_mem) {
@@ -1156,12 +1215,13 @@ std::vector<CommDevice *>
     if (src_mem->node_id == tar_mem->node_id) {
       return ret;
     } else {
-      int device_id = src_mem->node_id * total_devs + tar_mem->node_id;
+      NominalCommDevice *nominal =
+          get_nominal_device(src_mem->node_id, tar_mem->node_id);
       if (pipelined) {
-        ret.emplace_back(ids_to_nw_nominal_device.at(device_id));
+        ret.emplace_back(nominal);
       } else {
         std::vector<CommDevice *> physical_path =
-            ids_to_nw_nominal_device.at(device_id)->expand_to_physical();
+            nominal->expand_to_physical(get_flow_id(src_mem, tar_mem));
         ret.insert(ret.end(), physical_path.cbegin(), physical_path.cend());
       }
     }
@@ -1174,12 +1234,13 @@ std::vector<CommDevice *>
       if (pcie_on) {
         ret.emplace_back(id_to_gputodram_comm_device.at(src_mem->device_id));
       }
-      int device_id = src_mem->node_id * total_devs + tar_mem->node_id;
+      NominalCommDevice *nominal =
+          get_nominal_device(src_mem->node_id, tar_mem->node_id);
       if (pipelined) {
-        ret.emplace_back(ids_to_nw_nominal_device.at(device_id));
+        ret.emplace_back(nominal);
       } else {
         std::vector<CommDevice *> physical_path =
-            ids_to_nw_nominal_device.at(device_id)->expand_to_physical();
+            nominal->expand_to_physical(get_flow_id(src_mem, tar_mem));
         ret.insert(ret.end(), physical_path.cbegin(), physical_path.cend());
       }
       if (pcie_on) {
@@ -1193,12 +1254,13 @@ std::vector<CommDevice *>
         ret.emplace_back(id_to_dramtogpu_comm_device.at(tar_mem->device_id));
       }
     } else {
-      int device_id = src_mem->node_id * total_devs + tar_mem->node_id;
+      NominalCommDevice *nominal =
+          get_nominal_device(src_mem->node_id, tar_mem->node_id);
       if (pipelined) {
-        ret.emplace_back(ids_to_nw_nominal_device.at(device_id));
+        ret.emplace_back(nominal);
       } else {
         std::vector<CommDevice *> physical_path =
-            ids_to_nw_nominal_device.at(device_id)->expand_to_physical();
+            nominal->expand_to_physical(get_flow_id(src_mem, tar_mem));
         ret.insert(ret.end(), physical_path.cbegin(), physical_path.cend());
       }
       if (pcie_on) {
@@ -1215,12 +1277,13 @@ std::vector<CommDevice *>
       if (pcie_on) {
         ret.emplace_back(id_to_gputodram_comm_device.at(src_mem->device_id));
       }
-      int device_id = src_mem->node_id * total_devs + tar_mem->node_id;
+      NominalCommDevice *nominal =
+          get_nominal_device(src_mem->node_id, tar_mem->node_id);
       if (pipelined) {
-        ret.emplace_back(ids_to_nw_nominal_device.at(device_id));
+        ret.emplace_back(nominal);
       } else {
         std::vector<CommDevice *> physical_path =
-            ids_to_nw_nominal_device.at(device_id)->expand_to_physical();
+            nominal->expand_to_physical(get_flow_id(src_mem, tar_mem));
         ret.insert(ret.end(), physical_path.cbegin(), physical_path.cend());
       }
     }
@@ -1243,8 +1306,7 @@ CommDevice *NetworkedMachineModel::get_nominal_path(MemDevice *src_mem,
   if (src_mem->node_id == tar_mem->node_id) {
     return nullptr;
   }
-  int device_id = src_mem->node_id * num_nodes + tar_mem->node_id;
-  return ids_to_nw_nominal_device.at(device_id);
+  return get_nominal_device(src_mem->node_id, tar_mem->node_id);
 }
 
 // TODO
@@ -1265,12 +1327,14 @@ void NetworkedMachineModel::set_topology(ConnectionMatrix const &conn) {
   int total_devs = num_nodes + num_switches;
   for (int i = 0; i < total_devs; i++) {
     for (int j = 0; j < total_devs; j++) {
-      // if (conn_matrix[i * total_devs + j] > 0) {
       int device_id = i * total_devs + j;
-      ids_to_nw_comm_device[device_id]->bandwidth =
-          conn[i * total_devs + j] * link_bandwidth;
+      auto it = ids_to_nw_comm_device.find(device_id);
+      if (it != ids_to_nw_comm_device.end()) {
+        it->second->bandwidth = conn[device_id] * link_bandwidth;
+      } else if (conn[device_id] > 0) {
+        add_link_device(i, j);
+      }
     }
-    // }
   }
   update_route();
 }
@@ -14,11 +14,70 @@
  */
 
 #include "flexflow/memory_optimization.h"
+#include <algorithm>
 
 namespace FlexFlow {
 
 namespace PCG {
 
+int LivenessMemoryModel::add_op(std::vector<int> const &devices,
+                                size_t weights_memory,
+                                size_t outputs_memory,
+                                std::vector<int> const &producers) {
+  int index = ops.size();
+  for (int producer : producers) {
+    assert(producer >= 0 && producer < index);
+    ops[producer].last_consumer = index;
+  }
+  ops.push_back({devices, weights_memory, outputs_memory, -1});
+  return index;
+}
+
+std::unordered_map<int, size_t>
+    LivenessMemoryModel::peak_memory(bool training) const {
+  // Step s < n is the forward pass of operator s and step 2n - 1 - i the
+  // backward pass of operator i; deltas[d][s] is the memory device d
+  // allocates at step s, and frees at the end of step s - 1 if negative
+  int n = ops.size();
+  int num_steps = training ? 2 * n : n;
+  std::unordered_map<int, std::vector<long long>> deltas;
+  std::unordered_map<int, size_t> persistent;
+  auto live = [&](int device, size_t size, int first_step, int last_step) {
+    std::vector<long long> &d = deltas[device];
+    if (d.empty()) {
+      d.assign(num_steps + 1, 0);
+    }
+    d[first_step] += size;
+    d[last_step + 1] -= size;
+  };
+  for (int i = 0; i < n; i++) {
+    OpInfo const &op = ops[i];
+    for (int device : op.devices) {
+      persistent[device] += op.weights_memory;
+      if (training) {
+        int backward_step = 2 * n - 1 - i;
+        live(device, op.outputs_memory, i, backward_step);
+        int gradient_step = op.last_consumer >= 0
+                                ? 2 * n - 1 - op.last_consumer
+                                : backward_step;
+        live(device, op.outputs_memory, gradient_step, backward_step);
+      } else {
+        live(device, op.outputs_memory, i, std::max(i, op.last_consumer));
+      }
+    }
+  }
+  std::unordered_map<int, size_t> peaks = persistent;
+  for (auto const &it : deltas) {
+    long long current = 0, peak = 0;
+    for (int s = 0; s < num_steps; s++) {
+      current += it.second[s];
+      peak = std::max(peak, current);
+    }
+    peaks[it.first] += peak;
+  }
+  return peaks;
+}
+
 std::string MemoryUsage::to_string() const {
   std::string type_name;
   switch (usage_type) {
@@ -28,6 +87,9 @@ std::string MemoryUsage::to_string() const {
     case MemoryUsageType::PER_DEVICE_MAX:
       type_name = "PER_DEVICE_MAX";
       break;
+    case MemoryUsageType::PER_DEVICE_LIVENESS:
+      type_name = "PER_DEVICE_LIVENESS";
+      break;
   }
   return "(MemoryUsageType:" + type_name + ", Usage:" + std::to_string(num) +
          ")";
@@ -44,6 +106,11 @@ MemoryUsage &MemoryUsage::operator+=(MemoryUsage const &rhs) {
     case MemoryUsageType::PER_DEVICE_MAX:
       num = std::max(num, rhs.num);
       break;
+    case MemoryUsageType::PER_DEVICE_LIVENESS:
+      // Without their schedules, the peaks of two sub-PCGs can only be
+      // bounded by the sum
+      num += rhs.num;
+      break;
   }
 
   return *this;
@@ -35,6 +35,7 @@
 #include "flexflow/ops/element_binary.h"
 #include "flexflow/ops/element_unary.h"
 #include "flexflow/ops/embedding.h"
+#include "flexflow/ops/experts.h"
 #include "flexflow/ops/flat.h"
 #include "flexflow/ops/fused.h"
 #include "flexflow/ops/gather.h"
@@ -55,11 +56,16 @@
 #include "flexflow/parallel_ops/partition.h"
 #include "flexflow/parallel_ops/reduction.h"
 #include "flexflow/parallel_ops/replicate.h"
+#include "flexflow/strategy_cache.h"
 #include "flexflow/substitution.h"
 #include "flexflow/utils/random_utils.h"
+#include "flexflow/utils/replica_exchange.h"
 #include "flexflow/utils/test_utils.h"
 #include "legion/legion_utilities.h"
+#include <cinttypes>
 #include <dirent.h>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <unordered_set>
 
@@ -340,7 +346,7 @@ ParallelConfig Op::get_random_parallel_config(FFModel const &ff) const {
     }
   }
   assert(candidates.size() > 0);
-  int idx = std::rand() % candidates.size();
+  int idx = randi() % candidates.size();
   int num_parts = candidates[idx];
   ParallelConfig pc;
   pc.device_type = ParallelConfig::GPU;
@@ -349,7 +355,7 @@ ParallelConfig Op::get_random_parallel_config(FFModel const &ff) const {
     pc.dim[i] = i == pc.nDims - 1 ? num_parts : 1;
   }
   int total_num_devices = ff.config.workersPerNode * ff.config.numNodes;
-  int start_idx = std::rand() % (total_num_devices - num_parts + 1);
+  int start_idx = randi() % (total_num_devices - num_parts + 1);
   for (int i = 0; i < num_parts; i++) {
     pc.device_ids[i] = start_idx + i;
   }
@@ -2492,114 +2498,106 @@ void FFModel::compile(Optimizer *_optimizer,
   compile(loss_type, metrics, comp_mode);
 }
 
-bool FFModel::apply_fusion(std::vector<Op *> const &operators,
+// Whether an operator (or the first operator of a group) can be fused with
+// the operators after it
+static bool can_fuse_into(Op const *op) {
+  if (op->op_type == OP_FUSED) {
+    return true;
+  }
+  //  cannot be an in-place operator
+  if (op->has_inplace_output()) {
+    return false;
+  }
+  // don't fuse input and weight operator since they don't involve any
+  // forward/backward kernels
+  if (op->op_type == OP_INPUT || op->op_type == OP_WEIGHT) {
+    return false;
+  }
+  // don't fuse parallel op since they have different parallel_is in
+  // forward/backward
+  return !op->is_parallel_op();
+}
+
+void FFModel::apply_fusion(std::vector<Op *> const &operators,
                            std::vector<Op *> &new_operators) {
-  // Context ctx = config.lg_ctx;
-  // Runtime* runtime = config.lg_hlr;
-  for (size_t l = 1; l < operators.size() - 1; l++) {
-    // don't fuse input and weight operator since they don't involve any
-    // forward/backward task launches
-    if (operators[l]->op_type == OP_INPUT ||
-        operators[l]->op_type == OP_WEIGHT) {
-      continue;
-    }
-    // don't fuse parallel op since they have different parallel_is in
-    // forward/backward
-    if (operators[l]->is_parallel_op()) {
-      continue;
-    }
+  // A single pass over the operators in topological order. Every operator is
+  // fused into the first group of new_operators (an operator or a FusedOp)
+  // that comes after the groups of all its producers and has the same
+  // MachineView, or starts a new group. group_idx maps every operator, fused
+  // or not, to the index of its group.
+  new_operators.clear();
+  std::unordered_map<Op const *, size_t> group_idx;
+  // The groups that can be fused into, in order, by MachineView
+  std::unordered_map<MachineView, std::vector<size_t>> candidates;
+  for (size_t l = 0; l < operators.size(); l++) {
+    Op *op = operators[l];
     size_t start = 0;
-    {
-      Op *opl = operators[l];
-      for (int idx = 0; idx < opl->numInputs; idx++) {
-        bool found = false;
-        for (size_t i = 0; i < l; i++) {
-          if (opl->inputs[idx]->owner_op == operators[i]) {
-            assert(!found);
-            found = true;
-            if (i > start) {
-              start = i;
-            }
+    for (int idx = 0; idx < op->numInputs; idx++) {
+      Op const *owner = op->inputs[idx]->owner_op;
+      if (owner == NULL) {
+        continue;
+      }
+      assert(group_idx.find(owner) != group_idx.end());
+      size_t i = group_idx.at(owner);
+      Op *group = new_operators[i];
+      if (owner != group) {
+        // FusedOp::add_operator took over the outputs of owner, except those
+        // sharing a region with an output of the group; use that one instead
+        int found = -1;
+        for (int k = 0; k < group->numOutputs; k++) {
+          if (group->outputs[k]->region == op->inputs[idx]->region) {
+            assert(found == -1);
+            found = k;
           }
         }
-        assert(found || (opl->inputs[idx]->owner_op == NULL));
-      }
-    }
-    for (size_t i = start; i < l; i++) {
-      // Domain d1 =
-      // runtime->get_index_space_domain(operators[l]->outputs[0]->parallel_is);
-      // Domain d2 =
-      // runtime->get_index_space_domain(operators[i]->outputs[0]->parallel_is);
-      MachineView view1 = operators[l]->outputs[0]->machine_view;
-      MachineView view2 = operators[i]->outputs[0]->machine_view;
-      if (view1 == view2) {
-        FusedOp *fused_op = nullptr;
-        bool allocate_new_fused_op = false;
-        if (operators[i]->op_type == OP_FUSED) {
-          fused_op = (FusedOp *)operators[i];
-        } else {
-          //  cannot be an in-place operator
-          if (operators[i]->has_inplace_output()) {
-            continue;
-          }
-          // don't fuse input and weight operator since they don't involve any
-          // forward/backward kernels
-          if (operators[i]->op_type == OP_INPUT ||
-              operators[i]->op_type == OP_WEIGHT) {
-            continue;
-          }
-          // don't fuse parallel op since they have different parallel_is in
-          // forward/backward
-          if (operators[i]->is_parallel_op()) {
-            continue;
+        assert(found >= 0);
+        op->inputs[idx] = group->outputs[found];
+      }
+      start = std::max(start, i);
+    }
+    bool fused = false;
+    // don't fuse the first and last operators, input and weight operators,
+    // and parallel ops
+    if (l > 0 && l + 1 < operators.size() && op->op_type != OP_INPUT &&
+        op->op_type != OP_WEIGHT && !op->is_parallel_op()) {
+      std::vector<size_t> const &views =
+          candidates[op->outputs[0]->machine_view];
+      for (auto it = std::lower_bound(views.begin(), views.end(), start);
+           it != views.end() && !fused;
+           it++) {
+        Op *group = new_operators[*it];
+        if (group->op_type == OP_FUSED) {
+          if (((FusedOp *)group)->add_operator(*this, op)) {
+            group_idx[op] = *it;
+            fused = true;
           }
-          fused_op = new FusedOp(*this, operators[i]);
-          allocate_new_fused_op = true;
+          continue;
         }
-        if (fused_op->add_operator(*this, operators[l])) {
-          // Construct new operators
-          new_operators.clear();
-          for (size_t j = 0; j < i; j++) {
-            new_operators.push_back(operators[j]);
-          }
-          new_operators.push_back(fused_op);
-          for (size_t j = i + 1; j < operators.size(); j++) {
-            if (j == l) {
-              continue; // l and i are fused
-            }
-            Op *op = operators[j];
-            // Update input tensors that belong to operator[l] or operator[i]
-            for (int idx = 0; idx < op->numInputs; idx++) {
-              if ((op->inputs[idx]->owner_op == operators[l]) ||
-                  (op->inputs[idx]->owner_op == operators[i])) {
-                int found = -1;
-                for (int k = 0; k < fused_op->numOutputs; k++) {
-                  if (fused_op->outputs[k]->region == op->inputs[idx]->region) {
-                    assert(found == -1);
-                    found = k;
-                  }
-                }
-                assert(found >= 0);
-                op->inputs[idx] = fused_op->outputs[found];
-              }
-            }
-            // Insert op
-            new_operators.push_back(op);
-          }
-          // We are exact one operator fewer than the original
-          assert(new_operators.size() + 1 == operators.size());
-          return true;
+        FusedOp *fused_op = new FusedOp(*this, group);
+        if (fused_op->add_operator(*this, op)) {
+          new_operators[*it] = fused_op;
+          group_idx[fused_op] = *it;
+          group_idx[op] = *it;
+          fused = true;
         } else {
-          // TODO: delete fused_op to avoid memory leakage
-          if (allocate_new_fused_op) {
-            delete fused_op;
+          // Give the outputs back to group
+          for (int i = 0; i < group->numOutputs; i++) {
+            group->outputs[i]->owner_op = group;
+            group->outputs[i]->owner_idx = i;
           }
-          continue;
+          delete fused_op;
         }
       }
     }
+    if (!fused) {
+      group_idx[op] = new_operators.size();
+      if (can_fuse_into(op)) {
+        candidates[op->outputs[0]->machine_view].push_back(
+            new_operators.size());
+      }
+      new_operators.push_back(op);
+    }
   }
-  return false;
 }
 
 Op *FFModel::create_operator_from_layer(
@@ -2777,6 +2775,11 @@ Op *FFModel::create_operator_from_layer(
       operators.push_back(op);
       return op;
     }
+    case OP_EXPERTS: {
+      Op *op = Experts::create_operator_from_layer(*this, layer, inputs);
+      operators.push_back(op);
+      return op;
+    }
     default:
       assert(false);
   }
@@ -2820,20 +2823,37 @@ void FFModel::compile(LossType loss_type,
             "data-parallel PCG.\n");
   }
   create_operators_from_layers();
-  // Launch the graph optimize task
+  // Launch the graph optimize task, unless the strategy cache already has
+  // the result of the same search
   {
-    FFModel *model = this;
-    TaskLauncher launcher(GRAPH_OPTIMIZE_TASK_ID,
-                          TaskArgument(&model, sizeof(FFModel *)));
-    Future future = runtime->execute_task(ctx, launcher);
-
-    PCG::GraphOptimalViewSerialized ret =
-        future.get_result<PCG::GraphOptimalViewSerialized>();
-    Deserializer dez(ret.data, ret.total_bytes);
+    std::unique_ptr<StrategyCache> strategy_cache;
+    uint64_t cache_key = 0;
+    PCG::GraphOptimalViewSerialized ret;
+    bool cached = false;
+    if (!config.strategy_cache_dir.empty()) {
+      strategy_cache.reset(new StrategyCache(config.strategy_cache_dir));
+      cache_key = StrategyCache::get_key(this);
+      cached = strategy_cache->lookup(cache_key, ret);
+      if (cached) {
+        fprintf(stderr,
+                "Restored strategy %016" PRIx64 " from the strategy cache\n",
+                cache_key);
+      }
+    }
+    if (!cached) {
+      FFModel *model = this;
+      TaskLauncher launcher(GRAPH_OPTIMIZE_TASK_ID,
+                            TaskArgument(&model, sizeof(FFModel *)));
+      Future future = runtime->execute_task(ctx, launcher);
+      ret = future.get_result<PCG::GraphOptimalViewSerialized>();
+      if (strategy_cache) {
+        strategy_cache->insert(cache_key, ret);
+      }
+    }
     // Reconstruct operators
     PCG::Graph *best_graph = new PCG::Graph(this);
     std::unordered_map<PCG::Node, MachineView> optimal_views;
-    deserialize_graph_optimal_view(dez, best_graph, optimal_views);
+    deserialize_graph_optimal_view(ret, best_graph, optimal_views);
     operators.clear();
     convert_graph_to_operators(best_graph, optimal_views);
     best_graph->print_dot();
@@ -2965,22 +2985,20 @@ void FFModel::compile(LossType loss_type,
   if (config.perform_fusion) {
     fprintf(stderr, "Applying fusion optimizations during compilation...\n");
     fprintf(stderr, "%zu operators before fusion...\n", operators.size());
+    std::unordered_set<Op const *> old_operators(operators.begin(),
+                                                 operators.end());
     std::vector<Op *> new_operators;
-    std::vector<Op *> old_operators = operators;
-    while (apply_fusion(operators, new_operators)) {
-      for (size_t i = 0; i < new_operators.size(); i++) {
-        for (int idx = 0; idx < new_operators[i]->numInputs; idx++) {
-          for (size_t j = i + 1; j < new_operators.size(); j++) {
-            if (new_operators[i]->inputs[idx]->owner_op == new_operators[j]) {
-              assert(false);
-            }
-          }
-        }
-      }
-      operators = new_operators;
-    }
+    apply_fusion(operators, new_operators);
+    operators = new_operators;
     // Check integrity
+    std::unordered_set<Op const *> visited;
     for (size_t l = 0; l < operators.size(); l++) {
+      // Producers come before their consumers
+      for (int idx = 0; idx < operators[l]->numInputs; idx++) {
+        Op const *owner = operators[l]->inputs[idx]->owner_op;
+        assert(owner == NULL || visited.find(owner) != visited.end());
+      }
+      visited.insert(operators[l]);
       if (operators[l]->op_type == OP_FUSED) {
         FusedOp *fused = (FusedOp *)operators[l];
         int ioff = 0, woff = 0, ooff = 0;
@@ -3016,14 +3034,7 @@ void FFModel::compile(LossType loss_type,
           ooff += fused->op_num_outputs[op];
         }
       } else {
-        bool found = false;
-        for (size_t i = 0; i < old_operators.size(); i++) {
-          if (old_operators[i] == operators[l]) {
-            assert(!found);
-            found = true;
-          }
-        }
-        assert(found);
+        assert(old_operators.find(operators[l]) != old_operators.end());
       }
     }
     fprintf(stderr, "%zu operators after fusion...\n", operators.size());
@@ -3173,15 +3184,11 @@ struct PropagationEdgeInfo {
   size_t size;
 };
 
-float randf() {
-  return static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
-}
-
 #ifdef FF_USE_PROPAGATE
 void FFModel::propagate(std::map<Op *, ParallelConfig> const &current,
                         std::map<Op *, ParallelConfig> &next) const {
   next = current;
-  size_t opId = std::rand() % (operators.size() - 1);
+  size_t opId = randi() % (operators.size() - 1);
   // TODO: need to make sure opId is not an output operator of the model
   assert(opId != operators.size() - 1);
 
@@ -3274,7 +3281,7 @@ void FFModel::rewrite(std::map<Op const *, ParallelConfig> const &current,
     this->propagate(current, next);
 #endif
   } else {
-    size_t opId = std::rand() % operators.size();
+    size_t opId = randi() % operators.size();
     // TODO: need to make sure opId is not an output operator of the model
     if (opId == operators.size() - 1) {
       return;
@@ -3288,53 +3295,76 @@ void FFModel::mcmc_optimize(std::map<Op const *, ParallelConfig> &best,
                             float alpha,
                             CompMode comp_mode,
                             bool use_propagation) const {
+  // Every chain needs a simulator of its own for its task graph and
+  // checkpoint; the others measure operators on simulator, with its
+  // workspace and cost caches
+  std::vector<std::unique_ptr<Simulator>> chain_simulators;
+  std::vector<Simulator *> simulators = {simulator};
+  if (config.mcmc_chains > 1 && simulator->profile_mutex == nullptr) {
+    simulator->profile_mutex = std::make_shared<std::mutex>();
+  }
+  for (int c = 1; c < config.mcmc_chains; c++) {
+    chain_simulators.emplace_back(new Simulator(simulator));
+    simulators.push_back(chain_simulators.back().get());
+  }
+  mcmc_optimize(simulators,
+                best,
+                budget,
+                alpha,
+                comp_mode,
+                use_propagation);
+}
+
+void FFModel::mcmc_optimize(std::vector<Simulator *> const &simulators,
+                            std::map<Op const *, ParallelConfig> &best,
+                            size_t budget,
+                            float alpha,
+                            CompMode comp_mode,
+                            bool use_propagation) const {
+  assert(simulators.size() > 0);
   // Start from data parallel
-  std::map<Op const *, ParallelConfig> current, next;
-  float best_runtime = simulator->simulate_runtime(this, best, comp_mode);
-  current = best;
-  float current_runtime = best_runtime;
-  size_t reset_span = budget / 100, last_reset_iter = 0;
-  if (reset_span == 0) {
-    reset_span = 1;
-  }
-  if (reset_span > 1000) {
-    reset_span = 1000;
-  }
-  for (size_t iter = 0; iter <= budget; iter++) {
-    // Reset the current strategy to be the best strategy
-    if (iter - last_reset_iter >= reset_span) {
-      current = best;
-      current_runtime = best_runtime;
-      last_reset_iter = iter;
-    }
-    rewrite(current, next, use_propagation);
-    float next_runtime = simulator->simulate_runtime(this, next, comp_mode);
-    if (iter % 1000 == 0) {
-      printf("iteration(%zu) current_strategy(%.4lf) best_strategy(%.4lf)\n",
-             iter,
-             current_runtime,
-             best_runtime);
-    }
-    float rn = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
-    // float ratio = (next_runtime - current_runtime) / current_runtime;
-    float diff = (next_runtime - current_runtime);
-    if (next_runtime < best_runtime) {
-      best_runtime = next_runtime;
-      best = next;
-    }
-    if (next_runtime < current_runtime) {
-      current = next;
-      current_runtime = next_runtime;
-    } else if (rn < std::exp(-alpha * diff)) {
-      current = next;
-      current_runtime = next_runtime;
-    }
-  }
+  float initial_runtime =
+      simulators[0]->simulate_runtime(this, best, comp_mode);
+  ReplicaExchangeParams params;
+  params.num_chains = simulators.size();
+  params.budget = budget;
+  params.alpha = alpha;
+  params.temperature_ratio = MCMC_TEMPERATURE_RATIO;
+  params.seed = config.search_seed;
+  if (config.mcmc_exchange_interval > 0) {
+    params.exchange_interval = config.mcmc_exchange_interval;
+  }
+  params.reset_span = std::min(std::max(budget / 100, (size_t)1),
+                               (size_t)1000);
+  using Strategy = std::map<Op const *, ParallelConfig>;
+  replica_exchange_search<Strategy>(
+      best,
+      initial_runtime,
+      params,
+      [&](int c, Strategy const &current, Strategy &next) {
+        rewrite(current, next, use_propagation);
+      },
+      [&](int c, Strategy const &next) {
+        // next differs from the previously simulated strategy in a few ops
+        return simulators[c]->simulate_runtime_incremental(
+            this, next, comp_mode);
+      });
   printf("=========== Best Discovered Strategy ==========\n");
-  simulator->simulate_runtime(
-      this, best, comp_mode, this->config.export_strategy_task_graph_file);
+  SimulationReport report;
+  bool export_report = this->config.export_strategy_report_file != "";
+  simulators[0]->simulate_runtime(this,
+                                  best,
+                                  comp_mode,
+                                  this->config.export_strategy_task_graph_file,
+                                  this->config.export_strategy_trace_file,
+                                  export_report ? &report : nullptr);
+  if (export_report) {
+    report.write_json(this->config.export_strategy_report_file);
+  }
+  std::map<std::string, ParallelConfig> strategies;
   std::map<Op const *, ParallelConfig>::const_iterator it;
   for (it = best.begin(); it != best.end(); it++) {
+    strategies[it->first->name] = it->second;
     printf("[%s] num_dims(%d) dims[", it->first->name, it->second.nDims);
     for (int i = 0; i < it->second.nDims; i++) {
       if (i < it->second.nDims - 1) {
@@ -3353,6 +3383,9 @@ void FFModel::mcmc_optimize(std::map<Op const *, ParallelConfig> &best,
     }
     printf("]\n");
   }
+  if (config.export_strategy_file.length() > 0) {
+    save_strategies_to_file(config.export_strategy_file, strategies);
+  }
   printf("============= MCMC Search Finished ============\n\n");
 }
 
@@ -3492,7 +3525,13 @@ struct DefaultConfig {
   const static int machine_model_version = 0;
   const static int simulator_segment_size = 16777216; // 16 MB
   const static int simulator_max_num_segments = 1;
+  const static int simulator_num_threads = 1;
+  const static bool simulator_flow_level_network = false;
   const static int base_optimize_threshold = 10;
+  const static int search_num_threads = 1;
+  const static unsigned search_seed = 0;
+  const static int mcmc_exchange_interval = 0;
+  const static int mcmc_chains = 1;
   const static bool enable_control_replication = true;
   // The default python data loader type is 2 to enable control replication
   const static int python_data_loader_type = 2;
@@ -3523,20 +3562,38 @@ FFConfig::FFConfig() {
   machine_model_version = DefaultConfig::machine_model_version;
   simulator_segment_size = DefaultConfig::simulator_segment_size;
   simulator_max_num_segments = DefaultConfig::simulator_max_num_segments;
+  simulator_num_threads = DefaultConfig::simulator_num_threads;
+  simulator_flow_level_network = DefaultConfig::simulator_flow_level_network;
+  allreduce_algorithm = CHOSEN_SYNC_TYPE == ParameterSyncType::NCCL
+                            ? ALLREDUCE_AUTO
+                            : ALLREDUCE_PARAMETER_SERVER;
+  search_seed = DefaultConfig::search_seed;
+  mcmc_exchange_interval = DefaultConfig::mcmc_exchange_interval;
+  mcmc_chains = DefaultConfig::mcmc_chains;
   enable_control_replication = DefaultConfig::enable_control_replication;
   python_data_loader_type = DefaultConfig::python_data_loader_type;
   machine_model_file = "";
   import_strategy_file = "";
   export_strategy_file = "";
   export_strategy_task_graph_file = "";
+  export_strategy_trace_file = "";
+  export_strategy_report_file = "";
   include_costs_dot_graph = false;
   export_strategy_computation_graph_file = "";
+  cost_database_file = "";
+  strategy_cache_dir = "";
+  analytical_cost_model = false;
+  gpu_peak_tflops = 0.0f;
+  gpu_fb_mem_bandwidth = 0.0f;
   dataset_path = "";
   substitution_json_path = tl::nullopt;
   syntheticInput = false;
   perform_fusion = false;
   base_optimize_threshold = DefaultConfig::base_optimize_threshold;
+  search_num_threads = DefaultConfig::search_num_threads;
   perform_memory_search = false;
+  memory_usage_type = MemoryUsageType::PER_DEVICE_MAX;
+  memory_search_algo = MemorySearchAlgo::MULTI_OBJECTIVE;
 
   // Parse input arguments
   {
@@ -3667,6 +3724,14 @@ void FFConfig::parse_args(char **argv, int argc) {
       export_strategy_task_graph_file = std::string(argv[++i]);
       continue;
     }
+    if (!strcmp(argv[i], "--trace")) {
+      export_strategy_trace_file = std::string(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--simulation-report")) {
+      export_strategy_report_file = std::string(argv[++i]);
+      continue;
+    }
     if (!strcmp(argv[i], "--include-costs-dot-graph")) {
       include_costs_dot_graph = true;
       continue;
@@ -3675,6 +3740,26 @@ void FFConfig::parse_args(char **argv, int argc) {
       export_strategy_computation_graph_file = std::string(argv[++i]);
       continue;
     }
+    if (!strcmp(argv[i], "--strategy-cache")) {
+      strategy_cache_dir = std::string(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--cost-database")) {
+      cost_database_file = std::string(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--analytical-cost-model")) {
+      analytical_cost_model = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--gpu-peak-tflops")) {
+      gpu_peak_tflops = atof(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--gpu-fb-mem-bandwidth")) {
+      gpu_fb_mem_bandwidth = atof(argv[++i]);
+      continue;
+    }
     if (!strcmp(argv[i], "--machine-model-version")) {
       machine_model_version = atoi(argv[++i]);
       continue;
@@ -3691,6 +3776,32 @@ void FFConfig::parse_args(char **argv, int argc) {
       simulator_max_num_segments = atoi(argv[++i]);
       continue;
     }
+    if (!strcmp(argv[i], "--simulator-num-threads")) {
+      simulator_num_threads = atoi(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--simulator-flow-level-network")) {
+      simulator_flow_level_network = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--allreduce-algorithm")) {
+      char const *name = argv[++i];
+      if (!strcmp(name, "auto")) {
+        allreduce_algorithm = ALLREDUCE_AUTO;
+      } else if (!strcmp(name, "ring")) {
+        allreduce_algorithm = ALLREDUCE_RING;
+      } else if (!strcmp(name, "tree")) {
+        allreduce_algorithm = ALLREDUCE_TREE;
+      } else if (!strcmp(name, "hierarchical")) {
+        allreduce_algorithm = ALLREDUCE_HIERARCHICAL;
+      } else if (!strcmp(name, "ps")) {
+        allreduce_algorithm = ALLREDUCE_PARAMETER_SERVER;
+      } else {
+        fprintf(stderr, "Unknown allreduce algorithm: %s\n", name);
+        assert(false);
+      }
+      continue;
+    }
     if (!strcmp(argv[i], "--enable-propagation")) {
       enable_propagation = true;
       continue;
@@ -3710,6 +3821,22 @@ void FFConfig::parse_args(char **argv, int argc) {
     if (!strcmp(argv[i], "--base-optimize-threshold")) {
       base_optimize_threshold = atoi(argv[++i]);
     }
+    if (!strcmp(argv[i], "--search-num-threads")) {
+      search_num_threads = atoi(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--search-seed")) {
+      search_seed = (unsigned)atoll(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--mcmc-exchange-interval")) {
+      mcmc_exchange_interval = atoi(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--mcmc-chains")) {
+      mcmc_chains = atoi(argv[++i]);
+      continue;
+    }
     if (!strcmp(argv[i], "--disable-control-replication")) {
       enable_control_replication = false;
       continue;
@@ -3726,6 +3853,30 @@ void FFConfig::parse_args(char **argv, int argc) {
       perform_memory_search = true;
       continue;
     }
+    if (!strcmp(argv[i], "--memory-usage-type")) {
+      char const *name = argv[++i];
+      if (!strcmp(name, "per-device-max")) {
+        memory_usage_type = MemoryUsageType::PER_DEVICE_MAX;
+      } else if (!strcmp(name, "liveness")) {
+        memory_usage_type = MemoryUsageType::PER_DEVICE_LIVENESS;
+      } else {
+        fprintf(stderr, "Unknown memory usage type: %s\n", name);
+        assert(false);
+      }
+      continue;
+    }
+    if (!strcmp(argv[i], "--memory-search-algo")) {
+      char const *name = argv[++i];
+      if (!strcmp(name, "multi-objective")) {
+        memory_search_algo = MemorySearchAlgo::MULTI_OBJECTIVE;
+      } else if (!strcmp(name, "pareto")) {
+        memory_search_algo = MemorySearchAlgo::PARETO;
+      } else {
+        fprintf(stderr, "Unknown memory search algorithm: %s\n", name);
+        assert(false);
+      }
+      continue;
+    }
   }
 }
 
@@ -4170,6 +4321,66 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<Group_by::backward_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(GROUP_BY_METRICS_TASK_ID,
+                                   "Group_by Metrics");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<PerfMetrics,
+                                        Group_by::routing_metrics_task>(
+          registrar, "Group_by Metrics Task");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<PerfMetrics,
+                                     Group_by::routing_metrics_task>(registrar);
+    }
+  }
+  // Experts task GPU
+  {
+    TaskVariantRegistrar registrar(EXPERTS_INIT_TASK_ID, "Experts Init");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *, Experts::init_task>(
+          registrar, "Experts Init Task");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *, Experts::init_task>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(EXPERTS_FWD_TASK_ID, "Experts Forward");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<Experts::forward_task>(
+          registrar, "Experts Forward Task");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Experts::forward_task>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(EXPERTS_BWD_TASK_ID, "Experts Backward");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<Experts::backward_task>(
+          registrar, "Experts Backward Task");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Experts::backward_task>(registrar);
+    }
+  }
 
   // Aggregate task CPU
   {
@@ -5428,10 +5639,11 @@ void register_flexflow_internal_tasks(Runtime *runtime,
           registrar);
     }
   }
-  // Graph optimize
-  {
+  // Graph optimize, on a GPU to measure the operators or on a CPU with
+  // --analytical-cost-model
+  for (Processor::Kind kind : {Processor::TOC_PROC, Processor::LOC_PROC}) {
     TaskVariantRegistrar registrar(GRAPH_OPTIMIZE_TASK_ID, "Graph Optimize");
-    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.add_constraint(ProcessorConstraint(kind));
     registrar.set_leaf();
     if (pre_register) {
       Runtime::preregister_task_variant<PCG::GraphOptimalViewSerialized,
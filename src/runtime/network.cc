@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <cmath>
 #include <functional>
 #include <limits>
+#include <numeric>
 #include <queue>
 #include <random>
 #include <unordered_set>
@@ -25,7 +27,6 @@ namespace FlexFlow {
 
 static std::random_device rd;
 static std::mt19937 gen = std::mt19937(rd());
-static std::uniform_real_distribution<float> unif(0, 1);
 
 // for summing connections...
 template <typename T>
@@ -44,334 +45,249 @@ static std::vector<T> operator+(std::vector<T> const &a,
   return result;
 }
 
-WeightedShortestPathRoutingStrategy::WeightedShortestPathRoutingStrategy(
-    ConnectionMatrix const &c,
-    std::map<size_t, CommDevice *> const &devmap,
-    int total_devs)
-    : conn(c), devmap(devmap), total_devs(total_devs) {}
-
-EcmpRoutes WeightedShortestPathRoutingStrategy::get_routes(int src_node,
-                                                           int dst_node) {
-  int key = src_node * total_devs + dst_node;
-
-  if (conn[key] > 0) {
-    return std::make_pair(std::vector<float>({1}),
-                          std::vector<Route>({Route({devmap.at(key)})}));
-  }
-
-  // one-shortest path routing
-  std::vector<uint64_t> dist(total_devs, std::numeric_limits<uint64_t>::max());
-  std::vector<int> prev(total_devs, -1);
-  std::vector<bool> visited(total_devs, false);
-
-  std::priority_queue<std::pair<uint64_t, uint64_t>,
-                      std::vector<std::pair<uint64_t, uint64_t>>,
-                      std::greater<std::pair<uint64_t, uint64_t>>>
-      pq;
-  pq.push(std::make_pair(dist[src_node], src_node));
-  dist[src_node] = 0;
-
-  while (!pq.empty()) {
-    int min_node = pq.top().second;
-    pq.pop();
-    visited[min_node] = true;
-
-    if (min_node == dst_node) {
-      break;
+ConnectionCSR::ConnectionCSR(ConnectionMatrix const &conn,
+                             int total_devs,
+                             bool transpose)
+    : offsets(total_devs + 1, 0) {
+  for (int i = 0; i < total_devs; i++) {
+    for (int j = 0; j < total_devs; j++) {
+      int key = transpose ? j * total_devs + i : i * total_devs + j;
+      if (conn[key] > 0) {
+        dsts.push_back(j);
+        links.push_back(conn[key]);
+      }
     }
+    offsets[i + 1] = dsts.size();
+  }
+}
 
-    for (int i = 0; i < total_devs; i++) {
-      if (visited[i] || conn[min_node * total_devs + i] == 0) {
-        continue;
-      }
-      float new_dist = dist[min_node] + 1; // numeric_limits<uint64_t>::max() /
-                                           // get_bandwidth_bps(min_node, i);
-      if (new_dist < dist[i] || (new_dist == dist[i] && unif(gen) < 0.5)) {
-        dist[i] = new_dist;
-        prev[i] = min_node;
-        pq.push(std::make_pair(new_dist, i));
+/**
+ * Mark the nodes on shortest paths to dst_node, i.e. those from which
+ * dst_node is reached by going one hop further away from the source at each
+ * step, and append them to marked.
+ */
+static void mark_shortest_paths(ConnectionCSR const &in_links,
+                                std::vector<int> const &hops,
+                                int dst_node,
+                                std::vector<char> &on_path,
+                                std::vector<int> &marked) {
+  on_path[dst_node] = true;
+  marked.push_back(dst_node);
+  for (size_t k = 0; k < marked.size(); k++) {
+    int v = marked[k];
+    for (int e = in_links.offsets[v]; e < in_links.offsets[v + 1]; e++) {
+      int u = in_links.dsts[e];
+      if (!on_path[u] && hops[u] >= 0 && hops[u] == hops[v] - 1) {
+        on_path[u] = true;
+        marked.push_back(u);
       }
     }
   }
+}
 
-  Route result = Route();
+/**
+ * Walk one shortest path back from dst_node, preferring the widest link at
+ * each hop, and return the narrowest link on it.
+ */
+static int narrowest_link(ConnectionCSR const &in_links,
+                          std::vector<int> const &hops,
+                          int dst_node) {
+  int narrowest = std::numeric_limits<int>::max();
   int curr = dst_node;
-  while (prev[curr] != -1) {
-    result.insert(result.begin(), devmap.at(prev[curr] * total_devs + curr));
-    curr = prev[curr];
+  while (hops[curr] > 0) {
+    int widest_pred = -1;
+    int widest = 0;
+    for (int e = in_links.offsets[curr]; e < in_links.offsets[curr + 1];
+         e++) {
+      int u = in_links.dsts[e];
+      if (hops[u] == hops[curr] - 1 && in_links.links[e] > widest) {
+        widest_pred = u;
+        widest = in_links.links[e];
+      }
+    }
+    assert(widest_pred != -1);
+    narrowest = std::min(narrowest, widest);
+    curr = widest_pred;
   }
-  assert(result.size() || src_node == dst_node);
-  return std::make_pair(std::vector<float>{1}, std::vector<Route>{result});
+  return narrowest;
 }
 
-void WeightedShortestPathRoutingStrategy::hop_count(int src_node,
-                                                    int dst_node,
-                                                    int &hop,
-                                                    int &narrowest) {
-  int key = src_node * total_devs + dst_node;
+EcmpRouteCache::EcmpRouteCache(ConnectionMatrix const &conn,
+                               std::map<size_t, CommDevice *> const &devmap,
+                               int total_devs,
+                               int max_num_routes)
+    : conn(conn), devmap(devmap), total_devs(total_devs),
+      max_num_routes(max_num_routes) {
+  assert(max_num_routes > 0);
+  build_links();
+}
 
-  if (conn[key] > 0) {
-    hop = 0;
-    narrowest = conn[key];
-    return;
-  }
-  // one-shortest path routing
-  std::vector<uint64_t> dist(total_devs, std::numeric_limits<uint64_t>::max());
-  std::vector<int> prev(total_devs, -1);
-  std::vector<bool> visited(total_devs, false);
-
-  std::priority_queue<std::pair<uint64_t, uint64_t>,
-                      std::vector<std::pair<uint64_t, uint64_t>>,
-                      std::greater<std::pair<uint64_t, uint64_t>>>
-      pq;
-  pq.push(std::make_pair(dist[src_node], src_node));
-  dist[src_node] = 0;
-  while (!pq.empty()) {
-    int min_node = pq.top().second;
-    pq.pop();
-    visited[min_node] = true;
-    if (min_node == dst_node) {
-      break;
+void EcmpRouteCache::build_links() {
+  out_links = ConnectionCSR(conn, total_devs);
+  in_links = ConnectionCSR(conn, total_devs, true /*transpose*/);
+  out_devices.resize(out_links.dsts.size());
+  for (int u = 0; u < total_devs; u++) {
+    for (int e = out_links.offsets[u]; e < out_links.offsets[u + 1]; e++) {
+      out_devices[e] = devmap.at((size_t)u * total_devs + out_links.dsts[e]);
     }
-    for (int i = 0; i < total_devs; i++) {
-      if (visited[i] || conn[min_node * total_devs + i] == 0) {
-        continue;
-      }
-      float new_dist = dist[min_node] + 1; // numeric_limits<uint64_t>::max() /
-                                           // get_bandwidth_bps(min_node, i);
-      if (new_dist < dist[i]) {
-        dist[i] = new_dist;
-        prev[i] = min_node;
-        pq.push(std::make_pair(new_dist, i));
-      }
+  }
+}
+
+void EcmpRouteCache::clear() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  build_links();
+  cached_hops.clear();
+}
+
+std::shared_ptr<std::vector<int> const>
+    EcmpRouteCache::get_hops(int src_node) {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cached_hops.find(src_node);
+    if (it != cached_hops.end()) {
+      return it->second;
     }
   }
-  hop = 0;
-  narrowest = std::numeric_limits<int>::max();
-  int curr = dst_node;
-  while (prev[curr] != -1) {
-    if (narrowest > conn[prev[curr] * total_devs + curr]) {
-      narrowest = conn[prev[curr] * total_devs + curr];
+
+  // BFS, using hops itself as the visited set
+  auto hops = std::make_shared<std::vector<int>>(total_devs, -1);
+  std::vector<int> queue;
+  queue.reserve(total_devs);
+  (*hops)[src_node] = 0;
+  queue.push_back(src_node);
+  for (size_t k = 0; k < queue.size(); k++) {
+    int u = queue[k];
+    for (int e = out_links.offsets[u]; e < out_links.offsets[u + 1]; e++) {
+      int v = out_links.dsts[e];
+      if ((*hops)[v] < 0) {
+        (*hops)[v] = (*hops)[u] + 1;
+        queue.push_back(v);
+      }
     }
-    hop++;
-    curr = prev[curr];
   }
-  assert(hop > 0 || src_node == dst_node);
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  return cached_hops.emplace(src_node, std::move(hops)).first->second;
 }
 
-std::vector<EcmpRoutes>
-    WeightedShortestPathRoutingStrategy::get_routes_from_src(int src_node) {
-  std::vector<uint64_t> dist(total_devs, std::numeric_limits<uint64_t>::max());
-  std::vector<int> prev(total_devs, -1);
-  std::vector<bool> visited(total_devs, false);
-
-  std::priority_queue<std::pair<uint64_t, uint64_t>,
-                      std::vector<std::pair<uint64_t, uint64_t>>,
-                      std::greater<std::pair<uint64_t, uint64_t>>>
-      pq;
-  pq.push(std::make_pair(dist[src_node], src_node));
-  dist[src_node] = 0;
-  while (!pq.empty()) {
-    int min_node = pq.top().second;
-    pq.pop();
-    visited[min_node] = true;
-
-    for (int i = 0; i < total_devs; i++) {
-      if (visited[i] || conn[min_node * total_devs + i] == 0) {
-        continue;
-      }
-      float new_dist = dist[min_node] + 1; // numeric_limits<uint64_t>::max() /
-                                           // get_bandwidth_bps(min_node, i);
-      if (new_dist < dist[i]) {
-        dist[i] = new_dist;
-        prev[i] = min_node;
-        pq.push(std::make_pair(new_dist, i));
+EcmpRoutes EcmpRouteCache::enumerate_routes(std::vector<int> const &hops,
+                                            int src_node,
+                                            int dst_node) const {
+  EcmpRoutes result;
+  if (src_node == dst_node || hops[dst_node] < 0) {
+    return result;
+  }
+
+  // scratch space, kept all false between calls
+  static thread_local std::vector<char> on_path;
+  static thread_local std::vector<int> marked;
+  if ((int)on_path.size() < total_devs) {
+    on_path.resize(total_devs, false);
+  }
+  marked.clear();
+  mark_shortest_paths(in_links, hops, dst_node, on_path, marked);
+
+  auto is_next_hop = [&](int u, int v) {
+    return on_path[v] && hops[v] == hops[u] + 1;
+  };
+  auto next_hop_links = [&](int u) {
+    int total = 0;
+    for (int e = out_links.offsets[u]; e < out_links.offsets[u + 1]; e++) {
+      if (is_next_hop(u, out_links.dsts[e])) {
+        total += out_links.links[e];
       }
     }
-  }
-  std::vector<EcmpRoutes> final_result;
-  for (int i = 0; i < total_devs; i++) {
-    if (i == src_node) {
-      final_result.emplace_back(
-          std::make_pair(std::vector<float>{}, std::vector<Route>{}));
+    return total;
+  };
+
+  // Depth-first enumeration of the shortest paths, where each route gets the
+  // chance that per-hop ECMP takes it
+  std::vector<double> chances;
+  std::vector<int> nodes = {src_node};
+  std::vector<int> cursors = {out_links.offsets[src_node]};
+  std::vector<double> path_chances = {1.0};
+  std::vector<int> totals = {next_hop_links(src_node)};
+  Route path;
+  auto pop = [&]() {
+    nodes.pop_back();
+    cursors.pop_back();
+    path_chances.pop_back();
+    totals.pop_back();
+    if (!path.empty()) {
+      path.pop_back();
+    }
+  };
+  while (!nodes.empty() && (int)result.second.size() < max_num_routes) {
+    int u = nodes.back();
+    if (u == dst_node) {
+      result.second.push_back(path);
+      chances.push_back(path_chances.back());
+      pop();
       continue;
     }
-    Route result = Route();
-    int curr = i;
-    while (prev[curr] != -1) {
-      result.insert(result.begin(), devmap.at(prev[curr] * total_devs + curr));
-      curr = prev[curr];
+    int &e = cursors.back();
+    while (e < out_links.offsets[u + 1] && !is_next_hop(u, out_links.dsts[e])) {
+      e++;
+    }
+    if (e == out_links.offsets[u + 1]) {
+      pop();
+      continue;
     }
-    assert(result.size() > 0);
-    final_result.emplace_back(
-        std::make_pair(std::vector<float>{1}, std::vector<Route>{result}));
+    int v = out_links.dsts[e];
+    double chance = path_chances.back() * out_links.links[e] / totals.back();
+    path.push_back(out_devices[e]);
+    e++;
+    nodes.push_back(v);
+    cursors.push_back(out_links.offsets[v]);
+    path_chances.push_back(chance);
+    totals.push_back(next_hop_links(v));
   }
-  return final_result;
-}
 
-std::vector<std::pair<int, int>>
-    WeightedShortestPathRoutingStrategy::hop_count(int src_node) {
-  std::vector<uint64_t> dist(total_devs, std::numeric_limits<uint64_t>::max());
-  std::vector<int> prev(total_devs, -1);
-  std::vector<bool> visited(total_devs, false);
-
-  std::priority_queue<std::pair<uint64_t, uint64_t>,
-                      std::vector<std::pair<uint64_t, uint64_t>>,
-                      std::greater<std::pair<uint64_t, uint64_t>>>
-      pq;
-  pq.push(std::make_pair(dist[src_node], src_node));
-  dist[src_node] = 0;
-  while (!pq.empty()) {
-    int min_node = pq.top().second;
-    pq.pop();
-    visited[min_node] = true;
-
-    for (int i = 0; i < total_devs; i++) {
-      if (visited[i] || conn[min_node * total_devs + i] == 0) {
-        continue;
-      }
-      float new_dist = dist[min_node] + 1; // numeric_limits<uint64_t>::max() /
-                                           // get_bandwidth_bps(min_node, i);
-      if (new_dist < dist[i]) {
-        dist[i] = new_dist;
-        prev[i] = min_node;
-        pq.push(std::make_pair(new_dist, i));
-      }
-    }
+  for (int node : marked) {
+    on_path[node] = false;
   }
 
-  std::vector<std::pair<int, int>> result;
-  for (int i = 0; i < total_devs; i++) {
-    if (i == src_node) {
-      result.emplace_back(std::make_pair(-1, 0));
-      continue;
-    }
-    int hop = -1;
-    int narrowest = 0;
-    int curr = i;
-    while (prev[curr] != -1) {
-      if (!narrowest || (narrowest > conn[prev[curr] * total_devs + curr])) {
-        narrowest = conn[prev[curr] * total_devs + curr];
-      }
-      hop++;
-      curr = prev[curr];
-    }
-    result.emplace_back(std::make_pair(hop, narrowest));
+  // Renormalize in case some routes were cut off by max_num_routes
+  double sum = std::accumulate(chances.begin(), chances.end(), 0.0);
+  double cumulative = 0.0;
+  for (double chance : chances) {
+    cumulative += chance;
+    result.first.push_back(cumulative / sum);
   }
+  result.first.back() = 1.0f;
   return result;
 }
 
-ShortestPathNetworkRoutingStrategy::ShortestPathNetworkRoutingStrategy(
-    ConnectionMatrix const &c,
-    std::map<size_t, CommDevice *> const &devmap,
-    int total_devs)
-    : conn(c), devmap(devmap), total_devs(total_devs) {}
+EcmpRoutes EcmpRouteCache::get_routes(int src_node, int dst_node) {
+  if (src_node == dst_node) {
+    return std::make_pair(std::vector<float>{1}, std::vector<Route>{Route()});
+  }
 
-EcmpRoutes ShortestPathNetworkRoutingStrategy::get_routes(int src_node,
-                                                          int dst_node) {
   int key = src_node * total_devs + dst_node;
-  // std::cerr << "routing " << src_node << ", " << dst_node << std::endl;
-
   if (conn[key] > 0) {
     return std::make_pair(std::vector<float>({1}),
                           std::vector<Route>({Route({devmap.at(key)})}));
   }
 
-  // one-shortest path routing
-  std::vector<uint64_t> dist(total_devs, std::numeric_limits<uint64_t>::max());
-  std::vector<int> prev(total_devs, -1);
-  std::vector<bool> visited(total_devs, false);
-
-  std::queue<uint64_t> q;
-  q.push(src_node);
-  dist[src_node] = 0;
-
-  // BFS
-  while (!q.empty()) {
-    int min_node = q.front();
-    q.pop();
-    visited[min_node] = true;
-
-    if (min_node == dst_node) {
-      break;
-    }
-
-    for (int i = 0; i < total_devs; i++) {
-      if (visited[i] || conn[min_node * total_devs + i] == 0) {
-        continue;
-      }
-      float new_dist = dist[min_node] + 1;
-      if (new_dist < dist[i] || (new_dist == dist[i] && unif(gen) < 0.5)) {
-        dist[i] = new_dist;
-        prev[i] = min_node;
-        q.push(i);
-      }
-    }
-  }
-
-  Route result = Route();
-  int curr = dst_node;
-  while (prev[curr] != -1) {
-    result.insert(result.begin(), devmap.at(prev[curr] * total_devs + curr));
-    curr = prev[curr];
-  }
-  assert(result.size() || src_node == dst_node);
-  return std::make_pair(std::vector<float>{1}, std::vector<Route>{result});
+  EcmpRoutes result = enumerate_routes(*get_hops(src_node), src_node, dst_node);
+  assert(result.second.size() > 0);
+  return result;
 }
 
-std::vector<EcmpRoutes>
-    ShortestPathNetworkRoutingStrategy::get_routes_from_src(int src_node) {
-  std::vector<uint64_t> dist(total_devs, std::numeric_limits<uint64_t>::max());
-  std::vector<int> prev(total_devs, -1);
-  std::vector<bool> visited(total_devs, false);
-
-  std::queue<uint64_t> q;
-  q.push(src_node);
-  dist[src_node] = 0;
-
-  // BFS
-  while (!q.empty()) {
-    int min_node = q.front();
-    q.pop();
-    visited[min_node] = true;
-
-    for (int i = 0; i < total_devs; i++) {
-      if (visited[i] || conn[min_node * total_devs + i] == 0) {
-        continue;
-      }
-      float new_dist = dist[min_node] + 1;
-      if (new_dist < dist[i] || (new_dist == dist[i] && unif(gen) < 0.5)) {
-        dist[i] = new_dist;
-        prev[i] = min_node;
-        q.push(i);
-      }
-    }
-  }
-
+std::vector<EcmpRoutes> EcmpRouteCache::get_routes_from_src(int src_node) {
+  std::shared_ptr<std::vector<int> const> hops = get_hops(src_node);
   std::vector<EcmpRoutes> final_result;
+  final_result.reserve(total_devs);
   for (int i = 0; i < total_devs; i++) {
-    if (i == src_node) {
-      final_result.emplace_back(
-          std::make_pair(std::vector<float>{}, std::vector<Route>{}));
-      continue;
-    }
-    Route result = Route();
-    int curr = i;
-    while (prev[curr] != -1) {
-      result.insert(result.begin(), devmap.at(prev[curr] * total_devs + curr));
-      curr = prev[curr];
-    }
-    // assert(result.size() > 0);
-    final_result.emplace_back(
-        std::make_pair(std::vector<float>{1}, std::vector<Route>{result}));
+    final_result.emplace_back(enumerate_routes(*hops, src_node, i));
   }
   return final_result;
 }
 
-void ShortestPathNetworkRoutingStrategy::hop_count(int src_node,
-                                                   int dst_node,
-                                                   int &hop,
-                                                   int &narrowest) {
+void EcmpRouteCache::hop_count(int src_node,
+                               int dst_node,
+                               int &hop,
+                               int &narrowest) {
   int key = src_node * total_devs + dst_node;
 
   if (conn[key] > 0) {
@@ -379,100 +295,94 @@ void ShortestPathNetworkRoutingStrategy::hop_count(int src_node,
     narrowest = conn[key];
     return;
   }
-  // one-shortest path routing
-  std::vector<uint64_t> dist(total_devs, std::numeric_limits<uint64_t>::max());
-  std::vector<int> prev(total_devs, -1);
-  std::vector<bool> visited(total_devs, false);
-
-  std::queue<uint64_t> q;
-  q.push(src_node);
-  dist[src_node] = 0;
-
-  // BFS
-  while (!q.empty()) {
-    int min_node = q.front();
-    q.pop();
-    visited[min_node] = true;
-
-    if (min_node == dst_node) {
-      break;
-    }
-
-    for (int i = 0; i < total_devs; i++) {
-      if (visited[i] || conn[min_node * total_devs + i] == 0) {
-        continue;
-      }
-      float new_dist = dist[min_node] + 1;
-      if (new_dist < dist[i] || (new_dist == dist[i] && unif(gen) < 0.5)) {
-        dist[i] = new_dist;
-        prev[i] = min_node;
-        q.push(i);
-      }
-    }
-  }
-  hop = 0;
-  narrowest = std::numeric_limits<int>::max();
-  int curr = dst_node;
-  while (prev[curr] != -1) {
-    if (narrowest > conn[prev[curr] * total_devs + curr]) {
-      narrowest = conn[prev[curr] * total_devs + curr];
-    }
-    hop++;
-    curr = prev[curr];
-  }
-  assert(hop > 0 || src_node == dst_node);
+  std::shared_ptr<std::vector<int> const> hops = get_hops(src_node);
+  assert((*hops)[dst_node] >= 0);
+  hop = (*hops)[dst_node];
+  narrowest = narrowest_link(in_links, *hops, dst_node);
 }
 
-std::vector<std::pair<int, int>>
-    ShortestPathNetworkRoutingStrategy::hop_count(int src_node) {
-  std::vector<uint64_t> dist(total_devs, std::numeric_limits<uint64_t>::max());
-  std::vector<int> prev(total_devs, -1);
-  std::vector<bool> visited(total_devs, false);
-
-  std::queue<uint64_t> q;
-  q.push(src_node);
-  dist[src_node] = 0;
-
-  // BFS
-  while (!q.empty()) {
-    int min_node = q.front();
-    q.pop();
-    visited[min_node] = true;
-
-    for (int i = 0; i < total_devs; i++) {
-      if (visited[i] || conn[min_node * total_devs + i] == 0) {
-        continue;
-      }
-      float new_dist = dist[min_node] + 1;
-      if (new_dist < dist[i] || (new_dist == dist[i] && unif(gen) < 0.5)) {
-        dist[i] = new_dist;
-        prev[i] = min_node;
-        q.push(i);
-      }
-    }
-  }
-
+std::vector<std::pair<int, int>> EcmpRouteCache::hop_count(int src_node) {
+  std::shared_ptr<std::vector<int> const> hops = get_hops(src_node);
   std::vector<std::pair<int, int>> result;
   for (int i = 0; i < total_devs; i++) {
-    if (i == src_node) {
+    if (i == src_node || (*hops)[i] < 0) {
       result.emplace_back(std::make_pair(-1, 0));
       continue;
     }
-    int hop = -1;
-    int narrowest = 0;
-    int curr = i;
-    while (prev[curr] != -1) {
-      if (!narrowest || (narrowest > conn[prev[curr] * total_devs + curr])) {
-        narrowest = conn[prev[curr] * total_devs + curr];
-      }
-      hop++;
-      curr = prev[curr];
-    }
-    result.emplace_back(std::make_pair(hop, narrowest));
+    result.emplace_back(std::make_pair((*hops)[i] - 1,
+                                       narrowest_link(in_links, *hops, i)));
   }
   return result;
 }
 
+WeightedShortestPathRoutingStrategy::WeightedShortestPathRoutingStrategy(
+    ConnectionMatrix const &c,
+    std::map<size_t, CommDevice *> const &devmap,
+    int total_devs,
+    int max_num_routes)
+    : conn(c), devmap(devmap), total_devs(total_devs),
+      routes(c, devmap, total_devs, max_num_routes) {}
+
+EcmpRoutes WeightedShortestPathRoutingStrategy::get_routes(int src_node,
+                                                           int dst_node) {
+  return routes.get_routes(src_node, dst_node);
+}
+
+std::vector<EcmpRoutes>
+    WeightedShortestPathRoutingStrategy::get_routes_from_src(int src_node) {
+  return routes.get_routes_from_src(src_node);
+}
+
+void WeightedShortestPathRoutingStrategy::hop_count(int src_node,
+                                                    int dst_node,
+                                                    int &hop,
+                                                    int &narrowest) {
+  routes.hop_count(src_node, dst_node, hop, narrowest);
+}
+
+std::vector<std::pair<int, int>>
+    WeightedShortestPathRoutingStrategy::hop_count(int src_node) {
+  return routes.hop_count(src_node);
+}
+
+void WeightedShortestPathRoutingStrategy::clear() {
+  routes.clear();
+}
+
+ShortestPathNetworkRoutingStrategy::ShortestPathNetworkRoutingStrategy(
+    ConnectionMatrix const &c,
+    std::map<size_t, CommDevice *> const &devmap,
+    int total_devs,
+    int max_num_routes)
+    : conn(c), devmap(devmap), total_devs(total_devs),
+      routes(c, devmap, total_devs, max_num_routes) {}
+
+EcmpRoutes ShortestPathNetworkRoutingStrategy::get_routes(int src_node,
+                                                          int dst_node) {
+  return routes.get_routes(src_node, dst_node);
+}
+
+std::vector<EcmpRoutes>
+    ShortestPathNetworkRoutingStrategy::get_routes_from_src(int src_node) {
+  return routes.get_routes_from_src(src_node);
+}
+
+void ShortestPathNetworkRoutingStrategy::hop_count(int src_node,
+                                                   int dst_node,
+                                                   int &hop,
+                                                   int &narrowest) {
+  routes.hop_count(src_node, dst_node, hop, narrowest);
+}
+
+std::vector<std::pair<int, int>>
+    ShortestPathNetworkRoutingStrategy::hop_count(int src_node) {
+  return routes.hop_count(src_node);
+}
+
+void ShortestPathNetworkRoutingStrategy::clear() {
+  routes.clear();
+}
+
 FlatDegConstraintNetworkTopologyGenerator::
     FlatDegConstraintNetworkTopologyGenerator(int num_nodes, int degree)
     : num_nodes(num_nodes), degree(degree) {}
@@ -584,4 +494,140 @@ ConnectionMatrix BigSwitchNetworkTopologyGenerator::generate_topology() const {
   return conn;
 }
 
-}; // namespace FlexFlow
\ No newline at end of file
+FatTreeTopologyGenerator::FatTreeTopologyGenerator(int k, int oversubscription)
+    : k(k), oversubscription(oversubscription) {
+  assert(k >= 2 && k % 2 == 0);
+  assert(oversubscription >= 1);
+  num_nodes = k * (k / 2) * (oversubscription * k / 2);
+  num_switches = k * k + (k / 2) * (k / 2);
+}
+
+ConnectionMatrix FatTreeTopologyGenerator::generate_topology() const {
+  int half = k / 2;
+  int nodes_per_edge = oversubscription * half;
+  int total_devs = num_nodes + num_switches;
+  int first_edge = num_nodes;
+  int first_agg = first_edge + k * half;
+  int first_core = first_agg + k * half;
+  ConnectionMatrix conn(total_devs * total_devs, 0);
+  auto connect = [&](int a, int b) {
+    conn[a * total_devs + b]++;
+    conn[b * total_devs + a]++;
+  };
+  for (int pod = 0; pod < k; pod++) {
+    for (int i = 0; i < half; i++) {
+      int edge = first_edge + pod * half + i;
+      for (int n = 0; n < nodes_per_edge; n++) {
+        connect((pod * half + i) * nodes_per_edge + n, edge);
+      }
+      for (int j = 0; j < half; j++) {
+        connect(edge, first_agg + pod * half + j);
+      }
+    }
+    // the j-th aggregation switch of every pod reaches the j-th group of
+    // k/2 core switches
+    for (int j = 0; j < half; j++) {
+      for (int c = 0; c < half; c++) {
+        connect(first_agg + pod * half + j, first_core + j * half + c);
+      }
+    }
+  }
+#ifdef DEBUG_PRINT
+  std::cout << "Topology generated: " << std::endl;
+  NetworkTopologyGenerator::print_conn_matrix(conn, num_nodes, num_switches);
+#endif
+  return conn;
+}
+
+DragonflyTopologyGenerator::DragonflyTopologyGenerator(
+    int routers_per_group,
+    int nodes_per_router,
+    int global_links_per_router,
+    int local_link_width,
+    int global_link_width)
+    : routers_per_group(routers_per_group), nodes_per_router(nodes_per_router),
+      global_links_per_router(global_links_per_router),
+      local_link_width(local_link_width), global_link_width(global_link_width) {
+  assert(routers_per_group >= 1 && nodes_per_router >= 1);
+  assert(global_links_per_router >= 1);
+  num_groups = routers_per_group * global_links_per_router + 1;
+  num_switches = num_groups * routers_per_group;
+  num_nodes = num_switches * nodes_per_router;
+}
+
+ConnectionMatrix DragonflyTopologyGenerator::generate_topology() const {
+  int total_devs = num_nodes + num_switches;
+  ConnectionMatrix conn(total_devs * total_devs, 0);
+  auto connect = [&](int a, int b, int width) {
+    conn[a * total_devs + b] += width;
+    conn[b * total_devs + a] += width;
+  };
+  auto router = [&](int group, int r) {
+    return num_nodes + group * routers_per_group + r;
+  };
+  for (int g = 0; g < num_groups; g++) {
+    for (int r = 0; r < routers_per_group; r++) {
+      for (int n = 0; n < nodes_per_router; n++) {
+        connect((g * routers_per_group + r) * nodes_per_router + n,
+                router(g, r),
+                1);
+      }
+      for (int q = r + 1; q < routers_per_group; q++) {
+        connect(router(g, r), router(g, q), local_link_width);
+      }
+    }
+    // global port t of group g leads to group g + t + 1, which reaches g
+    // back through its port num_groups - 2 - t; add each link once
+    for (int t = 0; t < num_groups - 1; t++) {
+      int peer = (g + t + 1) % num_groups;
+      if (peer < g) {
+        continue;
+      }
+      int peer_t = num_groups - 2 - t;
+      connect(router(g, t / global_links_per_router),
+              router(peer, peer_t / global_links_per_router),
+              global_link_width);
+    }
+  }
+#ifdef DEBUG_PRINT
+  std::cout << "Topology generated: " << std::endl;
+  NetworkTopologyGenerator::print_conn_matrix(conn, num_nodes, num_switches);
+#endif
+  return conn;
+}
+
+TorusTopologyGenerator::TorusTopologyGenerator(std::vector<int> const &dims,
+                                               int link_width)
+    : dims(dims), link_width(link_width) {
+  assert(!dims.empty());
+  num_nodes = 1;
+  for (int d : dims) {
+    assert(d >= 1);
+    num_nodes *= d;
+  }
+}
+
+ConnectionMatrix TorusTopologyGenerator::generate_topology() const {
+  ConnectionMatrix conn(num_nodes * num_nodes, 0);
+  for (int node = 0; node < num_nodes; node++) {
+    int stride = 1;
+    for (int d : dims) {
+      int x = (node / stride) % d;
+      // the link to the next node along this dimension; a ring of two
+      // nodes gets two links, as its wrap-around is a second cable
+      int next = node + (((x + 1) % d) - x) * stride;
+      if (next != node) {
+        conn[node * num_nodes + next] += link_width;
+        conn[next * num_nodes + node] += link_width;
+      }
+      stride *= d;
+    }
+  }
+#ifdef DEBUG_PRINT
+  std::cout << "Topology generated: " << std::endl;
+  NetworkTopologyGenerator::print_conn_matrix(conn, num_nodes, 0);
+#endif
+  return conn;
+}
+
+}; // namespace FlexFlow
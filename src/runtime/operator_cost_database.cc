@@ -0,0 +1,186 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/operator_cost_database.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace FlexFlow {
+
+static char const COST_DATABASE_MAGIC[8] = {
+    'F', 'F', 'C', 'O', 'S', 'T', 'D', 'B'};
+
+OperatorCostDatabase::OperatorCostDatabase(std::string const &_filename)
+    : filename(_filename), fd(-1) {
+  fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    fprintf(stderr,
+            "Cannot open operator cost database %s; "
+            "measured costs will not be persisted\n",
+            filename.c_str());
+    return;
+  }
+  load();
+}
+
+OperatorCostDatabase::~OperatorCostDatabase() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void OperatorCostDatabase::load() {
+  // Held until the records are copied, so that no writer truncates a
+  // partial record from under the mapping
+  flock(fd, LOCK_SH);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+    flock(fd, LOCK_UN);
+    return;
+  }
+  size_t file_size = st.st_size;
+  void *ptr = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED) {
+    flock(fd, LOCK_UN);
+    fprintf(stderr, "Cannot map operator cost database %s\n", filename.c_str());
+    return;
+  }
+  char const *base = static_cast<char const *>(ptr);
+  Header header;
+  memcpy(&header, base, sizeof(Header));
+  if (memcmp(header.magic, COST_DATABASE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != VERSION || header.record_size != sizeof(Record)) {
+    fprintf(stderr,
+            "Ignoring operator cost database %s: "
+            "incompatible format (version %u, expected %u)\n",
+            filename.c_str(),
+            header.version,
+            VERSION);
+    munmap(ptr, file_size);
+    flock(fd, LOCK_UN);
+    // Do not append to a file we do not understand
+    close(fd);
+    fd = -1;
+    return;
+  }
+  // A trailing partial record is ignored
+  size_t num_records = (file_size - sizeof(Header)) / sizeof(Record);
+  for (size_t i = 0; i < num_records; i++) {
+    Record record;
+    memcpy(&record, base + sizeof(Header) + i * sizeof(Record), sizeof(Record));
+    Entry entry;
+    entry.check = record.check;
+    CostMetrics &cost_metrics = entry.cost_metrics;
+    cost_metrics.forward_time = record.forward_time;
+    cost_metrics.backward_time = record.backward_time;
+    cost_metrics.sync_time = record.sync_time;
+    cost_metrics.inputs_memory = record.inputs_memory;
+    cost_metrics.outputs_memory = record.outputs_memory;
+    cost_metrics.weights_memory = record.weights_memory;
+    cost_metrics.op_total_mem = record.op_total_mem;
+    costs.emplace(record.key, entry);
+  }
+  munmap(ptr, file_size);
+  flock(fd, LOCK_UN);
+}
+
+bool OperatorCostDatabase::lookup(OperatorCostKey const &key,
+                                  CostMetrics &cost_metrics) const {
+  auto const &it = costs.find(key.hash);
+  if (it == costs.end() || it->second.check != key.check) {
+    return false;
+  }
+  cost_metrics = it->second.cost_metrics;
+  return true;
+}
+
+void OperatorCostDatabase::insert(OperatorCostKey const &key,
+                                  CostMetrics const &cost_metrics) {
+  auto const &it = costs.emplace(key.hash, Entry{key.check, cost_metrics});
+  if (!it.second) {
+    if (it.first->second.check != key.check) {
+      fprintf(stderr,
+              "Operator cost database %s: key hash %llx collides with a "
+              "different operator; its costs are not persisted\n",
+              filename.c_str(),
+              (unsigned long long)key.hash);
+    }
+    return;
+  }
+  Record record;
+  memset(&record, 0, sizeof(Record));
+  record.key = key.hash;
+  record.check = key.check;
+  record.forward_time = cost_metrics.forward_time;
+  record.backward_time = cost_metrics.backward_time;
+  record.sync_time = cost_metrics.sync_time;
+  record.inputs_memory = cost_metrics.inputs_memory;
+  record.outputs_memory = cost_metrics.outputs_memory;
+  record.weights_memory = cost_metrics.weights_memory;
+  record.op_total_mem = cost_metrics.op_total_mem;
+  if (!append(record)) {
+    fprintf(stderr,
+            "Failed to append to operator cost database %s\n",
+            filename.c_str());
+  }
+}
+
+bool OperatorCostDatabase::append(Record const &record) {
+  if (fd < 0) {
+    return false;
+  }
+  flock(fd, LOCK_EX);
+  bool ok = true;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ok = false;
+  } else {
+    size_t file_size = st.st_size;
+    if (file_size < sizeof(Header)) {
+      // First writer creates the header, over any partial one left behind
+      // by a killed job
+      if (file_size > 0) {
+        ok = ftruncate(fd, 0) == 0;
+      }
+      Header header;
+      memcpy(header.magic, COST_DATABASE_MAGIC, sizeof(header.magic));
+      header.version = VERSION;
+      header.record_size = sizeof(Record);
+      ok = ok &&
+           write(fd, &header, sizeof(Header)) == (ssize_t)sizeof(Header);
+    } else if ((file_size - sizeof(Header)) % sizeof(Record) != 0) {
+      // Drop the partial record left behind by a killed job
+      ok = ftruncate(fd,
+                     file_size - (file_size - sizeof(Header)) %
+                                     sizeof(Record)) == 0;
+    }
+  }
+  if (ok) {
+    ok = write(fd, &record, sizeof(Record)) == (ssize_t)sizeof(Record);
+  }
+  flock(fd, LOCK_UN);
+  return ok;
+}
+
+size_t OperatorCostDatabase::size() const {
+  return costs.size();
+}
+
+}; // namespace FlexFlow
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+#include "flexflow/simulator.h"
+#include <nlohmann/json.hpp>
+namespace FlexFlow {
+
+using json = nlohmann::json;
+
+void SimulationReport::write_json(std::string const &filename) const {
+  json j;
+  j["total_time"] = total_time;
+  j["memory_penalty"] = memory_penalty;
+  j["critical_path"] = json::array();
+  for (TaskSpan const &span : critical_path) {
+    j["critical_path"].push_back({{"name", span.name},
+                                  {"type", span.type},
+                                  {"device", span.device},
+                                  {"ready_time", span.ready_time},
+                                  {"start_time", span.start_time},
+                                  {"end_time", span.end_time}});
+  }
+  j["device_utilization"] = json::object();
+  for (auto const &kv : device_utilization) {
+    j["device_utilization"][kv.first] = {{"busy_time", kv.second.busy_time},
+                                         {"idle_time", kv.second.idle_time},
+                                         {"num_tasks", kv.second.num_tasks}};
+  }
+  j["comm_volume"] = comm_volume;
+  j["peak_memory"] = peak_memory;
+  std::ofstream out(filename);
+  assert(out.good() && "Cannot open the simulation report file");
+  out << j.dump(2) << std::endl;
+}
+
+void SimulationReportBuilder::set_ready_after(SimTask const *next,
+                                              SimTask const *task) {
+  ready_after[next] = task;
+}
+
+void SimulationReportBuilder::add_task(SimTask const *task,
+                                       float start_time,
+                                       float end_time) {
+  TaskRecord record;
+  record.task = task;
+  record.start_time = start_time;
+  record.end_time = end_time;
+  record.critical_pred = -1;
+  // A task waited for its device if the device was still busy when its
+  // inputs were ready, and for the task that made it ready otherwise
+  auto last = last_on_device.find(task->device);
+  if (last != last_on_device.end() &&
+      records[last->second].end_time > task->ready_time) {
+    record.critical_pred = last->second;
+  } else {
+    auto pred = ready_after.find(task);
+    if (pred != ready_after.end()) {
+      auto id = record_ids.find(pred->second);
+      assert(id != record_ids.end());
+      record.critical_pred = id->second;
+    }
+  }
+  int id = records.size();
+  records.push_back(record);
+  record_ids[task] = id;
+  if (task->device != nullptr) {
+    last_on_device[task->device] = id;
+  }
+}
+
+void SimulationReportBuilder::build(SimulationReport &report,
+                                    float makespan) const {
+  report.total_time = makespan;
+  report.critical_path.clear();
+  report.device_utilization.clear();
+  report.comm_volume.clear();
+  int last = -1;
+  for (size_t i = 0; i < records.size(); i++) {
+    TaskRecord const &record = records[i];
+    if (last < 0 || record.end_time > records[last].end_time) {
+      last = i;
+    }
+    Device const *device = record.task->device;
+    if (device == nullptr) {
+      continue;
+    }
+    SimulationReport::DeviceUtilization &usage =
+        report.device_utilization[device->name];
+    usage.busy_time += record.end_time - record.start_time;
+    usage.num_tasks++;
+    if (device->type == Device::DEVICE_COMM) {
+      report.comm_volume[device->name] += record.task->xfer_size;
+    }
+  }
+  for (auto &kv : report.device_utilization) {
+    kv.second.idle_time = std::max(makespan - kv.second.busy_time, 0.0f);
+  }
+  for (int i = last; i >= 0; i = records[i].critical_pred) {
+    TaskRecord const &record = records[i];
+    SimTask const *task = record.task;
+    SimulationReport::TaskSpan span;
+    span.name = task->name[0] != '\0' ? task->name : task->get_type_str();
+    span.type = task->get_type_str();
+    span.device = task->device != nullptr ? task->device->name : "";
+    span.ready_time = task->ready_time;
+    span.start_time = record.start_time;
+    span.end_time = record.end_time;
+    report.critical_path.push_back(span);
+  }
+  std::reverse(report.critical_path.begin(), report.critical_path.end());
+}
+
+}; // namespace FlexFlow
@@ -14,16 +14,21 @@
  */
 
 #include "flexflow/simulator.h"
+#include "flexflow/analytical_cost_model.h"
+#include "flexflow/memory_optimization.h"
 #include "flexflow/model.h"
+#include "flexflow/operator_cost_database.h"
 #include "flexflow/parallel_ops/combine.h"
 #include "flexflow/parallel_ops/partition.h"
 #include "flexflow/parallel_ops/reduction.h"
 #include "flexflow/parallel_ops/replicate.h"
 #include "flexflow/utils/dot/dot_file.h"
 #include "flexflow/utils/hash_utils.h"
+#include "flexflow/utils/trace_file.h"
 #include "queue"
+#include <algorithm>
 #include <memory>
-#include <random>
+#include <thread>
 #include <unordered_set>
 
 namespace FlexFlow {
@@ -167,11 +172,6 @@ CommDevice::CommDevice(std::string const &name,
     : Device(name, Device::DEVICE_COMM, node_id, socket_id, device_id),
       comm_type(comm_type), latency(latency), bandwidth(bandwidth) {}
 
-static std::random_device rd;
-static std::mt19937 gen = std::mt19937(rd());
-static std::uniform_real_distribution<> std_uniform =
-    std::uniform_real_distribution<>(0.0, 1.0);
-
 NominalCommDevice::NominalCommDevice(std::string const &name,
                                      int device_id,
                                      int nnodes,
@@ -180,56 +180,70 @@ NominalCommDevice::NominalCommDevice(std::string const &name,
       routing_strategy(routing), dirty(true), nnode(nnodes) {}
 
 void NominalCommDevice::reset() {
+  std::lock_guard<std::mutex> lock(route_mutex);
   dirty = true;
   routes = {};
 }
 
-Route NominalCommDevice::expand_to_physical() const {
-  if (dirty) {
-    if (routing_strategy == nullptr) {
-      assert("don't know how to route!" && false);
-    }
-    // std::cerr << name << " dirty... " << std::endl;
-    *const_cast<EcmpRoutes *>(&routes) =
-        routing_strategy->get_routes(device_id / nnode, device_id % nnode);
-    *const_cast<bool *>(&dirty) = false;
-  }
-
-  assert(routes.first.size() > 0 || device_id / nnode == device_id % nnode);
-  size_t pick = 0;
-  double choice = std_uniform(gen);
-  for (size_t i = 0; i < routes.first.size(); i++) {
-    if (choice > routes.first[i]) {
-      break;
-    }
-    pick = i;
+Route NominalCommDevice::expand_to_physical(size_t flow_id) const {
+  EcmpRoutes const &all_routes =
+      const_cast<NominalCommDevice *>(this)->get_all_routes();
+  assert(all_routes.first.size() > 0 || device_id / nnode == device_id % nnode);
+  // Like the switches, hash the flow to one of the routes, so that a given
+  // transfer always takes the same one. all_routes.first is cumulative: take
+  // the first route whose cumulative chance covers the hash
+  size_t hash = flow_id * 0x9e3779b97f4a7c15ULL + device_id;
+  hash ^= hash >> 29;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 32;
+  double choice = (hash >> 11) * (1.0 / 9007199254740992.0);
+  size_t pick = std::lower_bound(all_routes.first.begin(),
+                                 all_routes.first.end(),
+                                 (float)choice) -
+                all_routes.first.begin();
+  if (pick >= all_routes.second.size()) {
+    pick = all_routes.second.size() - 1;
   }
-  Route ret = Route(routes.second[pick].begin(), routes.second[pick].end());
-  return ret;
+  return Route(all_routes.second[pick].begin(),
+               all_routes.second[pick].end());
 }
 
 void NominalCommDevice::set_physical_paths(EcmpRoutes const &rs) {
+  std::lock_guard<std::mutex> lock(route_mutex);
   routes = rs;
   dirty = false;
 }
 
 EcmpRoutes const &NominalCommDevice::get_all_routes() {
+  // Simulators on other threads may expand the same device
+  std::lock_guard<std::mutex> lock(route_mutex);
   if (dirty) {
     if (routing_strategy == nullptr) {
       assert("don't know how to route!" && false);
     }
     // std::cerr << name << " dirty... " << std::endl;
-    *const_cast<EcmpRoutes *>(&routes) =
+    routes =
         routing_strategy->get_routes(device_id / nnode, device_id % nnode);
-    *const_cast<bool *>(&dirty) = false;
+    dirty = false;
   }
   return routes;
 }
 
-SimTask::SimTask() {}
+SimTask::SimTask()
+    : next_tasks(NULL), num_next_tasks(0), max_num_next_tasks(0), name(""),
+      manager(NULL), id(0) {}
 
 void SimTask::add_next_task(SimTask *task) {
-  next_tasks.push_back(task);
+  if (num_next_tasks == max_num_next_tasks) {
+    // Move the successors to a larger space; the old space is reclaimed by
+    // the next TaskManager::reset()
+    size_t new_max = std::max(2 * max_num_next_tasks, (size_t)4);
+    SimTask **new_next_tasks = manager->allocate_next_tasks(new_max);
+    std::copy(next_tasks, next_tasks + num_next_tasks, new_next_tasks);
+    next_tasks = new_next_tasks;
+    max_num_next_tasks = new_max;
+  }
+  next_tasks[num_next_tasks++] = task;
   task->counter++;
 }
 
@@ -250,30 +264,139 @@ std::string SimTask::get_type_str() const {
   }
 }
 
+SimTaskTable::SimTaskTable() : slots(1024), num_entries(0), epoch(1) {
+  for (Slot &slot : slots) {
+    slot.epoch = 0;
+  }
+}
+
+void SimTaskTable::reset() {
+  num_entries = 0;
+  epoch++;
+}
+
+size_t SimTaskTable::get_slot_index(Op const *op, int idx) const {
+  size_t hash = 17 * 31 + (size_t)(op);
+  hash = hash * 31 + std::hash<int>()(idx);
+  // Mix the bits since op pointers are aligned; slots.size() is a power of 2
+  hash ^= hash >> 29;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 32;
+  size_t mask = slots.size() - 1;
+  size_t i = hash & mask;
+  while (slots[i].epoch == epoch &&
+         (slots[i].op != op || slots[i].idx != idx)) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+void SimTaskTable::grow() {
+  std::vector<Slot> old_slots(2 * slots.size());
+  std::swap(slots, old_slots);
+  for (Slot &slot : slots) {
+    slot.epoch = 0;
+  }
+  for (Slot const &slot : old_slots) {
+    if (slot.epoch == epoch) {
+      slots[get_slot_index(slot.op, slot.idx)] = slot;
+    }
+  }
+}
+
+void SimTaskTable::insert(Op const *op, int idx, SimTask *task) {
+  if (2 * (num_entries + 1) > slots.size()) {
+    grow();
+  }
+  Slot &slot = slots[get_slot_index(op, idx)];
+  if (slot.epoch != epoch) {
+    num_entries++;
+  }
+  slot.op = op;
+  slot.idx = idx;
+  slot.epoch = epoch;
+  slot.task = task;
+}
+
+SimTask *SimTaskTable::find(Op const *op, int idx) const {
+  Slot const &slot = slots[get_slot_index(op, idx)];
+  return slot.epoch == epoch ? slot.task : NULL;
+}
+
+constexpr size_t TaskManager::NEXT_TASKS_CHUNK_SIZE;
+constexpr size_t TaskManager::NAMES_CHUNK_SIZE;
+
 TaskManager::TaskManager(size_t _max_num_tasks)
-    : max_num_tasks(_max_num_tasks) {
-  tasks = (SimTask **)malloc(sizeof(SimTask *) * max_num_tasks);
+    : global_task_id(0), max_num_tasks(_max_num_tasks),
+      next_tasks_chunk_idx(0), next_tasks_offset(0), names_chunk_idx(0),
+      names_offset(0) {
+  tasks = new SimTask[max_num_tasks];
   for (size_t i = 0; i < max_num_tasks; i++) {
-    tasks[i] = new SimTask();
+    tasks[i].manager = this;
   }
 }
 
+TaskManager::~TaskManager() {
+  delete[] tasks;
+}
+
 void TaskManager::reset() {
   global_task_id = 0;
-  hash_to_forward_task.clear();
-  hash_to_backward_task.clear();
+  forward_tasks.reset();
+  backward_tasks.reset();
+  next_tasks_chunk_idx = 0;
+  next_tasks_offset = 0;
+  names_chunk_idx = 0;
+  names_offset = 0;
+}
+
+SimTask **TaskManager::allocate_next_tasks(size_t num_tasks) {
+  while (next_tasks_chunk_idx < next_tasks_chunks.size() &&
+         next_tasks_offset + num_tasks >
+             next_tasks_chunks[next_tasks_chunk_idx].size()) {
+    next_tasks_chunk_idx++;
+    next_tasks_offset = 0;
+  }
+  if (next_tasks_chunk_idx == next_tasks_chunks.size()) {
+    next_tasks_chunks.emplace_back(
+        std::max(num_tasks, NEXT_TASKS_CHUNK_SIZE));
+  }
+  SimTask **ptr =
+      next_tasks_chunks[next_tasks_chunk_idx].data() + next_tasks_offset;
+  next_tasks_offset += num_tasks;
+  return ptr;
+}
+
+char const *TaskManager::copy_name(char const *name) {
+  size_t size = strlen(name) + 1;
+  while (names_chunk_idx < names_chunks.size() &&
+         names_offset + size > names_chunks[names_chunk_idx].size()) {
+    names_chunk_idx++;
+    names_offset = 0;
+  }
+  if (names_chunk_idx == names_chunks.size()) {
+    names_chunks.emplace_back(std::max(size, NAMES_CHUNK_SIZE));
+  }
+  char *ptr = names_chunks[names_chunk_idx].data() + names_offset;
+  memcpy(ptr, name, size);
+  names_offset += size;
+  return ptr;
 }
 
 SimTask *TaskManager::new_task() {
   assert(global_task_id + 1 < max_num_tasks);
-  SimTask *task = tasks[global_task_id++];
+  SimTask *task = &tasks[global_task_id];
+  task->id = global_task_id++;
   task->ready_time = 0.0f;
   task->run_time = 0.0f;
-  task->next_tasks.clear();
+  // The successor space of the previous use was reclaimed by reset()
+  task->next_tasks = NULL;
+  task->num_next_tasks = 0;
+  task->max_num_next_tasks = 0;
   task->counter = 0;
   task->device = NULL;
   task->mem = NULL;
-  task->name.clear();
+  task->name = "";
 
   task->xfer_size = 0;
   task->xfer_left = 0;
@@ -300,23 +423,23 @@ SimTask *TaskManager::new_comm_task() {
   return task;
 }
 
-SimTask *TaskManager::new_comm_task(std::string const &name,
+SimTask *TaskManager::new_comm_task(char const *name,
                                     CommDevice *comm_device,
                                     size_t message_size) {
   SimTask *task = new_task();
   task->type = SimTask::TASK_COMM;
-  task->name = name;
+  task->name = copy_name(name);
   task->device = comm_device;
   task->run_time = comm_device->latency + message_size / comm_device->bandwidth;
+  task->xfer_size = message_size;
   return task;
 }
 
 SimTask *TaskManager::new_forward_task(Op const *op, int idx) {
   SimTask *task = new_task();
   task->type = SimTask::TASK_FORWARD;
-  size_t hash = 17 * 31 + (size_t)(op);
-  hash = hash * 31 + std::hash<int>()(idx);
-  hash_to_forward_task[hash] = task;
+  forward_tasks.insert(op, idx, task);
+  // Ops outlive the task graph, so their names need no copy
   task->name = op->name;
   return task;
 }
@@ -324,25 +447,111 @@ SimTask *TaskManager::new_forward_task(Op const *op, int idx) {
 SimTask *TaskManager::new_backward_task(Op const *op, int idx) {
   SimTask *task = new_task();
   task->type = SimTask::TASK_BACKWARD;
-  size_t hash = 17 * 31 + (size_t)(op);
-  hash = hash * 31 + std::hash<int>()(idx);
-  hash_to_backward_task[hash] = task;
+  backward_tasks.insert(op, idx, task);
   task->name = op->name;
   return task;
 }
 
 SimTask *TaskManager::get_forward_task(Op const *op, int idx) {
-  size_t hash = 17 * 31 + (size_t)(op);
-  hash = hash * 31 + std::hash<int>()(idx);
-  assert(hash_to_forward_task.find(hash) != hash_to_forward_task.end());
-  return hash_to_forward_task[hash];
+  SimTask *task = forward_tasks.find(op, idx);
+  assert(task != NULL);
+  return task;
 }
 
 SimTask *TaskManager::get_backward_task(Op const *op, int idx) {
-  size_t hash = 17 * 31 + (size_t)(op);
-  hash = hash * 31 + std::hash<int>()(idx);
-  assert(hash_to_backward_task.find(hash) != hash_to_backward_task.end());
-  return hash_to_backward_task[hash];
+  SimTask *task = backward_tasks.find(op, idx);
+  assert(task != NULL);
+  return task;
+}
+
+SimulatorThreadPool::SimulatorThreadPool(int num_threads)
+    : next_iteration(0) {
+  for (int i = 1; i < num_threads; i++) {
+    workers.emplace_back(&SimulatorThreadPool::worker_loop, this);
+  }
+}
+
+SimulatorThreadPool::~SimulatorThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  work_ready.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void SimulatorThreadPool::run_iterations() {
+  for (int i = next_iteration++; i < num_iterations; i = next_iteration++) {
+    (*body)(i);
+  }
+}
+
+void SimulatorThreadPool::worker_loop() {
+  size_t seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      work_ready.wait(lock,
+                      [&] { return stop || generation != seen_generation; });
+      if (stop) {
+        return;
+      }
+      seen_generation = generation;
+    }
+    run_iterations();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      num_running--;
+    }
+    work_done.notify_one();
+  }
+}
+
+void SimulatorThreadPool::parallel_for(int n,
+                                       std::function<void(int)> const &body) {
+  if (n <= 1 || workers.empty()) {
+    for (int i = 0; i < n; i++) {
+      body(i);
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->body = &body;
+    num_iterations = n;
+    next_iteration = 0;
+    num_running = workers.size();
+    generation++;
+  }
+  work_ready.notify_all();
+  run_iterations();
+  std::unique_lock<std::mutex> lock(mutex);
+  work_done.wait(lock, [&] { return num_running == 0; });
+}
+
+Simulator::Simulator(Simulator *_profiler)
+    : simulatorInst(Realm::RegionInstance::NO_INST),
+      machine(_profiler->machine), memory(_profiler->memory),
+      handler(_profiler->handler), base_ptr(nullptr), capacity(0),
+      offset(0), warmup_times(_profiler->warmup_times),
+      repeat_times(_profiler->repeat_times),
+      computationMode(_profiler->computationMode), conv2d_meta(nullptr),
+      linear_meta(nullptr), pool2d_meta(nullptr), ele_unary_meta(nullptr),
+      ele_binary_meta(nullptr), batch_matmul_meta(nullptr),
+      concat_meta(nullptr), transpose_meta(nullptr),
+      segment_size(_profiler->segment_size),
+      max_num_segments(_profiler->max_num_segments),
+      allreduce_algorithm(_profiler->allreduce_algorithm),
+      flow_level_network(_profiler->flow_level_network) {
+  // Measure on the simulator that owns the workspace
+  while (_profiler->profiler != nullptr) {
+    _profiler = _profiler->profiler;
+  }
+  profiler = _profiler;
+  size_t max_num_tasks = 1024 * 1024;
+  task_manager = new TaskManager(max_num_tasks);
 }
 
 void Simulator::free_all() {
@@ -398,12 +607,24 @@ void Simulator::add_task_dependencies_with_xfer(SimTask *src_task,
 
   if (path.empty() || zero_cost) {
     log_xfer_sim.spew("Simulated xfer cost from %s to %s: 0ms",
-                      src_task->name.c_str(),
-                      dst_task->name.c_str());
+                      src_task->name,
+                      dst_task->name);
     src_task->add_next_task(dst_task);
     return;
   }
   assert(message_size > 0);
+  if (flow_level_network) {
+    // A single flow carries the message along the whole path, sharing the
+    // bandwidth of its links with the other flows in flight
+    char name[2 * MAX_OPNAME + 64];
+    snprintf(
+        name, sizeof(name), "from %s to %s", src_task->name, dst_task->name);
+    SimTask *task = task_manager->new_comm_task(name, path[0], message_size);
+    flow_routes[task->id] = path;
+    src_task->add_next_task(task);
+    task->add_next_task(dst_task);
+    return;
+  }
   std::vector<std::vector<SimTask *>> all_tasks;
   // Limit the max number of segments per message
   int seg_size = segment_size;
@@ -431,15 +652,20 @@ void Simulator::add_task_dependencies_with_xfer(SimTask *src_task,
       if (j == num_segment - 1) {
         cur_seg_size = message_size - (num_segment - 1) * seg_size;
       }
-      std::string name = "seg " + std::to_string(j) + " from " +
-                         src_task->name + " to " + dst_task->name;
+      char name[2 * MAX_OPNAME + 64];
+      snprintf(name,
+               sizeof(name),
+               "seg %d from %s to %s",
+               j,
+               src_task->name,
+               dst_task->name);
       SimTask *cur_task =
           task_manager->new_comm_task(name, path[i], cur_seg_size);
       all_tasks[i].push_back(cur_task);
       if (j == 0) {
         log_xfer_sim.debug("Simulated xfer cost from %s to %s: %fms (%d)",
-                           src_task->name.c_str(),
-                           dst_task->name.c_str(),
+                           src_task->name,
+                           dst_task->name,
                            cur_task->run_time,
                            cur_seg_size);
       }
@@ -478,6 +704,46 @@ void Simulator::add_task_dependencies_with_xfer(SimTask *src_task,
   }
 }
 
+void Simulator::add_allreduce_dependencies(
+    std::vector<SimTask *> const &src_tasks,
+    std::vector<SimTask *> const &dst_tasks,
+    std::vector<int> const &gpus,
+    size_t message_size) {
+  assert(src_tasks.size() == gpus.size());
+  assert(dst_tasks.size() == gpus.size());
+  std::unordered_map<int, int> ranks;
+  for (size_t i = 0; i < gpus.size(); i++) {
+    ranks[gpus[i]] = i;
+  }
+  std::vector<SimTask *> prev_tasks = src_tasks;
+  for (CollectivePhase const &phase :
+       plan_allreduce(allreduce_algorithm, gpus, message_size, machine)) {
+    // The comm. tasks pay the latency of the first step of a pipelined
+    // phase; the GPUs pay the one of the later steps
+    float step_latency = std::max(phase.num_steps - 1, 0) *
+                         collective_phase_latency(phase, machine);
+    std::vector<SimTask *> phase_tasks(gpus.size());
+    for (size_t i = 0; i < gpus.size(); i++) {
+      SimTask *task = task_manager->new_barrier_task();
+      task->device = machine->get_gpu(gpus[i]);
+      task->mem = machine->get_gpu_fb_mem(gpus[i]);
+      task->run_time = step_latency;
+      prev_tasks[i]->add_next_task(task);
+      phase_tasks[i] = task;
+    }
+    for (CollectivePhase::Transfer const &t : phase.transfers) {
+      add_task_dependencies_with_xfer(prev_tasks[ranks.at(t.src_gpu)],
+                                      phase_tasks[ranks.at(t.dst_gpu)],
+                                      t.size,
+                                      t.size == 0 /*force_zero_cost*/);
+    }
+    prev_tasks = std::move(phase_tasks);
+  }
+  for (size_t i = 0; i < gpus.size(); i++) {
+    prev_tasks[i]->add_next_task(dst_tasks[i]);
+  }
+}
+
 [[noreturn]] void handle_measure_operator_cost_unimplemented(Op const *op) {
   std::cerr << "measure_operator_cost not implemented for op " << op->name
             << " (type " << op->op_type << ")"
@@ -534,21 +800,86 @@ ParallelConfig Op::view_to_pc(MachineView const &view) const {
   return config;
 }
 
+OperatorCostKey
+    Simulator::get_persistent_cost_key(Op const *op,
+                                       MachineView const &mv) const {
+  size_t hash = op->get_untyped_params_hash();
+  hash_combine(hash, mv);
+  for (int i = 0; i < op->numInputs; i++) {
+    hash_combine(hash, op->inputs[i]->get_shape());
+  }
+  hash_combine(hash, static_cast<int>(computationMode));
+  // The check also covers the output and weight shapes, which are derived
+  // from the parameters, so a collision of the parameter hashes alone does
+  // not collide the check
+  size_t check = static_cast<size_t>(op->op_type);
+  hash_combine(check, static_cast<int>(computationMode));
+  for (int i = 0; i < op->numOutputs; i++) {
+    hash_combine(check, op->outputs[i]->get_shape());
+  }
+  for (int i = 0; i < op->numWeights; i++) {
+    hash_combine(check, op->weights[i]->get_shape());
+  }
+  for (int i = op->numInputs - 1; i >= 0; i--) {
+    hash_combine(check, op->inputs[i]->get_shape());
+  }
+  hash_combine(check, mv);
+  hash_combine(check, op->get_untyped_params_hash());
+  return OperatorCostKey{hash, check};
+}
+
+CostMetrics Simulator::profile_operator_cost(Op const *op,
+                                             MachineView const &mv) {
+  CostMetrics cost_metrics{};
+  if (cost_model != nullptr &&
+      cost_model->estimate_operator_cost(op, mv, cost_metrics)) {
+    // Estimates are not persisted so that the database only holds
+    // measurements
+    op->estimate_sync_cost(this, mv, cost_metrics);
+    return cost_metrics;
+  }
+  OperatorCostKey db_key{0, 0};
+  if (cost_database != nullptr) {
+    db_key = get_persistent_cost_key(op, mv);
+    if (cost_database->lookup(db_key, cost_metrics)) {
+      return cost_metrics;
+    }
+  }
+  if (!simulatorInst.exists()) {
+    // Created for the analytical cost model, which cannot estimate op
+    std::cerr << "No estimate of the cost of op " << op->name << " (type "
+              << op->op_type << ") and no GPU workspace to measure it on"
+              << ", run without --analytical-cost-model." << std::endl;
+    std::abort();
+  }
+  bool is_implemented = op->measure_operator_cost(this, mv, cost_metrics);
+  if (!is_implemented) {
+    handle_measure_operator_cost_unimplemented(op);
+  }
+  op->estimate_sync_cost(this, mv, cost_metrics);
+  if (cost_database != nullptr) {
+    cost_database->insert(db_key, cost_metrics);
+  }
+  return cost_metrics;
+}
+
 CostMetrics Simulator::measure_operator_cost(Op const *op,
                                              MachineView const &mv) {
+  if (profiler != nullptr) {
+    return profiler->measure_operator_cost(op, mv);
+  }
+  std::unique_lock<std::mutex> lock;
+  if (profile_mutex != nullptr) {
+    lock = std::unique_lock<std::mutex>(*profile_mutex);
+  }
   tl::optional<OperatorParameters> retrieved_params = get_op_parameters(op);
   if (retrieved_params.has_value()) {
     OperatorParameters params = retrieved_params.value();
     ProfilingRecordKey key{params, mv};
     if (this->strict_hash_to_operator_cost.find(key) ==
         this->strict_hash_to_operator_cost.end()) {
-      CostMetrics cost_metrics{};
-      bool is_implemented = op->measure_operator_cost(this, mv, cost_metrics);
-      if (!is_implemented) {
-        handle_measure_operator_cost_unimplemented(op);
-      }
-      op->estimate_sync_cost(this, mv, cost_metrics);
-      this->strict_hash_to_operator_cost[key] = cost_metrics;
+      this->strict_hash_to_operator_cost[key] =
+          this->profile_operator_cost(op, mv);
     }
     return this->strict_hash_to_operator_cost.at(key);
   }
@@ -563,12 +894,7 @@ CostMetrics Simulator::measure_operator_cost(Op const *op,
       hash_to_operator_cost.find(hash);
 
   if (iter == hash_to_operator_cost.end()) {
-    CostMetrics cost_metrics{};
-    bool is_implemented = op->measure_operator_cost(this, mv, cost_metrics);
-    if (!is_implemented) {
-      handle_measure_operator_cost_unimplemented(op);
-    }
-    op->estimate_sync_cost(this, mv, cost_metrics);
+    CostMetrics cost_metrics = this->profile_operator_cost(op, mv);
     hash_to_operator_cost[hash] = cost_metrics;
     return cost_metrics;
   } else {
@@ -812,6 +1138,96 @@ float Simulator::default_estimate_sync_cost(
   }
 }
 
+// Compute devices are numbered GPUs first, then the CPUs of machine models
+// that describe them; CPU parts run on GPUs in the other models
+static bool runs_on_cpu(MachineModel *machine, ParallelConfig const &config) {
+  return config.device_type == ParallelConfig::CPU &&
+         machine->get_num_cpus() > 0;
+}
+
+static int num_comp_devices(MachineModel *machine) {
+  return machine->get_num_gpus() + machine->get_num_cpus();
+}
+
+static int get_comp_device_index(MachineModel *machine,
+                                 ParallelConfig const &config,
+                                 int part) {
+  int device_id = config.device_ids[part];
+  return runs_on_cpu(machine, config) ? machine->get_num_gpus() + device_id
+                                      : device_id;
+}
+
+// Parts of op holding the same shard of weight j as part first_id, which is
+// not synched yet, starting with first_id; all of them are marked synched
+static std::vector<int> get_weight_replicas(Op const *op,
+                                            ParallelConfig const &pc,
+                                            int j,
+                                            int first_id,
+                                            std::set<int> &synched) {
+  std::vector<int> part_ids = {first_id};
+  synched.insert(first_id);
+  Domain firstR = op->get_weight_tensor_shape(pc, j, first_id);
+  for (int nextId = first_id + 1; nextId < pc.num_parts(); nextId++) {
+    Domain nextR = op->get_weight_tensor_shape(pc, j, nextId);
+    if (firstR.intersection(nextR).get_volume() > 0) {
+      // Assert all or nothing:
+      // The two weights must be fully overlapped or not at all
+      assert(firstR == nextR);
+      assert(synched.find(nextId) == synched.end());
+      synched.insert(nextId);
+      part_ids.push_back(nextId);
+    }
+  }
+  return part_ids;
+}
+
+static CompDevice *get_comp_device(MachineModel *machine, int index) {
+  int num_gpus = machine->get_num_gpus();
+  return index < num_gpus ? machine->get_gpu(index)
+                          : machine->get_cpu(index - num_gpus);
+}
+
+// CPU parts keep their data in the system memory of their socket, so that
+// transfers between sockets go over UPI
+static MemDevice *get_comp_device_mem(MachineModel *machine, int index) {
+  int num_gpus = machine->get_num_gpus();
+  return index < num_gpus ? machine->get_gpu_fb_mem(index)
+                          : machine->get_cpu_mem(index - num_gpus);
+}
+
+// One track per device; tasks without a device (e.g. barriers) are skipped
+static void add_trace_span(ChromeTraceFile &trace,
+                           SimTask const *task,
+                           float start_time,
+                           float end_time) {
+  if (task->device == nullptr) {
+    return;
+  }
+  std::string process;
+  switch (task->device->type) {
+    case Device::DEVICE_COMP:
+      process = "Compute";
+      break;
+    case Device::DEVICE_COMM:
+      process = "Communication";
+      break;
+    default:
+      process = "Memory";
+  }
+  std::map<std::string, double> args;
+  args["ready_time"] = task->ready_time;
+  if (task->xfer_size > 0) {
+    args["bytes"] = task->xfer_size;
+  }
+  std::string name = task->name[0] != '\0' ? task->name : task->get_type_str();
+  trace.add_span(trace.get_track(process, task->device->name),
+                 name,
+                 task->get_type_str(),
+                 start_time,
+                 end_time - start_time,
+                 args);
+}
+
 float Simulator::simulate_runtime(
     FFModel const *model,
     std::map<Op const *, ParallelConfig> const &global,
@@ -823,85 +1239,180 @@ float Simulator::simulate_runtime(
     FFModel const *model,
     std::map<Op const *, ParallelConfig> const &global,
     CompMode comp_mode,
-    std::string const &export_file_name) {
+    std::string const &export_file_name,
+    std::string const &trace_file_name,
+    SimulationReport *report) {
+  return this->simulate_runtime(model,
+                                global,
+                                comp_mode,
+                                export_file_name,
+                                trace_file_name,
+                                report,
+                                false /*incremental*/);
+}
+
+float Simulator::simulate_runtime_incremental(
+    FFModel const *model,
+    std::map<Op const *, ParallelConfig> const &global,
+    CompMode comp_mode) {
+  return this->simulate_runtime(
+      model, global, comp_mode, "", "", nullptr, true /*incremental*/);
+}
+
+float Simulator::simulate_runtime(
+    FFModel const *model,
+    std::map<Op const *, ParallelConfig> const &global,
+    CompMode comp_mode,
+    std::string const &export_file_name,
+    std::string const &trace_file_name,
+    SimulationReport *report,
+    bool incremental) {
+  // A report covers every task, so it needs a full simulation
+  assert(report == nullptr || !incremental);
   // printf("%s\n", machine->to_string().c_str());
   task_manager->reset();
+  flow_routes.clear();
+  // Find the ops whose config changed since the checkpoint; the simulation
+  // can only resume from a checkpoint of the same model. Flows share links
+  // with the ones that start later, so they are always simulated again
+  std::vector<ParallelConfig> configs;
+  for (Op const *op : model->operators) {
+    configs.push_back(global.find(op)->second);
+  }
+  bool resume = incremental && !flow_level_network &&
+                checkpoint.model == model &&
+                checkpoint.comp_mode == comp_mode &&
+                checkpoint.configs.size() == configs.size();
+  std::unordered_set<Op const *> changed_ops;
+  for (size_t l = 0; resume && l < configs.size(); l++) {
+    if (!(configs[l] == checkpoint.configs[l])) {
+      changed_ops.insert(model->operators[l]);
+    }
+  }
+  auto is_changed = [&](Op const *op) {
+    return !resume || changed_ops.find(op) != changed_ops.end();
+  };
+  std::vector<SimulationCheckpoint::Segment> segments;
+  std::vector<bool> dirty_segments;
+  std::vector<std::vector<SimulationCheckpoint::Overlap>> overlaps;
+  auto open_segment = [&](bool dirty) {
+    segments.push_back({task_manager->global_task_id, 0});
+    dirty_segments.push_back(dirty);
+    overlaps.emplace_back();
+  };
+  auto close_segment = [&]() {
+    segments.back().end = task_manager->global_task_id;
+  };
   // Step 1: register forward and backward tasks
   for (Op *op : model->operators) {
     ParallelConfig config = global.find(op)->second;
+    open_segment(is_changed(op));
     CostMetrics cost_metrics = measure_operator_cost(op, config);
     float forward_time = cost_metrics.forward_time;
     float backward_time = cost_metrics.backward_time;
     for (int j = 0; j < config.num_parts(); j++) {
+      int device = get_comp_device_index(machine, config, j);
       SimTask *task1 = task_manager->new_forward_task(op, j);
-      task1->device = machine->get_gpu(config.device_ids[j]);
-      task1->mem = machine->get_gpu_fb_mem(config.device_ids[j]);
+      task1->device = get_comp_device(machine, device);
+      task1->mem = get_comp_device_mem(machine, device);
       task1->run_time = forward_time;
       if (comp_mode == COMP_MODE_TRAINING) {
         SimTask *task2 = task_manager->new_backward_task(op, j);
-        task2->device = machine->get_gpu(config.device_ids[j]);
-        task2->mem = machine->get_gpu_fb_mem(config.device_ids[j]);
+        task2->device = get_comp_device(machine, device);
+        task2->mem = get_comp_device_mem(machine, device);
         task2->run_time = backward_time;
         task1->add_next_task(task2);
       }
     }
+    close_segment();
   }
-  // Step 2: insert dependencies and comm. tasks before compute tasks
+  // Step 2: insert dependencies and comm. tasks before compute tasks.
+  // Finding the overlapping partitions of the dirty dependencies is quadratic
+  // in the number of parts and runs on the thread pool first; the tasks are
+  // then created in order, so the task graph does not depend on the number
+  // of threads
+  std::vector<std::pair<Op *, int>> dependencies;
   for (Op *op : model->operators) {
-    ParallelConfig config = global.find(op)->second;
     for (int j = 0; j < op->numInputs; j++) {
-      ParallelTensor t = op->inputs[j];
-      Op const *pre_op = t->owner_op;
-      if (pre_op == NULL) {
-        continue;
+      if (op->inputs[j]->owner_op != NULL) {
+        dependencies.push_back(std::make_pair(op, j));
       }
-      ParallelConfig pre_config = global.find(pre_op)->second;
-      size_t element_size = data_type_size(t->data_type);
-      for (int dstId = 0; dstId < config.num_parts(); dstId++) {
-        Domain dstR = op->get_input_tensor_shape(config, j, dstId);
-        for (int srcId = 0; srcId < pre_config.num_parts(); srcId++) {
-          Domain srcR =
-              pre_op->get_output_tensor_shape(pre_config, t->owner_idx, srcId);
-          bool force_zero_cost = pre_op->op_type == OP_INPUT;
-          if (dstR.intersection(srcR).get_volume() > 0) {
-            // Forward dependency
-            {
-              SimTask *dstT = task_manager->get_forward_task(op, dstId);
-              SimTask *srcT = task_manager->get_forward_task(pre_op, srcId);
-              size_t xfer_size =
-                  dstR.intersection(srcR).get_volume() * element_size;
-              if (dstId == 0 && srcId == 0) {
-                log_sim.debug("fwd xfer from %s to %s: %zu",
-                              srcT->name.c_str(),
-                              dstT->name.c_str(),
-                              xfer_size);
-              }
-              add_task_dependencies_with_xfer(
-                  srcT, dstT, xfer_size, force_zero_cost);
-              // add_task_dependencies_with_xfer(srcT, dstT,
-              // dstR.intersection(srcR).get_volume() * element_size);
-            }
-            // Backward dependency
-            if (comp_mode == COMP_MODE_TRAINING) {
-              SimTask *dstT = task_manager->get_backward_task(op, dstId);
-              SimTask *srcT = task_manager->get_backward_task(pre_op, srcId);
-              size_t xfer_size =
-                  dstR.intersection(srcR).get_volume() * element_size;
-              if (dstId == 0 && srcId == 0) {
-                log_sim.debug("bwd xfer from %s to %s: %zu",
-                              dstT->name.c_str(),
-                              srcT->name.c_str(),
-                              xfer_size);
-              }
-              add_task_dependencies_with_xfer(
-                  dstT, srcT, xfer_size, force_zero_cost);
-              // add_task_dependencies_with_xfer(dstT, srcT,
-              // dstR.intersection(srcR).get_volume() * element_size);
-            }
-          }
+    }
+  }
+  std::vector<std::vector<SimulationCheckpoint::Overlap>> new_overlaps(
+      dependencies.size());
+  auto find_overlaps = [&](int i) {
+    Op const *op = dependencies[i].first;
+    int j = dependencies[i].second;
+    ParallelTensor t = op->inputs[j];
+    Op const *pre_op = t->owner_op;
+    if (!is_changed(op) && !is_changed(pre_op)) {
+      return;
+    }
+    ParallelConfig config = global.find(op)->second;
+    ParallelConfig pre_config = global.find(pre_op)->second;
+    for (int dstId = 0; dstId < config.num_parts(); dstId++) {
+      Domain dstR = op->get_input_tensor_shape(config, j, dstId);
+      for (int srcId = 0; srcId < pre_config.num_parts(); srcId++) {
+        Domain srcR =
+            pre_op->get_output_tensor_shape(pre_config, t->owner_idx, srcId);
+        size_t volume = dstR.intersection(srcR).get_volume();
+        if (volume > 0) {
+          new_overlaps[i].push_back({dstId, srcId, volume});
+        }
+      }
+    }
+  };
+  if (thread_pool) {
+    thread_pool->parallel_for(dependencies.size(), find_overlaps);
+  } else {
+    for (size_t i = 0; i < dependencies.size(); i++) {
+      find_overlaps(i);
+    }
+  }
+  for (size_t i = 0; i < dependencies.size(); i++) {
+    Op *op = dependencies[i].first;
+    ParallelTensor t = op->inputs[dependencies[i].second];
+    Op const *pre_op = t->owner_op;
+    size_t element_size = data_type_size(t->data_type);
+    bool dirty = is_changed(op) || is_changed(pre_op);
+    open_segment(dirty);
+    std::vector<SimulationCheckpoint::Overlap> &cur_overlaps = overlaps.back();
+    if (dirty) {
+      cur_overlaps = std::move(new_overlaps[i]);
+    } else {
+      cur_overlaps = std::move(checkpoint.overlaps[segments.size() - 1]);
+    }
+    bool force_zero_cost = pre_op->op_type == OP_INPUT;
+    for (auto const &overlap : cur_overlaps) {
+      int dstId = overlap.dst_id, srcId = overlap.src_id;
+      size_t xfer_size = overlap.volume * element_size;
+      // Forward dependency
+      {
+        SimTask *dstT = task_manager->get_forward_task(op, dstId);
+        SimTask *srcT = task_manager->get_forward_task(pre_op, srcId);
+        if (dstId == 0 && srcId == 0) {
+          log_sim.debug("fwd xfer from %s to %s: %zu",
+                        srcT->name,
+                        dstT->name,
+                        xfer_size);
+        }
+        add_task_dependencies_with_xfer(srcT, dstT, xfer_size, force_zero_cost);
+      }
+      // Backward dependency
+      if (comp_mode == COMP_MODE_TRAINING) {
+        SimTask *dstT = task_manager->get_backward_task(op, dstId);
+        SimTask *srcT = task_manager->get_backward_task(pre_op, srcId);
+        if (dstId == 0 && srcId == 0) {
+          log_sim.debug("bwd xfer from %s to %s: %zu",
+                        dstT->name,
+                        srcT->name,
+                        xfer_size);
         }
+        add_task_dependencies_with_xfer(dstT, srcT, xfer_size, force_zero_cost);
       }
     }
+    close_segment();
   }
 #ifdef FF_USE_NCCL
   // Do nothing since we will calculate NCCL cost at the end
@@ -909,13 +1420,15 @@ float Simulator::simulate_runtime(
   // Step 2.5: add finals tasks for each compute device to capture the returning
   // comm tasks from parameter servers
   std::vector<SimTask *> finals;
-  for (int d = 0; d < machine->get_num_gpus(); d++) {
+  open_segment(false /*dirty*/);
+  for (int d = 0; d < num_comp_devices(machine); d++) {
     SimTask *t = task_manager->new_barrier_task();
-    t->device = machine->get_gpu(d);
-    t->mem = machine->get_gpu_fb_mem(d);
+    t->device = get_comp_device(machine, d);
+    t->mem = get_comp_device_mem(machine, d);
     t->run_time = 0;
     finals.push_back(t);
   }
+  close_segment();
 
   if (model->config.search_overlap_backward_update &&
       comp_mode == COMP_MODE_TRAINING) {
@@ -925,16 +1438,33 @@ float Simulator::simulate_runtime(
       size_t element_size =
           data_type_size(DT_FLOAT); // assume all weights have float elements
       ParallelConfig pc = global.find(op)->second;
+      bool allreduce = allreduce_algorithm != ALLREDUCE_PARAMETER_SERVER &&
+                       !runs_on_cpu(machine, pc);
+      open_segment(is_changed(op));
       for (int j = 0; j < op->numWeights; j++) {
         std::set<int> synched;
         for (int firstId = 0; firstId < pc.num_parts(); firstId++) {
-          if (synched.find(firstId) == synched.end()) {
+          if (synched.find(firstId) == synched.end() && allreduce) {
+            // Allreduce the gradients from the backward tasks to the finals
+            std::vector<SimTask *> backTs, finalTs;
+            std::vector<int> gpus;
+            for (int id : get_weight_replicas(op, pc, j, firstId, synched)) {
+              int device = get_comp_device_index(machine, pc, id);
+              backTs.push_back(task_manager->get_backward_task(op, id));
+              finalTs.push_back(finals[device]);
+              gpus.push_back(device);
+            }
+            Domain firstR = op->get_weight_tensor_shape(pc, j, firstId);
+            add_allreduce_dependencies(
+                backTs, finalTs, gpus, firstR.get_volume() * element_size);
+          } else if (synched.find(firstId) == synched.end()) {
             synched.insert(firstId);
             Domain firstR = op->get_weight_tensor_shape(pc, j, firstId);
             // Add a compute task for parameter update
+            int first_device = get_comp_device_index(machine, pc, firstId);
             SimTask *updateT = task_manager->new_update_task();
-            updateT->device = machine->get_gpu(pc.device_ids[firstId]);
-            updateT->mem = machine->get_gpu_fb_mem(pc.device_ids[firstId]);
+            updateT->device = get_comp_device(machine, first_device);
+            updateT->mem = get_comp_device_mem(machine, first_device);
             // TODO add parameter synchronization time
             updateT->run_time = 0.0f; // Assume update task takes no time
             for (int nextId = firstId + 1; nextId < pc.num_parts(); nextId++) {
@@ -950,7 +1480,8 @@ float Simulator::simulate_runtime(
                 add_task_dependencies_with_xfer(
                     backT, updateT, firstR.get_volume() * element_size);
                 // Add comm. tasks from updateT to finalT
-                SimTask *finalT = finals[backT->device->device_id];
+                SimTask *finalT =
+                    finals[get_comp_device_index(machine, pc, nextId)];
                 add_task_dependencies_with_xfer(
                     updateT, finalT, firstR.get_volume() * element_size);
               }
@@ -958,24 +1489,27 @@ float Simulator::simulate_runtime(
           }
         }
       }
+      close_segment();
     }
   } else if (comp_mode == COMP_MODE_TRAINING) {
     // Step 3b: Bulk Synchronous Model
     // Add a per-device barrier before weight update
     std::vector<SimTask *> barriers;
-    for (int d = 0; d < machine->get_num_gpus(); d++) {
+    open_segment(false /*dirty*/);
+    for (int d = 0; d < num_comp_devices(machine); d++) {
       SimTask *t = task_manager->new_barrier_task();
-      t->device = machine->get_gpu(d);
-      t->mem = machine->get_gpu_fb_mem(d);
+      t->device = get_comp_device(machine, d);
+      t->mem = get_comp_device_mem(machine, d);
       t->run_time = 0;
       barriers.push_back(t);
     }
+    close_segment();
     for (size_t l = 0; l < model->operators.size(); l++) {
       Op *op = model->operators[l];
       ParallelConfig pc = global.find(op)->second;
       for (int j = 0; j < pc.num_parts(); j++) {
         SimTask *backT = task_manager->get_backward_task(op, j);
-        backT->add_next_task(barriers[backT->device->device_id]);
+        backT->add_next_task(barriers[get_comp_device_index(machine, pc, j)]);
       }
     }
     for (size_t l = 0; l < model->operators.size(); l++) {
@@ -983,18 +1517,35 @@ float Simulator::simulate_runtime(
       ParallelConfig pc = global.find(op)->second;
       size_t element_size =
           data_type_size(DT_FLOAT); // assume all weights have float elements
+      bool allreduce = allreduce_algorithm != ALLREDUCE_PARAMETER_SERVER &&
+                       !runs_on_cpu(machine, pc);
+      open_segment(is_changed(op));
       for (int j = 0; j < op->numWeights; j++) {
         std::set<int> synched;
         for (int firstId = 0; firstId < pc.num_parts(); firstId++) {
-          if (synched.find(firstId) == synched.end()) {
+          if (synched.find(firstId) == synched.end() && allreduce) {
+            // Allreduce the gradients from the barriers to the finals
+            std::vector<SimTask *> barrierTs, finalTs;
+            std::vector<int> gpus;
+            for (int id : get_weight_replicas(op, pc, j, firstId, synched)) {
+              int device = get_comp_device_index(machine, pc, id);
+              barrierTs.push_back(barriers[device]);
+              finalTs.push_back(finals[device]);
+              gpus.push_back(device);
+            }
+            Domain firstR = op->get_weight_tensor_shape(pc, j, firstId);
+            add_allreduce_dependencies(
+                barrierTs, finalTs, gpus, firstR.get_volume() * element_size);
+          } else if (synched.find(firstId) == synched.end()) {
             synched.insert(firstId);
             Domain firstR = op->get_weight_tensor_shape(pc, j, firstId);
             // Add a compute task for parameter update
+            int first_device = get_comp_device_index(machine, pc, firstId);
             SimTask *updateT = task_manager->new_update_task();
-            updateT->device = machine->get_gpu(pc.device_ids[firstId]);
-            updateT->mem = machine->get_gpu_fb_mem(pc.device_ids[firstId]);
+            updateT->device = get_comp_device(machine, first_device);
+            updateT->mem = get_comp_device_mem(machine, first_device);
             updateT->run_time = 0.0f; // Assume update task takes no time
-            barriers[updateT->device->device_id]->add_next_task(updateT);
+            barriers[first_device]->add_next_task(updateT);
             for (int nextId = firstId + 1; nextId < pc.num_parts(); nextId++) {
               Domain nextR = op->get_weight_tensor_shape(pc, j, nextId);
               if (firstR.intersection(nextR).get_volume() > 0) {
@@ -1003,14 +1554,15 @@ float Simulator::simulate_runtime(
                 assert(firstR == nextR);
                 assert(synched.find(nextId) == synched.end());
                 synched.insert(nextId);
+                int next_device = get_comp_device_index(machine, pc, nextId);
                 SimTask *backT = task_manager->get_backward_task(op, nextId);
-                assert(backT->device->device_id == pc.device_ids[nextId]);
-                SimTask *barrierT = barriers[backT->device->device_id];
+                assert(backT->device == get_comp_device(machine, next_device));
+                SimTask *barrierT = barriers[next_device];
                 // Add comm. tasks from barrierT to updateT
                 add_task_dependencies_with_xfer(
                     barrierT, updateT, firstR.get_volume() * element_size);
                 // Add comm. tasks from updateT to finalT
-                SimTask *finalT = finals[backT->device->device_id];
+                SimTask *finalT = finals[next_device];
                 add_task_dependencies_with_xfer(
                     updateT, finalT, firstR.get_volume() * element_size);
               }
@@ -1018,44 +1570,122 @@ float Simulator::simulate_runtime(
           }
         }
       }
+      close_segment();
     }
   } else {
     assert(comp_mode == COMP_MODE_INFERENCE);
   }
 #endif
   // Step 4: add ready tasks into ready_queue
+  size_t num_tasks = task_manager->global_task_id;
+  std::vector<float> ready_times(num_tasks), end_times(num_tasks);
+  std::vector<bool> processed(num_tasks, false);
+  float sim_time = 0.0f;
+  std::map<Device *, float> device_times;
+  size_t idx = 0;
+  if (resume) {
+    assert(segments.size() == checkpoint.segments.size());
+    // Find the earliest time a task of a dirty segment (old or new) can be
+    // ready. Tasks are simulated in the order they become ready, so every
+    // task that became ready before then in the previous simulation runs
+    // exactly as it did, and is not simulated again
+    float resume_time = std::numeric_limits<float>::infinity();
+    std::vector<bool> dirty_tasks(num_tasks, false);
+    for (size_t i = 0; i < segments.size(); i++) {
+      SimulationCheckpoint::Segment const &old_segment =
+          checkpoint.segments[i];
+      if (!dirty_segments[i]) {
+        assert(segments[i].end - segments[i].begin ==
+               old_segment.end - old_segment.begin);
+        continue;
+      }
+      for (size_t id = old_segment.begin; id < old_segment.end; id++) {
+        resume_time = std::min(resume_time, checkpoint.ready_times[id]);
+      }
+      for (size_t id = segments[i].begin; id < segments[i].end; id++) {
+        dirty_tasks[id] = true;
+        if (task_manager->tasks[id].counter == 0) {
+          resume_time = 0.0f;
+        }
+      }
+    }
+    // A new task is not ready before a clean task it depends on finishes
+    for (size_t i = 0; i < segments.size(); i++) {
+      if (dirty_segments[i]) {
+        continue;
+      }
+      for (size_t id = segments[i].begin; id < segments[i].end; id++) {
+        SimTask const &task = task_manager->tasks[id];
+        size_t old_id = id - segments[i].begin + checkpoint.segments[i].begin;
+        for (size_t k = 0; k < task.num_next_tasks; k++) {
+          if (dirty_tasks[task.next_tasks[k]->id]) {
+            resume_time =
+                std::min(resume_time, checkpoint.end_times[old_id]);
+          }
+        }
+      }
+    }
+    // Restore the tasks that are not simulated again
+    for (size_t i = 0; i < segments.size(); i++) {
+      if (dirty_segments[i]) {
+        continue;
+      }
+      for (size_t id = segments[i].begin; id < segments[i].end; id++) {
+        size_t old_id = id - segments[i].begin + checkpoint.segments[i].begin;
+        if (checkpoint.ready_times[old_id] >= resume_time) {
+          continue;
+        }
+        SimTask &task = task_manager->tasks[id];
+        float end_time = checkpoint.end_times[old_id];
+        processed[id] = true;
+        ready_times[id] = checkpoint.ready_times[old_id];
+        end_times[id] = end_time;
+        // The busy time of a device only grows during the simulation
+        device_times[task.device] =
+            std::max(device_times[task.device], end_time);
+        sim_time = std::max(sim_time, end_time);
+        for (size_t k = 0; k < task.num_next_tasks; k++) {
+          SimTask *next = task.next_tasks[k];
+          next->ready_time = std::max(next->ready_time, end_time);
+          next->counter--;
+        }
+        idx++;
+      }
+    }
+    log_sim.debug("Resumed simulation at %.4lf ms: %zu/%zu changed ops, "
+                  "%zu/%zu tasks restored",
+                  resume_time,
+                  changed_ops.size(),
+                  model->operators.size(),
+                  idx,
+                  num_tasks);
+  }
   std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
       ready_queue;
-  for (size_t i = 0; i < task_manager->global_task_id; i++) {
-    if (task_manager->tasks[i]->counter == 0) {
-      ready_queue.push(task_manager->tasks[i]);
+  for (size_t i = 0; i < num_tasks; i++) {
+    if (!processed[i] && task_manager->tasks[i].counter == 0) {
+      ready_queue.push(&task_manager->tasks[i]);
     }
   }
   // Step 5: perform simulation
-  float sim_time = 0.0f;
-  std::map<Device *, float> device_times;
-  size_t idx = 0;
   DotFile<SimTask *> taskGraph;
   bool export_taskgraph = (export_file_name != "");
   if (export_taskgraph) {
     taskGraph.set_filename(export_file_name);
   }
-  while (!ready_queue.empty()) {
-    // Find the task with the earliest start time
-    SimTask *cur_task = ready_queue.top();
-    ready_queue.pop();
-    float ready_time = 0;
-    if (device_times.find(cur_task->device) != device_times.end()) {
-      ready_time = device_times[cur_task->device];
-    }
-    float start_time = std::max(ready_time, cur_task->ready_time);
-    float end_time = start_time + cur_task->run_time;
-    device_times[cur_task->device] = end_time;
+  std::unique_ptr<ChromeTraceFile> trace;
+  if (trace_file_name != "") {
+    trace.reset(new ChromeTraceFile(trace_file_name));
+  }
+  SimulationReportBuilder report_builder;
+  auto finish_task = [&](SimTask *cur_task, float start_time, float end_time) {
+    ready_times[cur_task->id] = cur_task->ready_time;
+    end_times[cur_task->id] = end_time;
     if (export_taskgraph) {
       std::map<std::string, std::string> nodeAttrs;
       std::ostringstream label;
       label << "\"{ ";
-      if (!(cur_task->name).empty()) {
+      if (cur_task->name[0] != '\0') {
         label << cur_task->name << " | ";
       }
       label << cur_task->get_type_str() << " | ";
@@ -1065,6 +1695,12 @@ float Simulator::simulate_runtime(
       nodeAttrs["shape"] = "record";
       taskGraph.add_node(cur_task, nodeAttrs);
     }
+    if (trace) {
+      add_trace_span(*trace, cur_task, start_time, end_time);
+    }
+    if (report != nullptr) {
+      report_builder.add_task(cur_task, start_time, end_time);
+    }
     // printf("task[%lu] type(%d) run_time(%.4lf) ready_time(%.4lf)
     // start_time(%.4lf) device(%s)\n",
     //       idx, cur_task->type, cur_task->run_time, ready_time, start_time,
@@ -1072,11 +1708,14 @@ float Simulator::simulate_runtime(
     if (end_time > sim_time) {
       sim_time = end_time;
     }
-    for (size_t i = 0; i < cur_task->next_tasks.size(); i++) {
+    for (size_t i = 0; i < cur_task->num_next_tasks; i++) {
       SimTask *next = cur_task->next_tasks[i];
       if (export_taskgraph) {
         taskGraph.add_edge(cur_task, next);
       }
+      if (report != nullptr && end_time > next->ready_time) {
+        report_builder.set_ready_after(next, cur_task);
+      }
       next->ready_time = std::max(next->ready_time, end_time);
       next->counter--;
       if (next->counter == 0) {
@@ -1084,12 +1723,70 @@ float Simulator::simulate_runtime(
       }
     }
     idx++;
+  };
+  flow_network.clear();
+  std::vector<std::pair<SimTask *, float>> finished_flows;
+  while (!ready_queue.empty() || !flow_network.empty()) {
+    // Flows that finish before the next task is ready release their
+    // successors first
+    if (!flow_network.empty() &&
+        (ready_queue.empty() || flow_network.next_completion_time() <=
+                                    ready_queue.top()->ready_time)) {
+      finished_flows.clear();
+      flow_network.advance(flow_network.next_completion_time(),
+                           finished_flows);
+      for (auto const &flow : finished_flows) {
+        flow.first->run_time = flow.second - flow.first->ready_time;
+        finish_task(flow.first, flow.first->ready_time, flow.second);
+      }
+      continue;
+    }
+    // Find the task with the earliest start time
+    SimTask *cur_task = ready_queue.top();
+    ready_queue.pop();
+    if (flow_level_network) {
+      // A flow starts once it is ready, without waiting for its links
+      auto route = flow_routes.find(cur_task->id);
+      if (route != flow_routes.end()) {
+        float latency = 0.0f;
+        for (CommDevice const *link : route->second) {
+          latency += link->latency;
+        }
+        flow_network.start_flow(cur_task,
+                                route->second,
+                                cur_task->xfer_size,
+                                latency,
+                                cur_task->ready_time);
+        continue;
+      }
+    }
+    float ready_time = 0;
+    if (device_times.find(cur_task->device) != device_times.end()) {
+      ready_time = device_times[cur_task->device];
+    }
+    float start_time = std::max(ready_time, cur_task->ready_time);
+    float end_time = start_time + cur_task->run_time;
+    device_times[cur_task->device] = end_time;
+    finish_task(cur_task, start_time, end_time);
+  }
+  if (report != nullptr) {
+    report_builder.build(*report, sim_time);
   }
   if (export_taskgraph) {
     taskGraph.close();
   }
+  if (trace) {
+    trace->close();
+  }
   // Assert all tasks were processed
   assert(idx == task_manager->global_task_id);
+  checkpoint.model = model;
+  checkpoint.comp_mode = comp_mode;
+  checkpoint.configs = std::move(configs);
+  checkpoint.segments = std::move(segments);
+  checkpoint.overlaps = std::move(overlaps);
+  checkpoint.ready_times = std::move(ready_times);
+  checkpoint.end_times = std::move(end_times);
 #ifdef FF_USE_NCCL
   if (comp_mode == COMP_MODE_TRAINING) {
     std::unordered_set<Op const *> possible_syncs(model->operators.begin(),
@@ -1110,7 +1807,7 @@ float Simulator::simulate_runtime(
     }
     assert(possible_syncs.size() == 1);
 
-    std::vector<bool> available_devices(this->machine->get_num_gpus(), true);
+    std::vector<bool> available_devices(num_comp_devices(machine), true);
 
     std::priority_queue<OpSyncTask *,
                         std::vector<OpSyncTask *>,
@@ -1126,7 +1823,8 @@ float Simulator::simulate_runtime(
         bool can_be_run = true;
         ParallelConfig config = global.find(op)->second;
         for (int j = 0; j < config.num_parts(); j++) {
-          can_be_run &= available_devices[config.device_ids[j]];
+          can_be_run &=
+              available_devices[get_comp_device_index(machine, config, j)];
         }
         if (can_be_run) {
           to_run = op;
@@ -1143,43 +1841,27 @@ float Simulator::simulate_runtime(
             data_type_size(DT_FLOAT); // assume all weights have float elements
 
         for (int j = 0; j < pc.num_parts(); j++) {
-          available_devices[pc.device_ids[j]] = false;
+          available_devices[get_comp_device_index(machine, pc, j)] = false;
         }
 
-        for (int j = 0; j < op->numWeights; j++) {
+        // NCCL only synchronizes the weights of GPU parts
+        int num_synched_weights = runs_on_cpu(machine, pc) ? 0 : op->numWeights;
+        for (int j = 0; j < num_synched_weights; j++) {
           std::set<int> synched;
           for (int firstId = 0; firstId < pc.num_parts(); firstId++) {
             if (synched.find(firstId) == synched.end()) {
-              synched.insert(firstId);
               Domain firstR = op->get_weight_tensor_shape(pc, j, firstId);
-              Device *firstDevice = machine->get_gpu(pc.device_ids[firstId]);
-              float nccl_time = 0.0f;
-              for (int nextId = firstId + 1; nextId < pc.num_parts();
-                   nextId++) {
-                Domain nextR = op->get_weight_tensor_shape(pc, j, nextId);
-                if (firstR.intersection(nextR).get_volume() > 0) {
-                  // Assert all or nothing:
-                  // The two weights must be fully overlapped or not at all
-                  assert(firstR == nextR);
-                  assert(synched.find(nextId) == synched.end());
-                  synched.insert(nextId);
-                  Device *nextDevice = machine->get_gpu(pc.device_ids[nextId]);
-                  // Compute the bandwidth between firstDevice/nextDevice
-                  float bandwidth = 0.0f;
-                  if (firstDevice->node_id == nextDevice->node_id) {
-                    bandwidth = machine->get_intra_node_gpu_bandwidth();
-                  } else {
-                    bandwidth = machine->get_inter_node_gpu_bandwidth();
-                  }
-                  // printf("[NCCL Time] Op(%s) Weight(%d) firstId(%d)
-                  // nextId(%d): volume is %f\n", op->name, j, firstId, nextId,
-                  // (float)firstR.get_volume());
-                  nccl_time = std::max(nccl_time,
-                                       2 * (float)firstR.get_volume() *
-                                           element_size / bandwidth);
-                }
+              std::vector<int> gpus;
+              for (int id : get_weight_replicas(op, pc, j, firstId, synched)) {
+                gpus.push_back(get_comp_device_index(machine, pc, id));
               }
-              sync_run_time += nccl_time;
+              // NCCL allreduces the replicas of the weight
+              sync_run_time += estimate_collective_time(
+                  plan_allreduce(allreduce_algorithm,
+                                 gpus,
+                                 firstR.get_volume() * element_size,
+                                 machine),
+                  machine);
             }
           }
         }
@@ -1197,8 +1879,9 @@ float Simulator::simulate_runtime(
         log_ps_sim.debug("  Time: %fms", sync_sim_time);
         ParallelConfig config = global.find(completed->op)->second;
         for (int j = 0; j < config.num_parts(); j++) {
-          assert(!available_devices[config.device_ids[j]]);
-          available_devices[config.device_ids[j]] = true;
+          int device = get_comp_device_index(machine, config, j);
+          assert(!available_devices[device]);
+          available_devices[device] = true;
         }
         for (int i = 0; i < completed->op->numInputs; i++) {
           OpSyncTask *dependent_task =
@@ -1222,14 +1905,36 @@ float Simulator::simulate_runtime(
   // Step 6: add penalty to strategies that exceed the memory limits on devices
   std::vector<size_t> gpu_mem_usage(machine->get_num_gpus(), 0);
   float memory_penalty = 0.0f;
+  // The report gives the peak of the live memory rather than the sum
+  PCG::LivenessMemoryModel liveness;
+  std::unordered_map<Op const *, int> liveness_ids;
   for (size_t l = 0; l < model->operators.size(); l++) {
     Op *op = model->operators[l];
     ParallelConfig config = global.find(op)->second;
     CostMetrics cost_metrics = measure_operator_cost(op, config);
     size_t memory_requirement = cost_metrics.total_memory();
+    if (runs_on_cpu(machine, config)) {
+      // system memory is not budgeted
+      continue;
+    }
     for (int j = 0; j < config.num_parts(); j++) {
       gpu_mem_usage[config.device_ids[j]] += memory_requirement;
     }
+    if (report != nullptr) {
+      std::vector<int> producers;
+      for (int j = 0; j < op->numInputs; j++) {
+        auto producer = liveness_ids.find(op->inputs[j]->owner_op);
+        if (producer != liveness_ids.end()) {
+          producers.push_back(producer->second);
+        }
+      }
+      liveness_ids[op] = liveness.add_op(
+          std::vector<int>(config.device_ids,
+                           config.device_ids + config.num_parts()),
+          cost_metrics.weights_memory,
+          cost_metrics.outputs_memory,
+          producers);
+    }
   }
   if (export_file_name != "") {
     for (int i = 0; i < machine->get_num_gpus(); i++) {
@@ -1245,6 +1950,18 @@ float Simulator::simulate_runtime(
   }
   // if (memory_penalty > 0.0f)
   //   printf("Memory penalty = %.4lf ms\n", memory_penalty);
+  if (report != nullptr) {
+    report->total_time = sim_time + memory_penalty;
+    report->memory_penalty = memory_penalty;
+    report->peak_memory.clear();
+    std::unordered_map<int, size_t> peaks =
+        liveness.peak_memory(comp_mode == COMP_MODE_TRAINING);
+    for (int i = 0; i < machine->get_num_gpus(); i++) {
+      auto peak = peaks.find(i);
+      report->peak_memory[machine->get_gpu_fb_mem(i)->name] =
+          peak != peaks.end() ? peak->second : 0;
+    }
+  }
   return sim_time + memory_penalty;
 }
 
@@ -1324,7 +2041,9 @@ float LogicalTaskgraphBasedSimulator::simulate_runtime(
     }
   }
 
-  // Step 2: insert dependencies and comm. tasks before compute tasks
+  // Step 2: insert dependencies and comm. tasks before compute tasks.
+  // As in Simulator::simulate_runtime, the overlapping partitions are found
+  // on the thread pool and the tasks are then created in order
   for (size_t l = 0; l < model->layers.size(); l++) {
     Op *op = model->operators[l];
     ParallelConfig config = global.find(op)->second;
@@ -1336,113 +2055,57 @@ float LogicalTaskgraphBasedSimulator::simulate_runtime(
       }
       ParallelConfig pre_config = global.find(pre_op)->second;
       size_t element_size = data_type_size(t->data_type);
-      for (int dstId = 0; dstId < config.num_parts(); dstId++) {
+      // overlaps[dstId] lists (srcId, overlapping volume) in srcId order
+      std::vector<std::vector<std::pair<int, size_t>>> overlaps(
+          config.num_parts());
+      auto find_overlaps = [&](int dstId) {
         Domain dstR = op->get_input_tensor_shape(config, j, dstId);
         for (int srcId = 0; srcId < pre_config.num_parts(); srcId++) {
-          Domain srcR =
-              pre_op->get_output_tensor_shape(pre_config, t->owner_idx, srcId);
-          if (dstR.intersection(srcR).get_volume() > 0) {
-            // Forward dependency
-            {
-              SimTask *dstT = task_manager->get_forward_task(op, dstId);
-              SimTask *srcT = task_manager->get_forward_task(pre_op, srcId);
-              add_task_dependencies_with_xfer(
-                  srcT,
-                  dstT,
-                  dstR.intersection(srcR).get_volume() * element_size);
-            }
-            // Backward dependency
-            if (comp_mode == COMP_MODE_TRAINING) {
-              SimTask *dstT = task_manager->get_backward_task(op, dstId);
-              SimTask *srcT = task_manager->get_backward_task(pre_op, srcId);
-              add_task_dependencies_with_xfer(
-                  dstT,
-                  srcT,
-                  dstR.intersection(srcR).get_volume() * element_size);
-            }
+          Domain srcR = pre_op->get_output_tensor_shape(
+              pre_config, t->owner_idx, srcId);
+          size_t volume = dstR.intersection(srcR).get_volume();
+          if (volume > 0) {
+            overlaps[dstId].push_back(std::make_pair(srcId, volume));
           }
         }
-      }
-    }
-  }
-
-  // Step 4: add ready tasks into ready_queue
-  std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
-      ready_queue;
-  for (size_t i = 0; i < task_manager->global_task_id; i++) {
-    if (task_manager->tasks[i]->counter == 0) {
-      ready_queue.push(task_manager->tasks[i]);
-    }
-  }
-
-  // Step 5: perform simulation
-
-  float sim_time = 0.0f;
-  std::map<Device *, float> device_times;
-  // map<Device*, SimTask*> device_schedule;
-  size_t idx = 0;
-  while (!ready_queue.empty()) {
-    // Find the task with the earliest start time
-    SimTask *cur_task = ready_queue.top();
-    ready_queue.pop();
-    float ready_time = 0;
-    float end_time;
-    if (device_times.find(cur_task->device) != device_times.end()) {
-      ready_time = device_times[cur_task->device];
-    }
-    float start_time = std::max(ready_time, cur_task->ready_time);
-    if (cur_task->type == SimTask::TASK_NOMINAL_COMM) {
-      if (!segment_transfer) {
-        end_time = route_transfer(cur_task, start_time, device_times);
+      };
+      if (thread_pool) {
+        thread_pool->parallel_for(config.num_parts(), find_overlaps);
       } else {
-        bool finished;
-        end_time =
-            route_transfer_seg(cur_task, start_time, device_times, finished);
-        if (!finished) {
-          ready_queue.push(cur_task);
-          continue;
+        for (int dstId = 0; dstId < config.num_parts(); dstId++) {
+          find_overlaps(dstId);
         }
       }
-    } else if (cur_task->type == SimTask::TASK_ALLREDUCE) {
-      expand_allreduce(cur_task, start_time, ready_queue);
-      idx++;
-      continue;
-    } else {
-      end_time = start_time + cur_task->run_time;
-      device_times[cur_task->device] = end_time;
-    }
-
-#ifdef DEBUG_PRINT
-    printf("task[%lu/%lu] type(%d) run_time(%.4lf) ready_time(%.4lf) "
-           "start_time(%.4lf) device(%s)\n",
-           idx,
-           task_manager->global_task_id,
-           cur_task->type,
-           cur_task->run_time,
-           ready_time,
-           start_time,
-           (cur_task->device->name).c_str());
-#endif
-
-    if (end_time > sim_time) {
-      sim_time = end_time;
-    }
-
-    for (size_t i = 0; i < cur_task->next_tasks.size(); i++) {
-      SimTask *next = cur_task->next_tasks[i];
-      // next->ready_time = max(next->ready_time, end_time);
-      if (end_time > next->ready_time) {
-        next->ready_time = end_time;
-        // next->prev = t;
-      }
-      next->counter--;
-      if (next->counter == 0) {
-        ready_queue.push(next);
+      for (int dstId = 0; dstId < config.num_parts(); dstId++) {
+        for (auto const &overlap : overlaps[dstId]) {
+          int srcId = overlap.first;
+          size_t xfer_size = overlap.second * element_size;
+          // Forward dependency
+          {
+            SimTask *dstT = task_manager->get_forward_task(op, dstId);
+            SimTask *srcT = task_manager->get_forward_task(pre_op, srcId);
+            add_task_dependencies_with_xfer(srcT, dstT, xfer_size);
+          }
+          // Backward dependency
+          if (comp_mode == COMP_MODE_TRAINING) {
+            SimTask *dstT = task_manager->get_backward_task(op, dstId);
+            SimTask *srcT = task_manager->get_backward_task(pre_op, srcId);
+            add_task_dependencies_with_xfer(dstT, srcT, xfer_size);
+          }
+        }
       }
     }
-    idx++;
   }
-  assert(idx == task_manager->global_task_id);
+
+  // Step 4 and 5: perform simulation
+  LogicalEventLoop event_loop(task_manager,
+                              machine,
+                              allreduce_algorithm,
+                              segment_transfer,
+                              segment_size,
+                              flow_level_network ? &flow_network : nullptr,
+                              thread_pool.get());
+  float sim_time = event_loop.run();
 
   // Step 6: add penalty to strategies that exceed the memory limits on devices
   // std::vector<size_t> gpu_mem_usage(machine->get_num_gpus(), 0);
@@ -1485,335 +2148,6 @@ float LogicalTaskgraphBasedSimulator::simulate_runtime(
   return this->simulate_runtime(model, global, comp_mode, "");
 }
 
-float LogicalTaskgraphBasedSimulator::route_transfer(
-    SimTask *transfer_task,
-    float start_time,
-    std::map<Device *, float> &device_times) {
-  std::vector<CommDevice *> route =
-      static_cast<NominalCommDevice *>(transfer_task->device)
-          ->expand_to_physical();
-
-  float curr_task_start_time;
-  float curr_task_finish_time;
-  float curr_task_run_time = 0;
-  float curr_task_ready_time = transfer_task->ready_time;
-  float xfer_size = transfer_task->xfer_size;
-
-  float final_start_time = 0;
-  float final_finish_time = 0;
-
-  SimTask *info_holder = new SimTask();
-  info_holder->type = SimTask::TASK_COMM;
-
-  for (unsigned int i = 0; i < route.size(); i++) {
-    CommDevice *latency_task_device = route[i];
-    if (device_times.find(latency_task_device) == device_times.end()) {
-      device_times[latency_task_device] = 0;
-    }
-    float latency_task_run_time = machine->get_inter_node_gpu_latency();
-    float latency_task_ready_time;
-    float latency_task_start_time;
-    if (i == 0) {
-      latency_task_ready_time = curr_task_ready_time + curr_task_run_time;
-      latency_task_start_time =
-          std::max(device_times[latency_task_device], latency_task_ready_time);
-      final_start_time = latency_task_start_time;
-    } else {
-      latency_task_ready_time = curr_task_finish_time;
-      latency_task_start_time =
-          std::max(device_times[latency_task_device], latency_task_ready_time);
-    }
-    float latency_task_finish_time =
-        latency_task_start_time + latency_task_run_time;
-    device_times[latency_task_device] = latency_task_finish_time;
-    float dram_to_dram_run_time = xfer_size / latency_task_device->bandwidth;
-
-    float dram_to_dram_start_time = latency_task_finish_time;
-    float dram_to_dram_finish_time =
-        dram_to_dram_start_time + dram_to_dram_run_time;
-    device_times[latency_task_device] = dram_to_dram_finish_time;
-
-    if (dram_to_dram_finish_time > final_finish_time) {
-      final_finish_time = dram_to_dram_finish_time;
-    }
-
-    curr_task_ready_time = latency_task_ready_time;
-    curr_task_start_time = latency_task_start_time;
-    curr_task_finish_time = latency_task_finish_time;
-    curr_task_run_time = latency_task_run_time;
-
-#ifdef DEBUG_PRINT
-    printf("\texpand: route[%u] run_time(%.4lf) ready_time(%.4lf) "
-           "start_time(%.4lf) device(%s)\n",
-           i,
-           curr_task_run_time,
-           curr_task_ready_time,
-           curr_task_start_time,
-           (latency_task_device->name).c_str());
-    printf("\t\td2d: run_time(%.4lf) start_time(%.4lf) device(%s)\n",
-           dram_to_dram_run_time,
-           dram_to_dram_start_time,
-           (latency_task_device->name).c_str());
-#endif
-
-    info_holder->device = latency_task_device;
-    info_holder->run_time = dram_to_dram_run_time;
-    info_holder->xfer_size = xfer_size;
-  }
-  delete info_holder;
-
-#ifdef WRITE_NETWORK_TRANSFER
-  auto *nw = static_cast<NominalCommDevice *>(transfer_task->device);
-  network_transfer_log << nw->device_id / machine->get_total_devs() << ", "
-                       << nw->device_id % machine->get_total_devs() << ", "
-                       << xfer_size << ", " << final_start_time << ", "
-                       << final_finish_time << std::endl;
-#endif
-
-  transfer_task->run_time = final_finish_time - final_start_time;
-  return final_finish_time;
-}
-
-float LogicalTaskgraphBasedSimulator::route_transfer_seg(
-    SimTask *transfer_task,
-    float start_time,
-    std::map<Device *, float> &device_times,
-    bool &finished) {
-  std::vector<CommDevice *> route =
-      static_cast<NominalCommDevice *>(transfer_task->device)
-          ->expand_to_physical();
-
-  float curr_task_start_time;
-  float curr_task_finish_time;
-  float curr_task_run_time = 0;
-  float curr_task_ready_time = transfer_task->ready_time;
-  float xfer_size = transfer_task->xfer_left > segment_size
-                        ? segment_size
-                        : transfer_task->xfer_left;
-  transfer_task->xfer_left = transfer_task->xfer_left > segment_size
-                                 ? transfer_task->xfer_left - segment_size
-                                 : 0;
-  finished = transfer_task->xfer_left == 0;
-  // #ifdef DEBUG_PRINT
-  // std::cerr << "xfer_total: " << transfer_task->xfer_size << ", xfer_left: "
-  // << transfer_task->xfer_left << " finished:" << finished << std::endl;
-  // #endif
-
-  float final_start_time = 0;
-  float final_finish_time = 0;
-  float final_first_seg_finish_time = 0;
-
-  SimTask *info_holder = new SimTask();
-  info_holder->type = SimTask::TASK_COMM;
-
-  for (unsigned int i = 0; i < route.size(); i++) {
-    CommDevice *latency_task_device = route[i];
-    if (device_times.find(latency_task_device) == device_times.end()) {
-      device_times[latency_task_device] = 0;
-    }
-    float latency_task_run_time = machine->get_inter_node_gpu_latency();
-    float latency_task_ready_time;
-    float latency_task_start_time;
-    if (i == 0) {
-      latency_task_ready_time = curr_task_ready_time + curr_task_run_time;
-      latency_task_start_time =
-          std::max(device_times[latency_task_device], latency_task_ready_time);
-      final_start_time = latency_task_start_time;
-    } else {
-      latency_task_ready_time = curr_task_finish_time;
-      latency_task_start_time =
-          std::max(device_times[latency_task_device], latency_task_ready_time);
-    }
-    float latency_task_finish_time =
-        latency_task_start_time + latency_task_run_time;
-    device_times[latency_task_device] = latency_task_finish_time;
-    float dram_to_dram_run_time = xfer_size / latency_task_device->bandwidth;
-    // std::cerr << "latency_task_device->bandwidth: " <<
-    // latency_task_device->bandwidth << std::endl; std::cerr << "d2drt: " <<
-    // dram_to_dram_run_time << std::endl;
-
-    float dram_to_dram_start_time = latency_task_finish_time;
-    float dram_to_dram_finish_time =
-        dram_to_dram_start_time + dram_to_dram_run_time;
-    if (i == 0) {
-      final_first_seg_finish_time = dram_to_dram_finish_time;
-    }
-    device_times[latency_task_device] = dram_to_dram_finish_time;
-
-    if (dram_to_dram_finish_time > final_finish_time) {
-      final_finish_time = dram_to_dram_finish_time;
-    }
-
-    curr_task_ready_time = latency_task_ready_time;
-    curr_task_start_time = latency_task_start_time;
-    curr_task_finish_time = latency_task_finish_time;
-    curr_task_run_time = latency_task_run_time;
-
-#ifdef DEBUG_PRINT
-    printf("\texpand: route[%u] run_time(%.4lf) ready_time(%.4lf) "
-           "start_time(%.4lf) device(%s)\n",
-           i,
-           curr_task_run_time,
-           curr_task_ready_time,
-           curr_task_start_time,
-           (latency_task_device->name).c_str());
-    printf("\t\td2d: run_time(%.4lf) start_time(%.4lf) device(%s)\n",
-           dram_to_dram_run_time,
-           dram_to_dram_start_time,
-           (latency_task_device->name).c_str());
-#endif
-    info_holder->device = latency_task_device;
-    info_holder->run_time = dram_to_dram_run_time;
-    info_holder->xfer_size = xfer_size;
-  }
-  delete info_holder;
-
-#ifdef WRITE_NETWORK_TRANSFER
-  auto *nw = static_cast<NominalCommDevice *>(transfer_task->device);
-  network_transfer_log << nw->device_id / machine->get_total_devs() << ", "
-                       << nw->device_id % machine->get_total_devs() << ", "
-                       << xfer_size << ", " << final_start_time << ", "
-                       << final_finish_time << std::endl;
-#endif
-  if (!finished) {
-#ifdef DEBUG_PRINT
-    std::cerr << "ready time: " << transfer_task->ready_time << " to "
-              << final_first_seg_finish_time << std::endl;
-#endif
-    transfer_task->ready_time = final_first_seg_finish_time;
-  }
-
-  transfer_task->run_time = final_finish_time - final_start_time;
-  return final_finish_time;
-}
-
-void LogicalTaskgraphBasedSimulator::expand_allreduce(
-    SimTask *allreduce_task,
-    float start_time,
-    std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
-        &ready_queue) {
-
-  int n_participants = allreduce_task->next_tasks.size();
-  if (n_participants == 1) {
-    return;
-  }
-
-  SimTask *final_task = new_update_task_unrecorded();
-
-#ifdef FF_USE_NCCL
-  // recall that next_task stores node group in this case
-  final_task->device = machine->get_gpu(
-      reinterpret_cast<uint64_t>(allreduce_task->next_tasks[0]));
-  MemDevice *src_mem = machine->get_gpu_fb_mem(
-      reinterpret_cast<uint64_t>(allreduce_task->next_tasks[0]));
-  MemDevice *dst_mem;
-  // std::cerr << "expand_ar size: " << allreduce_task->xfer_size << ", " <<
-  // "grp size: " << n_participants << std::endl;
-
-  int dir = std_uniform(gen) < 0.5 ? 1 : -1;
-  // std::cerr << "dir: " << dir << std::endl;
-  int round = 0, i = 0;
-  // for (int i = 0; i < n_participants; i++) {
-  while (round != n_participants) {
-    dst_mem = machine->get_gpu_fb_mem(reinterpret_cast<uint64_t>(
-        allreduce_task->next_tasks[MOD(i + dir, n_participants)]));
-    // dst_mem =
-    // machine->get_gpu_fb_mem(reinterpret_cast<uint64_t>(allreduce_task->next_tasks[(i+1)%n_participants]));
-    std::vector<CommDevice *> path = machine->get_comm_path(src_mem, dst_mem);
-    // if (dir)
-    // std::vector<CommDevice *> path = machine->get_comm_path(src_mem,
-    // dst_mem); std::cerr << "\tDevices: ";
-    for (CommDevice *d : path) {
-      SimTask *task = new_comm_task_unrecorded();
-      task->device = d;
-      // std::cerr << "dir: " << dir << ", " << d->name << ", ";
-      task->run_time = 0;
-      task->ready_time = allreduce_task->ready_time;
-      task->xfer_size = (2.0 * (n_participants - 1)) *
-                        allreduce_task->xfer_size / n_participants;
-      task->xfer_left = task->xfer_size;
-      task->add_next_task(final_task);
-      ready_queue.push(task);
-    }
-    // std::cerr << std::endl;
-    src_mem = dst_mem;
-    round++;
-    i += dir;
-  }
-  if (final_task->counter == 0) {
-    final_task->ready_time = allreduce_task->ready_time;
-    ready_queue.push(final_task);
-  }
-#else
-  // assume parameter server in this case
-  MemDevice *leader_mem = machine->get_gpu_fb_mem(
-      reinterpret_cast<uint64_t>(allreduce_task->next_tasks[0]));
-  MemDevice *worker_mem;
-  SimTask *ps_update_task = new_update_task_unrecorded();
-  ps_update_task->device = machine->get_gpu(
-      reinterpret_cast<uint64_t>(allreduce_task->next_tasks[0]));
-  final_task->device = machine->get_gpu(
-      reinterpret_cast<uint64_t>(allreduce_task->next_tasks[0]));
-  ps_update_task->add_next_task(final_task);
-
-  // ps gather
-  for (int i = 0; i < n_participants; i++) {
-    worker_mem = machine->get_gpu_fb_mem(
-        reinterpret_cast<uint64_t>(allreduce_task->next_tasks[i]));
-    std::vector<CommDevice *> path =
-        machine->get_comm_path(worker_mem, leader_mem);
-    for (CommDevice *d : path) {
-      SimTask *task = new_comm_task_unrecorded();
-      task->device = d;
-      task->run_time = 0;
-      task->ready_time = allreduce_task->ready_time;
-      task->xfer_size = allreduce_task->xfer_size;
-      task->xfer_left = task->xfer_size;
-      task->add_next_task(ps_update_task);
-      ready_queue.push(task);
-    }
-  }
-
-  // scatter
-  for (int i = 0; i < n_participants; i++) {
-    worker_mem = machine->get_gpu_fb_mem(
-        reinterpret_cast<uint64_t>(allreduce_task->next_tasks[i]));
-    std::vector<CommDevice *> path =
-        machine->get_comm_path(leader_mem, worker_mem);
-    for (CommDevice *d : path) {
-      SimTask *task = new_comm_task_unrecorded();
-      task->device = d;
-      task->run_time = 0;
-      task->ready_time = allreduce_task->ready_time;
-      task->xfer_size = allreduce_task->xfer_size;
-      ps_update_task->add_next_task(task);
-      task->add_next_task(final_task);
-    }
-  }
-
-  if (ps_update_task->counter == 0) {
-    assert(final_task->counter == 1);
-    ps_update_task->ready_time = allreduce_task->ready_time;
-    ready_queue.push(ps_update_task);
-  }
-
-#endif
-}
-
-SimTask *LogicalTaskgraphBasedSimulator::new_comm_task_unrecorded() {
-  SimTask *task = task_manager->new_task();
-  task->type = SimTask::TASK_NOMINAL_COMM;
-  task->store = false;
-  return task;
-}
-
-SimTask *LogicalTaskgraphBasedSimulator::new_update_task_unrecorded() {
-  SimTask *task = task_manager->new_task();
-  task->type = SimTask::TASK_UPDATE;
-  task->store = false;
-  return task;
-}
-
 void LogicalTaskgraphBasedSimulator::add_task_dependencies_with_xfer(
     SimTask *src_task, SimTask *dst_task, size_t message_size) {
   std::vector<CommDevice *> path =
@@ -1854,8 +2188,10 @@ SimTask *TaskManager::new_allreduce_task(Op const *op,
   SimTask *task = new_task();
   task->type = SimTask::TASK_ALLREDUCE;
   // task->counter = node_ids[0];
+  task->next_tasks = allocate_next_tasks(node_ids.size());
+  task->num_next_tasks = task->max_num_next_tasks = node_ids.size();
   for (size_t i = 0; i < node_ids.size(); i++) {
-    task->next_tasks.push_back(reinterpret_cast<SimTask *>(node_ids[i]));
+    task->next_tasks[i] = reinterpret_cast<SimTask *>(node_ids[i]);
   }
   task->xfer_size = message_size;
   return task;
@@ -1867,12 +2203,12 @@ SimTask *TaskManager::new_nominal_comm_task() {
   return task;
 }
 
-SimTask *TaskManager::new_nominal_comm_task(std::string const &name,
+SimTask *TaskManager::new_nominal_comm_task(char const *name,
                                             CommDevice *comm_device,
                                             size_t message_size) {
   SimTask *task = new_task();
   task->type = SimTask::TASK_NOMINAL_COMM;
-  task->name = name;
+  task->name = copy_name(name);
   task->device = comm_device;
   task->run_time = comm_device->latency + message_size / comm_device->bandwidth;
   return task;
@@ -56,8 +56,31 @@ Simulator::Simulator(FFModel const *model,
                      FFHandler _handler,
                      Memory _memory,
                      MachineModel *machine)
-    : memory(_memory), handler(_handler), offset(0), warmup_times(5),
-      repeat_times(10), computationMode(model->config.computationMode) {
+    : simulatorInst(Realm::RegionInstance::NO_INST), memory(_memory),
+      handler(_handler), base_ptr(nullptr), capacity(0), offset(0),
+      warmup_times(5), repeat_times(10),
+      computationMode(model->config.computationMode), conv2d_meta(nullptr),
+      linear_meta(nullptr), pool2d_meta(nullptr), ele_unary_meta(nullptr),
+      ele_binary_meta(nullptr), batch_matmul_meta(nullptr),
+      concat_meta(nullptr), transpose_meta(nullptr) {
+  this->machine = machine;
+  segment_size = model->config.simulator_segment_size;
+  max_num_segments = model->config.simulator_max_num_segments;
+  allreduce_algorithm = model->config.allreduce_algorithm;
+  flow_level_network = model->config.simulator_flow_level_network;
+  if (model->config.simulator_num_threads > 1) {
+    thread_pool.reset(
+        new SimulatorThreadPool(model->config.simulator_num_threads));
+  }
+  // Initialize task manager
+  size_t max_num_tasks = 1024 * 1024;
+  task_manager = new TaskManager(max_num_tasks);
+  // The analytical cost model runs no kernel, so the simulator needs no
+  // workspace, stream or meta, and the search may run on a CPU
+  if (model->config.analytical_cost_model) {
+    return;
+  }
+
   // Allocate simulator memory
   Rect1 bounds(Point1(0), Point1(0));
   std::vector<size_t> field_sizes;
@@ -78,8 +101,6 @@ Simulator::Simulator(FFModel const *model,
   checkCUDA(hipblasSetStream(handler.blas, stream));
   checkCUDNN(miopenSetStream(handler.dnn, stream));
 
-  size_t max_num_tasks = 1024 * 1024;
-
   hipEventCreate(&start_event);
   hipEventCreate(&end_event);
   conv2d_meta = new Conv2DMeta(handler);
@@ -93,14 +114,15 @@ Simulator::Simulator(FFModel const *model,
   concat_meta = new ConcatMeta(handler);
   // dropout_meta = new DropoutMeta(handler);
   transpose_meta = new TransposeMeta(handler);
-  this->machine = machine;
-  segment_size = model->config.simulator_segment_size;
-  max_num_segments = model->config.simulator_max_num_segments;
-  // Initialize task manager
-  task_manager = new TaskManager(max_num_tasks);
 }
 
 Simulator::~Simulator(void) {
+  delete task_manager;
+  // Simulators that measure operators on a profiler, or with the analytical
+  // cost model, have no workspace
+  if (!simulatorInst.exists()) {
+    return;
+  }
   simulatorInst.destroy();
 }
 
@@ -0,0 +1,189 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/strategy_cache.h"
+#include "flexflow/operator_cost_database.h"
+#include "flexflow/utils/hash_utils.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace FlexFlow {
+
+static char const STRATEGY_CACHE_MAGIC[8] = {
+    'F', 'F', 'S', 'T', 'R', 'A', 'T', 'C'};
+
+// Files the search reads are part of the key by their contents, so that
+// editing them in place invalidates the cached strategies
+static size_t hash_file_contents(std::string const &filename) {
+  std::ifstream in(filename, std::ios::binary);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  return std::hash<std::string>()(contents.str());
+}
+
+StrategyCache::StrategyCache(std::string const &_directory)
+    : directory(_directory) {
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr,
+            "Cannot create strategy cache directory %s; "
+            "searched strategies will not be persisted\n",
+            directory.c_str());
+  }
+}
+
+/*static*/
+uint64_t StrategyCache::get_key(FFModel const *model) {
+  FFConfig const &config = model->config;
+  size_t key = VERSION;
+
+  // The operators created from the layers, in order, and their connections
+  std::unordered_map<Op const *, size_t> op_index;
+  for (Op const *op : model->operators) {
+    op_index.emplace(op, op_index.size());
+    hash_combine(key, op->get_untyped_params_hash());
+    hash_combine(key, op->layer_guid.id);
+    hash_combine(key, op->numInputs);
+    for (int i = 0; i < op->numInputs; i++) {
+      Op const *owner = op->inputs[i]->owner_op;
+      auto it = op_index.find(owner);
+      hash_combine(key, it != op_index.end() ? it->second : SIZE_MAX);
+      hash_combine(key, op->inputs[i]->owner_idx);
+      hash_combine(key, op->inputs[i]->get_shape());
+    }
+    for (int i = 0; i < op->numOutputs; i++) {
+      hash_combine(key, op->outputs[i]->get_shape());
+    }
+  }
+  hash_combine(key, static_cast<int>(config.computationMode));
+
+  // The machine
+  hash_combine(key, config.numNodes);
+  hash_combine(key, config.workersPerNode);
+  hash_combine(key, config.cpusPerNode);
+  hash_combine(key, config.device_mem);
+  hash_combine(key, config.search_num_nodes.value_or(-1));
+  hash_combine(key, config.search_num_workers.value_or(-1));
+  hash_combine(key, config.machine_model_version);
+  if (!config.machine_model_file.empty()) {
+    hash_combine(key, hash_file_contents(config.machine_model_file));
+  }
+  hash_combine(key, config.gpu_peak_tflops);
+  hash_combine(key, config.gpu_fb_mem_bandwidth);
+  hash_combine(key, config.analytical_cost_model);
+  // Not the contents of the cost database: the search appends to it, and so
+  // do other jobs sharing it, while the costs it holds for a machine stay
+  // the same
+  hash_combine(key, !config.cost_database_file.empty());
+  hash_combine(key, OperatorCostDatabase::VERSION);
+  hash_combine(key, config.simulator_segment_size);
+  hash_combine(key, config.simulator_max_num_segments);
+  hash_combine(key, config.simulator_flow_level_network);
+  hash_combine(key, static_cast<int>(config.allreduce_algorithm));
+
+  // The search
+  hash_combine(key, config.search_budget);
+  hash_combine(key, config.search_alpha);
+  hash_combine(key, config.search_overlap_backward_update);
+  hash_combine(key, config.only_data_parallel);
+  hash_combine(key, config.enable_sample_parallel);
+  hash_combine(key, config.enable_parameter_parallel);
+  hash_combine(key, config.enable_attribute_parallel);
+  hash_combine(key, config.enable_propagation);
+  hash_combine(key, config.base_optimize_threshold);
+  hash_combine(key, config.search_seed);
+  if (config.substitution_json_path.has_value()) {
+    hash_combine(key,
+                 hash_file_contents(config.substitution_json_path.value()));
+  }
+  hash_combine(key, config.perform_memory_search);
+  hash_combine(key, static_cast<int>(config.memory_usage_type));
+  hash_combine(key, static_cast<int>(config.memory_search_algo));
+  return key;
+}
+
+std::string StrategyCache::get_filename(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016" PRIx64 ".pcg", key);
+  return directory + "/" + name;
+}
+
+bool StrategyCache::lookup(uint64_t key,
+                           PCG::GraphOptimalViewSerialized &strategy) const {
+  std::string filename = get_filename(key);
+  FILE *file = fopen(filename.c_str(), "rb");
+  if (file == NULL) {
+    return false;
+  }
+  Header header;
+  bool valid = fread(&header, sizeof(Header), 1, file) == 1 &&
+               memcmp(header.magic,
+                      STRATEGY_CACHE_MAGIC,
+                      sizeof(header.magic)) == 0 &&
+               header.version == VERSION && header.key == key;
+  if (valid) {
+    // Check the size against the file before allocating it
+    long offset = ftell(file);
+    valid = fseek(file, 0, SEEK_END) == 0 &&
+            (uint64_t)(ftell(file) - offset) == header.total_bytes &&
+            fseek(file, offset, SEEK_SET) == 0;
+  }
+  if (valid) {
+    strategy.data.resize(header.total_bytes);
+    valid = fread(strategy.data.data(), 1, header.total_bytes, file) ==
+            header.total_bytes;
+  }
+  fclose(file);
+  if (!valid) {
+    fprintf(stderr,
+            "Ignoring cached strategy %s: incompatible format or truncated\n",
+            filename.c_str());
+    strategy.data.clear();
+    return false;
+  }
+  return true;
+}
+
+void StrategyCache::insert(
+    uint64_t key, PCG::GraphOptimalViewSerialized const &strategy) const {
+  std::string filename = get_filename(key);
+  std::string tmp_filename = filename + ".tmp." + std::to_string(getpid());
+  FILE *file = fopen(tmp_filename.c_str(), "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot write cached strategy %s\n", filename.c_str());
+    return;
+  }
+  Header header;
+  memcpy(header.magic, STRATEGY_CACHE_MAGIC, sizeof(header.magic));
+  header.version = VERSION;
+  header.reserved = 0;
+  header.key = key;
+  header.total_bytes = strategy.data.size();
+  bool written = fwrite(&header, sizeof(Header), 1, file) == 1 &&
+                 fwrite(strategy.data.data(), 1, strategy.data.size(), file) ==
+                     strategy.data.size();
+  written = (fclose(file) == 0) && written;
+  if (!written || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    fprintf(stderr, "Cannot write cached strategy %s\n", filename.c_str());
+    remove(tmp_filename.c_str());
+  }
+}
+
+}; // namespace FlexFlow
@@ -312,7 +312,7 @@ bool GraphXfer::can_match(OpX *srcOp, Node const &op, Graph const *graph) {
             return false;
           }
         } else {
-          auto const &list = graph->inEdges.find(op)->second;
+          auto const &list = graph->get_in_edges(op);
           for (auto const &e : list) {
             if (e.dstIdx == (int)i) {
               newMapInputs.insert(
@@ -332,12 +332,28 @@ bool GraphXfer::can_match(OpX *srcOp, Node const &op, Graph const *graph) {
       }
     } else {
       // intermediate tensor
-      assert(in.op->mapOp != Node::INVALID_NODE);
+      if (in.op->mapOp == Node::INVALID_NODE) {
+        // The producer has not been matched yet and checks this edge when it
+        // is
+        continue;
+      }
       if (!(graph->has_edge(in.op->mapOp, op, in.idx, i))) {
         return false;
       }
     }
   }
+  // check outputs consumed by srcOps that have already been matched
+  for (OpX *dstOp : srcOps) {
+    if (dstOp == srcOp || dstOp->mapOp == Node::INVALID_NODE) {
+      continue;
+    }
+    for (size_t i = 0; i < dstOp->inputs.size(); i++) {
+      TensorX const &in = dstOp->inputs[i];
+      if (in.op == srcOp && !graph->has_edge(op, dstOp->mapOp, in.idx, i)) {
+        return false;
+      }
+    }
+  }
   // check tnConstraints
   for (size_t i = 0; i < srcOp->tnConstraints.size(); i++) {
     TNConstraint tnc = srcOp->tnConstraints[i];
@@ -398,7 +414,7 @@ void GraphXfer::match(OpX *srcOp, Node const &op, Graph const *graph) {
     TensorX in = srcOp->inputs[i];
     if (in.op == NULL) {
       // Update mappedInputs
-      auto const &list = graph->inEdges.find(op)->second;
+      auto const &list = graph->get_in_edges(op);
       for (auto const &e : list) {
         if (e.dstIdx == (int)i) {
           mappedInputs.insert(
@@ -507,9 +523,121 @@ GraphXferMatch GraphXfer::get_match_record(Graph const *g) const {
   return match;
 }
 
+void GraphXfer::build_match_index(Graph const *graph) {
+  nodesByType.clear();
+  edgelessNodes.clear();
+  for (auto const &it : graph->get_in_edges()) {
+    nodesByType[it.first.ptr->op_type].push_back(it.first);
+    if (it.second.empty() && graph->get_out_edges(it.first).empty()) {
+      edgelessNodes.push_back(it.first);
+    }
+  }
+  auto num_nodes_of_type = [&](int i) -> size_t {
+    auto const &it = nodesByType.find(srcOps[i]->type);
+    return it == nodesByType.end() ? 0 : it->second.size();
+  };
+  auto is_connected = [&](int i, int j) -> bool {
+    for (TensorX const &in : srcOps[i]->inputs) {
+      if (in.op == srcOps[j]) {
+        return true;
+      }
+    }
+    for (TensorX const &in : srcOps[j]->inputs) {
+      if (in.op == srcOps[i]) {
+        return true;
+      }
+    }
+    return false;
+  };
+  matchOrder.clear();
+  std::vector<bool> ordered(srcOps.size(), false);
+  while (matchOrder.size() < srcOps.size()) {
+    int best = -1;
+    bool best_connected = false;
+    for (int i = 0; i < (int)srcOps.size(); i++) {
+      if (ordered[i]) {
+        continue;
+      }
+      bool connected = false;
+      for (int j : matchOrder) {
+        connected = connected || is_connected(i, j);
+      }
+      if (best == -1 || (connected && !best_connected) ||
+          (connected == best_connected &&
+           num_nodes_of_type(i) < num_nodes_of_type(best))) {
+        best = i;
+        best_connected = connected;
+      }
+    }
+    ordered[best] = true;
+    matchOrder.push_back(best);
+  }
+}
+
+void GraphXfer::get_match_candidates(OpX *srcOp,
+                                     Graph const *graph,
+                                     std::vector<Node> &candidates) const {
+  candidates.clear();
+  // Follow the out-edges of an input that is already bound
+  for (size_t i = 0; i < srcOp->inputs.size(); i++) {
+    TensorX const &in = srcOp->inputs[i];
+    Node srcNode = Node::INVALID_NODE;
+    int srcIdx = 0;
+    if (in.op != NULL) {
+      srcNode = in.op->mapOp;
+      srcIdx = in.idx;
+    } else {
+      auto const &it = mappedInputs.find(in.idx);
+      if (it != mappedInputs.end()) {
+        srcNode = it->second.first;
+        srcIdx = it->second.second;
+      }
+    }
+    if (srcNode != Node::INVALID_NODE) {
+      for (auto const &e : graph->get_out_edges(srcNode)) {
+        if (e.srcIdx == srcIdx && e.dstIdx == (int)i) {
+          candidates.push_back(e.dstOp);
+        }
+      }
+      return;
+    }
+  }
+  // Follow the in-edges of a consumer that is already matched
+  for (OpX *dstOp : srcOps) {
+    if (dstOp == srcOp || dstOp->mapOp == Node::INVALID_NODE) {
+      continue;
+    }
+    for (size_t i = 0; i < dstOp->inputs.size(); i++) {
+      TensorX const &in = dstOp->inputs[i];
+      if (in.op == srcOp) {
+        for (auto const &e : graph->get_in_edges(dstOp->mapOp)) {
+          if (e.srcIdx == in.idx && e.dstIdx == (int)i) {
+            candidates.push_back(e.srcOp);
+          }
+        }
+        return;
+      }
+    }
+  }
+  // Otherwise every node of the right op type is a candidate
+  auto const &it = nodesByType.find(srcOp->type);
+  if (it != nodesByType.end()) {
+    candidates = it->second;
+  }
+}
+
 void GraphXfer::find_matches(Graph const *graph,
                              std::vector<GraphXferMatch> &matches) {
+  auto const start = std::chrono::steady_clock::now();
+  this->build_match_index(graph);
+  size_t num_matches = matches.size();
   this->find_matches(0, graph, matches);
+  match_stats.num_searches++;
+  match_stats.num_matches += matches.size() - num_matches;
+  match_stats.search_time +=
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start)
+          .count();
 }
 
 void GraphXfer::find_matches(int depth,
@@ -534,7 +662,7 @@ void GraphXfer::find_matches(int depth,
     log_xfer_matches.spew() << "Checking external edges";
     // Check that output tensors with external edges are mapped
     for (auto const &opIt : mappedOps) {
-      auto const &list = graph->outEdges.at(opIt.first);
+      auto const &list = graph->get_out_edges(opIt.first);
       for (auto const &e : list) {
         if (mappedOps.find(e.dstOp) == mappedOps.end()) {
           // dstOp is external, (srcOp, srcIdx) must be in mappedOutputs
@@ -574,24 +702,38 @@ void GraphXfer::find_matches(int depth,
     log_xfer_matches.spew() << "Finished getting match record";
     matches.push_back(match_record);
   } else {
-    OpX *srcOp = srcOps[depth];
-    for (auto const &it : graph->inEdges) {
-      log_xfer_matches.spew() << "Exploring node " << it.first.to_string();
-      // printf("can_match(%d)\n", can_match(srcOp, it->first, graph));
-      if (can_match(srcOp, it.first, graph) &&
-          (mappedOps.find(it.first) == mappedOps.end())) {
-        Node op = it.first;
-        // Check mapOutput
-        this->match(srcOp, op, graph);
-        this->find_matches(depth + 1, graph, matches);
-        log_xfer_matches.spew() << "Completed find matches. Unmatching";
-        this->unmatch(srcOp, op, graph);
-        log_xfer_matches.spew() << "Finished unmatching";
+    OpX *srcOp = srcOps[matchOrder[depth]];
+    std::vector<Node> candidates;
+    this->get_match_candidates(srcOp, graph, candidates);
+    for (Node const &op : candidates) {
+      log_xfer_matches.spew() << "Exploring node " << op.to_string();
+      if (mappedOps.find(op) != mappedOps.end()) {
+        continue;
+      }
+      match_stats.num_candidates++;
+      if (!can_match(srcOp, op, graph)) {
+        match_stats.num_pruned++;
+        continue;
       }
+      // Check mapOutput
+      this->match(srcOp, op, graph);
+      this->find_matches(depth + 1, graph, matches);
+      log_xfer_matches.spew() << "Completed find matches. Unmatching";
+      this->unmatch(srcOp, op, graph);
+      log_xfer_matches.spew() << "Finished unmatching";
     }
   }
 }
 
+// Key of a rewritten graph, before it is simplified, in the dedup hashmap of
+// the search, which also holds the hashes of the simplified candidates. A
+// rewrite that was already seen yields the same candidate, which was either
+// queued already or rejected for good since the cost threshold never grows,
+// so it is dropped before the graph is copied.
+static size_t rewrite_key(size_t rewrite_hash) {
+  return rewrite_hash ^ 0x9e3779b97f4a7c15ULL;
+}
+
 template <typename GraphComparator>
 void GraphXfer::run(
     int depth,
@@ -606,6 +748,11 @@ void GraphXfer::run(
     int &num_matches_rejected) {
   // printf("run: depth(%d) srcOps.size(%zu) graph.size(%zu) candidates(%zu)\n",
   // depth, srcOps.size(), graph->inEdges.size(), candidates.size());
+  auto const start = std::chrono::steady_clock::now();
+  if (depth == 0) {
+    this->build_match_index(graph);
+    match_stats.num_searches++;
+  }
   if (depth >= (int)srcOps.size()) {
     // Create dst operators
     bool pass = true;
@@ -619,7 +766,7 @@ void GraphXfer::run(
     }
     // Check that output tensors with external edges are mapped
     for (auto const &opIt : mappedOps) {
-      auto const &list = graph->outEdges[opIt.first];
+      auto const &list = graph->get_out_edges(opIt.first);
       for (auto const &e : list) {
         if (mappedOps.find(e.dstOp) == mappedOps.end()) {
           // dstOp is external, (srcOp, srcIdx) must be in mappedOutputs
@@ -636,7 +783,13 @@ void GraphXfer::run(
     // Generate a new graph by applying xfer rule
     log_xfers.spew() << "Found a match for xfer: " << this->get_name();
     num_matches_found++;
-    Graph *newGraph = this->create_new_graph(graph, simplification_settings);
+    match_stats.num_matches++;
+    GraphRewrite rewrite = this->get_rewrite(graph);
+    if (!hashmap.insert(rewrite_key(rewrite.hash(*graph))).second) {
+      return;
+    }
+    Graph *newGraph = rewrite.apply(*graph);
+    newGraph->simplify(simplification_settings);
     // Check that the new graph should not have any loop
     if (newGraph->has_loop()) {
       printf("Found a new graph with LOOP!!!!\n");
@@ -647,7 +800,7 @@ void GraphXfer::run(
     // TODO: remove me for better performance
     assert(newGraph->check_correctness());
     if (newGraph->optimal_cost() < threshold &&
-        (int)newGraph->inEdges.size() < maxNumOps) {
+        (int)newGraph->get_in_edges().size() < maxNumOps) {
       if (hashmap.find(newGraph->hash()) == hashmap.end()) {
         hashmap.insert(newGraph->hash());
         log_xfers.spew() << "Found new candidate";
@@ -659,29 +812,123 @@ void GraphXfer::run(
       delete newGraph;
     }
   } else {
-    OpX *srcOp = srcOps[depth];
-    for (auto const &it : graph->inEdges) {
-      // printf("can_match(%d)\n", can_match(srcOp, it->first, graph));
-      if (can_match(srcOp, it.first, graph) &&
-          (mappedOps.find(it.first) == mappedOps.end())) {
-        Node op = it.first;
-        // Check mapOutput
-        match(srcOp, op, graph);
-        run(depth + 1,
-            graph,
-            candidates,
-            hashmap,
-            threshold,
-            maxNumOps,
-            simplification_settings,
-            num_matches_found,
-            num_matches_rejected);
-        unmatch(srcOp, op, graph);
+    OpX *srcOp = srcOps[matchOrder[depth]];
+    std::vector<Node> matchCandidates;
+    get_match_candidates(srcOp, graph, matchCandidates);
+    for (Node const &op : matchCandidates) {
+      if (mappedOps.find(op) != mappedOps.end()) {
+        continue;
+      }
+      match_stats.num_candidates++;
+      if (!can_match(srcOp, op, graph)) {
+        match_stats.num_pruned++;
+        continue;
       }
+      // Check mapOutput
+      match(srcOp, op, graph);
+      run(depth + 1,
+          graph,
+          candidates,
+          hashmap,
+          threshold,
+          maxNumOps,
+          simplification_settings,
+          num_matches_found,
+          num_matches_rejected);
+      unmatch(srcOp, op, graph);
+    }
+    if (depth == 0) {
+      match_stats.search_time += std::chrono::duration<double, std::milli>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count();
     }
   }
 }
 
+void GraphXfer::find_match_bindings(Graph const *graph,
+                                    std::vector<std::vector<Node>> &bindings) {
+  auto const start = std::chrono::steady_clock::now();
+  this->build_match_index(graph);
+  size_t num_bindings = bindings.size();
+  std::vector<Node> binding(srcOps.size());
+  this->find_match_bindings(0, graph, binding, bindings);
+  match_stats.num_searches++;
+  match_stats.num_matches += bindings.size() - num_bindings;
+  match_stats.search_time +=
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+}
+
+void GraphXfer::find_match_bindings(int depth,
+                                    Graph const *graph,
+                                    std::vector<Node> &binding,
+                                    std::vector<std::vector<Node>> &bindings) {
+  if (depth >= (int)srcOps.size()) {
+    bindings.push_back(binding);
+    return;
+  }
+  OpX *srcOp = srcOps[matchOrder[depth]];
+  std::vector<Node> candidates;
+  get_match_candidates(srcOp, graph, candidates);
+  for (Node const &op : candidates) {
+    if (mappedOps.find(op) != mappedOps.end()) {
+      continue;
+    }
+    match_stats.num_candidates++;
+    if (!can_match(srcOp, op, graph)) {
+      match_stats.num_pruned++;
+      continue;
+    }
+    match(srcOp, op, graph);
+    binding[matchOrder[depth]] = op;
+    find_match_bindings(depth + 1, graph, binding, bindings);
+    unmatch(srcOp, op, graph);
+  }
+}
+
+bool GraphXfer::get_binding_rewrite(Graph const *graph,
+                                    std::vector<Node> const &binding,
+                                    GraphRewrite &rewrite) {
+  assert(binding.size() == srcOps.size());
+  for (size_t i = 0; i < binding.size(); i++) {
+    match(srcOps[i], binding[i], graph);
+  }
+  // Create dst operators
+  bool pass = true;
+  for (OpX *dstOp : this->dstOps) {
+    if (pass) {
+      pass &= create_new_operator(dstOp, dstOp->mapOp);
+    }
+  }
+  // Check that output tensors with external edges are mapped
+  for (auto const &opIt : mappedOps) {
+    if (!pass) {
+      break;
+    }
+    for (auto const &e : graph->get_out_edges(opIt.first)) {
+      if (mappedOps.find(e.dstOp) == mappedOps.end()) {
+        // dstOp is external, (srcOp, srcIdx) must be in mappedOutputs
+        TensorX srcTen;
+        srcTen.op = opIt.second;
+        srcTen.idx = e.srcIdx;
+        if (mappedOutputs.find(srcTen) == mappedOutputs.end()) {
+          pass = false;
+          break;
+        }
+      }
+    }
+  }
+  if (pass) {
+    log_xfers.spew() << "Found a match for xfer: " << this->get_name();
+    rewrite = this->get_rewrite(graph);
+  }
+  for (int i = (int)binding.size() - 1; i >= 0; i--) {
+    unmatch(srcOps[i], binding[i], graph);
+  }
+  return pass;
+}
+
 Node Graph::find_source_node() const {
   using FlexFlow::PCG::Utils::roots;
 
@@ -779,35 +1026,34 @@ std::unique_ptr<Graph> Graph::with_output_tensor_reshaped_to(
 /*   } */
 /* } */
 
-Graph *GraphXfer::create_new_graph(
-    Graph const *graph, SimplificationSettings const &simplification_settings) {
-  Graph *newGraph = new Graph(model);
-  // Step 1: map dst ops
-  std::vector<OpX *>::const_iterator dstIt;
-  // Step 2: add edges to the graph
-  for (auto const &opIt : graph->inEdges) {
-    if (mappedOps.find(opIt.first) == mappedOps.end()) {
-      // Unmapped ops
-      auto const &list = opIt.second;
-      for (auto const &it : list) {
-        if (mappedOps.find(it.srcOp) != mappedOps.end()) {
-          // mapped src -> unmapped dst
-          TensorX srcTen;
-          srcTen.op = mappedOps[it.srcOp];
-          srcTen.idx = it.srcIdx;
-          assert(mappedOutputs.find(srcTen) != mappedOutputs.end());
-          TensorX dstTen = mappedOutputs[srcTen];
-          newGraph->add_edge(dstTen.op->mapOp, it.dstOp, dstTen.idx, it.dstIdx);
-        } else {
-          // unmapped src -> unmmaped dst
-          newGraph->add_edge(it.srcOp, it.dstOp, it.srcIdx, it.dstIdx);
-        }
+GraphRewrite GraphXfer::get_rewrite(Graph const *graph) const {
+  GraphRewrite rewrite;
+  // Step 1: remove the edges of the matched ops, redirecting the outputs
+  // consumed by unmapped ops to the mapped outputs of the dst ops
+  for (auto const &opIt : mappedOps) {
+    for (Edge const &e : graph->get_out_edges(opIt.first)) {
+      rewrite.removed_edges.push_back(e);
+      if (mappedOps.find(e.dstOp) == mappedOps.end()) {
+        // mapped src -> unmapped dst
+        TensorX srcTen;
+        srcTen.op = opIt.second;
+        srcTen.idx = e.srcIdx;
+        auto const &it = mappedOutputs.find(srcTen);
+        assert(it != mappedOutputs.end());
+        TensorX const &dstTen = it->second;
+        rewrite.added_edges.push_back(
+            Edge(dstTen.op->mapOp, e.dstOp, dstTen.idx, e.dstIdx));
+      }
+    }
+    for (Edge const &e : graph->get_in_edges(opIt.first)) {
+      // the edges between mapped ops were removed as out-edges above
+      if (mappedOps.find(e.srcOp) == mappedOps.end()) {
+        rewrite.removed_edges.push_back(e);
       }
     }
   }
-  // Step 3: add edges for mapped ops
-  for (dstIt = dstOps.begin(); dstIt != dstOps.end(); dstIt++) {
-    OpX *dstOp = *dstIt;
+  // Step 2: add edges for mapped ops
+  for (OpX const *dstOp : dstOps) {
     for (size_t i = 0; i < dstOp->inputs.size(); i++) {
       if (dstOp->inputs[i].op == NULL) {
         // unmapped src -> mapped dst
@@ -815,17 +1061,25 @@ Graph *GraphXfer::create_new_graph(
             mappedInputs.find(dstOp->inputs[i].idx);
         assert(it != mappedInputs.end());
         std::pair<Node, int> const &srcEdge = it->second;
-        newGraph->add_edge(srcEdge.first, dstOp->mapOp, srcEdge.second, i);
+        rewrite.added_edges.push_back(
+            Edge(srcEdge.first, dstOp->mapOp, srcEdge.second, i));
       } else {
         // mapped src -> mapped dst
         OpX *srcOp = dstOp->inputs[i].op;
         int srcIdx = dstOp->inputs[i].idx;
-        newGraph->add_edge(srcOp->mapOp, dstOp->mapOp, srcIdx, i);
+        rewrite.added_edges.push_back(
+            Edge(srcOp->mapOp, dstOp->mapOp, srcIdx, i));
       }
     }
   }
-  newGraph->simplify(simplification_settings);
+  rewrite.edgeless_nodes = edgelessNodes;
+  return rewrite;
+}
 
+Graph *GraphXfer::create_new_graph(
+    Graph const *graph, SimplificationSettings const &simplification_settings) {
+  Graph *newGraph = this->get_rewrite(graph).apply(*graph);
+  newGraph->simplify(simplification_settings);
   return newGraph;
 }
 
@@ -1711,11 +1965,16 @@ std::vector<GraphXfer *> create_xfers(FFModel *model,
 GraphSearchHelper::GraphSearchHelper(FFModel *model)
     : model(model), config(model->config), mem_config(1.0) {
   this->logger = std::unique_ptr<RecursiveLogger>(new RecursiveLogger("gs"));
+  if (this->config.search_num_threads > 1) {
+    this->thread_pool = std::unique_ptr<SimulatorThreadPool>(
+        new SimulatorThreadPool(this->config.search_num_threads));
+  }
   generate_all_pcg_xfers();
 }
 
 void GraphSearchHelper::clear_cache() {
   cached_optimized_graphs.clear();
+  cached_pareto_fronts.clear();
 }
 
 void GraphSearchHelper::load_graph_substitutions(
@@ -1920,6 +2179,7 @@ void GraphSearchHelper::graph_optimize(
           tl::nullopt /*input_shape*/);
   this->logger->debug() << "Total cache size: "
                         << this->cached_optimized_graphs.size();
+  this->log_split_cache_stats();
   std::cout << "Optimal cost: " << optimal.cost << std::endl;
   SimplificationSettings settings;
   settings.fuse_parallel_ops = true;
@@ -1984,18 +2244,35 @@ void GraphSearchHelper::graph_optimize_with_memory(
   Node sink_node = graph->find_sink_node();
 
   auto const start = std::chrono::system_clock::now();
-  GraphOptimizeResultWithMemory optimal =
-      this->generic_sequence_optimize_with_memory<
-          GraphOptimizeResultWithMemory>(
-          graph, sink_node, tl::nullopt, tl::nullopt);
+  GraphOptimizeResultWithMemory optimal;
+  if (this->mem_config.mem_search_algo == MemorySearchAlgo::PARETO) {
+    this->pareto_front = this->pareto_sequence_optimize(
+        graph, sink_node, tl::nullopt, tl::nullopt);
+    assert(!this->pareto_front.empty() && "No valid strategy found");
+    optimal = this->pareto_front.front();
+  } else {
+    optimal = this->generic_sequence_optimize_with_memory<
+        GraphOptimizeResultWithMemory>(
+        graph, sink_node, tl::nullopt, tl::nullopt);
+  }
   auto const end = std::chrono::system_clock::now();
 
   this->logger->debug() << "Total cache size: "
                         << this->cached_optimized_graphs.size();
-  std::cout << "Optimal run time cost: " << optimal.cost
-            << ", Memory usage: " << optimal.mem_cost
-            << " | run_time_cost_factor: "
-            << this->mem_config.run_time_cost_factor << std::endl;
+  this->log_split_cache_stats();
+  if (this->mem_config.mem_search_algo == MemorySearchAlgo::PARETO) {
+    std::cout << "Pareto front of " << this->pareto_front.size()
+              << " strategies:" << std::endl;
+    for (auto const &r : this->pareto_front) {
+      std::cout << "  run time cost: " << r.cost
+                << ", Memory usage: " << r.mem_cost << std::endl;
+    }
+  } else {
+    std::cout << "Optimal run time cost: " << optimal.cost
+              << ", Memory usage: " << optimal.mem_cost
+              << " | run_time_cost_factor: "
+              << this->mem_config.run_time_cost_factor << std::endl;
+  }
 
   // Save the search performance results to the output argument
   search_result.run_time_cost = optimal.cost;
@@ -2003,7 +2280,32 @@ void GraphSearchHelper::graph_optimize_with_memory(
   search_result.search_time =
       std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
           .count();
+  this->pareto_search_time = search_result.search_time;
+
+  this->finalize_strategy(optimal, best_graph, optimal_views);
+}
 
+bool GraphSearchHelper::get_pareto_strategy(
+    size_t index,
+    std::unique_ptr<Graph> &best_graph,
+    std::unordered_map<Node, MachineView> &optimal_views,
+    MemorySearchResult &search_result) {
+  if (index >= this->pareto_front.size()) {
+    return false;
+  }
+  GraphOptimizeResultWithMemory const &strategy = this->pareto_front[index];
+  search_result.run_time_cost = strategy.cost;
+  search_result.memory_cost = strategy.mem_cost.num;
+  // All strategies of the front come from the same search
+  search_result.search_time = this->pareto_search_time;
+  this->finalize_strategy(strategy, best_graph, optimal_views);
+  return true;
+}
+
+void GraphSearchHelper::finalize_strategy(
+    GraphOptimizeResultWithMemory const &optimal,
+    std::unique_ptr<Graph> &best_graph,
+    std::unordered_map<Node, MachineView> &optimal_views) {
   // Further simplify the "optimal" graph/schedule to have a more efficient
   // graph and more accurate cost.
   best_graph = std::unique_ptr<Graph>(new Graph(optimal.graph.value()));
@@ -2090,13 +2392,25 @@ void GraphSearchHelper::find_rewrite_matches(
   log_xfer_matches.debug() << "Finished finding xfer matches";
 }
 
+void GraphSearchHelper::log_split_cache_stats() const {
+  DominatorCacheStats const &stats =
+      this->model->search->get_dominator_cache_stats();
+  log_xfers.print("split cache: hits(%zu) misses(%zu) entries(%zu)",
+                  this->num_split_cache_hits,
+                  this->num_split_cache_misses,
+                  this->cached_split_nodes.size());
+  log_xfers.print("post-dominator cache: hits(%zu) misses(%zu) derived(%zu)",
+                  stats.num_hits,
+                  stats.num_misses,
+                  stats.num_derived);
+}
+
 tl::optional<Node>
     GraphSearchHelper::find_split_node(Graph const *graph,
                                        int base_optimize_threshold) const {
   using FlexFlow::PCG::Utils::get_edges;
   using FlexFlow::PCG::Utils::MultisourceGraphStructure;
   using FlexFlow::PCG::Utils::nodes;
-  using FlexFlow::PCG::Utils::post_dominators;
   using FlexFlow::PCG::Utils::roots;
 
   TAG_ENTER(this->logger);
@@ -2111,6 +2425,18 @@ tl::optional<Node>
     return tl::nullopt;
   }
 
+  // The split only depends on the graph, so it is shared by all the
+  // boundary shapes the graph is optimized for
+  size_t split_hash = graph->hash();
+  hash_combine(split_hash, base_optimize_threshold);
+  auto cached = this->cached_split_nodes.find(split_hash);
+  if (cached != this->cached_split_nodes.end()) {
+    this->num_split_cache_hits++;
+    this->logger->debug() << "Found cached split node";
+    return cached->second;
+  }
+  this->num_split_cache_misses++;
+
   std::vector<Edge> edges = get_edges(*graph);
   std::unordered_map<Edge, int> edge_scores;
 
@@ -2152,8 +2478,8 @@ tl::optional<Node>
     }
   }
 
-  std::unordered_map<Node, std::unordered_set<Node>> post_dominator_map =
-      post_dominators<Graph, MultisourceGraphStructure<Graph>>(*graph);
+  std::unordered_map<Node, Node> const &ipd =
+      this->model->search->get_imm_post_dominators(graph);
   Node source_node;
   {
     std::unordered_set<Node> source_nodes = roots<Graph>(*graph);
@@ -2163,8 +2489,12 @@ tl::optional<Node>
     assert(source_nodes.size() == 1);
     source_node = *source_nodes.begin();
   }
-  std::unordered_set<Node> possible_bottlenecks =
-      post_dominator_map.at(source_node);
+  // The post-dominators of the source are its chain in the post-dominator
+  // tree
+  std::unordered_set<Node> possible_bottlenecks;
+  for (Node n = source_node; possible_bottlenecks.insert(n).second;) {
+    n = ipd.at(n);
+  }
   Node sink_node = graph->find_sink_node();
 
   int best_weight = 0;
@@ -2180,7 +2510,7 @@ tl::optional<Node>
       }
 
       int weight = 0;
-      for (Edge const &e : graph->outEdges.at(possible_bottleneck)) {
+      for (Edge const &e : graph->get_out_edges(possible_bottleneck)) {
         weight += edge_scores.at(e);
       }
       this->logger->debug()
@@ -2216,9 +2546,133 @@ tl::optional<Node>
     }
   }
 
+  this->cached_split_nodes.emplace(split_hash, best);
   return best;
 }
 
+/**
+ * @brief Expand a single search candidate with the search thread pool.
+ * @details Pattern matching only reads the candidate graph and the matching
+ * state owned by each xfer, so the xfers are matched concurrently. Every
+ * match is then handled on the calling thread in the order of GraphXfer::run:
+ * its new operators are created, its graph is built and simplified, which may
+ * create more operators, and its cost is estimated, which may profile
+ * operators on the GPU, before the next match creates its operators. Node
+ * guids are thus assigned exactly as in the serial search. Only the hashes of
+ * the graphs under the cost threshold are computed on the pool, after which
+ * they are deduplicated and queued in match order, so the candidate queue
+ * evolves exactly as in the serial search and the same best graph is
+ * returned.
+ */
+template <typename GraphComparator>
+void GraphSearchHelper::expand_candidate_parallel(
+    Graph *graph,
+    std::vector<GraphXfer *> const &xfers,
+    std::priority_queue<Graph *, std::vector<Graph *>, GraphComparator>
+        &candidates,
+    std::unordered_set<size_t> &hashmap,
+    float threshold,
+    int maxNumOps,
+    SimplificationSettings const &simplification_settings) {
+  assert(this->thread_pool != nullptr);
+
+  // Step 1: find all matches of all xfers
+  std::vector<std::vector<std::vector<Node>>> bindings(xfers.size());
+  this->thread_pool->parallel_for(xfers.size(), [&](int i) {
+    xfers[i]->find_match_bindings(graph, bindings[i]);
+  });
+
+  // Step 2: create, simplify and cost the new graphs in the same order as
+  // the serial search
+  std::vector<Graph *> new_graphs;
+  for (size_t i = 0; i < xfers.size(); i++) {
+    int num_matches_found = 0, num_matches_rejected = 0;
+    log_xfers.debug() << "Considering xfer: " << xfers[i]->get_name();
+    for (std::vector<Node> const &binding : bindings[i]) {
+      GraphRewrite rewrite;
+      if (!xfers[i]->get_binding_rewrite(graph, binding, rewrite)) {
+        continue;
+      }
+      num_matches_found++;
+      if (!hashmap.insert(rewrite_key(rewrite.hash(*graph))).second) {
+        continue;
+      }
+      Graph *newGraph = rewrite.apply(*graph);
+      newGraph->simplify(simplification_settings);
+      if (newGraph->has_loop()) {
+        printf("Found a new graph with LOOP!!!!\n");
+        newGraph->print();
+        delete newGraph;
+        continue;
+      }
+      if (newGraph->optimal_cost() < threshold &&
+          (int)newGraph->get_in_edges().size() < maxNumOps) {
+        new_graphs.push_back(newGraph);
+      } else {
+        num_matches_rejected++;
+        delete newGraph;
+      }
+    }
+    log_xfers.debug() << "Rejected [ " << num_matches_rejected << " / "
+                      << num_matches_found << " ] matches for xfer "
+                      << xfers[i]->get_name();
+  }
+
+  // Step 3: hash the new graphs and add the new candidates
+  std::vector<size_t> hashes(new_graphs.size());
+  this->thread_pool->parallel_for(new_graphs.size(), [&](int i) {
+    hashes[i] = new_graphs[i]->hash();
+  });
+  for (size_t i = 0; i < new_graphs.size(); i++) {
+    if (hashmap.insert(hashes[i]).second) {
+      log_xfers.spew() << "Found new candidate";
+      candidates.push(new_graphs[i]);
+    } else {
+      delete new_graphs[i];
+    }
+  }
+}
+
+/**
+ * @brief Clear the match statistics of the xfers, which are shared by all
+ * searches, so that they cover a single search.
+ */
+static void reset_xfer_match_stats(std::vector<GraphXfer *> const &xfers) {
+  for (GraphXfer *xfer : xfers) {
+    xfer->match_stats = GraphXferMatchStats();
+  }
+}
+
+/**
+ * @brief Report how much time each xfer spent matching and how many of the
+ * nodes it tried were pruned by can_match since reset_xfer_match_stats.
+ */
+static void log_xfer_match_stats(std::vector<GraphXfer *> const &xfers) {
+  GraphXferMatchStats total;
+  for (GraphXfer const *xfer : xfers) {
+    GraphXferMatchStats const &stats = xfer->match_stats;
+    log_xfers.debug("xfer(%s) searches(%zu) candidates(%zu) pruned(%zu) "
+                    "matches(%zu) time(%.3lf ms)",
+                    xfer->get_name().c_str(),
+                    stats.num_searches,
+                    stats.num_candidates,
+                    stats.num_pruned,
+                    stats.num_matches,
+                    stats.search_time);
+    total.num_candidates += stats.num_candidates;
+    total.num_pruned += stats.num_pruned;
+    total.num_matches += stats.num_matches;
+    total.search_time += stats.search_time;
+  }
+  log_xfers.info("Matched %zu xfers: candidates(%zu) pruned(%zu) matches(%zu) "
+                 "time(%.3lf ms)",
+                 xfers.size(),
+                 total.num_candidates,
+                 total.num_pruned,
+                 total.num_matches,
+                 total.search_time);
+}
+
 /**
  * @brief Base case of Unity's DP search algorithm.
  *
@@ -2242,6 +2696,7 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize(
 
   std::vector<GraphXfer *> xfers;
   this->load_graph_substitutions(xfers);
+  reset_xfer_match_stats(xfers);
 
   Graph *graph = new Graph(*r_graph);
 
@@ -2283,21 +2738,31 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize(
                    candidates.size());
 
     log_xfers.debug() << "Considering " << xfers.size() << " possible xfers";
-    for (size_t i = 0; i < xfers.size(); i++) {
-      int num_matches_found = 0, num_matches_rejected = 0;
-      log_xfers.debug() << "Considering xfer: " << xfers[i]->get_name();
-      xfers[i]->run(0,
-                    cur_graph,
-                    candidates,
-                    hashmap,
-                    best_cost * alpha,
-                    1000,
-                    simplification_settings,
-                    num_matches_found,
-                    num_matches_rejected);
-      log_xfers.debug() << "Rejected [ " << num_matches_rejected << " / "
-                        << num_matches_found << " ] matches";
-      /* std::cout << "." << std::flush; */
+    if (this->config.search_num_threads > 1) {
+      this->expand_candidate_parallel(cur_graph,
+                                      xfers,
+                                      candidates,
+                                      hashmap,
+                                      best_cost * alpha,
+                                      1000,
+                                      simplification_settings);
+    } else {
+      for (size_t i = 0; i < xfers.size(); i++) {
+        int num_matches_found = 0, num_matches_rejected = 0;
+        log_xfers.debug() << "Considering xfer: " << xfers[i]->get_name();
+        xfers[i]->run(0,
+                      cur_graph,
+                      candidates,
+                      hashmap,
+                      best_cost * alpha,
+                      1000,
+                      simplification_settings,
+                      num_matches_found,
+                      num_matches_rejected);
+        log_xfers.debug() << "Rejected [ " << num_matches_rejected << " / "
+                          << num_matches_found << " ] matches";
+        /* std::cout << "." << std::flush; */
+      }
     }
     /* std::cout << std::endl; */
     if (best_graph != cur_graph) {
@@ -2305,6 +2770,7 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize(
     }
   }
 
+  log_xfer_match_stats(xfers);
   this->logger->debug() << "Optimized cost: " << best_graph->optimal_cost();
   // best_graph->print_dot();
   return std::unique_ptr<Graph>(best_graph);
@@ -2335,6 +2801,7 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
   // Construct graph substitutions
   std::vector<GraphXfer *> xfers;
   this->load_graph_substitutions(xfers);
+  reset_xfer_match_stats(xfers);
 
   // Prepare for the search
   std::priority_queue<Graph *, std::vector<Graph *>, GraphCompareWithMemory>
@@ -2388,20 +2855,30 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
 
     log_xfers.debug() << "Considering " << xfers.size()
                       << " possible xfers in base_optimize_with_memory";
-    for (size_t i = 0; i < xfers.size(); i++) {
-      int num_matches_found = 0, num_matches_rejected = 0;
-      log_xfers.debug() << "Considering xfer: " << xfers[i]->get_name();
-      xfers[i]->run(0,
-                    cur_graph,
-                    candidates,
-                    hashmap,
-                    best_cost * alpha,
-                    1000,
-                    simplification_settings,
-                    num_matches_found,
-                    num_matches_rejected);
-      log_xfers.debug() << "Rejected [ " << num_matches_rejected << " / "
-                        << num_matches_found << " ] matches";
+    if (this->config.search_num_threads > 1) {
+      this->expand_candidate_parallel(cur_graph,
+                                      xfers,
+                                      candidates,
+                                      hashmap,
+                                      best_cost * alpha,
+                                      1000,
+                                      simplification_settings);
+    } else {
+      for (size_t i = 0; i < xfers.size(); i++) {
+        int num_matches_found = 0, num_matches_rejected = 0;
+        log_xfers.debug() << "Considering xfer: " << xfers[i]->get_name();
+        xfers[i]->run(0,
+                      cur_graph,
+                      candidates,
+                      hashmap,
+                      best_cost * alpha,
+                      1000,
+                      simplification_settings,
+                      num_matches_found,
+                      num_matches_rejected);
+        log_xfers.debug() << "Rejected [ " << num_matches_rejected << " / "
+                          << num_matches_found << " ] matches";
+      }
     }
 
     if (best_graph != cur_graph) {
@@ -2409,6 +2886,7 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
     }
   }
 
+  log_xfer_match_stats(xfers);
   this->logger->debug()
       << "Optimized cost at the end of base_optimize_with_memory: "
       << best_graph->optimal_cost_with_memory(mem_config.run_time_cost_factor);
@@ -2416,6 +2894,106 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
   return std::unique_ptr<Graph>(best_graph);
 }
 
+/**
+ * @brief Base case of the Pareto-set DP search.
+ *
+ * @details Explores substitutions like base_optimize, fastest candidate
+ * first and within search_alpha of the fastest one, and keeps every
+ * candidate it visits that no other one beats in both run time and memory
+ * cost.
+ *
+ * @param r_graph Graph to be optimized
+ * @param simplification_settings Settings to simplify the resulting PCG
+ * @return The Pareto front of the candidates, fastest first
+ */
+std::vector<GraphOptimizeResultWithMemory>
+    GraphSearchHelper::base_optimize_pareto(
+        Graph const *r_graph,
+        SimplificationSettings const &simplification_settings) {
+  TAG_ENTER(this->logger);
+  this->logger->debug() << "Optimizing base graph for a Pareto front";
+
+  std::vector<GraphXfer *> xfers;
+  this->load_graph_substitutions(xfers);
+  reset_xfer_match_stats(xfers);
+
+  std::priority_queue<Graph *, std::vector<Graph *>, GraphCompare> candidates;
+  std::unordered_set<size_t> hashmap;
+  Graph *graph = new Graph(*r_graph);
+  candidates.push(graph);
+  hashmap.insert(graph->hash());
+
+  std::vector<GraphOptimizeResultWithMemory> front;
+  float best_cost = graph->optimal_cost();
+  float const alpha = this->model->config.search_alpha;
+  int budget = model->config.search_budget;
+  for (int iter = 0; iter < budget || budget == -1; iter++) {
+    if (candidates.empty()) {
+      break;
+    }
+
+    Graph *cur_graph = candidates.top();
+    candidates.pop();
+    float cur_cost = cur_graph->optimal_cost();
+    if (cur_cost > best_cost * alpha) {
+      delete cur_graph;
+      continue;
+    }
+    best_cost = std::min(best_cost, cur_cost);
+
+    log_xfers.info("[%d] cur_cost(%.4lf) best_cost(%.4lf) front.size(%zu)",
+                   iter,
+                   cur_cost,
+                   best_cost,
+                   front.size());
+
+    if (this->config.search_num_threads > 1) {
+      this->expand_candidate_parallel(cur_graph,
+                                      xfers,
+                                      candidates,
+                                      hashmap,
+                                      best_cost * alpha,
+                                      1000,
+                                      simplification_settings);
+    } else {
+      for (size_t i = 0; i < xfers.size(); i++) {
+        int num_matches_found = 0, num_matches_rejected = 0;
+        xfers[i]->run(0,
+                      cur_graph,
+                      candidates,
+                      hashmap,
+                      best_cost * alpha,
+                      1000,
+                      simplification_settings,
+                      num_matches_found,
+                      num_matches_rejected);
+      }
+    }
+
+    GraphOptimizeResultWithMemory result =
+        this->get_optimal_cost<GraphOptimizeResultWithMemory>(
+            std::unique_ptr<Graph>(cur_graph));
+    if (result.cost != std::numeric_limits<float>::infinity()) {
+      front.push_back(std::move(result));
+      prune_to_pareto_front(front);
+    }
+  }
+  while (!candidates.empty()) {
+    delete candidates.top();
+    candidates.pop();
+  }
+  if (front.empty()) {
+    // Same as base_optimize_with_memory without any budget
+    front.push_back(this->get_optimal_cost<GraphOptimizeResultWithMemory>(
+        std::unique_ptr<Graph>(new Graph(*r_graph))));
+  }
+
+  log_xfer_match_stats(xfers);
+  this->logger->debug() << "Pareto front of the base graph has "
+                        << front.size() << " strategies";
+  return front;
+}
+
 size_t gs_dp_state_hash(Graph const *graph,
                         Node const &sink_node,
                         tl::optional<ParallelTensorShape> const &output_shape,
@@ -2581,8 +3159,8 @@ T GraphSearchHelper::generic_sequence_optimize(
   size_t hash = gs_dp_state_hash(graph, sink_node, output_shape, input_shape);
   tl::optional<T> cached = this->try_get_cost_from_cache<T>(hash);
   if (cached.has_value()) {
-    this->logger->spew() << "Optimizing graph with " << graph->inEdges.size()
-                         << " nodes";
+    this->logger->spew() << "Optimizing graph with "
+                         << graph->get_in_edges().size() << " nodes";
     {
       TAG_ENTER(this->logger);
       this->logger->spew() << "Nodes: ";
@@ -2597,8 +3175,8 @@ T GraphSearchHelper::generic_sequence_optimize(
     return cached.value();
   }
 
-  this->logger->debug() << "Optimizing graph with " << graph->inEdges.size()
-                        << " nodes";
+  this->logger->debug() << "Optimizing graph with "
+                        << graph->get_in_edges().size() << " nodes";
   T return_value;
   {
     TAG_ENTER(this->logger);
@@ -2668,6 +3246,8 @@ T GraphSearchHelper::generic_sequence_optimize(
       std::unique_ptr<Graph> pre_graph, post_graph;
       std::tie(pre_graph, post_graph) =
           graph->split_at_node(bottleneck.value());
+      this->model->search->split_imm_post_dominators(
+          graph, bottleneck.value(), pre_graph.get(), post_graph.get());
 
       MachineResource resources(this->model->config);
       std::vector<MachineView> valid_machine_views =
@@ -2776,8 +3356,8 @@ T GraphSearchHelper::generic_sequence_optimize_with_memory(
   size_t hash = gs_dp_state_hash(graph, sink_node, output_shape, input_shape);
   tl::optional<T> cached = this->try_get_cost_from_cache<T>(hash);
   if (cached.has_value()) {
-    this->logger->spew() << "Optimizing graph with " << graph->inEdges.size()
-                         << " nodes";
+    this->logger->spew() << "Optimizing graph with "
+                         << graph->get_in_edges().size() << " nodes";
     {
       TAG_ENTER(this->logger);
       this->logger->spew() << "Nodes: ";
@@ -2791,8 +3371,8 @@ T GraphSearchHelper::generic_sequence_optimize_with_memory(
   }
 
   // Couldn't find the result from cache. Try to optimize and get one.
-  this->logger->debug() << "Optimizing graph with " << graph->inEdges.size()
-                        << " nodes";
+  this->logger->debug() << "Optimizing graph with "
+                        << graph->get_in_edges().size() << " nodes";
   T return_value;
   {
     // Print out debug information
@@ -2825,39 +3405,9 @@ T GraphSearchHelper::generic_sequence_optimize_with_memory(
 
       // Construct the PCG to optimize based on input_shape and output_shape
       // information.
-      Graph to_optimize(*graph);
-      if (input_shape.has_value()) {
-        Node input_node =
-            this->model->get_or_create_input_node(input_shape.value());
-        Node noop_node =
-            this->model->get_or_create_noop_node(input_node.ptr->outputs[0]);
-        Graph input_graph(this->model);
-        Edge e(input_node, noop_node, 0, 0);
-        input_graph.add_edge(e);
-
-        Node old_source_node = graph->find_source_node();
-        ParallelTensorShape old_source_output_shape =
-            old_source_node.ptr->outputs[0]->get_shape();
-        input_graph.reshape_output_tensor(old_source_output_shape);
-
-        Node new_sink_node = input_graph.find_sink_node();
-        assert(new_sink_node.ptr->numOutputs == 1);
-        assert(new_sink_node.ptr->outputs[0]->get_shape() ==
-               old_source_output_shape);
-
-        to_optimize.replace_subgraph({old_source_node}, input_graph);
-      }
       SimplificationSettings settings;
-      if (output_shape.has_value()) {
-        to_optimize.reshape_output_tensor(output_shape.value());
-        Node sink_node = to_optimize.find_sink_node();
-        Node noop_node =
-            this->model->get_or_create_noop_node(sink_node.ptr->outputs[0]);
-        to_optimize.add_edge(sink_node, noop_node, 0, 0);
-      } else {
-        settings.remove_trailing_parallel_ops = true;
-      }
-      settings.simplify_parallel_ops = true;
+      Graph to_optimize =
+          this->base_case_graph(graph, output_shape, input_shape, settings);
 
       // Call base optimization to perform graph substitution.
       std::unique_ptr<Graph> optimized =
@@ -2870,6 +3420,8 @@ T GraphSearchHelper::generic_sequence_optimize_with_memory(
       std::unique_ptr<Graph> pre_graph, post_graph;
       std::tie(pre_graph, post_graph) =
           graph->split_at_node(bottleneck.value());
+      this->model->search->split_imm_post_dominators(
+          graph, bottleneck.value(), pre_graph.get(), post_graph.get());
 
       MachineResource resources(this->model->config);
       std::vector<MachineView> valid_machine_views =
@@ -2938,6 +3490,133 @@ T GraphSearchHelper::generic_sequence_optimize_with_memory(
   return return_value;
 }
 
+std::vector<GraphOptimizeResultWithMemory> const &
+    GraphSearchHelper::pareto_sequence_optimize(
+        Graph const *graph,
+        Node const &sink_node,
+        tl::optional<ParallelTensorShape> const &output_shape,
+        tl::optional<ParallelTensorShape> const &input_shape) {
+  TAG_ENTER(this->logger);
+
+  // Fronts hold whole graphs, so unlike the float costs of the other DP
+  // variants they are cached by reference
+  size_t hash = gs_dp_state_hash(graph, sink_node, output_shape, input_shape);
+  auto cached = this->cached_pareto_fronts.find(hash);
+  if (cached != this->cached_pareto_fronts.end()) {
+    this->logger->spew() << "Retrieved Pareto front of "
+                         << cached->second.size() << " strategies from cache";
+    return cached->second;
+  }
+
+  this->logger->debug() << "Optimizing graph with "
+                        << graph->get_in_edges().size()
+                        << " nodes for a Pareto front";
+  std::vector<GraphOptimizeResultWithMemory> front;
+
+  tl::optional<Node> bottleneck =
+      this->find_split_node(graph, this->config.base_optimize_threshold);
+  if (!bottleneck.has_value()) {
+    this->logger->debug() << "Applying base case";
+    SimplificationSettings settings;
+    Graph to_optimize =
+        this->base_case_graph(graph, output_shape, input_shape, settings);
+    front = this->base_optimize_pareto(&to_optimize, settings);
+  } else {
+    this->logger->debug() << "Applying recursive case on bottleneck "
+                          << bottleneck.value().guid;
+
+    std::unique_ptr<Graph> pre_graph, post_graph;
+    std::tie(pre_graph, post_graph) = graph->split_at_node(bottleneck.value());
+    this->model->search->split_imm_post_dominators(
+        graph, bottleneck.value(), pre_graph.get(), post_graph.get());
+
+    // A strategy of the whole graph is one of pre_graph followed by one of
+    // post_graph with the same boundary shape. Combine the costs first and
+    // only build the graphs of the combinations on the front.
+    struct Combination {
+      float cost;
+      MemoryUsage mem_cost;
+      GraphOptimizeResultWithMemory const *pre, *post;
+    };
+    std::vector<Combination> combinations;
+    for (auto const &bottleneck_output_shape :
+         this->possible_split_output_tensor_shapes(bottleneck.value())) {
+      std::vector<GraphOptimizeResultWithMemory> const &pre_front =
+          this->pareto_sequence_optimize(pre_graph.get(),
+                                         bottleneck.value(),
+                                         bottleneck_output_shape,
+                                         input_shape);
+      std::vector<GraphOptimizeResultWithMemory> const &post_front =
+          this->pareto_sequence_optimize(post_graph.get(),
+                                         sink_node,
+                                         output_shape,
+                                         bottleneck_output_shape);
+      this->logger->debug()
+          << "Boundary shape " << bottleneck_output_shape << " has "
+          << pre_front.size() << " x " << post_front.size()
+          << " Pareto strategies";
+      for (auto const &pre : pre_front) {
+        for (auto const &post : post_front) {
+          combinations.push_back({pre.cost + post.cost,
+                                  pre.mem_cost + post.mem_cost,
+                                  &pre,
+                                  &post});
+        }
+      }
+      prune_to_pareto_front(combinations);
+    }
+    for (Combination const &c : combinations) {
+      front.push_back(
+          sequence_cost<GraphOptimizeResultWithMemory>(*c.pre, *c.post));
+    }
+  }
+
+  this->logger->debug() << "Found Pareto front of " << front.size()
+                        << " strategies";
+  return this->cached_pareto_fronts.emplace(hash, std::move(front))
+      .first->second;
+}
+
+Graph GraphSearchHelper::base_case_graph(
+    Graph const *graph,
+    tl::optional<ParallelTensorShape> const &output_shape,
+    tl::optional<ParallelTensorShape> const &input_shape,
+    SimplificationSettings &settings) const {
+  Graph to_optimize(*graph);
+  if (input_shape.has_value()) {
+    Node input_node =
+        this->model->get_or_create_input_node(input_shape.value());
+    Node noop_node =
+        this->model->get_or_create_noop_node(input_node.ptr->outputs[0]);
+    Graph input_graph(this->model);
+    Edge e(input_node, noop_node, 0, 0);
+    input_graph.add_edge(e);
+
+    Node old_source_node = graph->find_source_node();
+    ParallelTensorShape old_source_output_shape =
+        old_source_node.ptr->outputs[0]->get_shape();
+    input_graph.reshape_output_tensor(old_source_output_shape);
+
+    Node new_sink_node = input_graph.find_sink_node();
+    assert(new_sink_node.ptr->numOutputs == 1);
+    assert(new_sink_node.ptr->outputs[0]->get_shape() ==
+           old_source_output_shape);
+
+    to_optimize.replace_subgraph({old_source_node}, input_graph);
+  }
+  if (output_shape.has_value()) {
+    to_optimize.reshape_output_tensor(output_shape.value());
+    Node sink_node = to_optimize.find_sink_node();
+    Node noop_node =
+        this->model->get_or_create_noop_node(sink_node.ptr->outputs[0]);
+    to_optimize.add_edge(sink_node, noop_node, 0, 0);
+  } else {
+    settings.remove_trailing_parallel_ops = true;
+  }
+  settings.simplify_parallel_ops = true;
+  return to_optimize;
+}
+
 std::vector<ParallelTensorShape>
     GraphSearchHelper::possible_split_output_tensor_shapes(
         Node const &source_node) const {
@@ -3604,6 +4283,15 @@ void FFModel::graph_optimize(
   }
 }
 
+bool FFModel::get_pareto_strategy(
+    size_t index,
+    std::unique_ptr<Graph> &best_graph,
+    std::unordered_map<Node, MachineView> &optimal_views,
+    MemorySearchResult &search_result) {
+  return this->graph_search->get_pareto_strategy(
+      index, best_graph, optimal_views, search_result);
+}
+
 bool FFModel::convert_graph_to_operators(
     Graph const *graph,
     std::unordered_map<Node, MachineView> const &optimal_views) {
@@ -3612,7 +4300,7 @@ bool FFModel::convert_graph_to_operators(
   std::unordered_map<Node, int> todos;
   std::unordered_map<Node, Op *> node_to_op;
   std::vector<Node> queue;
-  for (auto const &it : graph->inEdges) {
+  for (auto const &it : graph->get_in_edges()) {
     auto const &inList = it.second;
     if (inList.size() == 0) {
       queue.push_back(it.first);
@@ -3624,7 +4312,7 @@ bool FFModel::convert_graph_to_operators(
   while (index < queue.size()) {
     Node node = queue[index++];
     assert(node.ptr != NULL);
-    auto const &inList = graph->inEdges.find(node)->second;
+    auto const &inList = graph->get_in_edges(node);
     ParallelTensor inputs[MAX_NUM_INPUTS];
     int num_inputs = 0;
     for (auto const &e : inList) {
@@ -3648,7 +4336,8 @@ bool FFModel::convert_graph_to_operators(
       }
       case OP_AGGREGATE: {
         Aggregate *aggr = (Aggregate *)node.ptr;
-        new_op = new Aggregate(*this, inputs, aggr->n, aggr->lambda_bal, NULL);
+        new_op = new Aggregate(
+            *this, inputs, aggr->n, aggr->lambda_bal, aggr->dropless, NULL);
         break;
       }
       case OP_SPLIT: {
@@ -3767,7 +4456,7 @@ bool FFModel::convert_graph_to_operators(
     node_to_op[node] = new_op;
     operators.push_back(new_op);
     // Decrease the todos
-    auto const &outList = graph->outEdges.find(node)->second;
+    auto const &outList = graph->get_out_edges(node);
     for (auto const &it : outList) {
       todos[it.dstOp] -= 1;
       if (todos[it.dstOp] == 0) {
@@ -3775,7 +4464,7 @@ bool FFModel::convert_graph_to_operators(
       }
     }
   }
-  assert(queue.size() == graph->inEdges.size());
+  assert(queue.size() == graph->get_in_edges().size());
   // Remove the final parallel operators
   while (operators[operators.size() - 1]->is_parallel_op()) {
     Op *op = operators[operators.size() - 1];
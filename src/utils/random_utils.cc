@@ -0,0 +1,23 @@
+#include "flexflow/utils/random_utils.h"
+
+static thread_local std::mt19937 *thread_random_engine = nullptr;
+
+RandomEngineGuard::RandomEngineGuard(std::mt19937 &engine)
+    : prev_engine(thread_random_engine) {
+  thread_random_engine = &engine;
+}
+
+RandomEngineGuard::~RandomEngineGuard() {
+  thread_random_engine = prev_engine;
+}
+
+int randi() {
+  if (thread_random_engine == nullptr) {
+    return std::rand();
+  }
+  return std::uniform_int_distribution<int>(0, RAND_MAX)(*thread_random_engine);
+}
+
+float randf() {
+  return static_cast<float>(randi()) / static_cast<float>(RAND_MAX);
+}
@@ -0,0 +1,140 @@
+#include "flexflow/utils/trace_file.h"
+#include <cassert>
+#include <cstdio>
+
+ChromeTraceFile::ChromeTraceFile(std::string const &filename)
+    : owned_fstream(std::ofstream(filename)) {
+  this->out = &this->owned_fstream.value();
+  this->get_ostream() << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+}
+
+ChromeTraceFile::ChromeTraceFile(std::ostream &s) : out(&s) {
+  this->get_ostream() << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+}
+
+ChromeTraceFile::~ChromeTraceFile() {
+  this->close();
+}
+
+std::ostream &ChromeTraceFile::get_ostream() {
+  assert(!this->closed);
+  return *this->out;
+}
+
+std::pair<int, int>
+    ChromeTraceFile::get_track(std::string const &process_name,
+                               std::string const &thread_name) {
+  auto pit = this->process_ids.find(process_name);
+  if (pit == this->process_ids.end()) {
+    int pid = this->process_ids.size();
+    pit = this->process_ids.emplace(process_name, pid).first;
+    this->add_metadata("process_name",
+                       pid,
+                       0,
+                       "\"name\": \"" + escape(process_name) + "\"");
+    this->add_metadata("process_sort_index",
+                       pid,
+                       0,
+                       "\"sort_index\": " + std::to_string(pid));
+  }
+  int pid = pit->second;
+  auto tit = this->thread_ids.find(std::make_pair(pid, thread_name));
+  if (tit == this->thread_ids.end()) {
+    // tracks are listed in order of first use
+    int tid = this->thread_ids.size();
+    tit = this->thread_ids.emplace(std::make_pair(pid, thread_name), tid).first;
+    this->add_metadata("thread_name",
+                       pid,
+                       tid,
+                       "\"name\": \"" + escape(thread_name) + "\"");
+    this->add_metadata("thread_sort_index",
+                       pid,
+                       tid,
+                       "\"sort_index\": " + std::to_string(tid));
+  }
+  return std::make_pair(pid, tit->second);
+}
+
+void ChromeTraceFile::add_span(std::pair<int, int> const &track,
+                               std::string const &name,
+                               std::string const &category,
+                               double start_ms,
+                               double duration_ms,
+                               std::map<std::string, double> const &args) {
+  char times[96];
+  snprintf(times,
+           sizeof(times),
+           "\"ts\": %.3f, \"dur\": %.3f",
+           start_ms * 1000,
+           duration_ms * 1000);
+  this->start_event();
+  std::ostream &os = this->get_ostream();
+  os << "{\"ph\": \"X\", \"name\": \"" << escape(name) << "\", \"cat\": \""
+     << escape(category) << "\", " << times << ", \"pid\": " << track.first
+     << ", \"tid\": " << track.second;
+  if (!args.empty()) {
+    os << ", \"args\": {";
+    for (auto it = args.begin(); it != args.end(); ++it) {
+      if (it != args.begin()) {
+        os << ", ";
+      }
+      char value[32];
+      snprintf(value, sizeof(value), "%.15g", it->second);
+      os << "\"" << escape(it->first) << "\": " << value;
+    }
+    os << "}";
+  }
+  os << "}";
+}
+
+void ChromeTraceFile::close() {
+  if (this->closed) {
+    return;
+  }
+  this->get_ostream() << "\n]}" << std::endl;
+  this->closed = true;
+  if (this->owned_fstream.has_value()) {
+    this->owned_fstream.value().close();
+  }
+}
+
+void ChromeTraceFile::start_event() {
+  this->get_ostream() << (this->first_event ? "\n" : ",\n");
+  this->first_event = false;
+}
+
+void ChromeTraceFile::add_metadata(char const *kind,
+                                   int pid,
+                                   int tid,
+                                   std::string const &args) {
+  this->start_event();
+  this->get_ostream() << "{\"ph\": \"M\", \"name\": \"" << kind
+                      << "\", \"pid\": " << pid << ", \"tid\": " << tid
+                      << ", \"args\": {" << args << "}}";
+}
+
+std::string ChromeTraceFile::escape(std::string const &s) {
+  std::string result;
+  for (char c : s) {
+    switch (c) {
+      case '"':
+        result += "\\\"";
+        break;
+      case '\\':
+        result += "\\\\";
+        break;
+      case '\n':
+        result += "\\n";
+        break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          result += buf;
+        } else {
+          result += c;
+        }
+    }
+  }
+  return result;
+}
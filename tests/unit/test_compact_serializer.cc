@@ -0,0 +1,46 @@
+#include "flexflow/utils/compact_serializer.h"
+#include "gtest/gtest.h"
+#include <limits>
+
+TEST(compact_serializer, round_trip) {
+  std::vector<uint64_t> unsigned_values = {
+      0, 1, 127, 128, 300, 5000000, std::numeric_limits<uint64_t>::max()};
+  std::vector<int64_t> signed_values = {0,
+                                        -1,
+                                        1,
+                                        -2,
+                                        63,
+                                        -64,
+                                        std::numeric_limits<int64_t>::min(),
+                                        std::numeric_limits<int64_t>::max()};
+  CompactSerializer sez;
+  for (uint64_t value : unsigned_values) {
+    sez.write_varint(value);
+  }
+  for (int64_t value : signed_values) {
+    sez.write_signed_varint(value);
+  }
+  sez.write_bytes("abc", 3);
+
+  CompactDeserializer dez(sez.get_buffer().data(), sez.get_used_bytes());
+  for (uint64_t value : unsigned_values) {
+    EXPECT_EQ(dez.read_varint(), value);
+  }
+  for (int64_t value : signed_values) {
+    EXPECT_EQ(dez.read_signed_varint(), value);
+  }
+  char bytes[3];
+  dez.read_bytes(bytes, 3);
+  EXPECT_EQ(std::string(bytes, 3), "abc");
+  EXPECT_EQ(dez.get_remaining_bytes(), 0);
+}
+
+TEST(compact_serializer, small_values_take_one_byte) {
+  CompactSerializer sez;
+  sez.write_varint(127);
+  sez.write_signed_varint(-64);
+  sez.write_signed_varint(63);
+  EXPECT_EQ(sez.get_used_bytes(), 3);
+  sez.write_varint(128);
+  EXPECT_EQ(sez.get_used_bytes(), 5);
+}
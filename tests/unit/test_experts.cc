@@ -0,0 +1,67 @@
+#include "flexflow/ops/experts.h"
+#include "gtest/gtest.h"
+
+using namespace FlexFlow;
+
+TEST(experts_cpu, forward_matches_dense_layers) {
+  // Two experts, in_dim 2, out_dim 2, one row each
+  float x0[] = {1.0f, 2.0f}, x1[] = {-1.0f, 1.0f};
+  float const *inputs[] = {x0, x1};
+  // kernel[e][c][k]
+  float kernel[] = {1.0f, 0.0f, 0.0f, 1.0f, 2.0f, 1.0f, -1.0f, 1.0f};
+  float bias[] = {0.5f, 0.0f, 0.0f, -3.0f};
+  float y0[2], y1[2];
+  float *outputs[] = {y0, y1};
+
+  Experts::forward_kernel_cpu(
+      inputs, outputs, kernel, bias, 2, AC_MODE_RELU, false, 2, 2, 1);
+  EXPECT_FLOAT_EQ(y0[0], 1.5f);
+  EXPECT_FLOAT_EQ(y0[1], 2.0f);
+  EXPECT_FLOAT_EQ(y1[0], 0.0f);
+  EXPECT_FLOAT_EQ(y1[1], 0.0f);
+
+  Experts::forward_kernel_cpu(
+      inputs, outputs, kernel, bias, 2, AC_MODE_RELU, true, 2, 2, 1);
+  EXPECT_FLOAT_EQ(y0[0] + y0[1], 1.0f);
+  EXPECT_LT(y0[0], y0[1]);
+  EXPECT_FLOAT_EQ(y1[0], 0.5f);
+  EXPECT_FLOAT_EQ(y1[1], 0.5f);
+}
+
+TEST(experts_cpu, backward_masks_and_accumulates) {
+  float x[] = {1.0f, 2.0f};
+  float const *inputs[] = {x};
+  float kernel[] = {1.0f, 0.0f, 0.0f, 1.0f};
+  // The second output channel was clipped by the ReLU
+  float activations_0[] = {3.0f, 0.0f};
+  float const *activations[] = {activations_0};
+  float y_grad[] = {1.0f, 1.0f};
+  float *output_grads[] = {y_grad};
+  float x_grad[] = {0.0f, 0.0f};
+  float *input_grads[] = {x_grad};
+  float kernel_grad[] = {1.0f, 1.0f, 1.0f, 1.0f};
+  float bias_grad[] = {0.0f, 0.0f};
+
+  Experts::backward_kernel_cpu(inputs,
+                               input_grads,
+                               activations,
+                               output_grads,
+                               kernel,
+                               kernel_grad,
+                               bias_grad,
+                               1,
+                               AC_MODE_RELU,
+                               2,
+                               2,
+                               1);
+  EXPECT_FLOAT_EQ(y_grad[1], 0.0f);
+  EXPECT_FLOAT_EQ(bias_grad[0], 1.0f);
+  EXPECT_FLOAT_EQ(bias_grad[1], 0.0f);
+  EXPECT_FLOAT_EQ(x_grad[0], 1.0f);
+  EXPECT_FLOAT_EQ(x_grad[1], 0.0f);
+  // The weight gradients accumulate into the existing values
+  EXPECT_FLOAT_EQ(kernel_grad[0], 2.0f);
+  EXPECT_FLOAT_EQ(kernel_grad[1], 3.0f);
+  EXPECT_FLOAT_EQ(kernel_grad[2], 1.0f);
+  EXPECT_FLOAT_EQ(kernel_grad[3], 1.0f);
+}
@@ -0,0 +1,34 @@
+#include "flexflow/ops/groupby.h"
+#include "gtest/gtest.h"
+
+using namespace FlexFlow;
+
+TEST(group_by, expert_offsets) {
+  int exp_assign[] = {2, 0, 2, 2, 0};
+  int offsets[4];
+  Group_by::get_expert_offsets(exp_assign, 5, 3, offsets);
+  EXPECT_EQ(offsets[0], 0);
+  EXPECT_EQ(offsets[1], 2);
+  EXPECT_EQ(offsets[2], 2);
+  EXPECT_EQ(offsets[3], 5);
+}
+
+TEST(group_by, routing_metrics) {
+  // Three of the four tokens go to the first of three experts
+  int exp_assign[] = {0, 0, 0, 1};
+
+  // alpha 1.5 gives every expert room for two tokens
+  PerfMetrics perf = Group_by::get_routing_metrics(
+      exp_assign, 3, 1, 1.5f, false /*dropless*/, 4);
+  EXPECT_EQ(perf.routed_tokens, 4);
+  EXPECT_EQ(perf.dropped_tokens, 1);
+  EXPECT_FLOAT_EQ(perf.expert_peak_load, 9.0f);
+  // an alpha of at least 2.25 would have dropped no token
+  EXPECT_FLOAT_EQ(perf.max_load_imbalance, 2.25f);
+
+  perf = Group_by::get_routing_metrics(
+      exp_assign, 3, 1, 0.0f, true /*dropless*/, 4);
+  EXPECT_EQ(perf.routed_tokens, 4);
+  EXPECT_EQ(perf.dropped_tokens, 0);
+  EXPECT_FLOAT_EQ(perf.max_load_imbalance, 2.25f);
+}
@@ -0,0 +1,110 @@
+#include "flexflow/simulator.h"
+#include "gtest/gtest.h"
+#include <random>
+
+using namespace FlexFlow;
+
+namespace {
+
+struct LoopResult {
+  float sim_time;
+  std::vector<float> ready_times, run_times;
+};
+
+// Layers of tasks on random GPUs of 4 nodes with 2 GPUs each, connected to
+// the next layer through the network or NVLink, with a few allreduces and
+// device-less barriers; times are multiples of 1/4 so that ties are common
+LoopResult run_random_graph(NetworkedMachineModel *machine,
+                            unsigned seed,
+                            bool segment_transfer,
+                            SimulatorThreadPool *thread_pool) {
+  std::mt19937 gen(seed);
+  TaskManager task_manager(100000);
+  int num_gpus = machine->get_num_gpus();
+  std::vector<SimTask *> prev_layer;
+  for (int l = 0; l < 12; l++) {
+    std::vector<SimTask *> layer;
+    int num_parts = 1 + gen() % num_gpus;
+    for (int j = 0; j < num_parts; j++) {
+      int gpu = gen() % num_gpus;
+      SimTask *task = task_manager.new_barrier_task();
+      task->mem = machine->get_gpu_fb_mem(gpu);
+      task->device = gen() % 8 == 0 ? nullptr : machine->get_gpu(gpu);
+      task->run_time = (gen() % 4) * 0.25f;
+      layer.push_back(task);
+    }
+    for (SimTask *dst : layer) {
+      for (SimTask *src : prev_layer) {
+        if (gen() % 2 == 0) {
+          continue;
+        }
+        std::vector<CommDevice *> path =
+            machine->get_comm_path(src->mem, dst->mem);
+        SimTask *prev = src;
+        for (CommDevice *d : path) {
+          SimTask *comm = task_manager.new_nominal_comm_task();
+          comm->device = d;
+          comm->xfer_size = comm->xfer_left = 1 + gen() % (1 << 20);
+          prev->add_next_task(comm);
+          prev = comm;
+        }
+        prev->add_next_task(dst);
+      }
+    }
+    if (gen() % 3 == 0) {
+      std::vector<int> gpus;
+      for (int gpu = 0; gpu < num_gpus; gpu += 1 + gen() % 2) {
+        gpus.push_back(gpu);
+      }
+      SimTask *allreduce =
+          task_manager.new_allreduce_task(nullptr, gpus, 1 << 20);
+      for (SimTask *task : layer) {
+        task->add_next_task(allreduce);
+      }
+    }
+    prev_layer = layer;
+  }
+
+  LogicalEventLoop event_loop(&task_manager,
+                              machine,
+                              ALLREDUCE_RING,
+                              segment_transfer,
+                              1 << 18,
+                              nullptr,
+                              thread_pool);
+  LoopResult result;
+  result.sim_time = event_loop.run();
+  for (size_t i = 0; i < task_manager.global_task_id; i++) {
+    result.ready_times.push_back(task_manager.tasks[i].ready_time);
+    result.run_times.push_back(task_manager.tasks[i].run_time);
+  }
+  return result;
+}
+
+} // namespace
+
+TEST(logical_event_loop, threads_match_serial_loop) {
+  int num_nodes = 4;
+  std::vector<int> topology(num_nodes * num_nodes, 0);
+  for (int i = 0; i < num_nodes; i++) {
+    for (int j = 0; j < num_nodes; j++) {
+      topology[i * num_nodes + j] = i != j;
+    }
+  }
+  NetworkedMachineModel machine(
+      num_nodes, 2, 0, 0.005f, topology, 1ul << 34, 12.5f * 1024 * 1024);
+  SimulatorThreadPool thread_pool(4);
+  for (unsigned seed = 0; seed < 50; seed++) {
+    for (bool segment_transfer : {false, true}) {
+      LoopResult serial =
+          run_random_graph(&machine, seed, segment_transfer, nullptr);
+      LoopResult threaded =
+          run_random_graph(&machine, seed, segment_transfer, &thread_pool);
+      EXPECT_GT(serial.sim_time, 0.0f);
+      // Bit-identical, not merely close
+      EXPECT_EQ(serial.sim_time, threaded.sim_time);
+      EXPECT_EQ(serial.ready_times, threaded.ready_times);
+      EXPECT_EQ(serial.run_times, threaded.run_times);
+    }
+  }
+}
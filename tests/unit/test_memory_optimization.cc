@@ -0,0 +1,64 @@
+#include "flexflow/memory_optimization.h"
+#include "gtest/gtest.h"
+
+using namespace FlexFlow::PCG;
+
+TEST(liveness_memory_model, chain) {
+  // 0 -> 1 -> 2, all on device 0
+  LivenessMemoryModel liveness;
+  liveness.add_op({0}, 10, 100, {});
+  liveness.add_op({0}, 10, 100, {0});
+  liveness.add_op({0}, 10, 100, {1});
+
+  // The backward pass of op 2 holds all outputs and the gradients of ops 1
+  // and 2
+  EXPECT_EQ(liveness.peak_memory(true).at(0), 30 + 500);
+  // An op only needs its own and its producer's outputs
+  EXPECT_EQ(liveness.peak_memory(false).at(0), 30 + 200);
+}
+
+TEST(liveness_memory_model, per_device) {
+  // 0 -> {1, 2} -> 3, with 1 on device 1 and the others on device 0
+  LivenessMemoryModel liveness;
+  liveness.add_op({0}, 0, 100, {});
+  liveness.add_op({1}, 50, 10, {0});
+  liveness.add_op({0}, 0, 20, {0});
+  liveness.add_op({0}, 0, 1, {1, 2});
+
+  std::unordered_map<int, size_t> inference = liveness.peak_memory(false);
+  // Op 0's outputs are kept until op 2, its last consumer, ran
+  EXPECT_EQ(inference.at(0), 100 + 20);
+  EXPECT_EQ(inference.at(1), 50 + 10);
+
+  std::unordered_map<int, size_t> training = liveness.peak_memory(true);
+  // The backward pass of op 2 holds the outputs and gradients of ops 0 and 2
+  EXPECT_EQ(training.at(0), 100 + 100 + 20 + 20);
+  EXPECT_EQ(training.at(1), 50 + 10 + 10);
+}
+
+namespace {
+struct Strategy {
+  float cost;
+  MemoryUsage mem_cost;
+};
+} // namespace
+
+TEST(prune_to_pareto_front, basic) {
+  std::vector<Strategy> strategies = {
+      {3.0, MemoryUsage(FlexFlow::MemoryUsageType::GLOBAL, 10.0)},
+      {1.0, MemoryUsage(FlexFlow::MemoryUsageType::GLOBAL, 30.0)},
+      {2.0, MemoryUsage(FlexFlow::MemoryUsageType::GLOBAL, 30.0)},
+      {2.0, MemoryUsage(FlexFlow::MemoryUsageType::GLOBAL, 20.0)},
+      {4.0, MemoryUsage(FlexFlow::MemoryUsageType::GLOBAL, 10.0)},
+      {5.0, MemoryUsage(FlexFlow::MemoryUsageType::GLOBAL, 5.0)},
+  };
+  prune_to_pareto_front(strategies);
+
+  std::vector<std::pair<float, float>> front;
+  for (Strategy const &s : strategies) {
+    front.emplace_back(s.cost, s.mem_cost.num);
+  }
+  std::vector<std::pair<float, float>> expected = {
+      {1.0, 30.0}, {2.0, 20.0}, {3.0, 10.0}, {5.0, 5.0}};
+  EXPECT_EQ(front, expected);
+}
@@ -0,0 +1,103 @@
+#include "flexflow/operator_cost_database.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace FlexFlow;
+
+namespace {
+std::string temp_database_file() {
+  char name[] = "/tmp/ff_cost_db_XXXXXX";
+  int fd = mkstemp(name);
+  close(fd);
+  unlink(name);
+  return name;
+}
+} // namespace
+
+TEST(operator_cost_database, persists_across_instances) {
+  std::string filename = temp_database_file();
+  {
+    OperatorCostDatabase db(filename);
+    EXPECT_EQ(db.size(), 0);
+    CostMetrics cm;
+    cm.forward_time = 1.5f;
+    cm.backward_time = 3.0f;
+    cm.weights_memory = 42;
+    db.insert({7, 70}, cm);
+    db.insert({7, 70}, cm);
+    db.insert({8, 80}, cm);
+    EXPECT_EQ(db.size(), 2);
+  }
+  OperatorCostDatabase db(filename);
+  EXPECT_EQ(db.size(), 2);
+  CostMetrics cm;
+  EXPECT_TRUE(db.lookup({7, 70}, cm));
+  EXPECT_FLOAT_EQ(cm.forward_time, 1.5f);
+  EXPECT_FLOAT_EQ(cm.backward_time, 3.0f);
+  EXPECT_EQ(cm.weights_memory, 42);
+  EXPECT_FALSE(db.lookup({9, 90}, cm));
+  unlink(filename.c_str());
+}
+
+TEST(operator_cost_database, ignores_partial_record) {
+  std::string filename = temp_database_file();
+  {
+    OperatorCostDatabase db(filename);
+    db.insert({1, 10}, CostMetrics());
+  }
+  int fd = open(filename.c_str(), O_WRONLY | O_APPEND);
+  char garbage[5] = {1, 2, 3, 4, 5};
+  ASSERT_EQ(write(fd, garbage, sizeof(garbage)), (ssize_t)sizeof(garbage));
+  close(fd);
+  {
+    OperatorCostDatabase db(filename);
+    EXPECT_EQ(db.size(), 1);
+    db.insert({2, 20}, CostMetrics());
+  }
+  OperatorCostDatabase db(filename);
+  EXPECT_EQ(db.size(), 2);
+  CostMetrics cm;
+  EXPECT_TRUE(db.lookup({2, 20}, cm));
+  unlink(filename.c_str());
+}
+
+TEST(operator_cost_database, recovers_from_partial_header) {
+  std::string filename = temp_database_file();
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+  char garbage[3] = {'F', 'F', 'C'};
+  ASSERT_EQ(write(fd, garbage, sizeof(garbage)), (ssize_t)sizeof(garbage));
+  close(fd);
+  {
+    OperatorCostDatabase db(filename);
+    EXPECT_EQ(db.size(), 0);
+    db.insert({3, 30}, CostMetrics());
+  }
+  OperatorCostDatabase db(filename);
+  EXPECT_EQ(db.size(), 1);
+  CostMetrics cm;
+  EXPECT_TRUE(db.lookup({3, 30}, cm));
+  unlink(filename.c_str());
+}
+
+TEST(operator_cost_database, detects_hash_collision) {
+  std::string filename = temp_database_file();
+  CostMetrics cm;
+  cm.forward_time = 1.0f;
+  {
+    OperatorCostDatabase db(filename);
+    db.insert({5, 50}, cm);
+    // Same hash, different check: kept out of the database
+    cm.forward_time = 2.0f;
+    db.insert({5, 51}, cm);
+    EXPECT_EQ(db.size(), 1);
+    EXPECT_FALSE(db.lookup({5, 51}, cm));
+  }
+  OperatorCostDatabase db(filename);
+  EXPECT_EQ(db.size(), 1);
+  EXPECT_FALSE(db.lookup({5, 51}, cm));
+  EXPECT_TRUE(db.lookup({5, 50}, cm));
+  EXPECT_FLOAT_EQ(cm.forward_time, 1.0f);
+  unlink(filename.c_str());
+}
@@ -45,3 +45,39 @@ TEST(select_random, unnormalized_weights) {
   EXPECT_EQ(select_random_determistic(values, weights, 0.5), 2);
   EXPECT_EQ(select_random_determistic(values, weights, 0.9), 3);
 }
+
+TEST(random_engine_guard, reproducible) {
+  std::vector<int> first, second;
+  {
+    std::mt19937 engine(42);
+    RandomEngineGuard guard(engine);
+    for (int i = 0; i < 16; i++) {
+      first.push_back(randi());
+    }
+  }
+  std::rand(); // the global generator does not affect guarded draws
+  {
+    std::mt19937 engine(42);
+    RandomEngineGuard guard(engine);
+    for (int i = 0; i < 16; i++) {
+      second.push_back(randi());
+    }
+  }
+  EXPECT_EQ(first, second);
+  for (int value : first) {
+    EXPECT_GE(value, 0);
+    EXPECT_LE(value, RAND_MAX);
+  }
+}
+
+TEST(random_engine_guard, nested) {
+  std::mt19937 outer_engine(1), inner_engine(2), expected_engine(1);
+  RandomEngineGuard outer(outer_engine);
+  {
+    RandomEngineGuard inner(inner_engine);
+    randi();
+  }
+  // The outer engine is restored and was not drawn from by the inner guard
+  std::uniform_int_distribution<int> dist(0, RAND_MAX);
+  EXPECT_EQ(randi(), dist(expected_engine));
+}
@@ -0,0 +1,72 @@
+#include "flexflow/utils/replica_exchange.h"
+#include "gtest/gtest.h"
+#include <chrono>
+
+namespace {
+
+using State = std::vector<int>;
+
+// A rugged cost over 8 digits in [0, 16) with its minimum 0 at 3, 1, 4, ...
+float rugged_cost(State const &state) {
+  static State const target = {3, 1, 4, 1, 5, 9, 2, 6};
+  float cost = 0.0f;
+  for (size_t i = 0; i < state.size(); i++) {
+    int diff = std::abs(state[i] - target[i]);
+    cost += diff + 2.0f * (diff % 3);
+  }
+  return cost;
+}
+
+float search(State &best, ReplicaExchangeParams const &params) {
+  best = State(8, 0);
+  return replica_exchange_search<State>(
+      best,
+      rugged_cost(best),
+      params,
+      [](int c, State const &current, State &next) {
+        next = current;
+        next[randi() % next.size()] = randi() % 16;
+      },
+      [](int c, State const &next) {
+        // Let the chains interleave differently from run to run
+        if (randi() % 7 == c) {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        return rugged_cost(next);
+      });
+}
+
+ReplicaExchangeParams make_params(unsigned seed) {
+  ReplicaExchangeParams params;
+  params.num_chains = 4;
+  params.budget = 2000;
+  params.alpha = 0.5f;
+  params.seed = seed;
+  params.exchange_interval = 50;
+  params.reset_span = 20;
+  return params;
+}
+
+} // namespace
+
+TEST(replica_exchange, seed_reproduces_result) {
+  State first;
+  float first_cost = search(first, make_params(7));
+  EXPECT_EQ(first_cost, rugged_cost(first));
+  EXPECT_LT(first_cost, rugged_cost(State(8, 0)));
+  for (int run = 0; run < 4; run++) {
+    State again;
+    EXPECT_EQ(search(again, make_params(7)), first_cost);
+    EXPECT_EQ(again, first);
+  }
+}
+
+TEST(replica_exchange, single_chain) {
+  ReplicaExchangeParams params = make_params(3);
+  params.num_chains = 1;
+  State first, second;
+  float cost = search(first, params);
+  EXPECT_EQ(search(second, params), cost);
+  EXPECT_EQ(first, second);
+  EXPECT_LE(cost, rugged_cost(State(8, 0)));
+}
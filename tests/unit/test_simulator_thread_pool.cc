@@ -0,0 +1,18 @@
+#include "flexflow/simulator.h"
+#include "gtest/gtest.h"
+
+using namespace FlexFlow;
+
+TEST(simulator_thread_pool, runs_every_iteration_once) {
+  for (int num_threads = 1; num_threads <= 4; num_threads++) {
+    SimulatorThreadPool pool(num_threads);
+    // The workers are reused across loops
+    for (int n = 0; n < 64; n++) {
+      std::vector<int> counts(n, 0);
+      pool.parallel_for(n, [&](int i) { counts[i]++; });
+      for (int i = 0; i < n; i++) {
+        EXPECT_EQ(counts[i], 1);
+      }
+    }
+  }
+}
@@ -0,0 +1,616 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fits the latency and bandwidth of the communication devices of the
+// EnhancedMachineModel (--machine-model-version 1) to this host. Copies of
+// growing sizes are timed within a socket (membus), from the memory of
+// another socket (upi) and through a TCP connection over loopback (nic, a
+// best case for the network), and each device gets the line
+// time = latency + size / bandwidth whose largest relative error over them
+// is the smallest. That line is end to end, so it is then spread over the
+// devices of the path the simulator routes the same copy through (upi and
+// nic are chained OUT and IN devices). The fitted numbers replace those of a
+// base config file, and the transfers are simulated again with the resulting machine model and
+// compared to what was measured. Linux only: sockets are the NUMA nodes of
+// /sys/devices/system/node. Devices that cannot be measured here (PCI-e and
+// NVLink, or UPI on a single socket) keep the numbers of the base file.
+
+#include "flexflow/simulator.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <queue>
+#include <sstream>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace FlexFlow;
+
+namespace {
+
+struct CalibrationConfig {
+  std::string base_file = "machine_config_example";
+  std::string output_file = "machine_config_calibrated";
+  size_t min_size = 4 << 10;
+  size_t max_size = 64 << 20;
+  // memory cycled through by the copies, larger than the caches
+  size_t pool_size = 512 << 20;
+  int repetitions = 10;
+  // relative error allowed between simulated and measured copies
+  float tolerance = 0.15f;
+  bool network = true;
+};
+
+// Time of a copy of size bytes, in ms
+struct Sample {
+  size_t size;
+  double time;
+};
+
+struct LinkFit {
+  double latency;   // ms
+  double bandwidth; // B/ms
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// CPUs of every NUMA node, from /sys/devices/system/node/node<i>/cpulist
+std::vector<std::vector<int>> get_numa_nodes() {
+  std::vector<std::vector<int>> nodes;
+  for (int i = 0;; i++) {
+    std::ifstream cpulist("/sys/devices/system/node/node" +
+                          std::to_string(i) + "/cpulist");
+    if (!cpulist) {
+      break;
+    }
+    std::vector<int> cpus;
+    std::string range;
+    while (std::getline(cpulist, range, ',')) {
+      int first = 0, last = 0;
+      int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+      if (n < 1) {
+        continue;
+      }
+      for (int cpu = first; cpu <= (n == 2 ? last : first); cpu++) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      nodes.push_back(cpus);
+    }
+  }
+  if (nodes.empty()) {
+    // no NUMA information: a single socket with every CPU
+    std::vector<int> cpus(std::thread::hardware_concurrency());
+    for (size_t i = 0; i < cpus.size(); i++) {
+      cpus[i] = i;
+    }
+    nodes.push_back(cpus);
+  }
+  return nodes;
+}
+
+// Runs fn on a thread pinned to cpus; memory the thread touches first is
+// allocated on their NUMA node
+void run_on_cpus(std::vector<int> const &cpus, std::function<void()> fn) {
+  std::thread worker([&]() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      CPU_SET(cpu, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    fn();
+  });
+  worker.join();
+}
+
+std::vector<size_t> get_sizes(CalibrationConfig const &config) {
+  std::vector<size_t> sizes;
+  for (size_t size = config.min_size; size <= config.max_size; size *= 4) {
+    sizes.push_back(size);
+  }
+  return sizes;
+}
+
+// Copies from src_cpus' memory into a buffer of dst_cpus, on dst_cpus; the
+// best of the repetitions is kept. Every copy reads and writes parts of the
+// buffers that the previous copies did not touch, so that it goes to memory
+// rather than to the caches, as the transfers of tensors do
+std::vector<Sample> measure_memcpy(CalibrationConfig const &config,
+                                   std::vector<int> const &src_cpus,
+                                   std::vector<int> const &dst_cpus) {
+  std::vector<Sample> samples;
+  size_t pool_size = std::max(config.pool_size, 2 * config.max_size);
+  std::unique_ptr<char[]> src(new char[pool_size]);
+  std::unique_ptr<char[]> dst(new char[pool_size]);
+  run_on_cpus(src_cpus, [&]() { memset(src.get(), 1, pool_size); });
+  run_on_cpus(dst_cpus, [&]() {
+    memset(dst.get(), 0, pool_size);
+    size_t offset = 0;
+    for (size_t size : get_sizes(config)) {
+      double best = INFINITY;
+      for (int r = 0; r < config.repetitions; r++) {
+        if (offset + size > pool_size) {
+          offset = 0;
+        }
+        Clock::time_point start = Clock::now();
+        memcpy(dst.get() + offset, src.get() + offset, size);
+        best = std::min(best, elapsed_ms(start));
+        offset += size;
+      }
+      samples.push_back({size, best});
+    }
+  });
+  return samples;
+}
+
+bool send_all(int fd, char const *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, 0);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool recv_all(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = recv(fd, data, size, 0);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Sends every message to a server thread over a TCP connection on
+// 127.0.0.1, which acknowledges it with a single byte; a message takes from
+// the first byte sent to the acknowledgement
+std::vector<Sample> measure_loopback(CalibrationConfig const &config) {
+  std::vector<Sample> samples;
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  assert(listener >= 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t addr_len = sizeof(addr);
+  if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listener, 1) != 0 ||
+      getsockname(listener, (sockaddr *)&addr, &addr_len) != 0) {
+    perror("loopback benchmark");
+    close(listener);
+    return samples;
+  }
+  std::thread server([&]() {
+    int fd = accept(listener, nullptr, nullptr);
+    assert(fd >= 0);
+    std::unique_ptr<char[]> buffer(new char[config.max_size]);
+    uint64_t size = 0;
+    char ack = 1;
+    while (recv_all(fd, (char *)&size, sizeof(size)) && size > 0) {
+      if (!recv_all(fd, buffer.get(), size) || !send_all(fd, &ack, 1)) {
+        break;
+      }
+    }
+    close(fd);
+  });
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  assert(fd >= 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  int connected = connect(fd, (sockaddr *)&addr, sizeof(addr));
+  assert(connected == 0);
+  std::unique_ptr<char[]> buffer(new char[config.max_size]);
+  memset(buffer.get(), 1, config.max_size);
+  for (size_t size : get_sizes(config)) {
+    double best = INFINITY;
+    for (int r = 0; r < config.repetitions; r++) {
+      uint64_t header = size;
+      char ack = 0;
+      Clock::time_point start = Clock::now();
+      if (!send_all(fd, (char const *)&header, sizeof(header)) ||
+          !send_all(fd, buffer.get(), size) || !recv_all(fd, &ack, 1)) {
+        perror("loopback benchmark");
+        break;
+      }
+      best = std::min(best, elapsed_ms(start));
+    }
+    samples.push_back({size, best});
+  }
+  uint64_t done = 0;
+  send_all(fd, (char const *)&done, sizeof(done));
+  close(fd);
+  server.join();
+  close(listener);
+  return samples;
+}
+
+// Largest relative error of time = latency + slope * size over samples
+double max_relative_error(std::vector<Sample> const &samples,
+                          double latency,
+                          double slope) {
+  double error = 0.0;
+  for (Sample const &s : samples) {
+    double predicted = latency + slope * s.size;
+    error = std::max(error, std::abs(predicted - s.time) / s.time);
+  }
+  return error;
+}
+
+// The line time = latency + size / bandwidth with the smallest largest
+// relative error, since that is the error the simulator will make. The error
+// is convex in (latency, 1 / bandwidth), so each is found by a ternary search
+LinkFit fit_link(std::vector<Sample> const &samples) {
+  assert(!samples.empty());
+  double max_time = 0.0, max_slope = 0.0;
+  for (Sample const &s : samples) {
+    max_time = std::max(max_time, s.time);
+    max_slope = std::max(max_slope, s.time / s.size);
+  }
+  auto best_latency = [&](double slope, double *error) {
+    double lo = 0.0, hi = max_time;
+    for (int i = 0; i < 100; i++) {
+      double m1 = lo + (hi - lo) / 3, m2 = hi - (hi - lo) / 3;
+      if (max_relative_error(samples, m1, slope) <
+          max_relative_error(samples, m2, slope)) {
+        hi = m2;
+      } else {
+        lo = m1;
+      }
+    }
+    *error = max_relative_error(samples, lo, slope);
+    return lo;
+  };
+  double lo = 0.0, hi = max_slope, error1, error2;
+  for (int i = 0; i < 100; i++) {
+    double m1 = lo + (hi - lo) / 3, m2 = hi - (hi - lo) / 3;
+    best_latency(m1, &error1);
+    best_latency(m2, &error2);
+    if (error1 < error2) {
+      hi = m2;
+    } else {
+      lo = m1;
+    }
+  }
+  double latency = best_latency(lo, &error1);
+  assert(lo > 0);
+  return {latency, 1.0 / lo};
+}
+
+// Config values of a link that make the simulated path reproduce the
+// measured line. The machine model splits upi and nic into chained OUT and IN
+// devices, each charged its own latency and size / bandwidth, and a route
+// may also cross devices of other types, so the measured line is spread over
+// the devices of the link in path. written is what the config holds for the
+// link, from which the devices of path were built.
+LinkFit fit_to_path(std::vector<CommDevice *> const &path,
+                    std::vector<CommDevice::CommDevType> const &link_types,
+                    LinkFit const &written,
+                    LinkFit const &measured) {
+  double link_latency = 0.0, link_slope = 0.0;
+  double other_latency = 0.0, other_slope = 0.0;
+  for (CommDevice const *device : path) {
+    bool in_link = std::find(link_types.begin(),
+                             link_types.end(),
+                             device->comm_type) != link_types.end();
+    (in_link ? link_latency : other_latency) += device->latency;
+    (in_link ? link_slope : other_slope) += 1.0 / device->bandwidth;
+  }
+  assert(link_latency > 0.0 && link_slope > 0.0);
+  // Both sums scale linearly with the latency and 1 / bandwidth of the config
+  double latency = std::max(0.0, measured.latency - other_latency);
+  double slope = 1.0 / measured.bandwidth - other_slope;
+  if (slope <= 0.0) {
+    fprintf(stderr,
+            "warning: the other devices of the path are slower than the "
+            "measured copies; fitting the link alone\n");
+    slope = 1.0 / measured.bandwidth;
+  }
+  return {written.latency * latency / link_latency,
+          written.bandwidth * link_slope / slope};
+}
+
+// Same event loop as Simulator::simulate_runtime, over a single transfer
+// through path
+float simulate_transfer(TaskManager &task_manager,
+                        std::vector<CommDevice *> const &path,
+                        size_t size) {
+  task_manager.reset();
+  SimTask *prev = nullptr;
+  for (CommDevice *device : path) {
+    SimTask *task = task_manager.new_comm_task("copy", device, size);
+    if (prev != nullptr) {
+      prev->add_next_task(task);
+    }
+    prev = task;
+  }
+  std::priority_queue<SimTask *, std::vector<SimTask *>, SimTaskCompare>
+      ready_queue;
+  for (size_t i = 0; i < task_manager.global_task_id; i++) {
+    if (task_manager.tasks[i].counter == 0) {
+      ready_queue.push(&task_manager.tasks[i]);
+    }
+  }
+  float sim_time = 0.0f;
+  std::map<Device *, float> device_times;
+  while (!ready_queue.empty()) {
+    SimTask *cur_task = ready_queue.top();
+    ready_queue.pop();
+    float start_time =
+        std::max(device_times[cur_task->device], cur_task->ready_time);
+    float end_time = start_time + cur_task->run_time;
+    device_times[cur_task->device] = end_time;
+    sim_time = std::max(sim_time, end_time);
+    for (size_t i = 0; i < cur_task->num_next_tasks; i++) {
+      SimTask *next = cur_task->next_tasks[i];
+      next->ready_time = std::max(next->ready_time, end_time);
+      if (--next->counter == 0) {
+        ready_queue.push(next);
+      }
+    }
+  }
+  return sim_time;
+}
+
+// Copies the base config file with the given keys replaced, or appended if
+// it does not have them
+void write_machine_config(std::string const &base_file,
+                          std::string const &output_file,
+                          std::map<std::string, std::string> values) {
+  std::ifstream base(base_file);
+  if (!base) {
+    std::cerr << "Cannot open the base machine config " << base_file
+              << std::endl;
+    exit(1);
+  }
+  std::ofstream output(output_file);
+  output << "# Calibrated by machine_calibration from " << base_file << "\n";
+  std::string line;
+  while (std::getline(base, line)) {
+    std::istringstream iss(line);
+    std::string key;
+    iss >> key;
+    auto it = values.find(key);
+    if (line[0] != '#' && it != values.end()) {
+      output << key << " = " << it->second << "\n";
+      values.erase(it);
+    } else {
+      output << line << "\n";
+    }
+  }
+  for (auto const &kv : values) {
+    output << kv.first << " = " << kv.second << "\n";
+  }
+}
+
+double read_config_value(std::string const &file, std::string const &key) {
+  std::ifstream input(file);
+  std::string line;
+  while (std::getline(input, line)) {
+    std::istringstream iss(line);
+    std::string name, equals;
+    double value;
+    if (line[0] != '#' && iss >> name >> equals >> value && name == key) {
+      return value;
+    }
+  }
+  return 0.0;
+}
+
+std::string to_string(double value) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.9g", value);
+  return buffer;
+}
+
+// Simulated against measured times; returns the largest relative error
+float validate(char const *name,
+               TaskManager &task_manager,
+               std::vector<CommDevice *> const &path,
+               std::vector<Sample> const &samples) {
+  float max_error = 0.0f;
+  printf("%-8s %14s %14s %14s %8s\n",
+         name,
+         "size(B)",
+         "measured(ms)",
+         "simulated(ms)",
+         "error");
+  for (Sample const &s : samples) {
+    float simulated = simulate_transfer(task_manager, path, s.size);
+    float error = std::abs(simulated - s.time) / s.time;
+    max_error = std::max(max_error, error);
+    printf("%-8s %14zu %14.6f %14.6f %7.1f%%\n",
+           "",
+           s.size,
+           s.time,
+           simulated,
+           100 * error);
+  }
+  return max_error;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  CalibrationConfig config;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--base") && i + 1 < argc) {
+      config.base_file = argv[++i];
+    } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+      config.output_file = argv[++i];
+    } else if (!strcmp(argv[i], "--min-size") && i + 1 < argc) {
+      config.min_size = atoll(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-size") && i + 1 < argc) {
+      config.max_size = atoll(argv[++i]);
+    } else if (!strcmp(argv[i], "--pool-size") && i + 1 < argc) {
+      config.pool_size = atoll(argv[++i]);
+    } else if (!strcmp(argv[i], "--repetitions") && i + 1 < argc) {
+      config.repetitions = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+      config.tolerance = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--no-network")) {
+      config.network = false;
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--base <machine config>] [--output <machine config>]"
+                << " [--min-size <bytes>] [--max-size <bytes>]"
+                << " [--pool-size <bytes>]"
+                << " [--repetitions <n>] [--tolerance <relative error>]"
+                << " [--no-network]" << std::endl;
+      return 1;
+    }
+  }
+  assert(config.min_size > 0 && config.min_size <= config.max_size);
+
+  std::vector<std::vector<int>> sockets = get_numa_nodes();
+  std::map<std::string, std::string> values;
+  values["num_sockets_per_node"] = std::to_string(sockets.size());
+  values["num_cpus_per_socket"] = std::to_string(sockets[0].size());
+  // Bandwidths are written in GB/s, which the machine model multiplies by
+  // 1024 * 1024 to get B/ms
+  auto set_link = [&](std::string const &prefix, LinkFit const &fit) {
+    values[prefix + "_latency"] = to_string(fit.latency);
+    values[prefix + "_bandwidth"] = to_string(fit.bandwidth / (1024 * 1024));
+    printf("%-8s latency(%.6f ms) bandwidth(%.3f GB/s)\n",
+           prefix.c_str(),
+           fit.latency,
+           fit.bandwidth / (1024 * 1024));
+  };
+
+  printf("%zu socket(s) with %zu CPUs each\n",
+         sockets.size(),
+         sockets[0].size());
+  std::vector<Sample> membus_samples =
+      measure_memcpy(config, sockets[0], sockets[0]);
+  LinkFit membus = fit_link(membus_samples);
+  set_link("membus", membus);
+  std::vector<Sample> upi_samples;
+  LinkFit upi;
+  if (sockets.size() > 1) {
+    upi_samples = measure_memcpy(config, sockets[1], sockets[0]);
+    upi = fit_link(upi_samples);
+    set_link("upi", upi);
+  } else {
+    printf("upi      single socket, kept from %s\n", config.base_file.c_str());
+  }
+  std::vector<Sample> nic_samples;
+  LinkFit nic;
+  if (config.network) {
+    nic_samples = measure_loopback(config);
+    if (!nic_samples.empty()) {
+      nic = fit_link(nic_samples);
+      set_link("nic", nic);
+    }
+  }
+  write_machine_config(config.base_file, config.output_file, values);
+
+  // The lines above are end to end; spread them over the devices of the
+  // paths the simulator routes the same copies through
+  bool check_nic = !nic_samples.empty() &&
+                   read_config_value(config.output_file, "num_nodes") > 1;
+  // socket 0 of node 0 to socket 0 of node 1
+  int remote_socket = sockets.size();
+  if (!upi_samples.empty() || check_nic) {
+    printf("\nPer device of the simulated paths:\n");
+    EnhancedMachineModel machine(config.output_file, 0 /*capacity*/);
+    if (!upi_samples.empty()) {
+      set_link("upi",
+               fit_to_path(machine.get_comm_path(machine.get_sys_mem(0),
+                                                 machine.get_sys_mem(1)),
+                           {CommDevice::UPI_OUT_COMM, CommDevice::UPI_IN_COMM},
+                           upi,
+                           upi));
+    }
+    if (check_nic) {
+      set_link(
+          "nic",
+          fit_to_path(machine.get_comm_path(machine.get_sys_mem(0),
+                                            machine.get_sys_mem(remote_socket)),
+                      {CommDevice::NIC_OUT_COMM, CommDevice::NIC_IN_COMM},
+                      nic,
+                      nic));
+    }
+    write_machine_config(config.base_file, config.output_file, values);
+  }
+  printf("Wrote %s\n\n", config.output_file.c_str());
+
+  // Simulate the measured copies with the calibrated machine model
+  EnhancedMachineModel machine(config.output_file, 0 /*capacity*/);
+  TaskManager task_manager(1024);
+  float max_error = 0.0f;
+  // Copies within a socket are free in the machine model (the source and
+  // target memories are the same), so membus is checked on its own
+  float membus_latency = read_config_value(config.output_file,
+                                          "membus_latency");
+  float membus_bandwidth = read_config_value(config.output_file,
+                                            "membus_bandwidth");
+  CommDevice membus_device("MEMBUS 0",
+                           CommDevice::MEMBUS_COMM,
+                           0,
+                           0,
+                           0,
+                           membus_latency,
+                           membus_bandwidth * 1024 * 1024);
+  max_error = std::max(
+      max_error,
+      validate("membus", task_manager, {&membus_device}, membus_samples));
+  if (!upi_samples.empty()) {
+    max_error = std::max(max_error,
+                         validate("upi",
+                                  task_manager,
+                                  machine.get_comm_path(machine.get_sys_mem(0),
+                                                        machine.get_sys_mem(1)),
+                                  upi_samples));
+  }
+  if (check_nic) {
+    max_error =
+        std::max(max_error,
+                 validate("nic",
+                          task_manager,
+                          machine.get_comm_path(machine.get_sys_mem(0),
+                                                machine.get_sys_mem(
+                                                    remote_socket)),
+                          nic_samples));
+  }
+  printf("\nLargest error %.1f%% (tolerance %.1f%%)\n",
+         100 * max_error,
+         100 * config.tolerance);
+  return max_error <= config.tolerance ? 0 : 2;
+}
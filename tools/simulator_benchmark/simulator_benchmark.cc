@@ -0,0 +1,191 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how many task graphs per second the simulator can build and
+// simulate, with the TaskManager and the LogicalEventLoop of
+// LogicalTaskgraphBasedSimulator::simulate_runtime on a NetworkedMachineModel.
+// The task graph is the one simulate_runtime builds for a fixed PCG: a chain
+// of layers partitioned over all GPUs, where every part of a layer reads two
+// parts of the previous layer and the weights of every layer are allreduced
+// after the backward pass. Operator costs are fixed, since measuring them
+// needs a GPU and a Legion runtime.
+
+#include "flexflow/simulator.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+using namespace FlexFlow;
+
+namespace {
+
+struct BenchmarkConfig {
+  int num_layers = 100;
+  int num_nodes = 2;
+  int num_gpus_per_node = 4;
+  int num_iterations = 1000;
+  int num_threads = 1;
+  bool segment_transfer = false;
+};
+
+// Same as LogicalTaskgraphBasedSimulator::add_task_dependencies_with_xfer
+void add_task_dependencies_with_xfer(TaskManager &task_manager,
+                                     MachineModel *machine,
+                                     SimTask *src_task,
+                                     SimTask *dst_task,
+                                     size_t message_size) {
+  std::vector<CommDevice *> path =
+      machine->get_comm_path(src_task->mem, dst_task->mem);
+  if (path.empty()) {
+    src_task->add_next_task(dst_task);
+    return;
+  }
+  SimTask *prev = src_task;
+  for (CommDevice *d : path) {
+    SimTask *task = task_manager.new_nominal_comm_task();
+    task->device = d;
+    task->run_time = 0;
+    task->xfer_size = message_size;
+    task->xfer_left = message_size;
+    prev->add_next_task(task);
+    prev = task;
+  }
+  prev->add_next_task(dst_task);
+}
+
+// Steps 1 to 3 of LogicalTaskgraphBasedSimulator::simulate_runtime
+void build_task_graph(TaskManager &task_manager,
+                      BenchmarkConfig const &config,
+                      MachineModel *machine) {
+  int num_parts = machine->get_num_gpus();
+  std::vector<int> gpus;
+  for (int p = 0; p < num_parts; p++) {
+    gpus.push_back(p);
+  }
+  std::vector<SimTask *> prev_forward, prev_backward;
+  for (int l = 0; l < config.num_layers; l++) {
+    std::vector<SimTask *> forward, backward;
+    for (int p = 0; p < num_parts; p++) {
+      SimTask *fwd = task_manager.new_barrier_task();
+      fwd->device = machine->get_gpu(p);
+      fwd->mem = machine->get_gpu_fb_mem(p);
+      fwd->run_time = 1.0f;
+      SimTask *bwd = task_manager.new_barrier_task();
+      bwd->device = machine->get_gpu(p);
+      bwd->mem = machine->get_gpu_fb_mem(p);
+      bwd->run_time = 2.0f;
+      fwd->add_next_task(bwd);
+      forward.push_back(fwd);
+      backward.push_back(bwd);
+    }
+    SimTask *allreduce =
+        task_manager.new_allreduce_task(nullptr, gpus, 4 << 20);
+    for (SimTask *bwd : backward) {
+      bwd->add_next_task(allreduce);
+    }
+    if (l > 0) {
+      for (int p = 0; p < num_parts; p++) {
+        for (int q : {p, (p + 1) % num_parts}) {
+          add_task_dependencies_with_xfer(
+              task_manager, machine, prev_forward[q], forward[p], 1 << 20);
+          add_task_dependencies_with_xfer(
+              task_manager, machine, backward[p], prev_backward[q], 1 << 20);
+        }
+      }
+    }
+    prev_forward = forward;
+    prev_backward = backward;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchmarkConfig config;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--layers") && i + 1 < argc) {
+      config.num_layers = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--nodes") && i + 1 < argc) {
+      config.num_nodes = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--gpus-per-node") && i + 1 < argc) {
+      config.num_gpus_per_node = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      config.num_iterations = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      config.num_threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--segment-transfer")) {
+      config.segment_transfer = true;
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--layers <n>] [--nodes <n>] [--gpus-per-node <n>]"
+                << " [--iterations <n>] [--threads <n>] [--segment-transfer]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // Fully connected nodes, as in the default NetworkedMachineModel
+  std::vector<int> topology(config.num_nodes * config.num_nodes, 0);
+  for (int i = 0; i < config.num_nodes; i++) {
+    for (int j = 0; j < config.num_nodes; j++) {
+      topology[i * config.num_nodes + j] = i != j;
+    }
+  }
+  NetworkedMachineModel machine(config.num_nodes,
+                                config.num_gpus_per_node,
+                                0,
+                                0.005f,
+                                topology,
+                                16ul << 30,
+                                12.5f * 1024 * 1024);
+  std::unique_ptr<SimulatorThreadPool> thread_pool;
+  if (config.num_threads > 1) {
+    thread_pool.reset(new SimulatorThreadPool(config.num_threads));
+  }
+  TaskManager task_manager(1024 * 1024);
+
+  float sim_time = 0.0f;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < config.num_iterations; i++) {
+    task_manager.reset();
+    build_task_graph(task_manager, config, &machine);
+    LogicalEventLoop event_loop(&task_manager,
+                                &machine,
+                                ALLREDUCE_RING,
+                                config.segment_transfer,
+                                1 << 20,
+                                nullptr,
+                                thread_pool.get());
+    sim_time = event_loop.run();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  printf("layers(%d) gpus(%d) threads(%d) tasks(%zu) "
+         "simulated_time(%.4lf ms)\n",
+         config.num_layers,
+         machine.get_num_gpus(),
+         config.num_threads,
+         task_manager.global_task_id,
+         sim_time);
+  printf("%d simulations in %.3lf s: %.1lf simulations/s\n",
+         config.num_iterations,
+         elapsed.count(),
+         config.num_iterations / elapsed.count());
+  return 0;
+}
@@ -0,0 +1,214 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares network topologies of about the same size by the communication
+// patterns the search trades off against each other: an allreduce over all
+// GPUs with each collective algorithm (data parallelism) and an all-to-all
+// (expert and attribute parallelism). Every inter-node transfer is spread
+// over its ECMP routes by their probabilities, and a phase takes as long as
+// its most loaded link, GPU or NVLink, plus one network latency per hop of
+// its longest route and step. The best algorithm, and how much of a
+// data-parallel step is spent communicating, differ between topologies.
+
+#include "flexflow/simulator.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+
+using namespace FlexFlow;
+
+namespace {
+
+struct BenchmarkConfig {
+  int num_gpus_per_node = 4;
+  size_t message_size = 64 << 20;
+  float link_bandwidth = 12.5f; // GB/s
+  float network_latency = 0.001f;
+};
+
+struct NamedTopology {
+  std::string name;
+  std::unique_ptr<NetworkTopologyGenerator> generator;
+};
+
+std::vector<NamedTopology> make_topologies() {
+  std::vector<NamedTopology> topologies;
+  auto add = [&](std::string const &name, NetworkTopologyGenerator *g) {
+    topologies.push_back({name, std::unique_ptr<NetworkTopologyGenerator>(g)});
+  };
+  add("bigswitch(32)", new BigSwitchNetworkTopologyGenerator(32));
+  add("fattree(k=4,os=2)", new FatTreeTopologyGenerator(4, 2));
+  add("fattree(k=4,os=4)", new FatTreeTopologyGenerator(4, 4));
+  add("dragonfly(a=4,p=2,h=1)", new DragonflyTopologyGenerator(4, 2, 1));
+  add("dragonfly(a=2,p=4,h=2)", new DragonflyTopologyGenerator(2, 4, 2));
+  add("torus(4x8)", new TorusTopologyGenerator({4, 8}));
+  add("torus(2x4x4)", new TorusTopologyGenerator({2, 4, 4}));
+  return topologies;
+}
+
+// Time of one phase of concurrent transfers on an idle network
+float phase_time(NetworkedMachineModel *machine,
+                 CollectivePhase const &phase) {
+  std::map<CommDevice *, float> link_load;
+  std::map<int, float> gpu_egress, gpu_ingress;
+  size_t max_hops = 0;
+  for (CollectivePhase::Transfer const &t : phase.transfers) {
+    int src_node = machine->get_gpu(t.src_gpu)->node_id;
+    int dst_node = machine->get_gpu(t.dst_gpu)->node_id;
+    if (src_node == dst_node) {
+      gpu_egress[t.src_gpu] += t.size;
+      gpu_ingress[t.dst_gpu] += t.size;
+      continue;
+    }
+    EcmpRoutes const &routes =
+        machine->get_nominal_device(src_node, dst_node)->get_all_routes();
+    float prev_cdf = 0.0f;
+    for (size_t i = 0; i < routes.second.size(); i++) {
+      float chance = routes.first[i] - prev_cdf;
+      prev_cdf = routes.first[i];
+      for (CommDevice *link : routes.second[i]) {
+        link_load[link] += chance * t.size;
+      }
+      max_hops = std::max(max_hops, routes.second[i].size());
+    }
+  }
+  float busiest = 0.0f;
+  for (auto const &kv : link_load) {
+    busiest = std::max(busiest, kv.second / kv.first->bandwidth);
+  }
+  for (auto const *gpu_load : {&gpu_egress, &gpu_ingress}) {
+    for (auto const &kv : *gpu_load) {
+      busiest = std::max(busiest,
+                         kv.second / machine->get_intra_node_gpu_bandwidth());
+    }
+  }
+  return phase.num_steps * max_hops * machine->get_inter_node_gpu_latency() +
+         busiest;
+}
+
+float collective_time(NetworkedMachineModel *machine,
+                      std::vector<CollectivePhase> const &phases) {
+  float total = 0.0f;
+  for (CollectivePhase const &phase : phases) {
+    total += phase_time(machine, phase);
+  }
+  return total;
+}
+
+// Every GPU sends message_size / n bytes to every other GPU at once
+std::vector<CollectivePhase> plan_all_to_all(std::vector<int> const &gpus,
+                                             size_t message_size) {
+  CollectivePhase phase;
+  phase.num_steps = 1;
+  for (int src : gpus) {
+    for (int dst : gpus) {
+      if (src != dst) {
+        phase.transfers.push_back({src, dst, message_size / gpus.size()});
+      }
+    }
+  }
+  return {phase};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchmarkConfig config;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--gpus-per-node") && i + 1 < argc) {
+      config.num_gpus_per_node = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--message-size") && i + 1 < argc) {
+      config.message_size = atoll(argv[++i]);
+    } else if (!strcmp(argv[i], "--link-bandwidth") && i + 1 < argc) {
+      config.link_bandwidth = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--network-latency") && i + 1 < argc) {
+      config.network_latency = atof(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--gpus-per-node <n>] [--message-size <bytes>]"
+                << " [--link-bandwidth <GB/s>] [--network-latency <ms>]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<std::pair<std::string, AllReduceAlgorithm>> algorithms = {
+      {"ring", ALLREDUCE_RING},
+      {"tree", ALLREDUCE_TREE},
+      {"hierarchical", ALLREDUCE_HIERARCHICAL},
+      {"ps", ALLREDUCE_PARAMETER_SERVER}};
+
+  printf("message_size(%zu B) gpus_per_node(%d) link_bandwidth(%.2f GB/s)\n",
+         config.message_size,
+         config.num_gpus_per_node,
+         config.link_bandwidth);
+  printf("%-24s %6s %6s", "topology", "nodes", "links");
+  for (auto const &a : algorithms) {
+    printf(" %12s", a.first.c_str());
+  }
+  printf(" %12s %12s %14s %10s\n", "best", "auto", "all-to-all", "route(ms)");
+
+  for (NamedTopology const &topology : make_topologies()) {
+    ConnectionMatrix conn = topology.generator->generate_topology();
+    int num_nodes = topology.generator->get_num_nodes();
+    int num_links = 0;
+    for (int c : conn) {
+      num_links += c;
+    }
+    NetworkedMachineModel machine(num_nodes,
+                                  config.num_gpus_per_node,
+                                  topology.generator->get_num_switches(),
+                                  config.network_latency,
+                                  conn,
+                                  0 /*capacity*/,
+                                  config.link_bandwidth * 1024 * 1024);
+    std::vector<int> gpus(machine.get_num_gpus());
+    for (size_t i = 0; i < gpus.size(); i++) {
+      gpus[i] = i;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    printf("%-24s %6d %6d", topology.name.c_str(), num_nodes, num_links / 2);
+    std::string best;
+    float best_time = 0.0f;
+    for (auto const &a : algorithms) {
+      float time = collective_time(
+          &machine,
+          plan_allreduce(a.second, gpus, config.message_size, &machine));
+      printf(" %12.3f", time);
+      if (best.empty() || time < best_time) {
+        best = a.first;
+        best_time = time;
+      }
+    }
+    float auto_time = collective_time(
+        &machine,
+        plan_allreduce(ALLREDUCE_AUTO, gpus, config.message_size, &machine));
+    float all_to_all_time =
+        collective_time(&machine, plan_all_to_all(gpus, config.message_size));
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    printf(" %12s %12.3f %14.3f %10.1f\n",
+           best.c_str(),
+           auto_time,
+           all_to_all_time,
+           elapsed.count());
+  }
+  return 0;
+}